@@ -22,6 +22,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
 #include <stdint.h>   /* C99 types*/
+#include <stddef.h>   /* size_t */
 
 #include "config.h"   /* library configuration options (dynamically generated) */
 
@@ -41,6 +42,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 typedef enum com_type_e {
     LGW_COM_SPI,
     LGW_COM_USB,
+    LGW_COM_SIM,
     LGW_COM_UNKNOWN
 } lgw_com_type_t;
 
@@ -118,6 +120,26 @@ void* lgw_com_target(void);
  **/
 lgw_com_type_t lgw_com_type(void);
 
+/**
+@brief Size of the state of this module that belongs to one concentrator, see loragw_ctx.h
+*/
+size_t lgw_com_state_size(void);
+
+/**
+@brief Copy the current com type and target to state
+*/
+void lgw_com_state_save(void *state);
+
+/**
+@brief Make the com type and target saved in state the current ones
+*/
+void lgw_com_state_load(const void *state);
+
+/**
+@brief Forget the current com type and target, as for a concentrator never connected
+*/
+void lgw_com_state_reset(void);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
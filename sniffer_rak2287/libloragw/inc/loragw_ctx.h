@@ -0,0 +1,165 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Explicit HAL context handles, to drive several concentrators from a single
+    process. Each lgw_ctx_t holds the configuration and runtime state of one
+    concentrator (HAL context, com link, SX1302 RX buffer and counters, ...).
+    The lgw_ctx_* functions make that state current under a lock, call the
+    matching lgw_* function and release the lock, so calls on different
+    contexts can come from different threads but are serialized.
+    The lgw_* functions keep working on the default context, but must not be
+    used while lgw_ctx_* functions are used from other threads.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_CTX_H
+#define _LORAGW_CTX_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@brief Opaque handle on the state of one concentrator
+*/
+typedef struct lgw_ctx_s lgw_ctx_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Allocate a new concentrator context, stopped, configured as the default context of the lgw_* functions
+@return pointer to the context, NULL if allocation failed
+*/
+lgw_ctx_t * lgw_ctx_new(void);
+
+/**
+@brief Stop the concentrator if it is started, and release the context
+@param ctx context to release, can be NULL
+*/
+void lgw_ctx_free(lgw_ctx_t * ctx);
+
+/**
+@brief Make the context current and lock it, for direct calls to lgw_* functions
+@param ctx context to enter
+*/
+void lgw_ctx_enter(lgw_ctx_t * ctx);
+
+/**
+@brief Unlock a context entered with lgw_ctx_enter
+@param ctx context to leave
+*/
+void lgw_ctx_leave(lgw_ctx_t * ctx);
+
+/**
+@brief Generic pointer to the communication target of a context (see lgw_com_target)
+@param ctx context
+@return com target, NULL if the concentrator is not started
+*/
+void * lgw_ctx_com_target(lgw_ctx_t * ctx);
+
+/**
+@brief lgw_board_setconf on a context
+*/
+int lgw_ctx_board_setconf(lgw_ctx_t * ctx, struct lgw_conf_board_s * conf);
+
+/**
+@brief lgw_rxrf_setconf on a context
+*/
+int lgw_ctx_rxrf_setconf(lgw_ctx_t * ctx, uint8_t rf_chain, struct lgw_conf_rxrf_s * conf);
+
+/**
+@brief lgw_rxif_setconf on a context
+*/
+int lgw_ctx_rxif_setconf(lgw_ctx_t * ctx, uint8_t if_chain, struct lgw_conf_rxif_s * conf);
+
+/**
+@brief lgw_demod_setconf on a context
+*/
+int lgw_ctx_demod_setconf(lgw_ctx_t * ctx, struct lgw_conf_demod_s * conf);
+
+/**
+@brief lgw_txgain_setconf on a context
+*/
+int lgw_ctx_txgain_setconf(lgw_ctx_t * ctx, uint8_t rf_chain, struct lgw_tx_gain_lut_s * conf);
+
+/**
+@brief lgw_ftime_setconf on a context
+*/
+int lgw_ctx_ftime_setconf(lgw_ctx_t * ctx, struct lgw_conf_ftime_s * conf);
+
+/**
+@brief lgw_sx1261_setconf on a context
+*/
+int lgw_ctx_sx1261_setconf(lgw_ctx_t * ctx, struct lgw_conf_sx1261_s * conf);
+
+/**
+@brief lgw_debug_setconf on a context
+*/
+int lgw_ctx_debug_setconf(lgw_ctx_t * ctx, struct lgw_conf_debug_s * conf);
+
+/**
+@brief lgw_start on a context
+*/
+int lgw_ctx_start(lgw_ctx_t * ctx);
+
+/**
+@brief lgw_stop on a context
+*/
+int lgw_ctx_stop(lgw_ctx_t * ctx);
+
+/**
+@brief lgw_receive on a context
+*/
+int lgw_ctx_receive(lgw_ctx_t * ctx, uint8_t max_pkt, struct lgw_pkt_rx_s * pkt_data);
+
+/**
+@brief lgw_send on a context
+*/
+int lgw_ctx_send(lgw_ctx_t * ctx, struct lgw_pkt_tx_s * pkt_data);
+
+/**
+@brief lgw_status on a context
+*/
+int lgw_ctx_status(lgw_ctx_t * ctx, uint8_t rf_chain, uint8_t select, uint8_t * code);
+
+/**
+@brief lgw_abort_tx on a context
+*/
+int lgw_ctx_abort_tx(lgw_ctx_t * ctx, uint8_t rf_chain);
+
+/**
+@brief lgw_get_instcnt on a context
+*/
+int lgw_ctx_get_instcnt(lgw_ctx_t * ctx, uint32_t * inst_cnt_us);
+
+/**
+@brief lgw_get_eui on a context
+*/
+int lgw_ctx_get_eui(lgw_ctx_t * ctx, uint64_t * eui);
+
+/**
+@brief lgw_get_temperature on a context
+*/
+int lgw_ctx_get_temperature(lgw_ctx_t * ctx, float * temperature);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
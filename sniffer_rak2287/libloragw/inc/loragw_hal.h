@@ -21,6 +21,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
 
 #include "loragw_com.h"
 
@@ -591,6 +592,26 @@ int lgw_spectral_scan_get_results(int16_t levels_dbm[static LGW_SPECTRAL_SCAN_RE
 */
 int lgw_spectral_scan_abort();
 
+/**
+@brief Size of the HAL state that belongs to one concentrator, see loragw_ctx.h
+*/
+size_t lgw_hal_state_size(void);
+
+/**
+@brief Copy the current HAL context (configuration, started flag, sensors) to state
+*/
+void lgw_hal_state_save(void *state);
+
+/**
+@brief Make the HAL context saved in state the current one
+*/
+void lgw_hal_state_load(const void *state);
+
+/**
+@brief Mark the current HAL context as stopped with no sensor opened, the configuration is kept
+*/
+void lgw_hal_state_reset(void);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
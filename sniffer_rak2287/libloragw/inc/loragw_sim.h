@@ -0,0 +1,208 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    In-process model of a SX1302 used as a communication interface, so the
+    HAL and the applications built on it can run without a concentrator.
+    Registers are kept in memory, the RX_BUFFER_NB_BYTES and TIMESTAMP
+    registers are computed on read, and burst reads at 0x4000 pop the RX
+    buffer FIFO. Packets are pushed in the FIFO in the SX1302 RX buffer
+    format, either by the caller or by a source thread generating synthetic
+    LoRaWAN uplinks or replaying a recorded RX buffer dump at a chosen rate.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_SIM_H
+#define _LORAGW_SIM_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>        /* C99 types*/
+#include <stdbool.h>       /* bool type */
+
+#include "config.h"    /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_SIM_SUCCESS     0
+#define LGW_SIM_ERROR       -1
+
+#define LGW_SIM_FIFO_SIZE       4096    /* same size as the SX1302 RX buffer */
+#define LGW_SIM_COM_PATH_SYNTH  "synthetic" /* com_path selecting generated traffic */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_sim_conf_s
+@brief Configuration of the packet source of the simulated concentrator
+*/
+struct lgw_sim_conf_s {
+    double      rate;       /*!> packets per second pushed by the source thread, 0 to disable it */
+    uint32_t    nb_pkt;     /*!> number of packets pushed before the source stops, 0 for no limit */
+    bool        poisson;    /*!> exponential inter-arrival times instead of a fixed period */
+    uint32_t    seed;       /*!> seed of the synthetic traffic generator */
+};
+
+/**
+@struct lgw_sim_pkt_s
+@brief Packet to be pushed in the RX buffer, fields as found in the RX buffer metadata
+*/
+struct lgw_sim_pkt_s {
+    uint8_t     if_chain;       /*!> by which IF chain was packet received */
+    uint8_t     modem_id;       /*!> which modem demodulated the packet */
+    uint8_t     datarate;       /*!> spreading factor, 5 to 12 */
+    uint8_t     coderate;       /*!> 1 to 4 for 4/5 to 4/8 */
+    bool        crc_en;         /*!> payload CRC present */
+    bool        crc_error;      /*!> payload CRC failed */
+    int8_t      snr;            /*!> average SNR, in 0.25 dB steps */
+    uint8_t     rssi_chan;      /*!> channel RSSI, before the board RSSI offset is applied */
+    uint8_t     rssi_sig;       /*!> signal RSSI, before the board RSSI offset is applied */
+    int32_t     freq_offset;    /*!> 20-bit frequency offset, raw */
+    uint16_t    size;           /*!> payload size in bytes */
+    uint8_t     payload[256];   /*!> payload */
+};
+
+/**
+@struct lgw_sim_stats_s
+@brief Counters of a simulated concentrator
+*/
+struct lgw_sim_stats_s {
+    uint32_t    nb_pushed;      /*!> packets written in the RX buffer */
+    uint32_t    nb_overflow;    /*!> packets dropped because the RX buffer was full */
+    uint32_t    nb_fetch;       /*!> burst reads of the RX buffer */
+    uint64_t    bytes_fetched;  /*!> bytes read from the RX buffer */
+    uint16_t    fifo_level;     /*!> bytes currently waiting in the RX buffer */
+    uint16_t    fifo_high;      /*!> highest RX buffer fill level seen */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Configure the packet source of the simulated concentrators opened afterwards
+@param conf pointer to the source configuration
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_setconf(const struct lgw_sim_conf_s *conf);
+
+/**
+@brief Simulated concentrator setup
+@param com_path path to a RX buffer dump to replay, or LGW_SIM_COM_PATH_SYNTH (or "") for synthetic traffic
+@param com_target_ptr pointer on a generic pointer to the simulated concentrator
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_open(const char *com_path, void **com_target_ptr);
+
+/**
+@brief Simulated concentrator release, stops the source thread
+@param com_target generic pointer to the simulated concentrator
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_close(void *com_target);
+
+/**
+@brief Simulated single-byte write
+@param com_target generic pointer to the simulated concentrator
+@param spi_mux_target only LGW_SPI_MUX_TARGET_SX1302 is modelled, other targets are ignored
+@param address register address
+@param data data byte to write
+@return status of register operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_w(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t data);
+
+/**
+@brief Simulated single-byte read
+@param com_target generic pointer to the simulated concentrator
+@param spi_mux_target only LGW_SPI_MUX_TARGET_SX1302 is modelled, other targets read 0
+@param address register address
+@param data pointer to byte to be read
+@return status of register operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_r(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data);
+
+/**
+@brief Simulated single-byte read-modify-write
+@param com_target generic pointer to the simulated concentrator
+@param spi_mux_target only LGW_SPI_MUX_TARGET_SX1302 is modelled
+@param address register address
+@param offs start offset of the bits to be modified
+@param leng number of bits to be modified
+@param data value to be written in the selected bits
+@return status of register operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_rmw(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t offs, uint8_t leng, uint8_t data);
+
+/**
+@brief Simulated burst (multiple-byte) write
+@param com_target generic pointer to the simulated concentrator
+@param spi_mux_target only LGW_SPI_MUX_TARGET_SX1302 is modelled
+@param address register address
+@param data pointer to byte array to be written
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_wb(void *com_target, uint8_t spi_mux_target, uint16_t address, const uint8_t *data, uint16_t size);
+
+/**
+@brief Simulated burst (multiple-byte) read, pops the RX buffer FIFO at address 0x4000
+@param com_target generic pointer to the simulated concentrator
+@param spi_mux_target only LGW_SPI_MUX_TARGET_SX1302 is modelled
+@param address register address
+@param data pointer to byte array that will be written with the data read
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_rb(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data, uint16_t size);
+
+/**
+@brief Maximum burst size handled in a single transfer
+@return chunk size in bytes
+*/
+uint16_t lgw_sim_chunk_size(void);
+
+/**
+@brief Temperature of the simulated concentrator (constant)
+@param com_target generic pointer to the simulated concentrator
+@param temperature pointer to the temperature read, in degrees C
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_get_temperature(void *com_target, float *temperature);
+
+/**
+@brief Push a packet in the RX buffer, timestamped with the current counter value
+@param com_target generic pointer to the simulated concentrator
+@param pkt pointer to the packet to push
+@return LGW_SIM_SUCCESS, or LGW_SIM_ERROR if the packet is invalid or the RX buffer is full
+*/
+int lgw_sim_push(void *com_target, const struct lgw_sim_pkt_s *pkt);
+
+/**
+@brief Push raw bytes in the RX buffer as they are, i.e. a recorded RX buffer record
+@param com_target generic pointer to the simulated concentrator
+@param data pointer to the bytes to push
+@param size number of bytes
+@return LGW_SIM_SUCCESS, or LGW_SIM_ERROR if the RX buffer has not enough room
+*/
+int lgw_sim_push_raw(void *com_target, const uint8_t *data, uint16_t size);
+
+/**
+@brief Get the counters of a simulated concentrator
+@param com_target generic pointer to the simulated concentrator
+@param stats pointer to the counters to fill
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_get_stats(void *com_target, struct lgw_sim_stats_s *stats);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
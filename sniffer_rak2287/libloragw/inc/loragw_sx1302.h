@@ -19,6 +19,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
 #include <stdint.h>     /* C99 types*/
+#include <stddef.h>     /* size_t */
 
 #include "config.h"     /* library configuration options (dynamically generated) */
 
@@ -451,6 +452,26 @@ int sx1302_set_gpio(uint8_t gpio_reg_val);
 */
 double sx1302_dc_notch_delay(double if_freq_hz);
 
+/**
+@brief Size of the state of this module that belongs to one concentrator, see loragw_ctx.h
+*/
+size_t sx1302_state_size(void);
+
+/**
+@brief Copy the current RX buffer and timestamp counter to state
+*/
+void sx1302_state_save(void *state);
+
+/**
+@brief Make the RX buffer and timestamp counter saved in state the current ones
+*/
+void sx1302_state_load(const void *state);
+
+/**
+@brief Empty the RX buffer and clear the timestamp counter, as for a chip never started
+*/
+void sx1302_state_reset(void);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
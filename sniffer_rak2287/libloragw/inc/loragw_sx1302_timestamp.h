@@ -143,6 +143,26 @@ int timestamp_counter_mode(bool ftime_enable);
 */
 int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics, uint32_t pkt_coarse_tmst, uint8_t sf, int32_t if_freq_hz, double pkt_freq_error, uint32_t * result_ftime);
 
+/**
+@brief Size of the state of this module that belongs to one concentrator, see loragw_ctx.h
+*/
+size_t timestamp_state_size(void);
+
+/**
+@brief Copy the current PPS timestamp history to state
+*/
+void timestamp_state_save(void *state);
+
+/**
+@brief Make the PPS timestamp history saved in state the current ones
+*/
+void timestamp_state_load(const void *state);
+
+/**
+@brief Clear the PPS timestamp history
+*/
+void timestamp_state_reset(void);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -20,6 +20,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
 #include <stdint.h>     /* C99 types*/
+#include <stddef.h>     /* size_t */
 
 #include "loragw_com.h"
 #include "sx1261_defs.h"
@@ -68,6 +69,26 @@ int sx1261_com_set_write_mode(lgw_com_write_mode_t write_mode);
 */
 int sx1261_com_flush(void);
 
+/**
+@brief Size of the state of this module that belongs to one concentrator, see loragw_ctx.h
+*/
+size_t sx1261_com_state_size(void);
+
+/**
+@brief Copy the current SX1261 com type and target to state
+*/
+void sx1261_com_state_save(void *state);
+
+/**
+@brief Make the SX1261 com type and target saved in state the current ones
+*/
+void sx1261_com_state_load(const void *state);
+
+/**
+@brief Forget the current SX1261 com type and target, as for a radio never connected
+*/
+void sx1261_com_state_reset(void);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -24,6 +24,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_com.h"
 #include "loragw_usb.h"
 #include "loragw_spi.h"
+#include "loragw_sim.h"
 #include "loragw_aux.h"
 
 /* -------------------------------------------------------------------------- */
@@ -43,11 +44,20 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* Per concentrator state, see lgw_com_state_save */
+struct lgw_com_state_s {
+    lgw_com_type_t  com_type;
+    void*           com_target;
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
 /**
-@brief The current communication type in use (SPI, USB)
+@brief The current communication type in use (SPI, USB, SIM)
 */
 static lgw_com_type_t _lgw_com_type = LGW_COM_UNKNOWN;
 
@@ -64,7 +74,7 @@ int lgw_com_open(lgw_com_type_t com_type, const char * com_path) {
 
     /* Check input parameters */
     CHECK_NULL(com_path);
-    if ((com_type != LGW_COM_SPI) && (com_type != LGW_COM_USB)) {
+    if ((com_type != LGW_COM_SPI) && (com_type != LGW_COM_USB) && (com_type != LGW_COM_SIM)) {
         DEBUG_MSG("ERROR: COMMUNICATION INTERFACE TYPE IS NOT SUPPORTED\n");
         return LGW_COM_ERROR;
     }
@@ -86,6 +96,10 @@ int lgw_com_open(lgw_com_type_t com_type, const char * com_path) {
             printf("Opening USB communication interface\n");
             com_stat = lgw_usb_open(com_path, &_lgw_com_target);
             break;
+        case LGW_COM_SIM:
+            printf("Opening simulated communication interface\n");
+            com_stat = lgw_sim_open(com_path, &_lgw_com_target);
+            break;
         default:
             com_stat = LGW_COM_ERROR;
             break;
@@ -114,6 +128,10 @@ int lgw_com_close(void) {
             printf("Closing USB communication interface\n");
             com_stat = lgw_usb_close(_lgw_com_target);
             break;
+        case LGW_COM_SIM:
+            printf("Closing simulated communication interface\n");
+            com_stat = lgw_sim_close(_lgw_com_target);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -146,6 +164,9 @@ int lgw_com_w(uint8_t spi_mux_target, uint16_t address, uint8_t data) {
         case LGW_COM_USB:
             com_stat = lgw_usb_w(_lgw_com_target, spi_mux_target, address, data);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_w(_lgw_com_target, spi_mux_target, address, data);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -180,6 +201,9 @@ int lgw_com_r(uint8_t spi_mux_target, uint16_t address, uint8_t *data) {
         case LGW_COM_USB:
             com_stat = lgw_usb_r(_lgw_com_target, spi_mux_target, address, data);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_r(_lgw_com_target, spi_mux_target, address, data);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -212,6 +236,9 @@ int lgw_com_rmw(uint8_t spi_mux_target, uint16_t address, uint8_t offs, uint8_t
         case LGW_COM_USB:
             com_stat = lgw_usb_rmw(_lgw_com_target, address, offs, leng, data);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_rmw(_lgw_com_target, spi_mux_target, address, offs, leng, data);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -246,6 +273,9 @@ int lgw_com_wb(uint8_t spi_mux_target, uint16_t address, const uint8_t *data, ui
         case LGW_COM_USB:
             com_stat = lgw_usb_wb(_lgw_com_target, spi_mux_target, address, data, size);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_wb(_lgw_com_target, spi_mux_target, address, data, size);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -280,6 +310,9 @@ int lgw_com_rb(uint8_t spi_mux_target, uint16_t address, uint8_t *data, uint16_t
         case LGW_COM_USB:
             com_stat = lgw_usb_rb(_lgw_com_target, spi_mux_target, address, data, size);
             break;
+        case LGW_COM_SIM:
+            com_stat = lgw_sim_rb(_lgw_com_target, spi_mux_target, address, data, size);
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -304,6 +337,9 @@ int lgw_com_set_write_mode(lgw_com_write_mode_t write_mode) {
         case LGW_COM_USB:
             com_stat = lgw_usb_set_write_mode(write_mode);
             break;
+        case LGW_COM_SIM:
+            /* Do nothing: writes are applied immediately */
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -325,6 +361,9 @@ int lgw_com_flush(void) {
         case LGW_COM_USB:
             com_stat = lgw_usb_flush(_lgw_com_target);
             break;
+        case LGW_COM_SIM:
+            /* Do nothing: writes are applied immediately */
+            break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             com_stat = LGW_COM_ERROR;
@@ -343,6 +382,8 @@ uint16_t lgw_com_chunk_size(void) {
         case LGW_COM_USB:
             return lgw_usb_chunk_size();
             break;
+        case LGW_COM_SIM:
+            return lgw_sim_chunk_size();
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             return 0;
@@ -362,6 +403,8 @@ int lgw_com_get_temperature(float * temperature) {
             return -1;
         case LGW_COM_USB:
             return lgw_usb_get_temperature(_lgw_com_target, temperature);
+        case LGW_COM_SIM:
+            return lgw_sim_get_temperature(_lgw_com_target, temperature);
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             return LGW_COM_ERROR;
@@ -380,4 +423,35 @@ lgw_com_type_t lgw_com_type(void) {
     return _lgw_com_type;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+size_t lgw_com_state_size(void) {
+    return sizeof(struct lgw_com_state_s);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_com_state_save(void *state) {
+    struct lgw_com_state_s *s = (struct lgw_com_state_s *)state;
+
+    s->com_type = _lgw_com_type;
+    s->com_target = _lgw_com_target;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_com_state_load(const void *state) {
+    const struct lgw_com_state_s *s = (const struct lgw_com_state_s *)state;
+
+    _lgw_com_type = s->com_type;
+    _lgw_com_target = s->com_target;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_com_state_reset(void) {
+    _lgw_com_type = LGW_COM_UNKNOWN;
+    _lgw_com_target = NULL;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,457 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Explicit HAL context handles, to drive several concentrators from a single
+    process.
+    The HAL and the drivers below it keep the state of the concentrator in
+    module variables. A context holds a copy of these variables for each
+    module, and the context owning the module variables is switched under a
+    lock: the variables of the previous owner are saved in its copy, and the
+    copy of the new owner is loaded. Nothing is copied while the same context
+    is used again, so a single concentrator costs one lock per call.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* calloc free */
+#include <pthread.h>
+
+#include "loragw_ctx.h"
+#include "loragw_hal.h"
+#include "loragw_com.h"
+#include "loragw_sx1302.h"
+#include "loragw_sx1302_timestamp.h"
+#include "sx1261_com.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_HAL == 1
+    #define DEBUG_MSG(str)                fprintf(stdout, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stdout,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                 if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_HAL_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                 if(a==NULL){return LGW_HAL_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* Hooks of a module holding per concentrator state */
+struct ctx_module_s {
+    size_t (*size)(void);
+    void (*save)(void *state);
+    void (*load)(const void *state);
+    void (*reset)(void);
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+/* Modules holding per concentrator state.
+   Not switched: the USB write mode (only used during lgw_start), the
+   calibration images of loragw_cal and the debug payload generator. */
+static const struct ctx_module_s ctx_modules[] = {
+    { lgw_hal_state_size,       lgw_hal_state_save,     lgw_hal_state_load,     lgw_hal_state_reset },
+    { lgw_com_state_size,       lgw_com_state_save,     lgw_com_state_load,     lgw_com_state_reset },
+    { sx1261_com_state_size,    sx1261_com_state_save,  sx1261_com_state_load,  sx1261_com_state_reset },
+    { sx1302_state_size,        sx1302_state_save,      sx1302_state_load,      sx1302_state_reset },
+    { timestamp_state_size,     timestamp_state_save,   timestamp_state_load,   timestamp_state_reset }
+};
+
+#define CTX_NB_MODULES ARRAY_SIZE(ctx_modules)
+
+/* A context is a copy of the variables of each module */
+struct lgw_ctx_s {
+    void * state[CTX_NB_MODULES]; /* copy of the module variables, valid when not owner */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static pthread_mutex_t mx_ctx = PTHREAD_MUTEX_INITIALIZER; /* serializes the HAL calls of all contexts */
+
+/* context of the lgw_* functions, its copy is allocated with the first context */
+static lgw_ctx_t ctx_default;
+
+/* context whose state is in the module variables */
+static lgw_ctx_t * ctx_owner = &ctx_default;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static int ctx_alloc(lgw_ctx_t * ctx);
+
+static void ctx_release(lgw_ctx_t * ctx);
+
+static void ctx_switch(lgw_ctx_t * ctx);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int ctx_alloc(lgw_ctx_t * ctx) {
+    unsigned int i;
+
+    for (i = 0; i < CTX_NB_MODULES; i++) {
+        ctx->state[i] = calloc(1, ctx_modules[i].size());
+        if (ctx->state[i] == NULL) {
+            ctx_release(ctx);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void ctx_release(lgw_ctx_t * ctx) {
+    unsigned int i;
+
+    for (i = 0; i < CTX_NB_MODULES; i++) {
+        free(ctx->state[i]);
+        ctx->state[i] = NULL;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void ctx_switch(lgw_ctx_t * ctx) {
+    unsigned int i;
+
+    if (ctx == ctx_owner) {
+        return;
+    }
+
+    for (i = 0; i < CTX_NB_MODULES; i++) {
+        ctx_modules[i].save(ctx_owner->state[i]);
+        ctx_modules[i].load(ctx->state[i]);
+    }
+    ctx_owner = ctx;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+lgw_ctx_t * lgw_ctx_new(void) {
+    unsigned int i;
+    lgw_ctx_t * ctx;
+
+    ctx = calloc(1, sizeof *ctx);
+    if (ctx == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&mx_ctx);
+
+    if ((ctx_default.state[0] == NULL) && (ctx_alloc(&ctx_default) != 0)) {
+        pthread_mutex_unlock(&mx_ctx);
+        free(ctx);
+        return NULL;
+    }
+    if (ctx_alloc(ctx) != 0) {
+        pthread_mutex_unlock(&mx_ctx);
+        free(ctx);
+        return NULL;
+    }
+
+    /* Start from the configuration of the default context, with a fresh runtime state */
+    ctx_switch(&ctx_default);
+    for (i = 0; i < CTX_NB_MODULES; i++) {
+        ctx_modules[i].save(ctx_default.state[i]);
+        ctx_modules[i].reset();
+    }
+    ctx_owner = ctx;
+
+    pthread_mutex_unlock(&mx_ctx);
+
+    DEBUG_PRINTF("INFO: new HAL context %p\n", (void *)ctx);
+
+    return ctx;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_ctx_free(lgw_ctx_t * ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+
+    lgw_ctx_enter(ctx);
+    lgw_stop();
+    /* Give the module variables back to the default context */
+    ctx_switch(&ctx_default);
+    ctx_release(ctx);
+    lgw_ctx_leave(ctx);
+
+    free(ctx);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_ctx_enter(lgw_ctx_t * ctx) {
+    pthread_mutex_lock(&mx_ctx);
+    ctx_switch(ctx);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_ctx_leave(lgw_ctx_t * ctx) {
+    (void)ctx;
+    pthread_mutex_unlock(&mx_ctx);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void * lgw_ctx_com_target(lgw_ctx_t * ctx) {
+    void * target;
+
+    if (ctx == NULL) {
+        return NULL;
+    }
+
+    lgw_ctx_enter(ctx);
+    target = lgw_com_target();
+    lgw_ctx_leave(ctx);
+
+    return target;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_board_setconf(lgw_ctx_t * ctx, struct lgw_conf_board_s * conf) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_board_setconf(conf);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_rxrf_setconf(lgw_ctx_t * ctx, uint8_t rf_chain, struct lgw_conf_rxrf_s * conf) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_rxrf_setconf(rf_chain, conf);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_rxif_setconf(lgw_ctx_t * ctx, uint8_t if_chain, struct lgw_conf_rxif_s * conf) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_rxif_setconf(if_chain, conf);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_demod_setconf(lgw_ctx_t * ctx, struct lgw_conf_demod_s * conf) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_demod_setconf(conf);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_txgain_setconf(lgw_ctx_t * ctx, uint8_t rf_chain, struct lgw_tx_gain_lut_s * conf) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_txgain_setconf(rf_chain, conf);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_ftime_setconf(lgw_ctx_t * ctx, struct lgw_conf_ftime_s * conf) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_ftime_setconf(conf);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_sx1261_setconf(lgw_ctx_t * ctx, struct lgw_conf_sx1261_s * conf) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_sx1261_setconf(conf);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_debug_setconf(lgw_ctx_t * ctx, struct lgw_conf_debug_s * conf) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_debug_setconf(conf);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_start(lgw_ctx_t * ctx) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_start();
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_stop(lgw_ctx_t * ctx) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_stop();
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_receive(lgw_ctx_t * ctx, uint8_t max_pkt, struct lgw_pkt_rx_s * pkt_data) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_receive(max_pkt, pkt_data);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_send(lgw_ctx_t * ctx, struct lgw_pkt_tx_s * pkt_data) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_send(pkt_data);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_status(lgw_ctx_t * ctx, uint8_t rf_chain, uint8_t select, uint8_t * code) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_status(rf_chain, select, code);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_abort_tx(lgw_ctx_t * ctx, uint8_t rf_chain) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_abort_tx(rf_chain);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_get_instcnt(lgw_ctx_t * ctx, uint32_t * inst_cnt_us) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_get_instcnt(inst_cnt_us);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_get_eui(lgw_ctx_t * ctx, uint64_t * eui) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_get_eui(eui);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_get_temperature(lgw_ctx_t * ctx, float * temperature) {
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_enter(ctx);
+    x = lgw_get_temperature(temperature);
+    lgw_ctx_leave(ctx);
+
+    return x;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -106,6 +106,18 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* Version string, used to identify the library version/options once compiled */
 const char lgw_version_string[] = "Version: " LIBLORAGW_VERSION ";";
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* Per concentrator state, see lgw_hal_state_save */
+struct lgw_hal_state_s {
+    lgw_context_t   context;
+    FILE *          log_file;
+    int             ts_fd;
+    uint8_t         ts_addr;
+    int             ad_fd;
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
@@ -458,7 +470,7 @@ int lgw_board_setconf(struct lgw_conf_board_s * conf) {
     }
 
     /* Check input parameters */
-    if ((conf->com_type != LGW_COM_SPI) && (conf->com_type != LGW_COM_USB)) {
+    if ((conf->com_type != LGW_COM_SPI) && (conf->com_type != LGW_COM_USB) && (conf->com_type != LGW_COM_SIM)) {
         DEBUG_MSG("ERROR: WRONG COM TYPE\n");
         return LGW_HAL_ERROR;
     }
@@ -471,7 +483,7 @@ int lgw_board_setconf(struct lgw_conf_board_s * conf) {
     strncpy(CONTEXT_COM_PATH, conf->com_path, sizeof CONTEXT_COM_PATH);
     CONTEXT_COM_PATH[sizeof CONTEXT_COM_PATH - 1] = '\0'; /* ensure string termination */
 
-    DEBUG_PRINTF("Note: board configuration: com_type: %s, com_path: %s, lorawan_public:%d, clksrc:%d, full_duplex:%d\n",   (CONTEXT_COM_TYPE == LGW_COM_SPI) ? "SPI" : "USB",
+    DEBUG_PRINTF("Note: board configuration: com_type: %s, com_path: %s, lorawan_public:%d, clksrc:%d, full_duplex:%d\n",   (CONTEXT_COM_TYPE == LGW_COM_SPI) ? "SPI" : ((CONTEXT_COM_TYPE == LGW_COM_USB) ? "USB" : "SIM"),
                                                                                                                             CONTEXT_COM_PATH,
                                                                                                                             CONTEXT_LWAN_PUBLIC,
                                                                                                                             CONTEXT_BOARD.clksrc,
@@ -861,6 +873,18 @@ int lgw_start(void) {
         return LGW_HAL_ERROR;
     }
 
+    /* Simulated concentrator: no radio, no MCU, only the RX buffer and counters */
+    if (CONTEXT_COM_TYPE == LGW_COM_SIM) {
+        err = sx1302_init(&CONTEXT_FINE_TIMESTAMP);
+        if (err != LGW_REG_SUCCESS) {
+            printf("ERROR: failed to initialize simulated SX1302\n");
+            return LGW_HAL_ERROR;
+        }
+        CONTEXT_STARTED = true;
+        DEBUG_PRINTF(" --- %s\n", "OUT");
+        return LGW_HAL_SUCCESS;
+    }
+
     /* Set all GPIOs to 0 */
     err = sx1302_set_gpio(0x00);
     if (err != LGW_REG_SUCCESS) {
@@ -1199,8 +1223,8 @@ int lgw_stop(void) {
         return LGW_HAL_SUCCESS;
     }
 
-    /* Abort current TX if needed */
-    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+    /* Abort current TX if needed, there is no TX on a simulated concentrator */
+    for (i = 0; (i < LGW_RF_CHAIN_NB) && (CONTEXT_COM_TYPE != LGW_COM_SIM); i++) {
         DEBUG_PRINTF("INFO: aborting TX on chain %u\n", i);
         x = lgw_abort_tx(i);
         if (x != LGW_HAL_SUCCESS) {
@@ -1609,6 +1633,7 @@ int lgw_get_temperature(float* temperature) {
             err = stts751_get_temperature(ts_fd, ts_addr, temperature);
             break;
         case LGW_COM_USB:
+        case LGW_COM_SIM:
             err = lgw_com_get_temperature(temperature);
             break;
         default:
@@ -1709,4 +1734,45 @@ int lgw_spectral_scan_abort() {
     return sx1261_spectral_scan_abort();
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+size_t lgw_hal_state_size(void) {
+    return sizeof(struct lgw_hal_state_s);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_hal_state_save(void *state) {
+    struct lgw_hal_state_s *s = (struct lgw_hal_state_s *)state;
+
+    s->context = lgw_context;
+    s->log_file = log_file;
+    s->ts_fd = ts_fd;
+    s->ts_addr = ts_addr;
+    s->ad_fd = ad_fd;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_hal_state_load(const void *state) {
+    const struct lgw_hal_state_s *s = (const struct lgw_hal_state_s *)state;
+
+    lgw_context = s->context;
+    log_file = s->log_file;
+    ts_fd = s->ts_fd;
+    ts_addr = s->ts_addr;
+    ad_fd = s->ad_fd;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_hal_state_reset(void) {
+    /* The configuration is kept, it is the starting point of a new concentrator */
+    CONTEXT_STARTED = false;
+    log_file = NULL;
+    ts_fd = -1;
+    ts_addr = 0xFF;
+    ad_fd = -1;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,672 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    In-process model of a SX1302 used as a communication interface.
+    Only what the RX path depends on is modelled: a register map, the RX
+    buffer FIFO with its byte counter, and the 32MHz timestamp counters.
+    Radios, MCUs and TX are not modelled, lgw_start skips their setup.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#define _GNU_SOURCE     /* needed for clock_gettime and nanosleep */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fopen fgets */
+#include <stdlib.h>     /* malloc free strtoul */
+#include <string.h>     /* memset memcpy */
+#include <math.h>       /* log */
+#include <time.h>       /* clock_gettime nanosleep */
+#include <pthread.h>
+
+#include "loragw_sim.h"
+#include "loragw_com.h"
+#include "loragw_hal.h"
+#include "loragw_sx1302.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_COM == 1
+    #define DEBUG_MSG(str)                fprintf(stdout, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stdout,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_SIM_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                if(a==NULL){return LGW_SIM_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SIM_REG_SPACE           0x10000 /* 16-bit address space */
+#define SIM_BURST_CHUNK         1024
+
+/* Registers computed on read, see loragw_reg.c */
+#define SIM_ADDR_VERSION        0x5606  /* COMMON_VERSION_VERSION */
+#define SIM_ADDR_NB_BYTES_MSB   0x58C8  /* RX_TOP_RX_BUFFER_NB_BYTES_MSB */
+#define SIM_ADDR_NB_BYTES_LSB   0x58C9  /* RX_TOP_RX_BUFFER_NB_BYTES_LSB */
+#define SIM_ADDR_TS_PPS         0x6101  /* TIMESTAMP_PPS_MSB2..LSB1 */
+#define SIM_ADDR_TS_INST        0x6105  /* TIMESTAMP_MSB2..LSB1 */
+#define SIM_ADDR_RX_BUFFER      0x4000
+
+#define SIM_CHIP_VERSION        0x10
+#define SIM_TEMPERATURE         25.0
+
+/* RX buffer record layout, see loragw_sx1302_rx.c */
+#define SIM_PKT_SYNCWORD_0      0xA5
+#define SIM_PKT_SYNCWORD_1      0xC0
+#define SIM_PKT_HEAD_METADATA   9
+#define SIM_PKT_TAIL_METADATA   14
+#define SIM_PKT_TS_OFFSET       (SIM_PKT_HEAD_METADATA + 6)    /* tail offset of the timestamp, from the payload end */
+
+#define SIM_SOURCE_MAX_SLEEP_US 10000   /* keeps the source thread responsive to close */
+#define SIM_SYNTH_NB_DEV        64      /* distinct end devices in synthetic traffic */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef struct sim_s {
+    uint8_t regs[SIM_REG_SPACE];            /* SX1302 register map */
+
+    pthread_mutex_t mx_fifo;                /* FIFO and counters, shared with the source thread */
+    uint8_t fifo[LGW_SIM_FIFO_SIZE];        /* RX buffer, circular */
+    uint16_t fifo_rd;                       /* read index */
+    uint16_t fifo_level;                    /* bytes in the FIFO */
+    struct lgw_sim_stats_s stats;
+
+    struct timespec t0;                     /* counter origin */
+
+    struct lgw_sim_conf_s conf;             /* source configuration */
+    pthread_t source;
+    bool source_started;
+    volatile bool source_stop;
+    uint8_t *capture;                       /* recorded RX buffer records to replay */
+    uint32_t capture_size;
+    uint32_t rand;                          /* xorshift32 state */
+    uint16_t fcnt[SIM_SYNTH_NB_DEV];        /* uplink counter per synthetic device */
+} sim_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_sim_conf_s sim_conf = {
+    .rate = 10.0,
+    .nb_pkt = 0,
+    .poisson = true,
+    .seed = 1
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static uint64_t sim_now_us(const sim_t *sim);
+
+static uint8_t sim_reg_read(sim_t *sim, uint16_t address, uint32_t cnt_raw);
+
+static uint16_t sim_record_size(const uint8_t *rec, uint32_t size);
+
+static void sim_record_finalize(uint8_t *rec, uint16_t size, uint32_t cnt_raw);
+
+static int sim_capture_load(sim_t *sim, const char *path);
+
+static uint32_t sim_rand(sim_t *sim);
+
+static void sim_synth_pkt(sim_t *sim, struct lgw_sim_pkt_s *pkt);
+
+static void *sim_source_thread(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint64_t sim_now_us(const sim_t *sim) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t)(t.tv_sec - sim->t0.tv_sec) * 1000000 + (t.tv_nsec - sim->t0.tv_nsec) / 1000;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Must be called with mx_fifo locked */
+static uint8_t sim_reg_read(sim_t *sim, uint16_t address, uint32_t cnt_raw) {
+    switch (address) {
+        case SIM_ADDR_NB_BYTES_MSB:
+            return (uint8_t)((sim->fifo_level >> 8) & 0x1F);
+        case SIM_ADDR_NB_BYTES_LSB:
+            return (uint8_t)(sim->fifo_level & 0xFF);
+        case SIM_ADDR_TS_PPS:
+        case SIM_ADDR_TS_PPS + 1:
+        case SIM_ADDR_TS_PPS + 2:
+        case SIM_ADDR_TS_PPS + 3:
+            return 0; /* no PPS */
+        case SIM_ADDR_TS_INST:
+        case SIM_ADDR_TS_INST + 1:
+        case SIM_ADDR_TS_INST + 2:
+        case SIM_ADDR_TS_INST + 3:
+            return (uint8_t)(cnt_raw >> (8 * (3 - (address - SIM_ADDR_TS_INST))));
+        default:
+            return sim->regs[address];
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Size of the RX buffer record starting at rec, 0 if it is not complete */
+static uint16_t sim_record_size(const uint8_t *rec, uint32_t size) {
+    uint32_t len, nb_ts;
+
+    if (size < (SIM_PKT_HEAD_METADATA + SIM_PKT_TAIL_METADATA)) {
+        return 0;
+    }
+    if ((rec[0] != SIM_PKT_SYNCWORD_0) || (rec[1] != SIM_PKT_SYNCWORD_1)) {
+        return 0;
+    }
+
+    len = rec[2];
+    if (size < (SIM_PKT_HEAD_METADATA + len + SIM_PKT_TAIL_METADATA)) {
+        return 0;
+    }
+    nb_ts = rec[SIM_PKT_HEAD_METADATA + len + 12];
+    len += SIM_PKT_HEAD_METADATA + SIM_PKT_TAIL_METADATA + (2 * nb_ts);
+    if (size < len) {
+        return 0;
+    }
+
+    return (uint16_t)len;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Stamp a record with the counter value and compute its checksum */
+static void sim_record_finalize(uint8_t *rec, uint16_t size, uint32_t cnt_raw) {
+    uint16_t i, ts_idx = rec[2] + SIM_PKT_TS_OFFSET;
+    uint8_t checksum = 0;
+
+    rec[ts_idx + 0] = (uint8_t)(cnt_raw >> 0);
+    rec[ts_idx + 1] = (uint8_t)(cnt_raw >> 8);
+    rec[ts_idx + 2] = (uint8_t)(cnt_raw >> 16);
+    rec[ts_idx + 3] = (uint8_t)(cnt_raw >> 24);
+
+    for (i = 0; i < (size - 1); i++) {
+        checksum += rec[i];
+    }
+    rec[size - 1] = checksum;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Load a RX buffer dump, as written by dbg_log_buffer_to_file, and keep its complete records */
+static int sim_capture_load(sim_t *sim, const char *path) {
+    FILE *fp;
+    char line[1024];
+    char *p, *end;
+    unsigned long b;
+    uint8_t *raw = NULL, *tmp;
+    uint32_t raw_size = 0, raw_cap = 0;
+    uint32_t i = 0, n;
+    uint16_t rec_size;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        printf("ERROR: failed to open RX buffer capture %s\n", path);
+        return LGW_SIM_ERROR;
+    }
+
+    /* Hex bytes separated by spaces, lines starting with '-' are headers */
+    while (fgets(line, sizeof line, fp) != NULL) {
+        if (line[0] == '-') {
+            continue;
+        }
+        for (p = line; ; p = end) {
+            b = strtoul(p, &end, 16);
+            if (end == p) {
+                break;
+            }
+            if (raw_size == raw_cap) {
+                raw_cap = (raw_cap == 0) ? 4096 : (2 * raw_cap);
+                tmp = realloc(raw, raw_cap);
+                if (tmp == NULL) {
+                    free(raw);
+                    fclose(fp);
+                    return LGW_SIM_ERROR;
+                }
+                raw = tmp;
+            }
+            raw[raw_size++] = (uint8_t)b;
+        }
+    }
+    fclose(fp);
+
+    /* Keep complete records only, back to back */
+    n = 0;
+    while (i < raw_size) {
+        rec_size = sim_record_size(&raw[i], raw_size - i);
+        if (rec_size == 0) {
+            i += 1; /* re-sync on the next syncword */
+            continue;
+        }
+        memmove(&raw[n], &raw[i], rec_size);
+        n += rec_size;
+        i += rec_size;
+    }
+
+    if (n == 0) {
+        printf("ERROR: no RX buffer record found in %s\n", path);
+        free(raw);
+        return LGW_SIM_ERROR;
+    }
+
+    sim->capture = raw;
+    sim->capture_size = n;
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t sim_rand(sim_t *sim) {
+    uint32_t x = sim->rand;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->rand = x;
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* LoRaWAN unconfirmed data uplink from one of a fixed population of devices */
+static void sim_synth_pkt(sim_t *sim, struct lgw_sim_pkt_s *pkt) {
+    uint32_t dev = sim_rand(sim) % SIM_SYNTH_NB_DEV;
+    uint32_t dev_addr = 0x26000000 | (dev * 0x01010101 & 0x00FFFFFF);
+    uint16_t fcnt = sim->fcnt[dev]++;
+    uint16_t i, frm_size = 4 + (sim_rand(sim) % 48);
+
+    memset(pkt, 0, sizeof *pkt);
+    pkt->if_chain = sim_rand(sim) % 8;
+    pkt->modem_id = pkt->if_chain;
+    pkt->datarate = 7 + (sim_rand(sim) % 6);
+    pkt->coderate = 1;
+    pkt->crc_en = true;
+    pkt->crc_error = false;
+    pkt->snr = (int8_t)(-80 + (int)(sim_rand(sim) % 121)); /* -20dB to +10dB */
+    pkt->rssi_chan = 90 + (sim_rand(sim) % 86);
+    pkt->rssi_sig = pkt->rssi_chan - 2;
+    pkt->freq_offset = (int32_t)(sim_rand(sim) % 64);
+
+    pkt->payload[0] = 0x40; /* MHDR: unconfirmed data up */
+    pkt->payload[1] = (uint8_t)(dev_addr >> 0);
+    pkt->payload[2] = (uint8_t)(dev_addr >> 8);
+    pkt->payload[3] = (uint8_t)(dev_addr >> 16);
+    pkt->payload[4] = (uint8_t)(dev_addr >> 24);
+    pkt->payload[5] = 0x80; /* FCtrl: ADR */
+    pkt->payload[6] = (uint8_t)(fcnt >> 0);
+    pkt->payload[7] = (uint8_t)(fcnt >> 8);
+    pkt->payload[8] = 1 + (sim_rand(sim) % 223); /* FPort */
+    for (i = 0; i < (frm_size + 4); i++) {
+        pkt->payload[9 + i] = (uint8_t)sim_rand(sim); /* FRMPayload and MIC */
+    }
+    pkt->size = 9 + frm_size + 4;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void *sim_source_thread(void *arg) {
+    sim_t *sim = (sim_t *)arg;
+    struct lgw_sim_pkt_s pkt;
+    uint8_t rec[SIM_PKT_HEAD_METADATA + 255 + SIM_PKT_TAIL_METADATA + 2 * 255];
+    uint32_t capture_idx = 0;
+    uint32_t nb_pkt = 0;
+    uint16_t rec_size;
+    double period_us = 1e6 / sim->conf.rate;
+    double next_us = 0.0;
+    uint64_t now_us;
+    struct timespec ts;
+
+    while (sim->source_stop == false) {
+        now_us = sim_now_us(sim);
+
+        /* Push every packet due by now, so high rates are kept with a coarse sleep */
+        while ((double)now_us >= next_us) {
+            if ((sim->conf.nb_pkt > 0) && (nb_pkt >= sim->conf.nb_pkt)) {
+                return NULL;
+            }
+
+            if (sim->capture != NULL) {
+                rec_size = sim_record_size(&sim->capture[capture_idx], sim->capture_size - capture_idx);
+                memcpy(rec, &sim->capture[capture_idx], rec_size);
+                sim_record_finalize(rec, rec_size, (uint32_t)(now_us * 32));
+                lgw_sim_push_raw(sim, rec, rec_size);
+                capture_idx += rec_size;
+                if (capture_idx >= sim->capture_size) {
+                    capture_idx = 0; /* loop on the capture */
+                }
+            } else {
+                sim_synth_pkt(sim, &pkt);
+                lgw_sim_push(sim, &pkt);
+            }
+            nb_pkt += 1;
+
+            if (sim->conf.poisson == true) {
+                next_us += -log(((double)(sim_rand(sim) >> 8) + 1.0) / 16777217.0) * period_us;
+            } else {
+                next_us += period_us;
+            }
+        }
+
+        now_us = (uint64_t)(next_us - (double)now_us);
+        if (now_us > SIM_SOURCE_MAX_SLEEP_US) {
+            now_us = SIM_SOURCE_MAX_SLEEP_US;
+        }
+        ts.tv_sec = 0;
+        ts.tv_nsec = (long)now_us * 1000;
+        nanosleep(&ts, NULL);
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_sim_setconf(const struct lgw_sim_conf_s *conf) {
+    CHECK_NULL(conf);
+
+    if (conf->rate < 0.0) {
+        DEBUG_MSG("ERROR: NEGATIVE SIM RATE\n");
+        return LGW_SIM_ERROR;
+    }
+
+    sim_conf = *conf;
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_open(const char *com_path, void **com_target_ptr) {
+    sim_t *sim;
+
+    /* check input variables */
+    CHECK_NULL(com_path);
+    CHECK_NULL(com_target_ptr);
+
+    /* allocate memory for the simulated concentrator */
+    sim = calloc(1, sizeof *sim);
+    if (sim == NULL) {
+        DEBUG_MSG("ERROR: MALLOC FAIL\n");
+        return LGW_SIM_ERROR;
+    }
+
+    pthread_mutex_init(&sim->mx_fifo, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &sim->t0);
+    sim->regs[SIM_ADDR_VERSION] = SIM_CHIP_VERSION;
+    sim->conf = sim_conf;
+    sim->rand = (sim_conf.seed != 0) ? sim_conf.seed : 1;
+
+    if ((com_path[0] != '\0') && (strcmp(com_path, LGW_SIM_COM_PATH_SYNTH) != 0)) {
+        if (sim_capture_load(sim, com_path) != LGW_SIM_SUCCESS) {
+            pthread_mutex_destroy(&sim->mx_fifo);
+            free(sim);
+            return LGW_SIM_ERROR;
+        }
+        printf("INFO: replaying %u bytes of RX buffer records from %s\n", sim->capture_size, com_path);
+    }
+
+    if (sim->conf.rate > 0.0) {
+        if (pthread_create(&sim->source, NULL, sim_source_thread, sim) != 0) {
+            DEBUG_MSG("ERROR: FAILED TO START SIM SOURCE THREAD\n");
+            free(sim->capture);
+            pthread_mutex_destroy(&sim->mx_fifo);
+            free(sim);
+            return LGW_SIM_ERROR;
+        }
+        sim->source_started = true;
+    }
+
+    *com_target_ptr = (void *)sim;
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_close(void *com_target) {
+    sim_t *sim = (sim_t *)com_target;
+
+    CHECK_NULL(com_target);
+
+    if (sim->source_started == true) {
+        sim->source_stop = true;
+        pthread_join(sim->source, NULL);
+    }
+
+    free(sim->capture);
+    pthread_mutex_destroy(&sim->mx_fifo);
+    free(sim);
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_w(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t data) {
+    return lgw_sim_wb(com_target, spi_mux_target, address, &data, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_r(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data) {
+    return lgw_sim_rb(com_target, spi_mux_target, address, data, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_rmw(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t offs, uint8_t leng, uint8_t data) {
+    sim_t *sim = (sim_t *)com_target;
+    uint8_t mask;
+
+    CHECK_NULL(com_target);
+
+    if (spi_mux_target != LGW_SPI_MUX_TARGET_SX1302) {
+        return LGW_SIM_SUCCESS;
+    }
+
+    mask = (uint8_t)(((1 << leng) - 1) << offs);
+    pthread_mutex_lock(&sim->mx_fifo);
+    sim->regs[address] = (uint8_t)((sim->regs[address] & ~mask) | ((data << offs) & mask));
+    pthread_mutex_unlock(&sim->mx_fifo);
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_wb(void *com_target, uint8_t spi_mux_target, uint16_t address, const uint8_t *data, uint16_t size) {
+    sim_t *sim = (sim_t *)com_target;
+    uint32_t i;
+
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+
+    if (spi_mux_target != LGW_SPI_MUX_TARGET_SX1302) {
+        return LGW_SIM_SUCCESS;
+    }
+
+    pthread_mutex_lock(&sim->mx_fifo);
+    for (i = 0; i < size; i++) {
+        sim->regs[(uint16_t)(address + i)] = data[i];
+    }
+    pthread_mutex_unlock(&sim->mx_fifo);
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_rb(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data, uint16_t size) {
+    sim_t *sim = (sim_t *)com_target;
+    uint32_t cnt_raw;
+    uint16_t i, n;
+
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+
+    if (spi_mux_target != LGW_SPI_MUX_TARGET_SX1302) {
+        memset(data, 0, size);
+        return LGW_SIM_SUCCESS;
+    }
+
+    /* One counter snapshot per transfer, as the chip latches it */
+    cnt_raw = (uint32_t)(sim_now_us(sim) * 32);
+
+    pthread_mutex_lock(&sim->mx_fifo);
+    if (address == SIM_ADDR_RX_BUFFER) {
+        /* FIFO mode: pop, reading past the fill level returns zeros */
+        n = (size < sim->fifo_level) ? size : sim->fifo_level;
+        for (i = 0; i < n; i++) {
+            data[i] = sim->fifo[sim->fifo_rd];
+            sim->fifo_rd = (sim->fifo_rd + 1) % LGW_SIM_FIFO_SIZE;
+        }
+        memset(&data[n], 0, size - n);
+        sim->fifo_level -= n;
+        sim->stats.nb_fetch += 1;
+        sim->stats.bytes_fetched += n;
+    } else {
+        for (i = 0; i < size; i++) {
+            data[i] = sim_reg_read(sim, (uint16_t)(address + i), cnt_raw);
+        }
+    }
+    pthread_mutex_unlock(&sim->mx_fifo);
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint16_t lgw_sim_chunk_size(void) {
+    return (uint16_t)SIM_BURST_CHUNK;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_get_temperature(void *com_target, float *temperature) {
+    CHECK_NULL(com_target);
+    CHECK_NULL(temperature);
+
+    *temperature = SIM_TEMPERATURE;
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_push(void *com_target, const struct lgw_sim_pkt_s *pkt) {
+    uint8_t rec[SIM_PKT_HEAD_METADATA + 255 + SIM_PKT_TAIL_METADATA];
+    uint16_t crc, tail, size;
+    uint32_t foff;
+
+    CHECK_NULL(com_target);
+    CHECK_NULL(pkt);
+
+    if ((pkt->size > 255) || (pkt->datarate < 5) || (pkt->datarate > 12) || (pkt->coderate > 7)) {
+        DEBUG_MSG("ERROR: INVALID SIM PACKET\n");
+        return LGW_SIM_ERROR;
+    }
+
+    size = SIM_PKT_HEAD_METADATA + pkt->size + SIM_PKT_TAIL_METADATA;
+    tail = SIM_PKT_HEAD_METADATA + pkt->size;
+    foff = (uint32_t)pkt->freq_offset & 0x000FFFFF;
+    crc = sx1302_lora_payload_crc(pkt->payload, (uint8_t)pkt->size);
+
+    memset(rec, 0, size);
+    rec[0] = SIM_PKT_SYNCWORD_0;
+    rec[1] = SIM_PKT_SYNCWORD_1;
+    rec[2] = (uint8_t)pkt->size;
+    rec[3] = pkt->if_chain;
+    rec[4] = (uint8_t)((pkt->crc_en ? 0x01 : 0x00) | ((pkt->coderate & 0x07) << 1) | ((pkt->datarate & 0x0F) << 4));
+    rec[5] = pkt->modem_id;
+    rec[6] = (uint8_t)(foff >> 0);
+    rec[7] = (uint8_t)(foff >> 8);
+    rec[8] = (uint8_t)(foff >> 16);
+    memcpy(&rec[SIM_PKT_HEAD_METADATA], pkt->payload, pkt->size);
+    rec[tail + 0] = pkt->crc_error ? 0x01 : 0x00;
+    rec[tail + 1] = (uint8_t)pkt->snr;
+    rec[tail + 2] = pkt->rssi_chan;
+    rec[tail + 3] = pkt->rssi_sig;
+    rec[tail + 10] = (uint8_t)(crc >> 0);
+    rec[tail + 11] = (uint8_t)(crc >> 8);
+    rec[tail + 12] = 0; /* no timestamp metrics */
+    sim_record_finalize(rec, size, (uint32_t)(sim_now_us((sim_t *)com_target) * 32));
+
+    return lgw_sim_push_raw(com_target, rec, size);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_push_raw(void *com_target, const uint8_t *data, uint16_t size) {
+    sim_t *sim = (sim_t *)com_target;
+    uint16_t i, wr;
+
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+
+    pthread_mutex_lock(&sim->mx_fifo);
+
+    /* The chip drops what does not fit, the whole record is dropped here */
+    if ((sim->fifo_level + size) > LGW_SIM_FIFO_SIZE) {
+        sim->stats.nb_overflow += 1;
+        pthread_mutex_unlock(&sim->mx_fifo);
+        return LGW_SIM_ERROR;
+    }
+
+    wr = (sim->fifo_rd + sim->fifo_level) % LGW_SIM_FIFO_SIZE;
+    for (i = 0; i < size; i++) {
+        sim->fifo[wr] = data[i];
+        wr = (wr + 1) % LGW_SIM_FIFO_SIZE;
+    }
+    sim->fifo_level += size;
+    if (sim->fifo_level > sim->stats.fifo_high) {
+        sim->stats.fifo_high = sim->fifo_level;
+    }
+    sim->stats.nb_pushed += 1;
+
+    pthread_mutex_unlock(&sim->mx_fifo);
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_get_stats(void *com_target, struct lgw_sim_stats_s *stats) {
+    sim_t *sim = (sim_t *)com_target;
+
+    CHECK_NULL(com_target);
+    CHECK_NULL(stats);
+
+    pthread_mutex_lock(&sim->mx_fifo);
+    *stats = sim->stats;
+    stats->fifo_level = sim->fifo_level;
+    pthread_mutex_unlock(&sim->mx_fifo);
+
+    return LGW_SIM_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -56,6 +56,12 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE TYPES -------------------------------------------------------- */
 
+/* Per concentrator state, see sx1302_state_save */
+struct sx1302_state_s {
+    rx_buffer_t         rx_buffer;
+    timestamp_counter_t counter_us;
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
@@ -2823,4 +2829,35 @@ double sx1302_dc_notch_delay(double if_freq_khz) {
     return delay;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+size_t sx1302_state_size(void) {
+    return sizeof(struct sx1302_state_s);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void sx1302_state_save(void *state) {
+    struct sx1302_state_s *s = (struct sx1302_state_s *)state;
+
+    s->rx_buffer = rx_buffer;
+    s->counter_us = counter_us;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void sx1302_state_load(const void *state) {
+    const struct sx1302_state_s *s = (const struct sx1302_state_s *)state;
+
+    rx_buffer = s->rx_buffer;
+    counter_us = s->counter_us;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void sx1302_state_reset(void) {
+    memset(&rx_buffer, 0, sizeof rx_buffer);
+    memset(&counter_us, 0, sizeof counter_us);
+}
+
 /* --- EOF ------------------------------------------------------------------ */
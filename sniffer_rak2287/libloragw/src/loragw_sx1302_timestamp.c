@@ -56,6 +56,11 @@ struct timestamp_pps_history_s {
     uint8_t size; /* current size */
 };
 
+/* Per concentrator state, see timestamp_state_save */
+struct timestamp_state_s {
+    struct timestamp_pps_history_s pps_history;
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
@@ -631,4 +636,32 @@ int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics
     return 0;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+size_t timestamp_state_size(void) {
+    return sizeof(struct timestamp_state_s);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void timestamp_state_save(void *state) {
+    struct timestamp_state_s *s = (struct timestamp_state_s *)state;
+
+    s->pps_history = timestamp_pps_history;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void timestamp_state_load(const void *state) {
+    const struct timestamp_state_s *s = (const struct timestamp_state_s *)state;
+
+    timestamp_pps_history = s->pps_history;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void timestamp_state_reset(void) {
+    memset(&timestamp_pps_history, 0, sizeof timestamp_pps_history);
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -42,6 +42,15 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* Per concentrator state, see sx1261_com_state_save */
+struct sx1261_com_state_s {
+    lgw_com_type_t  com_type;
+    void*           com_target;
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
@@ -208,4 +217,35 @@ int sx1261_com_flush(void) {
     return com_stat;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+size_t sx1261_com_state_size(void) {
+    return sizeof(struct sx1261_com_state_s);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void sx1261_com_state_save(void *state) {
+    struct sx1261_com_state_s *s = (struct sx1261_com_state_s *)state;
+
+    s->com_type = _sx1261_com_type;
+    s->com_target = _sx1261_com_target;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void sx1261_com_state_load(const void *state) {
+    const struct sx1261_com_state_s *s = (const struct sx1261_com_state_s *)state;
+
+    _sx1261_com_type = s->com_type;
+    _sx1261_com_target = s->com_target;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void sx1261_com_state_reset(void) {
+    _sx1261_com_type = LGW_COM_UNKNOWN;
+    _sx1261_com_target = NULL;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
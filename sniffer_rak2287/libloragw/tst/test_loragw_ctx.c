@@ -0,0 +1,294 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Test program for the HAL context handles (lgw_ctx_t): several simulated
+    concentrators are configured and started in the same process, packets
+    pushed in one of them must only be received through its own context,
+    then one RX thread per concentrator polls them concurrently.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "loragw_hal.h"
+#include "loragw_ctx.h"
+#include "loragw_sim.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) do { if (cond) { printf("PASS: %s\n", msg); } else { printf("FAIL: %s\n", msg); nb_fail++; } } while (0)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_CTX              3
+#define FREQ_HZ_BASE        867100000U
+#define FREQ_HZ_STEP        1600000U
+#define DEFAULT_RATE        300.0
+#define DEFAULT_DURATION_S  2
+#define NB_PKT_MAX          16
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct rx_thread_s {
+    lgw_ctx_t *     ctx;
+    uint32_t        freq_hz;        /* center frequency of the concentrator */
+    pthread_t       thrid;
+    unsigned long   nb_rx;
+    unsigned long   nb_foreign;     /* packets not on a channel of this concentrator */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int nb_fail = 0;
+
+static volatile bool exit_sig = false;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+void usage(void) {
+    printf("Available options:\n");
+    printf(" -h print this help\n");
+    printf(" -r <float> Packets per second pushed in each concentrator [%.0f]\n", DEFAULT_RATE);
+    printf(" -t <uint> Load test duration in seconds [%d]\n", DEFAULT_DURATION_S);
+}
+
+static int configure(lgw_ctx_t *ctx, uint32_t freq_hz) {
+    int i;
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 0;
+    boardconf.full_duplex = false;
+    boardconf.com_type = LGW_COM_SIM;
+    strcpy(boardconf.com_path, LGW_SIM_COM_PATH_SYNTH);
+    if (lgw_ctx_board_setconf(ctx, &boardconf) != LGW_HAL_SUCCESS) {
+        return -1;
+    }
+
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.freq_hz = freq_hz;
+    rfconf.rssi_offset = -215.4;
+    rfconf.type = LGW_RADIO_TYPE_SX1250;
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+        if (lgw_ctx_rxrf_setconf(ctx, i, &rfconf) != LGW_HAL_SUCCESS) {
+            return -1;
+        }
+    }
+
+    memset(&ifconf, 0, sizeof ifconf);
+    for (i = 0; i < LGW_MULTI_NB; i++) {
+        ifconf.enable = true;
+        ifconf.rf_chain = 0;
+        ifconf.freq_hz = -400000 + (i * 100000);
+        ifconf.datarate = DR_LORA_SF7;
+        if (lgw_ctx_rxif_setconf(ctx, i, &ifconf) != LGW_HAL_SUCCESS) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static bool in_band(uint32_t freq_hz, uint32_t center_hz) {
+    return (freq_hz >= (center_hz - 500000)) && (freq_hz <= (center_hz + 500000));
+}
+
+static void * thread_rx(void *arg) {
+    struct rx_thread_s *t = (struct rx_thread_s *)arg;
+    struct lgw_pkt_rx_s rxpkt[NB_PKT_MAX];
+    int i, nb;
+
+    while (!exit_sig) {
+        nb = lgw_ctx_receive(t->ctx, NB_PKT_MAX, rxpkt);
+        if (nb < 0) {
+            break;
+        }
+        for (i = 0; i < nb; i++) {
+            t->nb_rx += 1;
+            t->nb_foreign += in_band(rxpkt[i].freq_hz, t->freq_hz) ? 0 : 1;
+        }
+        if (nb == 0) {
+            wait_ms(1);
+        }
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, j, nb, x;
+    double rate = DEFAULT_RATE;
+    unsigned int duration_s = DEFAULT_DURATION_S;
+    lgw_ctx_t *ctx[NB_CTX];
+    struct rx_thread_s rx[NB_CTX];
+    struct lgw_sim_conf_s simconf;
+    struct lgw_sim_pkt_s simpkt;
+    struct lgw_sim_stats_s stats;
+    struct lgw_pkt_rx_s rxpkt[NB_PKT_MAX];
+    bool ok;
+
+    while ((i = getopt(argc, argv, "hr:t:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'r':
+                rate = strtod(optarg, NULL);
+                break;
+            case 't':
+                duration_s = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* Functional checks: no source thread, packets pushed by hand */
+    memset(&simconf, 0, sizeof simconf);
+    lgw_sim_setconf(&simconf);
+
+    ok = true;
+    for (i = 0; i < NB_CTX; i++) {
+        ctx[i] = lgw_ctx_new();
+        ok = ok && (ctx[i] != NULL) && (configure(ctx[i], FREQ_HZ_BASE + (i * FREQ_HZ_STEP)) == 0);
+    }
+    CHECK(ok, "contexts configuration");
+
+    ok = true;
+    for (i = 0; i < NB_CTX; i++) {
+        ok = ok && (lgw_ctx_start(ctx[i]) == LGW_HAL_SUCCESS);
+    }
+    CHECK(ok, "start all concentrators");
+    CHECK((lgw_ctx_com_target(ctx[0]) != lgw_ctx_com_target(ctx[1])) && (lgw_ctx_com_target(ctx[1]) != NULL), "one com target per context");
+
+    memset(&simpkt, 0, sizeof simpkt);
+    simpkt.modem_id = 0;
+    simpkt.datarate = 7;
+    simpkt.coderate = 1;
+    simpkt.crc_en = true;
+    simpkt.size = 12;
+    /* i+1 packets for concentrator i, on IF chain i, first payload byte is i */
+    for (i = 0; i < NB_CTX; i++) {
+        simpkt.if_chain = i;
+        simpkt.payload[0] = (uint8_t)i;
+        for (j = 0; j <= i; j++) {
+            lgw_sim_push(lgw_ctx_com_target(ctx[i]), &simpkt);
+        }
+    }
+
+    /* Receive in reverse order so each context is switched in and out */
+    ok = true;
+    for (i = NB_CTX - 1; i >= 0; i--) {
+        nb = lgw_ctx_receive(ctx[i], NB_PKT_MAX, rxpkt);
+        ok = ok && (nb == (i + 1));
+        for (j = 0; (j < nb) && ok; j++) {
+            ok = (rxpkt[j].payload[0] == i) &&
+                 (rxpkt[j].freq_hz == (FREQ_HZ_BASE + (i * FREQ_HZ_STEP) - 400000 + (i * 100000)));
+        }
+    }
+    CHECK(ok, "each context receives its own packets, with its own channel plan");
+
+    ok = true;
+    for (i = 0; i < NB_CTX; i++) {
+        ok = ok && (lgw_ctx_receive(ctx[i], NB_PKT_MAX, rxpkt) == 0);
+    }
+    CHECK(ok, "RX buffers drained");
+
+    CHECK(lgw_ctx_stop(ctx[1]) == LGW_HAL_SUCCESS, "stop one concentrator");
+    CHECK(lgw_ctx_receive(ctx[1], NB_PKT_MAX, rxpkt) <= 0, "stopped concentrator does not receive");
+    simpkt.payload[0] = 0;
+    simpkt.if_chain = 0;
+    lgw_sim_push(lgw_ctx_com_target(ctx[0]), &simpkt);
+    CHECK(lgw_ctx_receive(ctx[0], NB_PKT_MAX, rxpkt) == 1, "other concentrators still receive");
+
+    for (i = 0; i < NB_CTX; i++) {
+        lgw_ctx_stop(ctx[i]);
+    }
+
+    /* Load test: one source thread and one RX thread per concentrator */
+    simconf.rate = rate;
+    simconf.poisson = true;
+    ok = true;
+    for (i = 0; i < NB_CTX; i++) {
+        simconf.seed = i + 1;
+        lgw_sim_setconf(&simconf);
+        ok = ok && (lgw_ctx_start(ctx[i]) == LGW_HAL_SUCCESS);
+    }
+    CHECK(ok, "restart with source threads");
+
+    for (i = 0; i < NB_CTX; i++) {
+        memset(&rx[i], 0, sizeof rx[i]);
+        rx[i].ctx = ctx[i];
+        rx[i].freq_hz = FREQ_HZ_BASE + (i * FREQ_HZ_STEP);
+        x = pthread_create(&rx[i].thrid, NULL, thread_rx, &rx[i]);
+        CHECK(x == 0, "RX thread creation");
+    }
+    sleep(duration_s);
+    exit_sig = true;
+    for (i = 0; i < NB_CTX; i++) {
+        pthread_join(rx[i].thrid, NULL);
+    }
+
+    for (i = 0; i < NB_CTX; i++) {
+        lgw_sim_get_stats(lgw_ctx_com_target(ctx[i]), &stats);
+        printf("INFO: concentrator %d: pushed %u, received %lu, foreign %lu, overflow %u\n",
+                i, stats.nb_pushed, rx[i].nb_rx, rx[i].nb_foreign, stats.nb_overflow);
+        CHECK(rx[i].nb_rx > 0, "packets received on each concentrator");
+        CHECK(rx[i].nb_rx <= stats.nb_pushed, "no packet made up");
+        CHECK(rx[i].nb_foreign == 0, "no packet from another concentrator");
+    }
+
+    for (i = 0; i < NB_CTX; i++) {
+        lgw_ctx_free(ctx[i]);
+    }
+
+    if (nb_fail > 0) {
+        printf("%d check(s) failed\n", nb_fail);
+        return EXIT_FAILURE;
+    }
+
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
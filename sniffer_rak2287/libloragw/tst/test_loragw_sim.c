@@ -0,0 +1,259 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Test program for the simulated concentrator (LGW_COM_SIM): packets pushed
+    in the simulated RX buffer are received through lgw_receive, then the
+    source thread is run at the requested rate to load the RX path.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "loragw_hal.h"
+#include "loragw_com.h"
+#include "loragw_sim.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define COM_PATH_DEFAULT LGW_SIM_COM_PATH_SYNTH
+
+#define CHECK(cond, msg) do { if (cond) { printf("PASS: %s\n", msg); } else { printf("FAIL: %s\n", msg); nb_fail++; } } while (0)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_FREQ_HZ     868500000U
+#define DEFAULT_RATE        1000.0
+#define DEFAULT_DURATION_S  2
+#define NB_PKT_MAX          16
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const int32_t if_freq[LGW_MULTI_NB] = {-400000, -200000, 0, -400000, -200000, 0, 200000, 400000};
+
+static int nb_fail = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+void usage(void) {
+    printf("Available options:\n");
+    printf(" -h print this help\n");
+    printf(" -d <path> RX buffer dump to replay (default is synthetic traffic)\n");
+    printf(" -r <float> Packets per second pushed by the source thread [%.0f]\n", DEFAULT_RATE);
+    printf(" -t <uint> Load test duration in seconds [%d]\n", DEFAULT_DURATION_S);
+}
+
+static int configure(const char *com_path) {
+    int i;
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 0;
+    boardconf.full_duplex = false;
+    boardconf.com_type = LGW_COM_SIM;
+    strncpy(boardconf.com_path, com_path, sizeof boardconf.com_path);
+    boardconf.com_path[sizeof boardconf.com_path - 1] = '\0';
+    if (lgw_board_setconf(&boardconf) != LGW_HAL_SUCCESS) {
+        return -1;
+    }
+
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.freq_hz = DEFAULT_FREQ_HZ;
+    rfconf.rssi_offset = -215.4;
+    rfconf.type = LGW_RADIO_TYPE_SX1250;
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+        if (lgw_rxrf_setconf(i, &rfconf) != LGW_HAL_SUCCESS) {
+            return -1;
+        }
+    }
+
+    memset(&ifconf, 0, sizeof ifconf);
+    for (i = 0; i < LGW_MULTI_NB; i++) {
+        ifconf.enable = true;
+        ifconf.rf_chain = 0;
+        ifconf.freq_hz = if_freq[i];
+        ifconf.datarate = DR_LORA_SF7;
+        if (lgw_rxif_setconf(i, &ifconf) != LGW_HAL_SUCCESS) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int receive_all(struct lgw_pkt_rx_s *rxpkt, int nb_max) {
+    int nb, total = 0;
+
+    while (total < nb_max) {
+        nb = lgw_receive(((nb_max - total) < NB_PKT_MAX) ? (nb_max - total) : NB_PKT_MAX, &rxpkt[total]);
+        if (nb <= 0) {
+            break;
+        }
+        total += nb;
+    }
+
+    return total;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, x, nb;
+    double rate = DEFAULT_RATE;
+    unsigned int duration_s = DEFAULT_DURATION_S;
+    const char *com_path = COM_PATH_DEFAULT;
+    struct lgw_sim_conf_s simconf;
+    struct lgw_sim_pkt_s simpkt;
+    struct lgw_sim_stats_s stats;
+    struct lgw_pkt_rx_s rxpkt[NB_PKT_MAX];
+    unsigned long nb_rx = 0, nb_crc_ok = 0;
+    time_t t_end;
+
+    while ((i = getopt(argc, argv, "hd:r:t:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'd':
+                com_path = optarg;
+                break;
+            case 'r':
+                rate = strtod(optarg, NULL);
+                break;
+            case 't':
+                duration_s = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* Functional checks: no source thread, packets pushed by hand */
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rate = 0.0;
+    CHECK(lgw_sim_setconf(&simconf) == LGW_SIM_SUCCESS, "sim configuration");
+    CHECK(configure(LGW_SIM_COM_PATH_SYNTH) == 0, "board and channels configuration");
+    CHECK(lgw_start() == LGW_HAL_SUCCESS, "start without hardware");
+
+    CHECK(lgw_receive(NB_PKT_MAX, rxpkt) == 0, "empty RX buffer");
+
+    memset(&simpkt, 0, sizeof simpkt);
+    simpkt.if_chain = 3;
+    simpkt.modem_id = 3;
+    simpkt.datarate = 9;
+    simpkt.coderate = 1;
+    simpkt.crc_en = true;
+    simpkt.snr = 30; /* 7.5 dB */
+    simpkt.rssi_chan = 120;
+    simpkt.rssi_sig = 118;
+    simpkt.size = 23;
+    for (i = 0; i < simpkt.size; i++) {
+        simpkt.payload[i] = (uint8_t)(0x40 + i);
+    }
+    for (i = 0; i < 3; i++) {
+        x = lgw_sim_push(lgw_com_target(), &simpkt);
+    }
+    CHECK(x == LGW_SIM_SUCCESS, "push packets");
+
+    nb = receive_all(rxpkt, NB_PKT_MAX);
+    CHECK(nb == 3, "receive the pushed packets");
+    CHECK(rxpkt[0].status == STAT_CRC_OK, "CRC OK");
+    CHECK(rxpkt[0].datarate == DR_LORA_SF9, "datarate");
+    CHECK(rxpkt[0].coderate == CR_LORA_4_5, "coderate");
+    CHECK(rxpkt[0].bandwidth == BW_125KHZ, "bandwidth");
+    CHECK(rxpkt[0].freq_hz == (uint32_t)(DEFAULT_FREQ_HZ + if_freq[3]), "frequency");
+    CHECK(rxpkt[0].snr == 7.5, "SNR");
+    CHECK((rxpkt[0].rssic > (120 - 215.4 - 10)) && (rxpkt[0].rssic < (120 - 215.4 + 10)), "RSSI with offset");
+    CHECK((rxpkt[0].size == 23) && (memcmp(rxpkt[0].payload, simpkt.payload, 23) == 0), "payload");
+
+    /* Fill the RX buffer past its size: extra packets are dropped, as on the chip */
+    for (i = 0; i < (LGW_SIM_FIFO_SIZE / (9 + 23 + 14)) + 10; i++) {
+        lgw_sim_push(lgw_com_target(), &simpkt);
+    }
+    lgw_sim_get_stats(lgw_com_target(), &stats);
+    CHECK(stats.nb_overflow == 10, "RX buffer overflow counted");
+    CHECK(stats.fifo_level <= LGW_SIM_FIFO_SIZE, "RX buffer level bounded");
+    nb = 0;
+    while ((x = lgw_receive(NB_PKT_MAX, rxpkt)) > 0) {
+        nb += x;
+    }
+    CHECK(nb == (LGW_SIM_FIFO_SIZE / (9 + 23 + 14)), "full RX buffer received");
+
+    CHECK(lgw_stop() == LGW_HAL_SUCCESS, "stop");
+
+    /* Load test: source thread at the requested rate, polled like the packet forwarder */
+    simconf.rate = rate;
+    simconf.poisson = true;
+    simconf.seed = 1;
+    lgw_sim_setconf(&simconf);
+    CHECK(configure(com_path) == 0, "configuration for load test");
+    CHECK(lgw_start() == LGW_HAL_SUCCESS, "start with source thread");
+
+    t_end = time(NULL) + duration_s;
+    while (time(NULL) < t_end) {
+        nb = lgw_receive(NB_PKT_MAX, rxpkt);
+        if (nb < 0) {
+            break;
+        }
+        for (i = 0; i < nb; i++) {
+            nb_rx += 1;
+            nb_crc_ok += (rxpkt[i].status == STAT_CRC_OK) ? 1 : 0;
+        }
+        if (nb == 0) {
+            wait_ms(1);
+        }
+    }
+    lgw_sim_get_stats(lgw_com_target(), &stats);
+    printf("INFO: %.0f pkt/s for %us: pushed %u, received %lu (%lu CRC OK), overflow %u, RX buffer high water %u bytes\n",
+            rate, duration_s, stats.nb_pushed, nb_rx, nb_crc_ok, stats.nb_overflow, stats.fifo_high);
+    CHECK(stats.nb_pushed > 0, "source thread pushed packets");
+    CHECK(nb_rx > 0, "source thread packets received");
+    CHECK(nb_rx <= stats.nb_pushed, "no packet made up");
+
+    CHECK(lgw_stop() == LGW_HAL_SUCCESS, "stop with source thread");
+
+    if (nb_fail > 0) {
+        printf("%d check(s) failed\n", nb_fail);
+        return EXIT_FAILURE;
+    }
+
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,162 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Test program for the time on air lookup table: every LoRa packet
+    description is checked against lora_packet_time_on_air, then both are
+    timed on the same packet mix.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) do { if (cond) { printf("PASS: %s\n", msg); } else { printf("FAIL: %s\n", msg); nb_fail++; } } while (0)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_BENCH_LOOPS      10000000
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const uint16_t preambles[] = {6, 8, 10, 65535};
+
+static int nb_fail = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *stop) {
+    return (stop->tv_sec - start->tv_sec) * 1e9 + (stop->tv_nsec - start->tv_nsec);
+}
+
+static int compare_all(uint16_t preamble) {
+    int bw, sf, cr, h, c, size, nb_diff = 0;
+    uint32_t ref, toa;
+
+    for (bw = BW_125KHZ; bw <= BW_500KHZ; bw++) {
+        for (sf = DR_LORA_SF5; sf <= DR_LORA_SF12; sf++) {
+            for (cr = CR_LORA_4_5; cr <= CR_LORA_4_8; cr++) {
+                for (h = 0; h < 2; h++) {
+                    for (c = 0; c < 2; c++) {
+                        for (size = 0; size < 256; size++) {
+                            ref = lora_packet_time_on_air(bw, sf, cr, preamble, h, c, size, NULL, NULL, NULL);
+                            toa = lora_packet_toa_lookup(bw, sf, cr, preamble, h, c, size);
+                            if (toa != ref) {
+                                if (nb_diff == 0) {
+                                    printf("INFO: bw:%d sf:%d cr:%d preamble:%u no_header:%d no_crc:%d size:%d => %u us, expected %u us\n",
+                                            bw, sf, cr, preamble, h, c, size, toa, ref);
+                                }
+                                nb_diff += 1;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return nb_diff;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void)
+{
+    unsigned int i;
+    int nb_diff;
+    uint32_t sum_ref = 0, sum_toa = 0;
+    uint8_t sf, size;
+    uint16_t t_symbol_us;
+    struct timespec start, stop;
+    double ns_ref, ns_toa;
+
+    /* Before the table is built, the lookup falls back to the exact computation */
+    CHECK(lora_packet_toa_lookup(BW_125KHZ, DR_LORA_SF7, CR_LORA_4_5, 8, false, false, 23) ==
+          lora_packet_time_on_air(BW_125KHZ, DR_LORA_SF7, CR_LORA_4_5, 8, false, false, 23, NULL, NULL, NULL), "lookup before init");
+
+    lora_packet_toa_init();
+
+    nb_diff = 0;
+    for (i = 0; i < sizeof preambles / sizeof preambles[0]; i++) {
+        nb_diff += compare_all(preambles[i]);
+    }
+    CHECK(nb_diff == 0, "table matches lora_packet_time_on_air for every packet description");
+
+    /* Known values: LoRaWAN SF7BW125 23 bytes, SF12BW125 51 bytes, SF9BW500 implicit header no CRC */
+    CHECK(lora_packet_toa_lookup(BW_125KHZ, DR_LORA_SF7, CR_LORA_4_5, 8, false, false, 23) == 61696, "SF7BW125 23 bytes");
+    CHECK(lora_packet_toa_lookup(BW_125KHZ, DR_LORA_SF12, CR_LORA_4_5, 8, false, false, 51) == 2465792, "SF12BW125 51 bytes");
+    CHECK(lora_packet_toa_lookup(BW_500KHZ, DR_LORA_SF9, CR_LORA_4_8, 8, true, true, 10) == 37120, "SF9BW500 implicit header");
+
+    CHECK(lora_packet_toa_lookup(BW_125KHZ, 13, CR_LORA_4_5, 8, false, false, 23) == 0, "invalid spreading factor");
+    CHECK(lora_packet_toa_lookup(0, DR_LORA_SF7, CR_LORA_4_5, 8, false, false, 23) == 0, "invalid bandwidth");
+    CHECK(lora_packet_toa_lookup(BW_125KHZ, DR_LORA_SF7, 0, 8, false, false, 23) == 0, "invalid coding rate");
+
+    nb_diff = 0;
+    for (sf = DR_LORA_SF5; sf <= DR_LORA_SF12; sf++) {
+        lora_packet_time_on_air(BW_250KHZ, sf, CR_LORA_4_5, 8, false, false, 0, NULL, NULL, &t_symbol_us);
+        nb_diff += (lora_symbol_time_us(BW_250KHZ, sf) != t_symbol_us) ? 1 : 0;
+    }
+    CHECK(nb_diff == 0, "symbol duration");
+
+    /* Benchmark on the same packet mix */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < NB_BENCH_LOOPS; i++) {
+        sf = DR_LORA_SF7 + (i % 6);
+        size = (uint8_t)(i * 7);
+        sum_ref += lora_packet_time_on_air(BW_125KHZ, sf, CR_LORA_4_5, 8, false, false, size, NULL, NULL, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    ns_ref = elapsed_ns(&start, &stop) / NB_BENCH_LOOPS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < NB_BENCH_LOOPS; i++) {
+        sf = DR_LORA_SF7 + (i % 6);
+        size = (uint8_t)(i * 7);
+        sum_toa += lora_packet_toa_lookup(BW_125KHZ, sf, CR_LORA_4_5, 8, false, false, size);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    ns_toa = elapsed_ns(&start, &stop) / NB_BENCH_LOOPS;
+
+    CHECK(sum_ref == sum_toa, "benchmark sums match");
+    printf("INFO: lora_packet_time_on_air %.1f ns, lora_packet_toa_lookup %.1f ns per packet\n", ns_ref, ns_toa);
+
+    if (nb_fail > 0) {
+        printf("%d check(s) failed\n", nb_fail);
+        return EXIT_FAILURE;
+    }
+
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,78 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    AES-128 block encryption (FIPS-197) and AES-CMAC (RFC 4493), enough for
+    the LoRaWAN MIC and payload encryption, which only use the forward
+    cipher. Table based, the key schedule and CMAC subkeys are computed once
+    per key.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _AES128_H
+#define _AES128_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stddef.h>     /* size_t */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define AES128_BLOCK_SIZE   16
+#define AES128_KEY_SIZE     16
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct aes128_ctx_s
+@brief Expanded key, ready for encryption and CMAC
+*/
+typedef struct aes128_ctx_s {
+    uint32_t    rk[44];                     /*!> round keys, little endian columns */
+    uint8_t     k1[AES128_BLOCK_SIZE];      /*!> CMAC subkey for a complete last block */
+    uint8_t     k2[AES128_BLOCK_SIZE];      /*!> CMAC subkey for a padded last block */
+} aes128_ctx_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Expand a key and derive its CMAC subkeys
+@param ctx pointer to the context to fill
+@param key 16 bytes key
+*/
+void aes128_set_key(aes128_ctx_t * ctx, const uint8_t key[AES128_KEY_SIZE]);
+
+/**
+@brief Encrypt one block
+@param ctx expanded key
+@param in 16 bytes plaintext block
+@param out 16 bytes ciphertext block, can be the same as in
+*/
+void aes128_encrypt(const aes128_ctx_t * ctx, const uint8_t in[AES128_BLOCK_SIZE], uint8_t out[AES128_BLOCK_SIZE]);
+
+/**
+@brief AES-CMAC of a message given in two parts, as if they were concatenated
+@param ctx expanded key
+@param head first part of the message, NULL if head_len is 0
+@param head_len length of the first part in bytes
+@param msg second part of the message, NULL if len is 0
+@param len length of the second part in bytes
+@param mac 16 bytes CMAC
+*/
+void aes128_cmac(const aes128_ctx_t * ctx, const uint8_t * head, size_t head_len, const uint8_t * msg, size_t len, uint8_t mac[AES128_BLOCK_SIZE]);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
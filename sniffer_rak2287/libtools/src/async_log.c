@@ -0,0 +1,502 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Asynchronous logger. Callers claim a slot of a bounded multi-producer
+    queue (one sequence number per slot), format their message into it and
+    publish it. The single writer thread drains the queue in order, prefixes
+    the time, and writes whole batches through a buffered stream that stays
+    open until the file is rotated.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 700
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* fopen fwrite setvbuf vsnprintf */
+#include <stdlib.h>     /* atexit */
+#include <stdarg.h>     /* va_list */
+#include <string.h>     /* strncpy */
+#include <time.h>       /* clock_gettime clock_nanosleep strftime localtime_r gmtime_r */
+#include <pthread.h>
+#include <stdatomic.h>  /* C11 atomics */
+
+#include "async_log.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define LOG_KIND_MSG        0           /* slot holds a message */
+#define LOG_KIND_ROTATE     1           /* slot holds a rotation request, text is the new base name */
+
+#define LOG_IDLE_NS         10000000    /* writer sleep (ns) when the queue is empty */
+#define LOG_IO_BUF_LEN      16384       /* stdio buffer of the log file */
+#define LOG_ROTATE_TRIES    100         /* attempts at queueing a rotation request, one idle period apart */
+#define LOG_TIME_FMT_LEN    40
+#define LOG_PREFIX_LEN      64
+#define LOG_STAMP_LEN       24          /* "_yyyymmddThhmmssZ.txt" appended to the base name */
+
+#define LOG_DEFAULT_FMT     "%a %b %e %H:%M:%S %Y"  /* same as ctime() */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* queue slot, seq == position when free, position + 1 once published */
+typedef struct log_slot_s {
+    _Atomic uint32_t seq;
+    uint8_t kind;
+    uint16_t len;
+    struct timespec ts;                 /* time the message was logged */
+    char text[LOG_LINE_LEN];
+} log_slot_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* queue, shared by every producer and the writer */
+static log_slot_t log_queue[LOG_QUEUE_LEN];
+static _Atomic uint32_t log_enqueue_pos;
+static uint32_t log_dequeue_pos;        /* writer only */
+static _Atomic uint32_t log_drop_count;
+static _Atomic bool log_running = false;
+static _Atomic bool log_stopping = false;
+static bool log_atexit_set = false;
+static pthread_t log_thread;
+
+/* rotation limits, can be changed while running */
+static _Atomic size_t log_max_bytes;
+static _Atomic unsigned log_max_age;
+
+/* file state, owned by the writer once it is started */
+static FILE *log_fp = NULL;
+static char log_base[LOG_NAME_LEN];
+static char log_file_name[LOG_NAME_LEN + LOG_STAMP_LEN];
+static char log_time_fmt[LOG_TIME_FMT_LEN];
+static bool log_stamped;
+static bool log_truncate;
+static bool log_verbose;
+static size_t log_bytes;
+static time_t log_opened;
+static uint32_t log_drop_reported;
+static char log_io_buf[LOG_IO_BUF_LEN];
+
+/* time prefix of the last line, only rebuilt when the second changes */
+static time_t log_prefix_sec = (time_t)-1;
+static char log_prefix[LOG_PREFIX_LEN];
+static size_t log_prefix_len;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static log_slot_t *log_claim(uint32_t *pos);
+
+static void log_publish(log_slot_t *slot, uint32_t pos);
+
+static void log_write_line(const struct timespec *ts, const char *text, size_t len);
+
+static int log_open_file(void);
+
+static unsigned log_drain(void);
+
+static void *log_writer(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/**
+ * Claim the next free slot of the queue.
+ *
+ * @param pos   Set to the position of the slot, needed to publish it
+ * @return      Slot to fill, NULL if the queue is full
+*/
+static log_slot_t *log_claim(uint32_t *pos) {
+
+    uint32_t p = atomic_load_explicit(&log_enqueue_pos, memory_order_relaxed);
+    log_slot_t *slot;
+    int32_t dif;
+
+    for (;;) {
+        slot = &log_queue[p & (LOG_QUEUE_LEN - 1)];
+        dif = (int32_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - p);
+
+        if (dif == 0) {
+            /* slot is free, race the other producers for it (p is refreshed on failure) */
+            if (atomic_compare_exchange_weak_explicit(&log_enqueue_pos, &p, p + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *pos = p;
+                return slot;
+            }
+        } else if (dif < 0) {
+            return NULL; /* writer has not got this far yet */
+        } else {
+            p = atomic_load_explicit(&log_enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Hand a filled slot to the writer.
+ *
+ * @param slot  Slot returned by log_claim
+ * @param pos   Position returned by log_claim
+*/
+static void log_publish(log_slot_t *slot, uint32_t pos) {
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+/**
+ * Write one message, prefixed with its time, to the log file (and stdout if verbose).
+ *
+ * @param ts    Time the message was logged
+ * @param text  Message
+ * @param len   Length of the message
+*/
+static void log_write_line(const struct timespec *ts, const char *text, size_t len) {
+
+    struct tm tm;
+    char time_str[LOG_TIME_FMT_LEN * 2];
+    int n;
+
+    if (ts->tv_sec != log_prefix_sec) {
+        localtime_r(&ts->tv_sec, &tm);
+        strftime(time_str, sizeof time_str, log_time_fmt, &tm);
+        n = snprintf(log_prefix, sizeof log_prefix, "%s - ", time_str);
+        log_prefix_len = (n < 0) ? 0 : ((size_t)n >= sizeof log_prefix ? sizeof log_prefix - 1 : (size_t)n);
+        log_prefix_sec = ts->tv_sec;
+    }
+
+    if (log_verbose) {
+        fwrite(text, 1, len, stdout);
+    }
+
+    if (log_fp != NULL) {
+        fwrite(log_prefix, 1, log_prefix_len, log_fp);
+        fwrite(text, 1, len, log_fp);
+        log_bytes += log_prefix_len + len;
+    }
+}
+
+/**
+ * Close the current log file, if any, and open the next one.
+ *
+ * @return  0 on success, -1 if the file cannot be created
+*/
+static int log_open_file(void) {
+
+    struct timespec now;
+    struct tm tm;
+    char iso_date[20];
+    char line[LOG_LINE_LEN];
+    int n;
+
+    if (log_fp != NULL) {
+        fclose(log_fp);
+        log_fp = NULL;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    if (log_stamped) {
+        strftime(iso_date, sizeof iso_date, "%Y%m%dT%H%M%SZ", gmtime_r(&now.tv_sec, &tm)); /* format yyyymmddThhmmssZ */
+        snprintf(log_file_name, sizeof log_file_name, "%s_%s.txt", log_base, iso_date);
+    } else {
+        snprintf(log_file_name, sizeof log_file_name, "%s.txt", log_base);
+    }
+
+    log_bytes = 0;
+    log_opened = now.tv_sec;
+
+    log_fp = fopen(log_file_name, log_truncate ? "w" : "a");
+    if (log_fp == NULL) {
+        printf("impossible to create log file %s\n", log_file_name);
+        return -1;
+    }
+    setvbuf(log_fp, log_io_buf, _IOFBF, sizeof log_io_buf);
+
+    n = snprintf(line, sizeof line, "INFO: Now writing to log file %s\n", log_file_name);
+    if (n > 0 && (size_t)n < sizeof line) {
+        log_write_line(&now, line, (size_t)n);
+    }
+
+    return 0;
+}
+
+/**
+ * Write out everything published so far, up to one full queue.
+ *
+ * @return  Number of slots processed
+*/
+static unsigned log_drain(void) {
+
+    log_slot_t *slot;
+    unsigned nb = 0;
+    uint32_t dropped;
+    struct timespec now;
+    char line[LOG_LINE_LEN];
+    int n;
+
+    while (nb < LOG_QUEUE_LEN) {
+        slot = &log_queue[log_dequeue_pos & (LOG_QUEUE_LEN - 1)];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != log_dequeue_pos + 1) {
+            break;
+        }
+
+        if (slot->kind == LOG_KIND_ROTATE) {
+            if (slot->text[0] != '\0') {
+                strncpy(log_base, slot->text, sizeof log_base);
+                log_base[sizeof log_base - 1] = '\0';
+            }
+            log_open_file();
+        } else {
+            log_write_line(&slot->ts, slot->text, slot->len);
+        }
+
+        /* free the slot for the lap after this one */
+        atomic_store_explicit(&slot->seq, log_dequeue_pos + LOG_QUEUE_LEN, memory_order_release);
+        log_dequeue_pos++;
+        nb++;
+    }
+
+    dropped = atomic_load_explicit(&log_drop_count, memory_order_relaxed);
+    if (dropped != log_drop_reported) {
+        clock_gettime(CLOCK_REALTIME, &now);
+        n = snprintf(line, sizeof line, "WARNING: %lu log messages dropped, queue full\n", (unsigned long)(dropped - log_drop_reported));
+        if (n > 0 && (size_t)n < sizeof line) {
+            log_write_line(&now, line, (size_t)n);
+        }
+        log_drop_reported = dropped;
+        nb++;
+    }
+
+    return nb;
+}
+
+/**
+ * Writer thread: drain, flush once per batch, rotate when a limit is reached.
+*/
+static void *log_writer(void *arg) {
+
+    struct timespec idle = {0, LOG_IDLE_NS};
+    struct timespec now;
+    size_t max_bytes;
+    unsigned max_age;
+    unsigned nb;
+    bool stopping;
+
+    (void)arg;
+
+    for (;;) {
+        /* read before draining, so everything queued before log_stop is written */
+        stopping = atomic_load_explicit(&log_stopping, memory_order_acquire);
+
+        nb = log_drain();
+        if (nb > 0) {
+            if (log_fp != NULL) {
+                fflush(log_fp);
+            }
+            if (log_verbose) {
+                fflush(stdout);
+            }
+        }
+
+        max_bytes = atomic_load_explicit(&log_max_bytes, memory_order_relaxed);
+        max_age = atomic_load_explicit(&log_max_age, memory_order_relaxed);
+        clock_gettime(CLOCK_REALTIME, &now);
+        if ((max_bytes > 0 && log_bytes >= max_bytes) || (max_age > 0 && now.tv_sec - log_opened >= (time_t)max_age)) {
+            log_open_file();
+            fflush(log_fp != NULL ? log_fp : stdout);
+        }
+
+        if (stopping) {
+            break;
+        }
+        if (nb == 0) {
+            clock_nanosleep(CLOCK_MONOTONIC, 0, &idle, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int log_start(const log_conf_t *conf) {
+
+    uint32_t i;
+
+    if (atomic_load(&log_running)) {
+        return -1;
+    }
+
+    strncpy(log_base, conf->name, sizeof log_base);
+    log_base[sizeof log_base - 1] = '\0';
+    strncpy(log_time_fmt, (conf->time_fmt != NULL) ? conf->time_fmt : LOG_DEFAULT_FMT, sizeof log_time_fmt);
+    log_time_fmt[sizeof log_time_fmt - 1] = '\0';
+    log_stamped = conf->stamped;
+    log_truncate = conf->truncate;
+    log_verbose = conf->verbose;
+    log_prefix_sec = (time_t)-1;
+    atomic_store(&log_max_bytes, conf->max_bytes);
+    atomic_store(&log_max_age, conf->max_age);
+
+    for (i = 0; i < LOG_QUEUE_LEN; i++) {
+        atomic_store_explicit(&log_queue[i].seq, i, memory_order_relaxed);
+    }
+    atomic_store(&log_enqueue_pos, 0);
+    log_dequeue_pos = 0;
+    atomic_store(&log_drop_count, 0);
+    log_drop_reported = 0;
+
+    if (log_open_file()) {
+        return -1;
+    }
+
+    atomic_store(&log_stopping, false);
+    if (pthread_create(&log_thread, NULL, log_writer, NULL) != 0) {
+        fclose(log_fp);
+        log_fp = NULL;
+        return -1;
+    }
+
+    atomic_store(&log_running, true);
+
+    /* programs leave through exit() from any thread, make sure the queue is written out */
+    if (!log_atexit_set) {
+        atexit(log_stop);
+        log_atexit_set = true;
+    }
+
+    return 0;
+}
+
+void log_stop(void) {
+
+    if (!atomic_exchange(&log_running, false)) {
+        return;
+    }
+
+    atomic_store(&log_stopping, true);
+    pthread_join(log_thread, NULL);
+
+    if (log_fp != NULL) {
+        fclose(log_fp);
+        log_fp = NULL;
+    }
+}
+
+void log_printf(const char *format, ...) {
+
+    va_list ap;
+    log_slot_t *slot;
+    uint32_t pos;
+    int n;
+
+    if (!atomic_load_explicit(&log_running, memory_order_acquire)) {
+        va_start(ap, format);
+        vfprintf(stdout, format, ap);
+        va_end(ap);
+        return;
+    }
+
+    slot = log_claim(&pos);
+    if (slot == NULL) {
+        atomic_fetch_add_explicit(&log_drop_count, 1, memory_order_relaxed);
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &slot->ts);
+
+    va_start(ap, format);
+    n = vsnprintf(slot->text, sizeof slot->text, format, ap);
+    va_end(ap);
+
+    if (n < 0) {
+        n = 0;
+        slot->text[0] = '\0';
+    } else if ((size_t)n >= sizeof slot->text) {
+        n = sizeof slot->text - 1;
+        slot->text[n - 1] = '\n'; /* keep lines whole in the file */
+    }
+
+    slot->kind = LOG_KIND_MSG;
+    slot->len = (uint16_t)n;
+
+    log_publish(slot, pos);
+}
+
+void log_set_rotation(size_t max_bytes, unsigned max_age) {
+
+    atomic_store(&log_max_bytes, max_bytes);
+    atomic_store(&log_max_age, max_age);
+}
+
+int log_rotate(const char *name) {
+
+    struct timespec idle = {0, LOG_IDLE_NS};
+    log_slot_t *slot;
+    uint32_t pos;
+    int i;
+
+    if (!atomic_load(&log_running)) {
+        return -1;
+    }
+
+    /* not on any hot path, so wait for room rather than lose the request */
+    for (i = 0; i < LOG_ROTATE_TRIES; i++) {
+        slot = log_claim(&pos);
+        if (slot != NULL) {
+            slot->kind = LOG_KIND_ROTATE;
+            slot->len = 0;
+            clock_gettime(CLOCK_REALTIME, &slot->ts);
+            if (name != NULL) {
+                strncpy(slot->text, name, LOG_NAME_LEN);
+                slot->text[LOG_NAME_LEN - 1] = '\0';
+            } else {
+                slot->text[0] = '\0';
+            }
+            log_publish(slot, pos);
+            return 0;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &idle, NULL);
+    }
+
+    return -1;
+}
+
+uint32_t log_dropped(void) {
+
+    return atomic_load_explicit(&log_drop_count, memory_order_relaxed);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
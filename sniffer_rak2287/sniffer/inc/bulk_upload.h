@@ -0,0 +1,145 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Elasticsearch style _bulk request building. NDJSON report records are
+    interleaved with an action line, and the per item statuses of the
+    response are mapped back onto the documents so only the rejected ones
+    need to be sent again.
+*/
+
+#ifndef _SNIFFER_BULK_UPLOAD_H
+#define _SNIFFER_BULK_UPLOAD_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* FILE */
+
+#include "http_uploader.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define BULK_ACTION_LEN     128         /* Max length of the action line, including null terminator */
+
+#define BULK_STATUS_NONE    0           /* no item status received for the document */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* location and outcome of one document within the request body */
+typedef struct bulk_doc_s {
+    uint32_t off;                       /* offset of the document line in the body */
+    uint32_t len;                       /* length of the document line, excluding the newline */
+    uint16_t status;                    /* item status from the response */
+} bulk_doc_t;
+
+/* a _bulk request under construction */
+typedef struct bulk_req_s {
+    char action[BULK_ACTION_LEN];       /* action line written before every document */
+    size_t action_len;
+    http_buf_t body;                    /* request body */
+    bulk_doc_t *docs;                   /* documents in body order */
+    size_t nb_docs;
+    size_t cap_docs;
+} bulk_req_t;
+
+/* outcome of a response once mapped onto the documents */
+typedef struct bulk_result_s {
+    size_t accepted;                    /* documents stored by the server */
+    size_t retry;                       /* documents rejected with a status worth retrying (429, 5xx) */
+    size_t rejected;                    /* documents rejected for good (i.e. mapping errors) */
+} bulk_result_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Initialise a bulk request.
+ *
+ * @param b     Bulk request
+ * @param index Index to target in the action line, NULL or empty to leave it to the url
+ * @return      0 on success, -1 otherwise
+*/
+int bulk_init(bulk_req_t *b, const char *index);
+
+/**
+ * Empty a bulk request, keeping its allocations for the next one.
+ *
+ * @param b Bulk request
+*/
+void bulk_reset(bulk_req_t *b);
+
+/**
+ * Release a bulk request.
+ *
+ * @param b Bulk request
+*/
+void bulk_free(bulk_req_t *b);
+
+/**
+ * Add every record of an NDJSON buffer to the request. Empty lines are skipped.
+ *
+ * @param b     Bulk request
+ * @param data  NDJSON records
+ * @param len   Length of the records
+ * @return      Number of documents added, -1 on failure
+*/
+long bulk_add_ndjson(bulk_req_t *b, const char *data, size_t len);
+
+/**
+ * Map a _bulk response onto the documents of the request.
+ *
+ * @param b         Bulk request the response belongs to
+ * @param response  Null terminated response body
+ * @param result    Filled with the counts of each outcome
+ * @return          0 on success, -1 if the response is not a _bulk response
+*/
+int bulk_parse_response(bulk_req_t *b, const char *response, bulk_result_t *result);
+
+/**
+ * Check if an item status means the document should be sent again.
+ *
+ * @param status    Item status
+ * @return          true for throttling and server side failures
+*/
+bool bulk_status_retry(uint16_t status);
+
+/**
+ * Write the documents that match the retry selection, one per line.
+ *
+ * @param b     Bulk request
+ * @param fp    Stream to write to
+ * @param retry true to write the retryable documents, false for the ones rejected for good
+ * @return      Number of documents written, -1 on a write error
+*/
+long bulk_write_failed(bulk_req_t *b, FILE *fp, bool retry);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
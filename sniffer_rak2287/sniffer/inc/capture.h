@@ -0,0 +1,196 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Raw packet captures. Every received lgw_pkt_rx_s is appended to a binary,
+    versioned capture file together with the wall clock time it was fetched,
+    so traffic can be analysed again long after the JSON reports are gone.
+
+    File layout, all fields little endian:
+      file header (CAPTURE_FILE_HDR_LEN bytes)
+        0  magic "LGWC"          4  u16 version        6  u16 file header length
+        8  u16 record header len 10 u16 reserved       12 u64 gateway ID
+        20 u64 creation time (ns since epoch)          28 u32 reserved
+      records, back to back
+        0  u16 record length     2  u8 card            3  u8 flags (bit 0: fine timestamp)
+        4  u64 fetch time (ns)   12 u32 count_us       16 u32 freq_hz
+        20 s32 freq_offset       24 u32 datarate       28 u8 if_chain, status, rf_chain, modem_id
+        32 u8 modulation, bandwidth, coderate, 0       36 u16 crc          38 u16 size
+        40 f32 rssic, rssis, snr, snr_min, snr_max     60 u32 ftime
+        64 payload, size bytes
+    The record length counts header and payload, readers skip whatever a later
+    version appends to the record header. A record cut short by a crash ends
+    the capture, and is dropped when the writer opens the file again.
+
+    Captures are read back through a memory map and can be exported to pcapng
+    with LoRaTap (link type 270) headers for Wireshark.
+*/
+
+#ifndef _SNIFFER_CAPTURE_H
+#define _SNIFFER_CAPTURE_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+#include <stdio.h>      /* FILE */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define CAPTURE_MAGIC           "LGWC"
+#define CAPTURE_VERSION         1
+#define CAPTURE_FILE_HDR_LEN    32          /* bytes of the file header */
+#define CAPTURE_REC_HDR_LEN     64          /* bytes of a record header, before the payload */
+#define CAPTURE_REC_MAX         (CAPTURE_REC_HDR_LEN + 256)
+
+#define CAPTURE_SUFFIX          ".lgwcap"
+#define CAPTURE_PREFIX_LEN      64          /* Max length of the path prefix, including null terminator */
+#define CAPTURE_NAME_LEN        100         /* Max length of a capture file name, including null terminator */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* capture writer - rotates the file once it grows past max_bytes */
+typedef struct capture_writer_s {
+    char prefix[CAPTURE_PREFIX_LEN];    /* files are <prefix>.lgwcap, then <prefix>.1.lgwcap... when rotated */
+    size_t max_bytes;                   /* rotate once the file would grow past this size, 0 for no limit */
+    unsigned keep;                      /* rotated files kept */
+    uint64_t gateway_id;
+    FILE *fp;
+    size_t bytes;                       /* bytes in the current file */
+    uint64_t records;                   /* records written since capture_open */
+    uint64_t errors;                    /* records that could not be written */
+} capture_writer_t;
+
+/* memory mapped capture file */
+typedef struct capture_reader_s {
+    const uint8_t *map;
+    size_t size;
+    size_t pos;                         /* offset of the next record */
+    uint16_t version;
+    uint16_t rec_hdr_len;
+    uint64_t gateway_id;
+    uint64_t created_ns;
+} capture_reader_t;
+
+/* one record read back */
+typedef struct capture_rec_s {
+    uint64_t time_ns;                   /* wall clock time the packet was fetched, ns since epoch */
+    uint8_t card;                       /* concentrator the packet came from */
+    struct lgw_pkt_rx_s pkt;
+} capture_rec_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Open <prefix>.lgwcap for appending, creating it with a file header if needed.
+ * A partial record left at the end of an existing file is cut off.
+ *
+ * @param cw            Capture writer
+ * @param prefix        Path of the capture, without suffix
+ * @param max_bytes     Size (bytes) at which the file is rotated, 0 for no limit
+ * @param keep          Number of rotated files kept
+ * @param gateway_id    Gateway ID written in new file headers
+ * @return              0 on success, -1 otherwise
+*/
+int capture_open(capture_writer_t *cw, const char *prefix, size_t max_bytes, unsigned keep, uint64_t gateway_id);
+
+/**
+ * Append a packet. Records go through the stdio buffer of the file,
+ * capture_flush pushes them to the kernel.
+ *
+ * @param cw        Capture writer
+ * @param card      Concentrator the packet came from
+ * @param time_ns   Wall clock time the packet was fetched (ns since epoch)
+ * @param p         Received packet
+ * @return          0 on success, -1 otherwise
+*/
+int capture_write(capture_writer_t *cw, uint8_t card, uint64_t time_ns, const struct lgw_pkt_rx_s *p);
+
+/**
+ * Flush buffered records to the file.
+ *
+ * @param cw    Capture writer
+ * @return      0 on success, -1 otherwise
+*/
+int capture_flush(capture_writer_t *cw);
+
+/**
+ * Flush and close the capture.
+ *
+ * @param cw    Capture writer
+*/
+void capture_close(capture_writer_t *cw);
+
+/**
+ * Map a capture file and check its header.
+ *
+ * @param cr    Capture reader
+ * @param path  Capture file
+ * @return      0 on success, -1 if it cannot be mapped or is not a capture
+*/
+int capture_reader_open(capture_reader_t *cr, const char *path);
+
+/**
+ * Decode the next record.
+ *
+ * @param cr    Capture reader
+ * @param rec   Record to fill
+ * @return      1 if a record was read, 0 at the end of the capture, -1 on a malformed record
+*/
+int capture_reader_next(capture_reader_t *cr, capture_rec_t *rec);
+
+/**
+ * Go back to the first record.
+ *
+ * @param cr    Capture reader
+*/
+void capture_reader_rewind(capture_reader_t *cr);
+
+/**
+ * Unmap a capture file.
+ *
+ * @param cr    Capture reader
+*/
+void capture_reader_close(capture_reader_t *cr);
+
+/**
+ * Export a capture to pcapng, one LoRaTap packet per record.
+ *
+ * @param in_path   Capture file
+ * @param out_path  pcapng file to create
+ * @return          Number of packets exported, -1 on error
+*/
+long capture_export_pcapng(const char *in_path, const char *out_path);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
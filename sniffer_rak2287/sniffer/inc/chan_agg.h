@@ -0,0 +1,165 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Description:
+    Channel aggregation: packets are accumulated in fixed time buckets per
+    (frequency, datarate), each holding packet and CRC counts, summed time
+    on air, RSSI/SNR min/avg/max and the number of distinct DevAddrs, from
+    a HyperLogLog sketch. One compact document per active channel and
+    bucket can then be uploaded, instead of, or on top of, one report per
+    packet. The aggregator has a single writer.
+*/
+
+#ifndef _SNIFFER_CHAN_AGG_H
+#define _SNIFFER_CHAN_AGG_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+#include <time.h>       /* time_t */
+
+#include "loragw_hal.h"
+#include "ed_report.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define CHAN_AGG_TYPE           "channel"   /* value of the type field of buckets */
+
+#define CHAN_AGG_SLOTS          256         /* (frequency, datarate) cells of a bucket, power of two */
+#define CHAN_AGG_MAX_CELLS      (CHAN_AGG_SLOTS / 2)    /* active cells accepted, keeps probe runs short */
+#define CHAN_AGG_HLL_BITS       8           /* HyperLogLog registers are indexed by 8 hash bits */
+#define CHAN_AGG_HLL_SIZE       (1 << CHAN_AGG_HLL_BITS)    /* 256 registers, about 6.5% standard error */
+
+#define CHAN_AGG_JSON_MAX       384         /* buffer size that always holds an encoded bucket */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* one (frequency, datarate) cell of the current bucket */
+typedef struct chan_cell_s {
+    uint32_t freq_hz;
+    uint32_t datarate;                  /* spreading factor for LoRa, bit rate for FSK */
+    uint32_t nb_pkt;
+    uint32_t nb_crc_ok;
+    uint32_t nb_crc_bad;
+    uint64_t airtime_us;                /* summed time on air */
+    float rssi_min, rssi_max;
+    float snr_min, snr_max;
+    double rssi_sum, snr_sum;
+    uint8_t hll[CHAN_AGG_HLL_SIZE];     /* DevAddrs of the CRC checked frames */
+} chan_cell_t;
+
+/* aggregator, the bucket is [start, start + width[ */
+typedef struct chan_agg_s {
+    chan_cell_t *cells;                 /* CHAN_AGG_SLOTS cells, open addressing on (frequency, datarate) */
+    uint16_t used[CHAN_AGG_MAX_CELLS];  /* slots of the active cells, in the order they started */
+    uint32_t nb_used;
+    unsigned width;                     /* bucket length (seconds) */
+    time_t start;                       /* start of the current bucket, 0 before the first packet */
+    uint32_t full;                      /* packets not counted because too many cells were active */
+} chan_agg_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Allocate the cells of an aggregator.
+ *
+ * @param a     Aggregator to initialise
+ * @param width Bucket length (seconds), buckets start on multiples of it
+ * @return      0 on success, -1 otherwise
+*/
+int chan_agg_init(chan_agg_t *a, unsigned width);
+
+/**
+ * Release the cells of an aggregator.
+ *
+ * @param a Aggregator to free
+*/
+void chan_agg_free(chan_agg_t *a);
+
+/**
+ * Tell whether the current bucket is over and must be emitted before more packets are added.
+ *
+ * @param a     Aggregator
+ * @param now   Current time
+ * @return      true if the bucket holds packets and ended before now
+*/
+bool chan_agg_due(const chan_agg_t *a, time_t now);
+
+/**
+ * Count a packet in the current bucket.
+ *
+ * @param a         Aggregator
+ * @param p         Received packet
+ * @param report    Report written from the packet
+ * @param now       Reception time, within the current bucket (see chan_agg_due)
+ * @return          0 on success, -1 if too many cells are active
+*/
+int chan_agg_add(chan_agg_t *a, const struct lgw_pkt_rx_s *p, const ed_report_t *report, time_t now);
+
+/**
+ * Walk the active cells of the current bucket, in the order they started.
+ *
+ * @param a     Aggregator
+ * @param pos   Position, set to 0 to start
+ * @return      Next cell, NULL at the end of the bucket
+*/
+const chan_cell_t *chan_agg_next(const chan_agg_t *a, uint32_t *pos);
+
+/**
+ * Clear the cells and start a new bucket with the next packet.
+ *
+ * @param a Aggregator
+*/
+void chan_agg_reset(chan_agg_t *a);
+
+/**
+ * Estimate the number of distinct DevAddrs seen in a cell.
+ *
+ * @param c Cell
+ * @return  Estimated count
+*/
+double chan_agg_devices(const chan_cell_t *c);
+
+/**
+ * Serialise a cell of the current bucket as a single line of JSON, without the newline.
+ *
+ * @param a     Aggregator
+ * @param c     Cell
+ * @param buf   Output buffer, CHAN_AGG_JSON_MAX bytes are always enough
+ * @param size  Size of the output buffer
+ * @return      Length of the line (null terminator excluded), -1 if it does not fit
+*/
+int chan_agg_encode(const chan_agg_t *a, const chan_cell_t *c, char *buf, size_t size);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,177 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Description:
+    Per device state, kept in an open addressing table keyed by DevAddr.
+    Every CRC checked uplink updates the state of its device: FCnt extended
+    to 32 bits, frames lost in the FCnt sequence, repeated frames, RSSI and
+    SNR averages, SF and ADR changes, last seen time. A compact summary of
+    each device seen over a period can then be encoded, instead of, or on
+    top of, one report per uplink. The table has a single writer.
+*/
+
+#ifndef _SNIFFER_DEV_TABLE_H
+#define _SNIFFER_DEV_TABLE_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+#include <time.h>       /* time_t */
+
+#include "ed_report.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define DEV_TABLE_TYPE          "summary"   /* value of the type field of summaries */
+
+#define DEV_FCNT_MAX_GAP        16384       /* FCnt jumps from this on are a device reset, as MAX_FCNT_GAP in LoRaWAN 1.0 */
+#define DEV_EWMA_WEIGHT         0.125f      /* weight of a new RSSI/SNR sample in the averages */
+
+#define DEV_SUMMARY_JSON_MAX    384         /* buffer size that always holds an encoded summary */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* state of one device, counters are reset by dev_table_reset_period */
+typedef struct dev_entry_s {
+    uint32_t devaddr;
+    bool used;                          /* slot holds a device */
+    uint8_t sf;                         /* last spreading factor */
+    bool adr;                           /* last ADR bit */
+    uint32_t fcnt;                      /* last FCnt, extended to 32 bits */
+    uint32_t nb_rx;                     /* frames received this period */
+    uint32_t nb_lost;                   /* frames missing from the FCnt sequence this period */
+    uint32_t nb_dup;                    /* frames received again with the same FCnt this period */
+    uint16_t nb_sf_change;              /* SF changes this period */
+    uint16_t nb_adr_change;             /* ADR bit changes this period */
+    uint16_t nb_reset;                  /* FCnt restarts (rejoin, reboot) this period */
+    float rssi;                         /* RSSI average (dBm) */
+    float snr;                          /* SNR average (dB) */
+    time_t last_seen;
+} dev_entry_t;
+
+/* table of devices, at most half full so probe runs stay short */
+typedef struct dev_table_s {
+    dev_entry_t *slots;
+    uint32_t size;                      /* number of slots, power of two */
+    uint32_t mask;                      /* size - 1 */
+    uint32_t shift;                     /* 32 - log2(size), for the hash */
+    uint32_t capacity;                  /* devices the table accepts */
+    uint32_t count;                     /* devices in the table */
+    uint32_t full;                      /* uplinks of new devices refused because the table was full */
+} dev_table_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Allocate the slots of a table.
+ *
+ * @param t         Table to initialise
+ * @param capacity  Number of devices the table can hold
+ * @return          0 on success, -1 otherwise
+*/
+int dev_table_init(dev_table_t *t, uint32_t capacity);
+
+/**
+ * Release the slots of a table.
+ *
+ * @param t Table to free
+*/
+void dev_table_free(dev_table_t *t);
+
+/**
+ * Look a device up.
+ *
+ * @param t         Table
+ * @param devaddr   DevAddr of the device
+ * @return          Pointer to the device state, NULL if the device is not in the table
+*/
+dev_entry_t *dev_table_find(dev_table_t *t, uint32_t devaddr);
+
+/**
+ * Update the state of a device from a report, adding the device if it is new.
+ * Only CRC checked uplinks (UDU, CDU) are taken, and not those with a bad
+ * MIC, other reports are ignored.
+ *
+ * @param t         Table
+ * @param report    Report of the received frame
+ * @param now       Reception time
+ * @return          0 if the device was updated, 1 if the report was ignored, -1 if the table is full
+*/
+int dev_table_update(dev_table_t *t, const ed_report_t *report, time_t now);
+
+/**
+ * Walk the devices of the table. Entries must not be added or removed during the walk.
+ *
+ * @param t     Table
+ * @param pos   Position, set to 0 to start
+ * @return      Next device, NULL at the end of the table
+*/
+dev_entry_t *dev_table_next(dev_table_t *t, uint32_t *pos);
+
+/**
+ * Remove the devices not seen since a given time.
+ *
+ * @param t         Table
+ * @param before    Devices last seen before this time are removed
+ * @return          Number of devices removed
+*/
+uint32_t dev_table_expire(dev_table_t *t, time_t before);
+
+/**
+ * Start a new period for a device, clearing its counters.
+ *
+ * @param d Device
+*/
+void dev_table_reset_period(dev_entry_t *d);
+
+/**
+ * Frames lost over the period, as a share of the frames sent.
+ *
+ * @param d Device
+ * @return  Loss rate [0..1], 0 if nothing was sent
+*/
+float dev_table_loss_rate(const dev_entry_t *d);
+
+/**
+ * Serialise the summary of a device over the period as a single line of JSON, without the newline.
+ *
+ * @param d     Device
+ * @param now   End of the period, used as timestamp
+ * @param buf   Output buffer, DEV_SUMMARY_JSON_MAX bytes are always enough
+ * @param size  Size of the output buffer
+ * @return      Length of the line (null terminator excluded), -1 if it does not fit
+*/
+int dev_table_encode(const dev_entry_t *d, time_t now, char *buf, size_t size);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,133 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    End device reports. A report is a flat, fixed layout record filled from a
+    received packet without any heap allocation: strings are held in inline
+    arrays, the FOpts field in a fixed size binary slot, and DevAddr and
+    the join request EUIs stay integers until the report is serialised.
+    MAC commands carried in FOpts are decoded into the report as well, and
+    for devices with known session keys the MIC is checked and FRMPayload
+    decrypted (see key_store). The encoder writes the JSON line straight into a caller buffer through
+    json_emit, with the same fields, order and number formatting as the
+    former parson based encoder. report_cbor holds the compact binary
+    encoding of the same reports.
+*/
+
+#ifndef _SNIFFER_ED_REPORT_H
+#define _SNIFFER_ED_REPORT_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+#include <time.h>       /* struct timespec */
+
+#include "loragw_hal.h"
+#include "mac_cmd.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define ED_REPORT_TYPE          "device"    /* value of the type field */
+
+#define ED_REPORT_TIME_LEN      25          /* Max length of the ISO 8601 timestamp, including null terminator */
+#define ED_REPORT_MTYPE_LEN     4           /* Max length of the message type string, including null terminator */
+#define ED_REPORT_CRC_LEN       6           /* Max length of the CRC string, including null terminator */
+#define ED_REPORT_FOPTS_LEN     15          /* Max length of FOpts, FOptsLen is 4 bits */
+#define ED_REPORT_DATA_LEN      256         /* Max length of the decrypted FRMPayload, less than a packet */
+
+#define ED_REPORT_JSON_MAX      1536        /* buffer size that always holds an encoded report */
+
+/* MIC status of a report */
+#define ED_MIC_NONE             0           /* not checked, no session key for the device */
+#define ED_MIC_OK               1
+#define ED_MIC_BAD              2
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* end device report - structured like a data frame, no pointers */
+typedef struct ed_report_s {
+    /* Auxiliary metrics */
+    char timestamp[ED_REPORT_TIME_LEN];
+    uint64_t time_ms;                           /* fetch time, in ms since the epoch, for the binary encoding */
+    float freq;
+    uint8_t sf;
+    float snr;
+    float rssi;
+    float toa;
+    /* Fields structured like a data frame! */
+    char mtype[ED_REPORT_MTYPE_LEN];
+    uint32_t devaddr;
+    bool adr;
+    bool ack;
+    uint8_t foptslen;                           /* FOpts length in bytes, from FCtrl */
+    uint32_t fcnt;
+    uint8_t fopts[ED_REPORT_FOPTS_LEN];         /* raw MAC commands, foptslen bytes are valid */
+    mac_cmd_t mac_cmds[ED_REPORT_FOPTS_LEN];    /* FOpts decoded, at most one command per byte */
+    uint8_t nb_mac_cmds;
+    uint8_t mac_status;                         /* MAC_CMD_* status of the FOpts decoding */
+    int fport;
+    uint8_t frmlength;
+    char crc[ED_REPORT_CRC_LEN];
+    /* Session key items, set by key_store_process */
+    uint8_t mic;                                /* ED_MIC_* */
+    uint8_t datalen;                            /* decrypted FRMPayload length, 0 if not decrypted or not kept */
+    uint8_t data[ED_REPORT_DATA_LEN];           /* decrypted FRMPayload */
+    /* Special JR request items */
+    bool is_jr;
+    uint64_t app_eui;
+    uint64_t dev_eui;
+} ed_report_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Fill a report from a received packet. Every field is written, there is
+ * no need to clear the report between packets.
+ *
+ * @param report        Report to fill
+ * @param p             Received packet
+ * @param fetch_time    Time (CLOCK_REALTIME) the packet was fetched
+*/
+void ed_report_write(ed_report_t *report, const struct lgw_pkt_rx_s *p, const struct timespec *fetch_time);
+
+/**
+ * Serialise a report as a single line of JSON, without the newline.
+ *
+ * @param report    Report to serialise
+ * @param buf       Output buffer, ED_REPORT_JSON_MAX bytes are always enough
+ * @param size      Size of the output buffer
+ * @return          Length of the line (null terminator excluded), -1 if it does not fit
+*/
+int ed_report_encode(const ed_report_t *report, char *buf, size_t size);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
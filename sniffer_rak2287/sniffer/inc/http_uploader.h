@@ -0,0 +1,190 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    In-process HTTP uploader built on the libcurl easy interface. A single
+    handle is kept for the life of the program so the connection (and TLS
+    session) to the dashboard is reused between uploads. Responses are
+    collected in memory rather than through an output file.
+*/
+
+#ifndef _SNIFFER_HTTP_UPLOADER_H
+#define _SNIFFER_HTTP_UPLOADER_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stddef.h>     /* size_t */
+
+#include <curl/curl.h>
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define HTTP_CONTENT_JSON       "Content-Type: application/json"
+#define HTTP_CONTENT_NDJSON     "Content-Type: application/x-ndjson"
+
+#define HTTP_BEARER_LEN         800     /* Max length of a bearer token, including null terminator */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* growable byte buffer, reused between requests */
+typedef struct http_buf_s {
+    char *data;
+    size_t len;
+    size_t cap;
+} http_buf_t;
+
+/* persistent uploader - one per destination thread */
+typedef struct http_uploader_s {
+    CURL *curl;                         /* easy handle, owns the keep-alive connection */
+    long connect_timeout;               /* connection timeout (seconds) */
+    char bearer[HTTP_BEARER_LEN];       /* bearer token sent with authorised requests */
+    http_buf_t request;                 /* request body of the last request */
+    http_buf_t response;                /* response body of the last request, always null terminated */
+    long status;                        /* HTTP status of the last request, 0 if none was received */
+    char error[CURL_ERROR_SIZE];        /* libcurl error string of the last request */
+} http_uploader_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Initialise libcurl for the process. Must be called once before any other
+ * thread is created.
+ *
+ * @return  0 on success, -1 otherwise
+*/
+int http_global_init(void);
+
+/**
+ * Release the process wide libcurl state.
+*/
+void http_global_cleanup(void);
+
+/**
+ * Initialise an uploader.
+ *
+ * @param h                 Uploader to initialise
+ * @param connect_timeout   Connection timeout in seconds
+ * @return                  0 on success, -1 otherwise
+*/
+int http_init(http_uploader_t *h, long connect_timeout);
+
+/**
+ * Close the connection and release the uploader.
+ *
+ * @param h Uploader to release
+*/
+void http_cleanup(http_uploader_t *h);
+
+/**
+ * Set the bearer token sent by http_post when authorised is requested.
+ *
+ * @param h         Uploader
+ * @param token     Bearer token string
+ * @return          0 on success, -1 if the token does not fit
+*/
+int http_set_bearer(http_uploader_t *h, const char *token);
+
+/**
+ * POST a body held in memory.
+ *
+ * @param h             Uploader
+ * @param url           Destination url
+ * @param content_type  Full Content-Type header line (i.e. HTTP_CONTENT_JSON)
+ * @param authorised    Non-zero to send the stored bearer token
+ * @param body          Request body
+ * @param len           Length of the request body
+ * @return              libcurl code (CURLE_OK on success)
+*/
+int http_post(http_uploader_t *h, const char *url, const char *content_type, int authorised, const void *body, size_t len);
+
+/**
+ * POST a body held in memory that is already encoded (compressed).
+ *
+ * @param h                 Uploader
+ * @param url               Destination url
+ * @param content_type      Full Content-Type header line
+ * @param content_encoding  Full Content-Encoding header line, NULL for an identity body
+ * @param authorised        Non-zero to send the stored bearer token
+ * @param body              Request body
+ * @param len               Length of the request body
+ * @return                  libcurl code (CURLE_OK on success)
+*/
+int http_post_encoded(http_uploader_t *h, const char *url, const char *content_type, const char *content_encoding, int authorised, const void *body, size_t len);
+
+/**
+ * POST the contents of a file. The file is read into the uploader's request
+ * buffer, which is reused between calls.
+ *
+ * @param h             Uploader
+ * @param url           Destination url
+ * @param content_type  Full Content-Type header line
+ * @param authorised    Non-zero to send the stored bearer token
+ * @param file_name     File to send
+ * @return              libcurl code, or CURLE_READ_ERROR if the file could not be read
+*/
+int http_post_file(http_uploader_t *h, const char *url, const char *content_type, int authorised, const char *file_name);
+
+/**
+ * GET a url, used to probe if a connection can be made.
+ *
+ * @param h     Uploader
+ * @param url   Url to fetch
+ * @return      libcurl code (CURLE_OK on success)
+*/
+int http_get(http_uploader_t *h, const char *url);
+
+/**
+ * Read a whole file into a buffer.
+ *
+ * @param buf       Buffer to fill, grown as needed
+ * @param file_name File to read
+ * @return          0 on success, -1 otherwise
+*/
+int http_buf_load(http_buf_t *buf, const char *file_name);
+
+/**
+ * Make sure a buffer can hold at least the given number of bytes plus a terminator.
+ *
+ * @param buf   Buffer to grow
+ * @param size  Number of bytes required
+ * @return      0 on success, -1 otherwise
+*/
+int http_buf_reserve(http_buf_t *buf, size_t size);
+
+/**
+ * Release a buffer.
+ *
+ * @param buf   Buffer to free
+*/
+void http_buf_free(http_buf_t *buf);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
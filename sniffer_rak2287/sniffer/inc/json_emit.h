@@ -0,0 +1,129 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Single pass JSON emitter for flat report objects. Members are written
+    straight into a caller buffer, in the order they are emitted, with the
+    same escaping and number formatting as parson's compact serialiser, so a
+    line built here is byte for byte the one json_serialize_to_string would
+    return for the same object. Nothing is allocated.
+*/
+
+#ifndef _SNIFFER_JSON_EMIT_H
+#define _SNIFFER_JSON_EMIT_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* emitter state - writing stops, and the object is refused, once the buffer is full */
+typedef struct json_emit_s {
+    char *buf;
+    size_t size;
+    size_t len;
+    bool first;                         /* no member written yet */
+    bool full;                          /* something did not fit */
+} json_emit_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Start an object in a buffer.
+ *
+ * @param e     Emitter
+ * @param buf   Output buffer
+ * @param size  Size of the output buffer
+*/
+void json_emit_begin(json_emit_t *e, char *buf, size_t size);
+
+/**
+ * Close the object and null terminate it.
+ *
+ * @param e     Emitter
+ * @return      Length of the object (null terminator excluded), -1 if it did not fit
+*/
+int json_emit_end(json_emit_t *e);
+
+/**
+ * Add a string member. Quotes, backslashes, slashes and the \b \f \n \r \t
+ * controls are escaped, every other byte is copied as is (as parson does).
+ * UTF-8 is not validated, parson would drop an invalid string altogether.
+ *
+ * @param e     Emitter
+ * @param key   Member name
+ * @param value Null terminated string
+*/
+void json_emit_string(json_emit_t *e, const char *key, const char *value);
+
+/**
+ * Add a string member holding an unsigned value as lowercase hex, zero
+ * padded to a number of digits ("%.8x" for 8).
+ *
+ * @param e         Emitter
+ * @param key       Member name
+ * @param value     Value to print
+ * @param digits    Minimum number of digits, up to 16
+*/
+void json_emit_hex(json_emit_t *e, const char *key, uint64_t value, int digits);
+
+/**
+ * Add a number member. Integral values that fit an int are printed as "%d",
+ * anything else as "%.3f", as parson does.
+ *
+ * @param e     Emitter
+ * @param key   Member name
+ * @param num   Value
+*/
+void json_emit_number(json_emit_t *e, const char *key, double num);
+
+/**
+ * Add a true/false member.
+ *
+ * @param e     Emitter
+ * @param key   Member name
+ * @param value Value
+*/
+void json_emit_bool(json_emit_t *e, const char *key, bool value);
+
+/**
+ * Format a number the way json_emit_number does, without key.
+ *
+ * @param dest  Destination string, 32 bytes always hold an int or a "%.3f" below 1e6
+ * @param size  Size of the destination string
+ * @param num   Value
+ * @return      Length written (null terminator excluded), -1 if it did not fit
+*/
+int json_format_number(char *dest, size_t size, double num);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,153 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Session keys of known devices, loaded from a JSON file and keyed by
+    DevAddr. With them the sniffer checks the MIC of the data frames of
+    those devices, which tells genuine frames from corrupted ones that went
+    through the CRC, and decrypts their FRMPayload (LoRaWAN 1.0.x). The
+    keys are expanded when the file is loaded, a frame then costs one
+    AES-CMAC and one AES block per 16 bytes of payload. The store has a
+    single writer, the counters can be read from any thread.
+
+    Key file format:
+        {"devices": [{"DevAddr": "26011BDA", "NwkSKey": "<32 hex digits>", "AppSKey": "<32 hex digits>"}, ...]}
+*/
+
+#ifndef _SNIFFER_KEY_STORE_H
+#define _SNIFFER_KEY_STORE_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+#include <stdatomic.h>  /* C11 atomics */
+
+#include "loragw_hal.h"
+#include "aes128.h"
+#include "ed_report.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define KEY_STORE_MAX_DEVICES   1000000     /* sanity limit on the size of a key file */
+#define KEY_MIC_LEN             4           /* MIC length in bytes */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* keys and frame counters of one device */
+typedef struct key_entry_s {
+    uint32_t devaddr;
+    bool seen_up;                       /* fcnt_up holds the FCnt of a frame with a good MIC */
+    bool seen_down;
+    uint32_t fcnt_up;                   /* last uplink FCnt, extended to 32 bits */
+    uint32_t fcnt_down;                 /* last downlink FCnt, extended to 32 bits */
+    aes128_ctx_t nwk_skey;
+    aes128_ctx_t app_skey;
+} key_entry_t;
+
+/* devices sorted by DevAddr */
+typedef struct key_store_s {
+    key_entry_t *entries;
+    uint32_t count;
+    bool keep_data;                     /* copy decrypted application payloads into the reports */
+    _Atomic uint64_t nb_mic_ok;         /* frames of known devices with a good MIC */
+    _Atomic uint64_t nb_mic_bad;        /* frames of known devices with a bad MIC */
+    _Atomic uint64_t nb_decrypted;      /* FRMPayloads decrypted */
+} key_store_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Load the session keys of a key file into an empty store.
+ *
+ * @param ks    Store to fill
+ * @param path  Key file
+ * @return      Number of devices loaded, -1 if the file cannot be read or an entry is malformed
+*/
+int key_store_load(key_store_t *ks, const char *path);
+
+/**
+ * Release the devices of a store.
+ *
+ * @param ks    Store to free
+*/
+void key_store_free(key_store_t *ks);
+
+/**
+ * Look a device up.
+ *
+ * @param ks        Store
+ * @param devaddr   DevAddr of the device
+ * @return          Pointer to the device, NULL if its keys are not known
+*/
+key_entry_t *key_store_find(key_store_t *ks, uint32_t devaddr);
+
+/**
+ * Check the MIC of a data frame from a known device and decrypt its
+ * FRMPayload. A port 0 payload is decoded into the MAC commands of the
+ * report; an application payload is copied into the report if the store
+ * keeps data. Nothing is done for unknown devices and other frames.
+ *
+ * @param ks        Store
+ * @param p         Received packet
+ * @param report    Report of the packet, from ed_report_write
+ * @return          ED_MIC_* status, also set in the report
+*/
+int key_store_process(key_store_t *ks, const struct lgw_pkt_rx_s *p, ed_report_t *report);
+
+/**
+ * Compute the MIC of a data frame.
+ *
+ * @param nwk_skey  Network session key
+ * @param msg       MHDR to the end of FRMPayload
+ * @param len       Length of the message in bytes
+ * @param uplink    Frame sent by the end device
+ * @param devaddr   DevAddr of the device
+ * @param fcnt      Frame counter, 32 bits
+ * @param mic       KEY_MIC_LEN bytes MIC, in frame order
+*/
+void key_store_mic(const aes128_ctx_t *nwk_skey, const uint8_t *msg, size_t len, bool uplink, uint32_t devaddr, uint32_t fcnt, uint8_t mic[KEY_MIC_LEN]);
+
+/**
+ * Encrypt or decrypt a FRMPayload (the operation is the same).
+ *
+ * @param key       NwkSKey for port 0, AppSKey otherwise
+ * @param in        Payload
+ * @param len       Length of the payload in bytes
+ * @param uplink    Frame sent by the end device
+ * @param devaddr   DevAddr of the device
+ * @param fcnt      Frame counter, 32 bits
+ * @param out       Output payload, can be the same as in
+*/
+void key_store_crypt(const aes128_ctx_t *key, const uint8_t *in, size_t len, bool uplink, uint32_t devaddr, uint32_t fcnt, uint8_t *out);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,107 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Latency histograms with bounded relative error, in the manner of HDR
+    histograms. Values below 2^LATENCY_SUB_BITS are counted exactly, larger
+    ones in log-linear buckets: every power of two is split in
+    2^(LATENCY_SUB_BITS - 1) equal buckets, so a reported value is within
+    1/2^(LATENCY_SUB_BITS - 1) of the recorded one. Recording is a few
+    instructions and never allocates; a histogram has a single writer and
+    is read once the writer is done with it (or merged into another one).
+*/
+
+#ifndef _SNIFFER_LATENCY_HIST_H
+#define _SNIFFER_LATENCY_HIST_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LATENCY_SUB_BITS        7       /* 64 buckets per power of two, each under 1.6% wide */
+#define LATENCY_BUCKETS         ((64 - LATENCY_SUB_BITS + 2) << (LATENCY_SUB_BITS - 1))
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* histogram of one measured quantity, in whatever unit it is recorded (ns for the pipeline stages) */
+typedef struct latency_hist_s {
+    uint64_t count;                     /* values recorded */
+    uint64_t sum;                       /* sum of the values recorded, for the mean */
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[LATENCY_BUCKETS];
+} latency_hist_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Empty a histogram.
+ *
+ * @param h Histogram
+*/
+void latency_hist_reset(latency_hist_t *h);
+
+/**
+ * Record one value.
+ *
+ * @param h     Histogram
+ * @param value Value to record
+*/
+void latency_hist_record(latency_hist_t *h, uint64_t value);
+
+/**
+ * Add every value of a histogram to another.
+ *
+ * @param dst   Histogram to add to
+ * @param src   Histogram to add
+*/
+void latency_hist_merge(latency_hist_t *dst, const latency_hist_t *src);
+
+/**
+ * Get the value below which a share of the recorded values fall.
+ *
+ * @param h         Histogram
+ * @param percentile Share of the values, from 0 to 100 (i.e. 99.9)
+ * @return          Middle of the bucket holding that value, clamped to the recorded range, 0 if empty
+*/
+uint64_t latency_hist_percentile(const latency_hist_t *h, double percentile);
+
+/**
+ * Get the mean of the recorded values.
+ *
+ * @param h Histogram
+ * @return  Mean value, 0 if empty
+*/
+double latency_hist_mean(const latency_hist_t *h);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,204 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    LoRaWAN MAC commands. A table indexed by CID gives, for each direction,
+    the name and payload length of every command of LoRaWAN 1.0.x and 1.1,
+    so a FOpts field (or a port 0 FRMPayload, once decrypted) is split into
+    commands without guessing. Commands are decoded into fixed size
+    records, nothing is allocated and no byte past the buffer is read.
+*/
+
+#ifndef _SNIFFER_MAC_CMD_H
+#define _SNIFFER_MAC_CMD_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+/* Command identifiers, shared by the request and its answer */
+#define MAC_CID_RESET               0x01
+#define MAC_CID_LINK_CHECK          0x02
+#define MAC_CID_LINK_ADR            0x03
+#define MAC_CID_DUTY_CYCLE          0x04
+#define MAC_CID_RX_PARAM_SETUP      0x05
+#define MAC_CID_DEV_STATUS          0x06
+#define MAC_CID_NEW_CHANNEL         0x07
+#define MAC_CID_RX_TIMING_SETUP     0x08
+#define MAC_CID_TX_PARAM_SETUP      0x09
+#define MAC_CID_DL_CHANNEL          0x0A
+#define MAC_CID_REKEY               0x0B
+#define MAC_CID_ADR_PARAM_SETUP     0x0C
+#define MAC_CID_DEVICE_TIME         0x0D
+#define MAC_CID_FORCE_REJOIN        0x0E
+#define MAC_CID_REJOIN_PARAM_SETUP  0x0F
+#define MAC_CID_PING_SLOT_INFO      0x10
+#define MAC_CID_PING_SLOT_CHANNEL   0x11
+#define MAC_CID_BEACON_TIMING       0x12
+#define MAC_CID_BEACON_FREQ         0x13
+#define MAC_CID_DEVICE_MODE         0x20
+#define MAC_CID_NB                  0x21        /* CIDs from here on are unknown, 0x80 and up are proprietary */
+
+#define MAC_CMD_PAYLOAD_MAX         5           /* longest command payload (NewChannelReq, DeviceTimeAns) */
+#define MAC_CMD_NAME_MAX            20          /* longest command name, including null terminator */
+
+/* Parse status, why splitting stopped */
+#define MAC_CMD_OK                  0           /* every byte was decoded */
+#define MAC_CMD_UNKNOWN             1           /* unknown or proprietary CID, the length of what follows is unknown */
+#define MAC_CMD_TRUNCATED           2           /* the last command is longer than the bytes left */
+#define MAC_CMD_TOO_MANY            3           /* the output array is full */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* one decoded command - the union member in use follows from cid and uplink */
+typedef struct mac_cmd_s {
+    uint8_t cid;
+    bool uplink;                                /* sent by the end device */
+    uint8_t len;                                /* payload length in bytes */
+    union {
+        uint8_t raw[MAC_CMD_PAYLOAD_MAX];       /* commands without a decoder: payload as received */
+        uint8_t minor;                          /* ResetInd/Conf, RekeyInd/Conf: LoRaWAN minor version */
+        struct {
+            uint8_t margin;                     /* dB above the demodulation floor */
+            uint8_t gw_cnt;                     /* gateways that received the LinkCheckReq */
+        } link_check_ans;
+        struct {
+            uint16_t ch_mask;
+            uint8_t datarate;
+            uint8_t tx_power;
+            uint8_t ch_mask_cntl;
+            uint8_t nb_trans;
+        } link_adr_req;
+        struct {
+            bool power_ack;
+            bool datarate_ack;
+            bool ch_mask_ack;
+        } link_adr_ans;
+        struct {
+            uint8_t max_dcycle;                 /* aggregated duty cycle is 1 / 2^max_dcycle */
+        } duty_cycle_req;
+        struct {
+            uint32_t freq_hz;                   /* RX2 frequency */
+            uint8_t rx1_dr_offset;
+            uint8_t rx2_datarate;
+        } rx_param_setup_req;
+        struct {
+            bool rx1_dr_offset_ack;
+            bool rx2_datarate_ack;
+            bool channel_ack;
+        } rx_param_setup_ans;
+        struct {
+            uint8_t battery;                    /* 0 external power, 1..254 level, 255 unknown */
+            int8_t margin;                      /* SNR of the last DevStatusReq, -32..31 dB */
+        } dev_status_ans;
+        struct {
+            uint32_t freq_hz;                   /* 0 disables the channel */
+            uint8_t ch_index;
+            uint8_t min_dr;
+            uint8_t max_dr;
+        } new_channel_req;
+        struct {
+            bool datarate_ok;
+            bool channel_freq_ok;
+        } new_channel_ans;
+        struct {
+            uint8_t delay;                      /* RX1 delay in seconds, 0 is 1 s */
+        } rx_timing_setup_req;
+        struct {
+            bool downlink_dwell;
+            bool uplink_dwell;
+            uint8_t max_eirp;                   /* index in the MaxEIRP table */
+        } tx_param_setup_req;
+        struct {
+            uint32_t freq_hz;
+            uint8_t ch_index;
+        } dl_channel_req;
+        struct {
+            bool uplink_freq_exists;
+            bool channel_freq_ok;
+        } dl_channel_ans;
+        struct {
+            uint32_t seconds;                   /* GPS epoch seconds */
+            uint8_t fraction;                   /* 1/256 s */
+        } device_time_ans;
+    } u;
+} mac_cmd_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Split a buffer of plaintext MAC commands and decode them. Splitting stops
+ * on the first command that cannot be delimited, or once max commands are
+ * decoded; the commands before it are kept.
+ *
+ * @param buf       MAC commands (FOpts, or a decrypted port 0 FRMPayload)
+ * @param len       Length of the buffer in bytes
+ * @param uplink    Commands sent by the end device (UDU, CDU), otherwise by the network
+ * @param cmds      Output array
+ * @param max       Size of the output array
+ * @param status    Why splitting stopped, MAC_CMD_OK if the whole buffer was decoded
+ * @return          Number of commands decoded
+*/
+int mac_cmd_parse(const uint8_t *buf, size_t len, bool uplink, mac_cmd_t *cmds, int max, uint8_t *status);
+
+/**
+ * Name of a command, as in the LoRaWAN specification.
+ *
+ * @param cid       Command identifier
+ * @param uplink    Command sent by the end device
+ * @return          Static name ("LinkADRAns", ...), NULL if the command is unknown
+*/
+const char *mac_cmd_name(uint8_t cid, bool uplink);
+
+/**
+ * Name of a parse status.
+ *
+ * @param status    MAC_CMD_* status
+ * @return          Static string ("ok", "unknown", ...)
+*/
+const char *mac_cmd_status_str(uint8_t status);
+
+/**
+ * Write the names of a list of commands, comma separated.
+ *
+ * @param cmds  Commands
+ * @param nb    Number of commands
+ * @param buf   Output string, MAC_CMD_NAME_MAX bytes per command are always enough
+ * @param size  Size of the output string
+ * @return      Length written (null terminator excluded), -1 if it did not fit
+*/
+int mac_cmd_list(const mac_cmd_t *cmds, int nb, char *buf, size_t size);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
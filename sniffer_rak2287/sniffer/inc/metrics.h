@@ -0,0 +1,150 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Runtime metrics in the Prometheus text exposition format. Counters and
+    gauges are plain C11 atomics owned by the code that updates them, so
+    updating one is a single relaxed atomic add. Latencies go into atomic
+    histograms with fixed bounds, from 1 us to 10 s. A small server thread
+    answers GET /metrics on a TCP port by calling a render function, which
+    writes the current values with the metrics_family/metrics_sample helpers.
+*/
+
+#ifndef _SNIFFER_METRICS_H
+#define _SNIFFER_METRICS_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+#include <stdatomic.h>  /* C11 atomics */
+
+#include <pthread.h>
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define METRICS_HIST_BOUNDS     15      /* histogram bucket bounds, 1 and 5 of every decade from 1 us to 10 s */
+#define METRICS_OUT_MAX         1048576 /* largest page served (bytes) */
+#define METRICS_CONTENT_TYPE    "text/plain; version=0.0.4"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* latency histogram, can be updated from any thread */
+typedef struct metrics_hist_s {
+    _Atomic uint64_t buckets[METRICS_HIST_BOUNDS + 1];  /* values per bucket, the last one above every bound */
+    _Atomic uint64_t sum_us;                            /* sum of the values */
+} metrics_hist_t;
+
+/* page under construction, grown as needed up to METRICS_OUT_MAX */
+typedef struct metrics_out_s {
+    char *data;
+    size_t len;
+    size_t cap;
+    bool full;                          /* something did not fit */
+} metrics_out_t;
+
+/* writes the current value of every metric, returns 0 on success */
+typedef int (*metrics_render_t)(metrics_out_t *out, void *arg);
+
+/* metrics server - one thread answering scrapes one at a time */
+typedef struct metrics_server_s {
+    int fd;                             /* listening socket, -1 if not started */
+    uint16_t port;                      /* port listened on, the one picked by the kernel if 0 was asked for */
+    pthread_t thrid;
+    _Atomic bool stop;
+    metrics_render_t render;
+    void *arg;                          /* given back to render */
+    metrics_out_t out;                  /* page, reused for every scrape */
+    _Atomic uint64_t scrapes;           /* pages served */
+} metrics_server_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Count a value in a histogram.
+ *
+ * @param h     Histogram
+ * @param us    Value, in microseconds
+*/
+void metrics_hist_observe(metrics_hist_t *h, uint64_t us);
+
+/**
+ * Write the HELP and TYPE lines of a metric family.
+ *
+ * @param out   Page
+ * @param name  Metric name
+ * @param type  "counter", "gauge" or "histogram"
+ * @param help  Description of the metric
+*/
+void metrics_family(metrics_out_t *out, const char *name, const char *type, const char *help);
+
+/**
+ * Write one sample.
+ *
+ * @param out       Page
+ * @param name      Metric name
+ * @param labels    Labels without the braces (i.e. card="0",sf="7"), NULL or empty for none
+ * @param value     Value
+*/
+void metrics_sample(metrics_out_t *out, const char *name, const char *labels, double value);
+
+/**
+ * Write the samples of a histogram: cumulative buckets with their bound in
+ * seconds, then the sum (seconds) and count.
+ *
+ * @param out       Page
+ * @param name      Metric name, without the _bucket/_sum/_count suffixes
+ * @param labels    Labels without the braces, NULL or empty for none
+ * @param h         Histogram
+*/
+void metrics_sample_hist(metrics_out_t *out, const char *name, const char *labels, metrics_hist_t *h);
+
+/**
+ * Start serving metrics.
+ *
+ * @param srv       Server
+ * @param addr      IPv4 address to listen on (i.e. "127.0.0.1", "0.0.0.0")
+ * @param port      TCP port, 0 to let the kernel pick one
+ * @param render    Called for every scrape, from the server thread
+ * @param arg       Given back to render
+ * @return          0 on success, -1 otherwise
+*/
+int metrics_server_start(metrics_server_t *srv, const char *addr, uint16_t port, metrics_render_t render, void *arg);
+
+/**
+ * Stop serving metrics and release the server.
+ *
+ * @param srv   Server
+*/
+void metrics_server_stop(metrics_server_t *srv);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,144 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Lock-free single-producer/single-consumer ring of received packets.
+    All slots are allocated up front. The producer (listener) fills slots in
+    place, straight from lgw_receive, and the consumer (encoder) reads them
+    in place, so the hot path never locks, blocks or allocates.
+*/
+
+#ifndef _SNIFFER_PKT_RING_H
+#define _SNIFFER_PKT_RING_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdatomic.h>  /* C11 atomics */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define PKT_RING_CACHE_LINE     64      /* keeps producer and consumer indexes apart */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* indexes are free running, slot = index & mask */
+typedef struct pkt_ring_s {
+    struct lgw_pkt_rx_s *slots;         /* preallocated packet slots */
+    uint32_t size;                      /* number of slots, power of two */
+    uint32_t mask;                      /* size - 1 */
+
+    _Alignas(PKT_RING_CACHE_LINE) _Atomic uint32_t head;    /* next slot written, owned by the producer */
+    _Atomic uint32_t overflow;                              /* packets dropped because the ring was full */
+    _Atomic uint32_t high_water;                            /* highest fill level seen */
+
+    _Alignas(PKT_RING_CACHE_LINE) _Atomic uint32_t tail;    /* next slot read, owned by the consumer */
+} pkt_ring_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Allocate the slots of a ring. The capacity is rounded up to a power of two.
+ *
+ * @param r         Ring to initialise
+ * @param capacity  Minimum number of packets the ring can hold
+ * @return          0 on success, -1 otherwise
+*/
+int pkt_ring_init(pkt_ring_t *r, uint32_t capacity);
+
+/**
+ * Release the slots of a ring.
+ *
+ * @param r Ring to free
+*/
+void pkt_ring_free(pkt_ring_t *r);
+
+/**
+ * Producer: get the run of contiguous free slots starting at the head. The slots
+ * can be filled in place (i.e. by lgw_receive) and then published with pkt_ring_commit.
+ *
+ * @param r     Ring
+ * @param slots Set to the first free slot
+ * @return      Number of contiguous free slots, 0 if the ring is full
+*/
+uint32_t pkt_ring_write_span(pkt_ring_t *r, struct lgw_pkt_rx_s **slots);
+
+/**
+ * Producer: publish slots filled after pkt_ring_write_span.
+ *
+ * @param r     Ring
+ * @param nb    Number of slots filled, no more than the span
+*/
+void pkt_ring_commit(pkt_ring_t *r, uint32_t nb);
+
+/**
+ * Producer: copy a single packet in, counting it as dropped if the ring is full.
+ *
+ * @param r     Ring
+ * @param pkt   Packet to copy
+ * @return      0 on success, -1 if the ring was full
+*/
+int pkt_ring_push(pkt_ring_t *r, const struct lgw_pkt_rx_s *pkt);
+
+/**
+ * Producer: account for packets that were fetched but had nowhere to go.
+ *
+ * @param r     Ring
+ * @param nb    Number of packets dropped
+*/
+void pkt_ring_drop(pkt_ring_t *r, uint32_t nb);
+
+/**
+ * Consumer: get the oldest packet without removing it.
+ *
+ * @param r Ring
+ * @return  Pointer to the packet slot, NULL if the ring is empty
+*/
+struct lgw_pkt_rx_s *pkt_ring_peek(pkt_ring_t *r);
+
+/**
+ * Consumer: release the packet returned by pkt_ring_peek so its slot can be reused.
+ *
+ * @param r Ring
+*/
+void pkt_ring_release(pkt_ring_t *r);
+
+/**
+ * Number of packets waiting in the ring. Exact from either end, an estimate elsewhere.
+ *
+ * @param r Ring
+ * @return  Packets waiting
+*/
+uint32_t pkt_ring_count(pkt_ring_t *r);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,165 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Description:
+    Radio group hopping schedule of one concentrator card. The card listens
+    to one radio group (a pair of RF chain settings, one AU915 sub-band) at a
+    time; the schedule says when to leave it and which group comes next, in
+    turn so every group is visited each round. Dwell times are either fixed
+    or weighted by the traffic each group showed on its previous visits,
+    between a floor and a ceiling. Time spent on each group, packets heard
+    there, the longest time each group went unheard and the time lost
+    retuning are kept for the statistics. Time is passed in by the caller.
+*/
+
+#ifndef _SNIFFER_RADIO_HOP_H
+#define _SNIFFER_RADIO_HOP_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdatomic.h>  /* C11 atomics */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define RADIO_HOP_MAX_GROUPS    16          /* radio groups of one card, 8 cover AU915 */
+
+#define RADIO_HOP_FIXED         0           /* every group gets the same dwell */
+#define RADIO_HOP_TRAFFIC       1           /* busier groups get longer dwells */
+
+#define RADIO_HOP_RATE_FLOOR    0.01        /* packets per second credited to a silent group, so it keeps a share */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* schedule of one card, owned by the hopping thread, the counters can be read from any thread */
+typedef struct radio_hop_s {
+    int nb_groups;
+    int mode;                           /* RADIO_HOP_FIXED or RADIO_HOP_TRAFFIC */
+    uint32_t dwell_ms;                  /* fixed dwell, average dwell of a traffic weighted round */
+    uint32_t dwell_min_ms;              /* shortest traffic weighted dwell */
+    uint32_t dwell_max_ms;              /* longest traffic weighted dwell */
+    uint64_t start_us;                  /* time the first group was tuned */
+    uint64_t due_us;                    /* time to leave the current group */
+    uint64_t seen[RADIO_HOP_MAX_GROUPS];        /* packets of each group when it was last tuned */
+    uint64_t left_us[RADIO_HOP_MAX_GROUPS];     /* time each group was last left, the start for groups not heard yet */
+    double rate[RADIO_HOP_MAX_GROUPS];          /* smoothed packets per second of each group, negative until a visit ends */
+
+    _Atomic int current;                /* group listened to */
+    _Atomic uint64_t since_us;          /* time the current group was tuned */
+    _Atomic uint64_t packets[RADIO_HOP_MAX_GROUPS];     /* packets received on each group, counted by the listener */
+    _Atomic uint64_t listen_us[RADIO_HOP_MAX_GROUPS];   /* time spent on each group, visits that ended */
+    _Atomic uint64_t visits[RADIO_HOP_MAX_GROUPS];      /* visits of each group that ended */
+    _Atomic uint64_t gap_max_us[RADIO_HOP_MAX_GROUPS];  /* longest time each group went unheard between two visits */
+    _Atomic uint64_t hops;              /* retunes */
+    _Atomic uint64_t dead_us;           /* time spent retuning, no group heard */
+} radio_hop_t;
+
+/* snapshot of the statistics */
+typedef struct radio_hop_stats_s {
+    int nb_groups;
+    int current;
+    int covered;                        /* groups listened to at least once */
+    uint64_t elapsed_us;                /* time since the first group was tuned */
+    uint64_t hops;
+    uint64_t dead_us;
+    uint64_t packets[RADIO_HOP_MAX_GROUPS];
+    uint64_t listen_us[RADIO_HOP_MAX_GROUPS];   /* current visit included */
+    uint64_t visits[RADIO_HOP_MAX_GROUPS];
+    uint64_t gap_max_us[RADIO_HOP_MAX_GROUPS];
+} radio_hop_stats_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Initialise a schedule, the first group being tuned at now_us.
+ *
+ * @param h             Schedule
+ * @param nb_groups     Radio groups of the card, 1 to RADIO_HOP_MAX_GROUPS
+ * @param first         Group tuned first
+ * @param mode          RADIO_HOP_FIXED or RADIO_HOP_TRAFFIC
+ * @param dwell_ms      Fixed dwell (ms), average dwell of a traffic weighted round
+ * @param dwell_min_ms  Shortest traffic weighted dwell (ms)
+ * @param dwell_max_ms  Longest traffic weighted dwell (ms)
+ * @param now_us        Monotonic time (us)
+ * @return              0 on success, -1 on invalid parameters
+*/
+int radio_hop_init(radio_hop_t *h, int nb_groups, int first, int mode, uint32_t dwell_ms,
+                   uint32_t dwell_min_ms, uint32_t dwell_max_ms, uint64_t now_us);
+
+/**
+ * Count packets received on a group. Called by the listener.
+ *
+ * @param h         Schedule
+ * @param group     Group tuned when the packets were fetched
+ * @param nb_pkt    Packets fetched
+*/
+void radio_hop_count(radio_hop_t *h, int group, uint32_t nb_pkt);
+
+/**
+ * Dwell the schedule gives a group on its next visit.
+ *
+ * @param h         Schedule
+ * @param group     Group
+ * @return          Dwell (ms)
+*/
+uint32_t radio_hop_dwell_ms(const radio_hop_t *h, int group);
+
+/**
+ * Check whether the current group has had its dwell.
+ *
+ * @param h         Schedule
+ * @param now_us    Monotonic time (us)
+ * @return          Group to tune next, -1 to stay on the current one
+*/
+int radio_hop_next(const radio_hop_t *h, uint64_t now_us);
+
+/**
+ * Account for a retune: the visit of the current group ends at start_us, the
+ * new group is heard from end_us and gets its dwell from there.
+ *
+ * @param h         Schedule
+ * @param group     Group tuned
+ * @param start_us  Monotonic time (us) the retune started
+ * @param end_us    Monotonic time (us) the new group was heard from
+*/
+void radio_hop_tuned(radio_hop_t *h, int group, uint64_t start_us, uint64_t end_us);
+
+/**
+ * Read the statistics.
+ *
+ * @param h         Schedule
+ * @param now_us    Monotonic time (us)
+ * @param s         Filled with the statistics
+*/
+void radio_hop_stats(radio_hop_t *h, uint64_t now_us, radio_hop_stats_t *s);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
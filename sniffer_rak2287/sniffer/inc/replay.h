@@ -0,0 +1,106 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Replay of raw packet captures. Records are handed out in capture order
+    together with the time, from the start of the replay, at which each one
+    is due. Packets of one concentrator are spaced by their count_us deltas,
+    as the concentrator saw them, and the fetch time of the first packet of
+    each concentrator places it against the others. A count_us jump that the
+    wall clock does not confirm (concentrator restarted, capture appended
+    after a pause) is replaced by the wall clock gap. The schedule is divided
+    by the replay speed, or dropped altogether at maximum speed. Sleeping is
+    left to the caller, so the schedule can be checked without waiting.
+*/
+
+#ifndef _SNIFFER_REPLAY_H
+#define _SNIFFER_REPLAY_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "capture.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define REPLAY_SPEED_MAX        0.0         /* speed value for as fast as possible */
+#define REPLAY_RESYNC_US        1000000     /* count_us and wall clock disagreeing by more than this resyncs */
+#define REPLAY_CARDS            256         /* card numbers a capture can hold */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* replay state */
+typedef struct replay_s {
+    capture_reader_t cr;
+    double speed;                       /* 1 for real time, N for N times faster, REPLAY_SPEED_MAX for no pacing */
+    bool started;                       /* first record read */
+    uint64_t first_ns;                  /* fetch time of the first record */
+    uint64_t capture_us;                /* capture time of the last record, from the first one */
+    bool card_seen[REPLAY_CARDS];
+    uint32_t card_count_us[REPLAY_CARDS];   /* count_us of the last packet of each card */
+    uint64_t card_ns[REPLAY_CARDS];         /* fetch time of the last packet of each card */
+    uint64_t card_us[REPLAY_CARDS];         /* capture time of the last packet of each card */
+    uint64_t packets;                   /* records handed out */
+    uint64_t resyncs;                   /* count_us jumps replaced by the wall clock */
+} replay_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Open a capture for replay.
+ *
+ * @param rp    Replay state
+ * @param path  Capture file
+ * @param speed Replay speed, REPLAY_SPEED_MAX for no pacing
+ * @return      0 on success, -1 otherwise
+*/
+int replay_open(replay_t *rp, const char *path, double speed);
+
+/**
+ * Get the next record and when it is due.
+ *
+ * @param rp        Replay state
+ * @param rec       Record to fill
+ * @param due_us    Set to the time (us) from the start of the replay at which the record is due, 0 at maximum speed
+ * @return          1 if a record was read, 0 at the end of the capture, -1 on a malformed record
+*/
+int replay_next(replay_t *rp, capture_rec_t *rec, uint64_t *due_us);
+
+/**
+ * Close the capture.
+ *
+ * @param rp    Replay state
+*/
+void replay_close(replay_t *rp);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,110 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Binary encoding of the end device reports, the compact alternative to the
+    JSON lines of ed_report_encode. A report is a CBOR map (RFC 8949) with
+    small integer keys, behind the self-described CBOR tag and a schema
+    version as its first member: DevAddr and EUIs are integers, RSSI and SNR
+    fixed point hundredths of dB, the frequency in Hz, the time on air in
+    us and the timestamp in ms since the epoch. FOpts go raw, the decoder
+    parses them again.
+    Segments stay line oriented, so each record is framed with COBS over
+    the newline byte (every byte XORed with 0x0A once stuffed): a record
+    never holds a newline and the writer, the journal recovery and the
+    uploader handle it like a JSON line. The first byte of a framed record
+    is always REPORT_CBOR_LEAD, device summaries and channel buckets stay
+    JSON lines starting with '{' in the same segments.
+
+    Keys of the map (schema version 1):
+      0 version         6 RSSI (0.01 dB)    12 ADR              18 AppEUI
+      1 time (ms)       7 ToA (us)          13 ACK              19 DevEUI
+      2 MType (MHDR)    8 FRMLen            14 FPort
+      3 CRC status      9 SNR (0.01 dB)     15 FOpts (bytes)
+      4 frequency (Hz) 10 FCnt              16 MIC (ED_MIC_*)
+      5 SF             11 DevAddr           17 data (bytes)
+    MType is MHDR.MType (0 JR ... 7 PRP), CRC status 0 OK, 1 BAD, 2 NONE,
+    3 UNDEF, 4 ERR. Join requests carry keys 0 to 9, 18 and 19, the other
+    frames keys 0 to 13, then 14 to 17 when present.
+*/
+
+#ifndef _SNIFFER_REPORT_CBOR_H
+#define _SNIFFER_REPORT_CBOR_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+
+#include "ed_report.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define REPORT_CBOR_VERSION     1           /* schema version, key 0 of every record */
+#define REPORT_CBOR_LEAD        0x0F        /* first byte of every framed record */
+#define REPORT_CBOR_MAX         512         /* buffer size that always holds a framed record */
+
+#define HTTP_CONTENT_REPORTS    "Content-Type: application/x-sniffer-reports"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Serialise a report as a framed CBOR record, without the newline.
+ *
+ * @param report    Report to serialise
+ * @param buf       Output buffer, REPORT_CBOR_MAX bytes are always enough
+ * @param size      Size of the output buffer
+ * @return          Length of the framed record, -1 if it does not fit
+*/
+int report_cbor_encode(const ed_report_t *report, uint8_t *buf, size_t size);
+
+/**
+ * Reference decoder: read a framed CBOR record back into a report, with
+ * the strings, floats and MAC commands ed_report_write would have set.
+ *
+ * @param rec       Framed record, without the newline
+ * @param len       Length of the record
+ * @param report    Report to fill
+ * @return          0 on success, -1 if the record is malformed or of another schema version
+*/
+int report_cbor_decode(const uint8_t *rec, size_t len, ed_report_t *report);
+
+/**
+ * Rewrite a report segment as NDJSON: framed records are decoded and
+ * encoded with ed_report_encode, JSON lines are copied as they are.
+ *
+ * @param segment_file  Segment to read
+ * @param ndjson_file   NDJSON file to write
+ * @return              Number of lines written, -1 on a file error or a malformed record
+*/
+long report_cbor_export_ndjson(const char *segment_file, const char *ndjson_file);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,175 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Report filter: an ordered list of rules, each one a match expression and
+    an action, decides which received packets are reported at all. Rules
+    are compiled from the configuration into flat conditions (bit sets of
+    MTypes, CRC statuses and SFs, a DevAddr mask, RSSI/SNR bounds) that are
+    checked on the raw packet, before the report is formatted. The filter
+    only decides which device reports are written: device tracking and the
+    channel buckets are fed every packet, so loss rates, CRC counts and
+    airtime are not skewed by the rules.
+
+    Match expression: terms separated by spaces, all of them must hold, an
+    empty expression matches every packet.
+        mtype=UDU,CDU       crc=BAD,NONE        sf=7,8      sf>=10
+        devaddr=26011B00/24 netid=000013        rssi<-120   snr>=-5
+    mtype, crc, sf, devaddr and netid also take != to match the others.
+    The DevAddr of a frame without one (join request, join accept) never
+    matches a devaddr or netid term.
+
+    Actions:
+        drop                drop the packet, stop
+        keep                report the packet, stop
+        sample N            report one packet in N, drop the others
+        limit N/S           report N packets per device every S seconds, drop the others
+        dedup S             drop a packet identical to one seen less than S seconds ago
+    The packets that sample, limit and dedup let through go on to the next
+    rules. A packet no rule stops is reported. The per device and per
+    payload state of limit and dedup is held in a fixed size table per rule,
+    where a device can push another one out: the limits are approximate
+    with many more devices than slots. The filter has a single writer, the
+    counters can be read from any thread.
+*/
+
+#ifndef _SNIFFER_REPORT_FILTER_H
+#define _SNIFFER_REPORT_FILTER_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdatomic.h>  /* C11 atomics */
+#include <time.h>       /* time_t */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define FILTER_NAME_LEN         32          /* Max length of a rule name, including null terminator */
+#define FILTER_STATE_BITS       12          /* limit and dedup tables hold 4096 devices or payloads */
+#define FILTER_STATE_SLOTS      (1 << FILTER_STATE_BITS)
+
+/* Actions */
+#define FILTER_DROP             0
+#define FILTER_KEEP             1
+#define FILTER_SAMPLE           2
+#define FILTER_LIMIT            3
+#define FILTER_DEDUP            4
+
+/* Conditions in use in a rule */
+#define FILTER_COND_MTYPE       0x01
+#define FILTER_COND_CRC         0x02
+#define FILTER_COND_SF          0x04
+#define FILTER_COND_DEVADDR     0x08
+#define FILTER_COND_RSSI        0x10
+#define FILTER_COND_SNR         0x20
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* per device (limit) or per payload (dedup) state */
+typedef struct filter_slot_s {
+    uint64_t key;                       /* DevAddr, or payload hash */
+    time_t start;                       /* start of the limit window, or last time the payload was seen, 0 if free */
+    uint32_t count;                     /* packets reported in the limit window */
+} filter_slot_t;
+
+/* one compiled rule */
+typedef struct filter_rule_s {
+    char name[FILTER_NAME_LEN];
+    uint8_t conds;                      /* FILTER_COND_* in use */
+    uint8_t mtypes;                     /* matching MTypes, bit n for MHDR.MType n */
+    uint8_t crcs;                       /* matching CRC statuses, bit 0 OK, 1 BAD, 2 NONE, 3 anything else */
+    uint32_t sfs;                       /* matching datarates, bit n for DR n */
+    uint32_t devaddr_mask;
+    uint32_t devaddr_value;
+    bool devaddr_not;                   /* match the DevAddrs outside of the prefix */
+    float rssi_min, rssi_max;           /* matching RSSI range, bounds included */
+    float snr_min, snr_max;             /* matching SNR range, bounds included */
+    uint8_t action;                     /* FILTER_* action */
+    uint32_t n;                         /* sample 1 in n, or n packets per limit window */
+    uint32_t period;                    /* limit window, or dedup window (seconds) */
+    uint32_t seq;                       /* matching packets, for sampling */
+    filter_slot_t *slots;               /* FILTER_STATE_SLOTS for limit and dedup, NULL otherwise */
+    _Atomic uint64_t hits;              /* packets that matched the rule */
+    _Atomic uint64_t dropped;           /* packets the rule dropped */
+} filter_rule_t;
+
+/* ordered rules, the first ones are checked first */
+typedef struct report_filter_s {
+    filter_rule_t *rules;
+    int nb_rules;
+    int max_rules;
+    _Atomic uint64_t nb_kept;
+    _Atomic uint64_t nb_dropped;
+} report_filter_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Allocate the rules of a filter.
+ *
+ * @param f         Filter to initialise
+ * @param max_rules Number of rules the filter can hold
+ * @return          0 on success, -1 otherwise
+*/
+int report_filter_init(report_filter_t *f, int max_rules);
+
+/**
+ * Release the rules of a filter and their state.
+ *
+ * @param f Filter to free
+*/
+void report_filter_free(report_filter_t *f);
+
+/**
+ * Compile a rule and add it after the others.
+ *
+ * @param f         Filter
+ * @param name      Rule name, letters, digits, '_' and '-' only, NULL to name it after its position
+ * @param match     Match expression
+ * @param action    Action
+ * @return          0 on success, -1 if the filter is full or the rule is invalid
+*/
+int report_filter_add(report_filter_t *f, const char *name, const char *match, const char *action);
+
+/**
+ * Run the rules on a received packet.
+ *
+ * @param f     Filter
+ * @param p     Received packet
+ * @param now   Reception time
+ * @return      true if the packet is to be reported, false if it is dropped
+*/
+bool report_filter_check(report_filter_t *f, const struct lgw_pkt_rx_s *p, time_t now);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,264 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Rolling report segments. Encoded reports are appended as one record per
+    line (newline delimited JSON) to an open segment file, which is sealed once
+    it grows past a size limit or gets too old. Sealed segments are numbered
+    sequentially and are what the uploader ships.
+
+    With a journal, the segments form a durable spool: every sealed segment
+    is synced to disk before it is renamed, and its size and CRC-32 are
+    logged to the journal next to it, along with the end of the range the
+    uploader has acknowledged. The open segment and the journal are synced
+    together at most once per sync interval (group commit), so an SD card
+    sees one write per interval rather than one per record. On startup the
+    journal is replayed: the open segment left by a crash is cut back to
+    its last whole record and sealed, sealed segments missing from the
+    journal are taken in, segments failing their checksum are put aside,
+    and the uploader resumes at the first segment not acknowledged.
+    Without a journal, numbering only goes on after the segments found on
+    disk, so a restart never writes over them.
+
+    The writer (encoder) and the uploader only meet through atomics: the
+    writer publishes the end of the sealed range once a segment is renamed,
+    the uploader asks for the open segment to be sealed and publishes the
+    end of the range it acknowledged, which the writer journals on its next
+    poll. Sealed segments are never written again, so the uploader reads
+    them without a lock, however long the upload takes.
+*/
+
+#ifndef _SNIFFER_REPORT_SEGMENT_H
+#define _SNIFFER_REPORT_SEGMENT_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* FILE */
+#include <time.h>       /* time_t */
+#include <stdatomic.h>  /* C11 atomics */
+
+#include <pthread.h>
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define SEGMENT_SUFFIX_SEALED   ".ndjson"       /* suffix of a segment ready for upload */
+#define SEGMENT_SUFFIX_OPEN     ".ndjson.part"  /* suffix of the segment currently written to */
+#define SEGMENT_SUFFIX_BAD      ".ndjson.bad"   /* suffix of a sealed segment that failed its checksum */
+#define SEGMENT_SUFFIX_JOURNAL  ".journal"      /* suffix of the journal of sealed and acknowledged segments */
+
+#define SEGMENT_PREFIX_LEN      32              /* Max length of the file prefix, including null terminator */
+#define SEGMENT_NAME_LEN        100             /* Max length of a segment file name, including null terminator */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* rolling segment writer - one per report type */
+typedef struct segment_writer_s {
+    pthread_mutex_t mx;                 /* control access to everything below */
+    char prefix[SEGMENT_PREFIX_LEN];    /* file name prefix (i.e. "device") */
+    size_t max_bytes;                   /* seal the open segment once it would grow past this size */
+    unsigned max_age;                   /* seal the open segment once it is this many seconds old, 0 to disable */
+    FILE *fp;                           /* open segment, NULL if none is open */
+    uint32_t seq;                       /* number of the open (or next) segment, all below are sealed */
+    _Atomic uint32_t sealed_end;        /* seq, published once the segments below are sealed */
+    _Atomic bool seal_req;              /* the uploader wants the open segment sealed */
+    _Atomic uint32_t ack_end;           /* end of the acknowledged range, published by the uploader */
+    size_t bytes;                       /* bytes written to the open segment */
+    uint32_t records;                   /* records written to the open segment */
+    time_t opened;                      /* time the open segment was created */
+    uint32_t crc;                       /* CRC-32 of the open segment */
+    FILE *journal;                      /* journal of sealed and acknowledged segments, NULL for none */
+    long journal_bytes;                 /* size of the journal */
+    uint32_t seq_acked;                 /* every segment below this number is acknowledged */
+    unsigned sync_ms;                   /* group commit interval (ms) */
+    uint64_t synced_ms;                 /* time of the last group commit (monotonic ms) */
+    bool dirty;                         /* records or journal entries written since the last group commit */
+    _Atomic uint64_t nb_syncs;          /* group commits */
+} segment_writer_t;
+
+/* what the journal replay found on startup */
+typedef struct segment_recovery_s {
+    uint32_t seq_acked;                 /* first segment to upload */
+    uint32_t pending;                   /* sealed segments waiting for upload */
+    uint32_t adopted;                   /* sealed segments missing from the journal, taken in */
+    uint32_t repaired;                  /* open segments cut back to their last record and sealed */
+    uint32_t quarantined;               /* segments failing their checksum, renamed with SEGMENT_SUFFIX_BAD */
+    uint32_t missing;                   /* journaled segments no longer on disk */
+    bool torn_journal;                  /* the journal ended in a partial entry */
+} segment_recovery_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Initialise a segment writer. No file is created until the first record is appended.
+ *
+ * @param sw        Segment writer to initialise
+ * @param prefix    File name prefix of the segments
+ * @param max_bytes Size (bytes) at which a segment is sealed
+ * @param max_age   Age (seconds) at which a segment is sealed, 0 to disable
+ * @return          0 on success, -1 otherwise
+*/
+int segment_init(segment_writer_t *sw, const char *prefix, size_t max_bytes, unsigned max_age);
+
+/**
+ * Append a single record to the open segment, terminated by a newline. The record
+ * must not itself contain a newline. Opens a new segment or seals the current one
+ * as required by the size and age limits.
+ *
+ * @param sw        Segment writer
+ * @param record    Record to append
+ * @param len       Length of the record, excluding any terminator
+ * @return          0 on success, -1 otherwise
+*/
+int segment_append(segment_writer_t *sw, const char *record, size_t len);
+
+/**
+ * Replay the journal of a segment writer and keep it from now on. Must be called
+ * before the first record is appended. The segments left on disk by an earlier run
+ * are recovered, the journal is rewritten with the pending ones only.
+ *
+ * @param sw        Segment writer
+ * @param sync_ms   Group commit interval (ms)
+ * @param rec       Recovery results
+ * @return          0 on success, -1 otherwise
+*/
+int segment_journal_open(segment_writer_t *sw, unsigned sync_ms, segment_recovery_t *rec);
+
+/**
+ * Number segments after the ones an earlier run left on disk, for a writer kept
+ * without journal. Those segments are neither uploaded nor written over, whether
+ * they were uploaded is not known. Must be called before the first record is appended.
+ *
+ * @param sw        Segment writer
+ * @param found     Segment files found (sealed, open or put aside)
+ * @return          0 on success, -1 if the directory could not be read
+*/
+int segment_skip_existing(segment_writer_t *sw, uint32_t *found);
+
+/**
+ * Acknowledge every segment numbered below seq_end, they are not uploaded again after
+ * a restart. Does not lock: the entry is journaled by the next poll of the writer and
+ * is durable at the next group commit.
+ *
+ * @param sw        Segment writer
+ * @param seq_end   One past the last acknowledged segment
+*/
+void segment_ack(segment_writer_t *sw, uint32_t seq_end);
+
+/**
+ * Group commit: sync the open segment and the journal to disk if they were written to.
+ *
+ * @param sw    Segment writer
+ * @return      0 on success, -1 otherwise
+*/
+int segment_sync(segment_writer_t *sw);
+
+/**
+ * Seal the open segment (if any) so it becomes available for upload.
+ *
+ * @param sw    Segment writer
+ * @return      0 on success, -1 otherwise
+*/
+int segment_seal(segment_writer_t *sw);
+
+/**
+ * Ask the writer to seal the open segment on its next poll. Does not lock.
+ *
+ * @param sw    Segment writer
+*/
+void segment_request_seal(segment_writer_t *sw);
+
+/**
+ * Check if a seal asked for with segment_request_seal is still to be done. Does not lock.
+ *
+ * @param sw    Segment writer
+ * @return      true until the writer has sealed the open segment
+*/
+bool segment_seal_pending(segment_writer_t *sw);
+
+/**
+ * Seal the open segment if it has exceeded its maximum age or the uploader asked
+ * for it, journal the acknowledgements, and run the group commit once the sync
+ * interval has elapsed. Intended to be called regularly by the writer so quiet
+ * periods do not hold records back.
+ *
+ * @param sw    Segment writer
+ * @return      0 on success, -1 otherwise
+*/
+int segment_poll(segment_writer_t *sw);
+
+/**
+ * Get the end of the sealed range. Every segment numbered below the returned value
+ * is sealed and can be read. Does not lock.
+ *
+ * @param sw    Segment writer
+ * @return      One past the highest sealed segment number
+*/
+uint32_t segment_sealed_end(segment_writer_t *sw);
+
+/**
+ * Seal anything left open, commit the journal and release the writer.
+ *
+ * @param sw    Segment writer
+*/
+void segment_close(segment_writer_t *sw);
+
+/**
+ * Create the file name of a segment.
+ *
+ * @param dest      Destination string
+ * @param size      Size of the destination string
+ * @param prefix    File name prefix of the segment
+ * @param seq       Number of the segment
+ * @param sealed    true for the sealed name, false for the open name
+*/
+void segment_name(char *dest, size_t size, const char *prefix, uint32_t seq, bool sealed);
+
+/**
+ * Update a CRC-32 (IEEE 802.3, as zlib and gzip) with a buffer.
+ *
+ * @param crc   CRC of the data so far, 0 to start
+ * @param buf   Data
+ * @param len   Length of the data
+ * @return      CRC of the data so far and the buffer
+*/
+uint32_t segment_crc32(uint32_t crc, const void *buf, size_t len);
+
+/**
+ * Count the records held by a sealed segment file.
+ *
+ * @param file_name Segment file to read
+ * @return          Number of records, -1 if the file could not be read
+*/
+long segment_count_records(const char *file_name);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
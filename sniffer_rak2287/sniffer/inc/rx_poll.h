@@ -0,0 +1,113 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Adaptive polling schedule for the concentrator RX buffer. The listener
+    reports what each lgw_receive returned and gets back how long to sleep
+    before the next poll: nothing when the fetch came back full, nothing while
+    the buffer is filling, a short delay under light traffic and an
+    exponentially growing one when the site is quiet. Time is passed in by
+    the caller so the schedule can be driven by a simulated packet source.
+*/
+
+#ifndef _SNIFFER_RX_POLL_H
+#define _SNIFFER_RX_POLL_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdatomic.h>  /* C11 atomics */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define RX_POLL_MIN_US      1000        /* default delay (us) after a fetch that returned a few packets */
+#define RX_POLL_MAX_US      16000       /* default ceiling (us) of the idle backoff */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* polling state, the counters can be read from any thread */
+typedef struct rx_poll_s {
+    uint32_t min_us;                    /* delay after a light fetch, start of the idle backoff */
+    uint32_t max_us;                    /* ceiling of the idle backoff */
+    uint32_t delay_us;                  /* current idle delay */
+    uint64_t last_us;                   /* time of the previous poll, 0 before the first one */
+
+    _Atomic uint64_t polls;             /* lgw_receive calls */
+    _Atomic uint64_t polls_empty;       /* ... that returned nothing */
+    _Atomic uint64_t polls_full;        /* ... that filled the array, re-polled at once */
+    _Atomic uint64_t packets;           /* packets fetched */
+    _Atomic uint64_t sleep_us;          /* total delay handed out */
+    _Atomic uint64_t gap_sum_us;        /* sum of the gaps before polls that returned packets */
+    _Atomic uint32_t gap_max_us;        /* longest gap before a poll that returned packets */
+} rx_poll_t;
+
+/* snapshot of the counters */
+typedef struct rx_poll_stats_s {
+    uint64_t polls;
+    uint64_t polls_empty;
+    uint64_t polls_full;
+    uint64_t packets;
+    uint64_t sleep_us;
+    uint32_t gap_avg_us;                /* average time packets could have waited in the RX buffer */
+    uint32_t gap_max_us;                /* worst time packets could have waited in the RX buffer */
+} rx_poll_stats_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Initialise a polling schedule.
+ *
+ * @param p         Polling state
+ * @param min_us    Delay (us) after a light fetch, 0 for the default
+ * @param max_us    Ceiling (us) of the idle backoff, 0 for the default
+*/
+void rx_poll_init(rx_poll_t *p, uint32_t min_us, uint32_t max_us);
+
+/**
+ * Account for a poll and work out the delay before the next one.
+ *
+ * @param p         Polling state
+ * @param now_us    Monotonic time (us) of the poll
+ * @param nb_pkt    Packets returned by the poll
+ * @param max_pkt   Packets the poll could have returned
+ * @return          Delay (us) before the next poll, 0 to poll again at once
+*/
+uint32_t rx_poll_update(rx_poll_t *p, uint64_t now_us, int nb_pkt, int max_pkt);
+
+/**
+ * Read the counters.
+ *
+ * @param p     Polling state
+ * @param s     Filled with the counters
+*/
+void rx_poll_stats(rx_poll_t *p, rx_poll_stats_t *s);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,138 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Compression of upload bodies with zlib. A body is compressed as a whole
+    into a buffer reused from one upload to the next, either as gzip
+    (Content-Encoding: gzip, understood by any HTTP server that takes
+    compressed requests) or as a zlib stream primed with a preset
+    dictionary (Content-Encoding: deflate, the receiver needs the same
+    dictionary, named by its Adler-32 in the stream header). The dictionary
+    is built from the index mapping: the field names of the device reports
+    as they appear in the JSON, which is most of what a short body repeats.
+    Bytes in and out and the CPU time spent are counted for the metrics.
+*/
+
+#ifndef _SNIFFER_UPLOAD_COMPRESS_H
+#define _SNIFFER_UPLOAD_COMPRESS_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+#include <stdatomic.h>  /* C11 atomics */
+
+#include <zlib.h>
+
+#include "http_uploader.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define COMPRESS_NONE           0
+#define COMPRESS_GZIP           1
+#define COMPRESS_DEFLATE_DICT   2
+
+#define COMPRESS_DICT_MAX       32768   /* deflate window, a longer dictionary is cut from the front */
+
+#define HTTP_ENCODING_GZIP      "Content-Encoding: gzip"
+#define HTTP_ENCODING_DEFLATE   "Content-Encoding: deflate"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* compressor - one per uploading thread */
+typedef struct compress_s {
+    int method;                         /* COMPRESS_* */
+    int level;                          /* zlib level, 1 (fast) to 9 (small) */
+    z_stream zs;                        /* deflate state, reset for every body */
+    bool ready;                         /* zs is initialised */
+    uint8_t *dict;                      /* preset dictionary, NULL for none */
+    size_t dict_len;
+    uint32_t dict_id;                   /* Adler-32 of the dictionary */
+    http_buf_t out;                     /* compressed body of the last call */
+    _Atomic uint64_t nb_bodies;         /* bodies compressed */
+    _Atomic uint64_t bytes_in;          /* bytes before compression */
+    _Atomic uint64_t bytes_out;         /* bytes after compression */
+    _Atomic uint64_t cpu_us;            /* CPU time spent compressing (us) */
+} compress_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Initialise a compressor.
+ *
+ * @param c         Compressor to initialise
+ * @param method    COMPRESS_GZIP or COMPRESS_DEFLATE_DICT
+ * @param level     zlib level, 1 to 9
+ * @param dict      Preset dictionary for COMPRESS_DEFLATE_DICT, ignored otherwise
+ * @param dict_len  Length of the dictionary
+ * @return          0 on success, -1 otherwise
+*/
+int compress_init(compress_t *c, int method, int level, const void *dict, size_t dict_len);
+
+/**
+ * Release a compressor.
+ *
+ * @param c Compressor to free
+*/
+void compress_free(compress_t *c);
+
+/**
+ * Compress a body into c->out.
+ *
+ * @param c     Compressor
+ * @param body  Body to compress
+ * @param len   Length of the body
+ * @return      Length of the compressed body, -1 on error
+*/
+long compress_body(compress_t *c, const void *body, size_t len);
+
+/**
+ * Content-Encoding header line matching the method of a compressor.
+ *
+ * @param c Compressor
+ * @return  Header line, NULL for COMPRESS_NONE
+*/
+const char *compress_encoding(const compress_t *c);
+
+/**
+ * Build a preset dictionary from an index mapping (Elasticsearch style
+ * {"properties": {"field": {"type": ...}}}): every field name as it is
+ * written in a report, the most common ones last as deflate prefers.
+ *
+ * @param mapping_file  Mapping file to read
+ * @param dict          Destination buffer
+ * @param size          Size of the destination buffer
+ * @return              Length of the dictionary, -1 if the mapping could not be read
+*/
+long compress_dict_from_mapping(const char *mapping_file, char *dict, size_t size);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,284 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Elasticsearch style _bulk request building. NDJSON report records are
+    interleaved with an action line, and the per item statuses of the
+    response are mapped back onto the documents so only the rejected ones
+    need to be sent again.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* snprintf fwrite */
+#include <stdlib.h>     /* realloc free */
+#include <string.h>     /* memcpy memchr memset */
+
+#include "parson.h"
+#include "bulk_upload.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define BULK_DOCS_MIN       256     /* smallest document table allocated */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static int bulk_reserve_docs(bulk_req_t *b, size_t nb);
+
+static int bulk_append(bulk_req_t *b, const char *data, size_t len);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/**
+ * Grow the document table to hold at least nb documents.
+ *
+ * @param b     Bulk request
+ * @param nb    Number of documents required
+ * @return      0 on success, -1 otherwise
+*/
+static int bulk_reserve_docs(bulk_req_t *b, size_t nb) {
+
+    size_t cap;
+    bulk_doc_t *docs;
+
+    if (nb <= b->cap_docs) {
+        return 0;
+    }
+
+    cap = (b->cap_docs < BULK_DOCS_MIN) ? BULK_DOCS_MIN : b->cap_docs;
+    while (cap < nb) {
+        cap *= 2;
+    }
+
+    docs = realloc(b->docs, cap * sizeof *docs);
+    if (docs == NULL) {
+        return -1;
+    }
+
+    b->docs = docs;
+    b->cap_docs = cap;
+
+    return 0;
+}
+
+/**
+ * Append raw bytes to the request body.
+ *
+ * @param b     Bulk request
+ * @param data  Bytes to append
+ * @param len   Number of bytes
+ * @return      0 on success, -1 otherwise
+*/
+static int bulk_append(bulk_req_t *b, const char *data, size_t len) {
+
+    if (http_buf_reserve(&b->body, b->body.len + len)) {
+        return -1;
+    }
+
+    memcpy(b->body.data + b->body.len, data, len);
+    b->body.len += len;
+    b->body.data[b->body.len] = '\0';
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int bulk_init(bulk_req_t *b, const char *index) {
+
+    int i;
+
+    memset(b, 0, sizeof *b);
+
+    if (index == NULL || index[0] == '\0') {
+        i = snprintf(b->action, sizeof b->action, "{\"index\":{}}\n");
+    } else {
+        i = snprintf(b->action, sizeof b->action, "{\"index\":{\"_index\":\"%s\"}}\n", index);
+    }
+
+    if (i < 0 || (size_t)i >= sizeof b->action) {
+        return -1;
+    }
+    b->action_len = (size_t)i;
+
+    return 0;
+}
+
+void bulk_reset(bulk_req_t *b) {
+
+    b->body.len = 0;
+    if (b->body.data != NULL) {
+        b->body.data[0] = '\0';
+    }
+    b->nb_docs = 0;
+}
+
+void bulk_free(bulk_req_t *b) {
+
+    http_buf_free(&b->body);
+    free(b->docs);
+    b->docs = NULL;
+    b->nb_docs = 0;
+    b->cap_docs = 0;
+}
+
+long bulk_add_ndjson(bulk_req_t *b, const char *data, size_t len) {
+
+    const char *line = data;
+    const char *end = data + len;
+    const char *nl;
+    size_t line_len;
+    long added = 0;
+
+    while (line < end) {
+        nl = memchr(line, '\n', end - line);
+        line_len = (nl != NULL) ? (size_t)(nl - line) : (size_t)(end - line);
+
+        if (line_len > 0) {
+            if (bulk_reserve_docs(b, b->nb_docs + 1) || bulk_append(b, b->action, b->action_len)) {
+                return -1;
+            }
+
+            b->docs[b->nb_docs].off = (uint32_t)b->body.len;
+            b->docs[b->nb_docs].len = (uint32_t)line_len;
+            b->docs[b->nb_docs].status = BULK_STATUS_NONE;
+
+            if (bulk_append(b, line, line_len) || bulk_append(b, "\n", 1)) {
+                return -1;
+            }
+
+            b->nb_docs++;
+            added++;
+        }
+
+        line += line_len + 1;
+    }
+
+    return added;
+}
+
+int bulk_parse_response(bulk_req_t *b, const char *response, bulk_result_t *result) {
+
+    JSON_Value *root_val;
+    JSON_Object *root_obj, *item_obj, *action_obj;
+    JSON_Array *items;
+    JSON_Value *val;
+    size_t i, nb_items;
+    uint16_t status;
+
+    memset(result, 0, sizeof *result);
+
+    root_val = json_parse_string(response);
+    if (root_val == NULL) {
+        return -1;
+    }
+
+    root_obj = json_value_get_object(root_val);
+    val = json_object_get_value(root_obj, "errors");
+    if (json_value_get_type(val) != JSONBoolean) {
+        json_value_free(root_val);
+        return -1;
+    }
+
+    /* Nothing was rejected, no need to walk the items */
+    if (!json_value_get_boolean(val)) {
+        for (i = 0; i < b->nb_docs; i++) {
+            b->docs[i].status = 201;
+        }
+        result->accepted = b->nb_docs;
+        json_value_free(root_val);
+        return 0;
+    }
+
+    /* Items come back in request order, one object per action keyed by the action name */
+    items = json_object_get_array(root_obj, "items");
+    nb_items = json_array_get_count(items);
+
+    for (i = 0; i < b->nb_docs; i++) {
+        status = BULK_STATUS_NONE;
+
+        if (i < nb_items) {
+            item_obj = json_array_get_object(items, i);
+            if (item_obj != NULL && json_object_get_count(item_obj) == 1) {
+                action_obj = json_object_get_object(item_obj, json_object_get_name(item_obj, 0));
+                status = (uint16_t)json_object_get_number(action_obj, "status");
+            }
+        }
+
+        b->docs[i].status = status;
+
+        if (status >= 200 && status < 300) {
+            result->accepted++;
+        } else if (bulk_status_retry(status)) {
+            result->retry++;
+        } else {
+            result->rejected++;
+        }
+    }
+
+    json_value_free(root_val);
+
+    return 0;
+}
+
+bool bulk_status_retry(uint16_t status) {
+
+    /* A missing item is treated as not stored so it is sent again */
+    return (status == BULK_STATUS_NONE || status == 429 || status >= 500);
+}
+
+long bulk_write_failed(bulk_req_t *b, FILE *fp, bool retry) {
+
+    size_t i;
+    uint16_t status;
+    long written = 0;
+
+    for (i = 0; i < b->nb_docs; i++) {
+        status = b->docs[i].status;
+
+        if (status >= 200 && status < 300) {
+            continue;
+        }
+        if (bulk_status_retry(status) != retry) {
+            continue;
+        }
+
+        if (fwrite(b->body.data + b->docs[i].off, 1, b->docs[i].len, fp) != b->docs[i].len || fputc('\n', fp) == EOF) {
+            return -1;
+        }
+        written++;
+    }
+
+    return written;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
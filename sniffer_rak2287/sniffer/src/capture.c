@@ -0,0 +1,564 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Raw packet captures: append-only writer, memory mapped reader and pcapng
+    export with LoRaTap headers.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* fopen fwrite rename snprintf */
+#include <string.h>     /* memset memcpy strncpy */
+#include <time.h>       /* clock_gettime */
+#include <math.h>       /* lroundf */
+#include <fcntl.h>      /* open */
+#include <unistd.h>     /* close truncate */
+#include <sys/mman.h>   /* mmap */
+#include <sys/stat.h>   /* fstat */
+
+#include "capture.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define CAPTURE_BUF_SIZE    65536       /* stdio buffer of the capture file */
+
+#define REC_FLAG_FTIME      0x01        /* fine timestamp received */
+
+/* pcapng export */
+#define PCAPNG_SHB          0x0A0D0D0A  /* section header block */
+#define PCAPNG_IDB          0x00000001  /* interface description block */
+#define PCAPNG_EPB          0x00000006  /* enhanced packet block */
+#define PCAPNG_BOM          0x1A2B3C4D  /* byte order magic, blocks are written in host order */
+#define PCAPNG_OPT_TSRESOL  9           /* if_tsresol option */
+#define LINKTYPE_LORATAP    270
+
+#define LORATAP_VERSION     0
+#define LORATAP_HDR_LEN     15
+#define LORATAP_RSSI_BASE   139         /* LoRaTap RSSI fields are dBm + 139 */
+#define LORATAP_SYNC_PUBLIC 0x34        /* LoRaWAN public network sync word */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void put_u16(uint8_t *b, uint16_t v) {
+    b[0] = (uint8_t)v;
+    b[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *b, uint32_t v) {
+    b[0] = (uint8_t)v;
+    b[1] = (uint8_t)(v >> 8);
+    b[2] = (uint8_t)(v >> 16);
+    b[3] = (uint8_t)(v >> 24);
+}
+
+static void put_u64(uint8_t *b, uint64_t v) {
+    put_u32(b, (uint32_t)v);
+    put_u32(b + 4, (uint32_t)(v >> 32));
+}
+
+static void put_f32(uint8_t *b, float f) {
+    uint32_t v;
+    memcpy(&v, &f, sizeof v);
+    put_u32(b, v);
+}
+
+static uint16_t get_u16(const uint8_t *b) {
+    return (uint16_t)(b[0] | b[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *b) {
+    return (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+static uint64_t get_u64(const uint8_t *b) {
+    return (uint64_t)get_u32(b) | (uint64_t)get_u32(b + 4) << 32;
+}
+
+static float get_f32(const uint8_t *b) {
+    uint32_t v = get_u32(b);
+    float f;
+    memcpy(&f, &v, sizeof f);
+    return f;
+}
+
+static void capture_name(char *dest, size_t size, const char *prefix, unsigned index) {
+
+    if (index == 0) {
+        snprintf(dest, size, "%s%s", prefix, CAPTURE_SUFFIX);
+    } else {
+        snprintf(dest, size, "%s.%u%s", prefix, index, CAPTURE_SUFFIX);
+    }
+}
+
+/**
+ * Create a new capture file with its header.
+ *
+ * @param cw    Capture writer
+ * @return      0 on success, -1 otherwise
+*/
+static int capture_create(capture_writer_t *cw) {
+
+    char name[CAPTURE_NAME_LEN];
+    uint8_t hdr[CAPTURE_FILE_HDR_LEN];
+    struct timespec now;
+
+    capture_name(name, sizeof name, cw->prefix, 0);
+    cw->fp = fopen(name, "wb");
+    if (cw->fp == NULL) {
+        return -1;
+    }
+    setvbuf(cw->fp, NULL, _IOFBF, CAPTURE_BUF_SIZE);
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    memset(hdr, 0, sizeof hdr);
+    memcpy(hdr, CAPTURE_MAGIC, 4);
+    put_u16(&hdr[4], CAPTURE_VERSION);
+    put_u16(&hdr[6], CAPTURE_FILE_HDR_LEN);
+    put_u16(&hdr[8], CAPTURE_REC_HDR_LEN);
+    put_u64(&hdr[12], cw->gateway_id);
+    put_u64(&hdr[20], (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec);
+
+    if (fwrite(hdr, 1, sizeof hdr, cw->fp) != sizeof hdr) {
+        fclose(cw->fp);
+        cw->fp = NULL;
+        return -1;
+    }
+    cw->bytes = sizeof hdr;
+
+    return 0;
+}
+
+/**
+ * Close the current file, shift the rotated ones and start a new file.
+ *
+ * @param cw    Capture writer
+ * @return      0 on success, -1 otherwise
+*/
+static int capture_rotate(capture_writer_t *cw) {
+
+    char from[CAPTURE_NAME_LEN];
+    char to[CAPTURE_NAME_LEN];
+    unsigned i;
+
+    fclose(cw->fp);
+    cw->fp = NULL;
+
+    /* <prefix>.lgwcap becomes <prefix>.1.lgwcap, the oldest one is dropped */
+    capture_name(to, sizeof to, cw->prefix, cw->keep);
+    remove(to);
+    for (i = cw->keep; i > 0; i--) {
+        capture_name(from, sizeof from, cw->prefix, i - 1);
+        capture_name(to, sizeof to, cw->prefix, i);
+        rename(from, to);
+    }
+    if (cw->keep == 0) {
+        capture_name(to, sizeof to, cw->prefix, 0);
+        remove(to);
+    }
+
+    return capture_create(cw);
+}
+
+/**
+ * Encode the LoRaTap header of a packet.
+ *
+ * @param b     Destination, LORATAP_HDR_LEN bytes
+ * @param p     Received packet
+*/
+static void loratap_header(uint8_t *b, const struct lgw_pkt_rx_s *p) {
+
+    long v;
+
+    b[0] = LORATAP_VERSION;
+    b[1] = 0;
+    b[2] = 0;                               /* LoRaTap fields are big endian */
+    b[3] = LORATAP_HDR_LEN;
+    b[4] = (uint8_t)(p->freq_hz >> 24);
+    b[5] = (uint8_t)(p->freq_hz >> 16);
+    b[6] = (uint8_t)(p->freq_hz >> 8);
+    b[7] = (uint8_t)p->freq_hz;
+    switch (p->bandwidth) {                 /* in 125 kHz steps */
+        case BW_250KHZ: b[8] = 2; break;
+        case BW_500KHZ: b[8] = 4; break;
+        default:        b[8] = 1; break;
+    }
+    b[9] = (uint8_t)p->datarate;
+
+    /* packet RSSI is dBm = -139 + packet_rssi * 1.0667 with a positive SNR, -139 + packet_rssi + SNR otherwise */
+    if (p->snr >= 0) {
+        v = lroundf((p->rssis + LORATAP_RSSI_BASE) / 1.0667f);
+    } else {
+        v = lroundf(p->rssis + LORATAP_RSSI_BASE - p->snr);
+    }
+    b[10] = (uint8_t)((v < 0) ? 0 : (v > 255) ? 255 : v);
+    b[11] = b[10];                          /* max RSSI, not reported by the SX1302 */
+    v = lroundf(p->rssic + LORATAP_RSSI_BASE);
+    b[12] = (uint8_t)((v < 0) ? 0 : (v > 255) ? 255 : v);
+    v = lroundf(p->snr * 4);
+    b[13] = (uint8_t)(int8_t)((v < -128) ? -128 : (v > 127) ? 127 : v);
+    b[14] = LORATAP_SYNC_PUBLIC;
+}
+
+/**
+ * Write a pcapng block: type, length, body padded to 32 bits, length.
+ *
+ * @return  0 on success, -1 otherwise
+*/
+static int pcapng_block(FILE *fp, uint32_t type, const void *body, size_t body_len, const void *data, size_t data_len) {
+
+    static const uint8_t pad[4] = {0, 0, 0, 0};
+    uint32_t total = (uint32_t)(12 + body_len + ((data_len + 3) & ~(size_t)3));
+    size_t padding = ((data_len + 3) & ~(size_t)3) - data_len;
+
+    if (fwrite(&type, 4, 1, fp) != 1 || fwrite(&total, 4, 1, fp) != 1) {
+        return -1;
+    }
+    if (body_len > 0 && fwrite(body, 1, body_len, fp) != body_len) {
+        return -1;
+    }
+    if (data_len > 0 && fwrite(data, 1, data_len, fp) != data_len) {
+        return -1;
+    }
+    if (padding > 0 && fwrite(pad, 1, padding, fp) != padding) {
+        return -1;
+    }
+    if (fwrite(&total, 4, 1, fp) != 1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int capture_open(capture_writer_t *cw, const char *prefix, size_t max_bytes, unsigned keep, uint64_t gateway_id) {
+
+    char name[CAPTURE_NAME_LEN];
+    capture_reader_t cr;
+    capture_rec_t rec;
+    struct stat st;
+    size_t end;
+
+    if (cw == NULL || prefix == NULL || strlen(prefix) >= sizeof cw->prefix) {
+        return -1;
+    }
+
+    memset(cw, 0, sizeof *cw);
+    strncpy(cw->prefix, prefix, sizeof cw->prefix - 1);
+    cw->max_bytes = max_bytes;
+    cw->keep = keep;
+    cw->gateway_id = gateway_id;
+
+    capture_name(name, sizeof name, prefix, 0);
+    if (stat(name, &st) != 0 || st.st_size == 0) {
+        return capture_create(cw);
+    }
+
+    /* keep appending to an existing capture, up to its last complete record */
+    if (capture_reader_open(&cr, name) != 0) {
+        return -1;
+    }
+    while (capture_reader_next(&cr, &rec) == 1) {
+    }
+    end = cr.pos;
+    capture_reader_close(&cr);
+
+    if ((size_t)st.st_size != end && truncate(name, (off_t)end) != 0) {
+        return -1;
+    }
+
+    cw->fp = fopen(name, "ab");
+    if (cw->fp == NULL) {
+        return -1;
+    }
+    setvbuf(cw->fp, NULL, _IOFBF, CAPTURE_BUF_SIZE);
+    cw->bytes = end;
+
+    return 0;
+}
+
+int capture_write(capture_writer_t *cw, uint8_t card, uint64_t time_ns, const struct lgw_pkt_rx_s *p) {
+
+    uint8_t rec[CAPTURE_REC_MAX];
+    uint16_t size = (p->size <= sizeof p->payload) ? p->size : sizeof p->payload;
+    size_t len = CAPTURE_REC_HDR_LEN + size;
+
+    if (cw->max_bytes > 0 && cw->bytes > CAPTURE_FILE_HDR_LEN && cw->bytes + len > cw->max_bytes) {
+        if (cw->fp != NULL) {
+            capture_rotate(cw);
+        }
+    }
+    if (cw->fp == NULL) {
+        cw->errors++;
+        return -1;
+    }
+
+    put_u16(&rec[0], (uint16_t)len);
+    rec[2] = card;
+    rec[3] = p->ftime_received ? REC_FLAG_FTIME : 0;
+    put_u64(&rec[4], time_ns);
+    put_u32(&rec[12], p->count_us);
+    put_u32(&rec[16], p->freq_hz);
+    put_u32(&rec[20], (uint32_t)p->freq_offset);
+    put_u32(&rec[24], p->datarate);
+    rec[28] = p->if_chain;
+    rec[29] = p->status;
+    rec[30] = p->rf_chain;
+    rec[31] = p->modem_id;
+    rec[32] = p->modulation;
+    rec[33] = p->bandwidth;
+    rec[34] = p->coderate;
+    rec[35] = 0;
+    put_u16(&rec[36], p->crc);
+    put_u16(&rec[38], size);
+    put_f32(&rec[40], p->rssic);
+    put_f32(&rec[44], p->rssis);
+    put_f32(&rec[48], p->snr);
+    put_f32(&rec[52], p->snr_min);
+    put_f32(&rec[56], p->snr_max);
+    put_u32(&rec[60], p->ftime);
+    memcpy(&rec[CAPTURE_REC_HDR_LEN], p->payload, size);
+
+    if (fwrite(rec, 1, len, cw->fp) != len) {
+        cw->errors++;
+        return -1;
+    }
+    cw->bytes += len;
+    cw->records++;
+
+    return 0;
+}
+
+int capture_flush(capture_writer_t *cw) {
+
+    if (cw->fp == NULL) {
+        return 0;
+    }
+
+    return (fflush(cw->fp) == 0) ? 0 : -1;
+}
+
+void capture_close(capture_writer_t *cw) {
+
+    if (cw->fp != NULL) {
+        fclose(cw->fp);
+        cw->fp = NULL;
+    }
+}
+
+int capture_reader_open(capture_reader_t *cr, const char *path) {
+
+    int fd;
+    struct stat st;
+    void *map;
+
+    memset(cr, 0, sizeof *cr);
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < CAPTURE_FILE_HDR_LEN) {
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    cr->map = (const uint8_t *)map;
+    cr->size = (size_t)st.st_size;
+
+    if (memcmp(cr->map, CAPTURE_MAGIC, 4) != 0 || get_u16(&cr->map[6]) < CAPTURE_FILE_HDR_LEN ||
+        get_u16(&cr->map[8]) < CAPTURE_REC_HDR_LEN || get_u16(&cr->map[6]) > cr->size) {
+        capture_reader_close(cr);
+        return -1;
+    }
+
+    cr->version = get_u16(&cr->map[4]);
+    cr->rec_hdr_len = get_u16(&cr->map[8]);
+    cr->gateway_id = get_u64(&cr->map[12]);
+    cr->created_ns = get_u64(&cr->map[20]);
+    cr->pos = get_u16(&cr->map[6]);
+
+    return 0;
+}
+
+int capture_reader_next(capture_reader_t *cr, capture_rec_t *rec) {
+
+    const uint8_t *r;
+    uint16_t len, size;
+    struct lgw_pkt_rx_s *p = &rec->pkt;
+
+    if (cr->map == NULL || cr->size - cr->pos < CAPTURE_REC_HDR_LEN) {
+        return 0;
+    }
+
+    r = &cr->map[cr->pos];
+    len = get_u16(&r[0]);
+    size = get_u16(&r[38]);
+    if (len > cr->size - cr->pos) {
+        return 0; /* cut short */
+    }
+    if (size > sizeof p->payload || len != cr->rec_hdr_len + size) {
+        return -1;
+    }
+
+    memset(rec, 0, sizeof *rec);
+    rec->card = r[2];
+    rec->time_ns = get_u64(&r[4]);
+    p->ftime_received = (r[3] & REC_FLAG_FTIME) ? true : false;
+    p->count_us = get_u32(&r[12]);
+    p->freq_hz = get_u32(&r[16]);
+    p->freq_offset = (int32_t)get_u32(&r[20]);
+    p->datarate = get_u32(&r[24]);
+    p->if_chain = r[28];
+    p->status = r[29];
+    p->rf_chain = r[30];
+    p->modem_id = r[31];
+    p->modulation = r[32];
+    p->bandwidth = r[33];
+    p->coderate = r[34];
+    p->crc = get_u16(&r[36]);
+    p->size = size;
+    p->rssic = get_f32(&r[40]);
+    p->rssis = get_f32(&r[44]);
+    p->snr = get_f32(&r[48]);
+    p->snr_min = get_f32(&r[52]);
+    p->snr_max = get_f32(&r[56]);
+    p->ftime = get_u32(&r[60]);
+    memcpy(p->payload, &r[cr->rec_hdr_len], size);
+
+    cr->pos += len;
+
+    return 1;
+}
+
+void capture_reader_rewind(capture_reader_t *cr) {
+
+    if (cr->map != NULL) {
+        cr->pos = get_u16(&cr->map[6]);
+    }
+}
+
+void capture_reader_close(capture_reader_t *cr) {
+
+    if (cr->map != NULL) {
+        munmap((void *)cr->map, cr->size);
+    }
+    memset(cr, 0, sizeof *cr);
+}
+
+long capture_export_pcapng(const char *in_path, const char *out_path) {
+
+    capture_reader_t cr;
+    capture_rec_t rec;
+    FILE *fp;
+    uint8_t shb[16];
+    uint8_t idb[8 + 8 + 4];
+    uint8_t epb[20];
+    uint8_t data[LORATAP_HDR_LEN + 256];
+    uint32_t u32;
+    uint16_t u16;
+    int64_t section_len = -1;
+    long nb = 0;
+    int x;
+
+    if (capture_reader_open(&cr, in_path) != 0) {
+        return -1;
+    }
+    fp = fopen(out_path, "wb");
+    if (fp == NULL) {
+        capture_reader_close(&cr);
+        return -1;
+    }
+
+    /* section header: byte order magic, version 1.0, unknown section length */
+    u32 = PCAPNG_BOM;
+    memcpy(&shb[0], &u32, 4);
+    u16 = 1;
+    memcpy(&shb[4], &u16, 2);
+    u16 = 0;
+    memcpy(&shb[6], &u16, 2);
+    memcpy(&shb[8], &section_len, 8);
+
+    /* interface: LoRaTap, no snap length, nanosecond timestamps */
+    memset(idb, 0, sizeof idb);
+    u16 = LINKTYPE_LORATAP;
+    memcpy(&idb[0], &u16, 2);
+    u16 = PCAPNG_OPT_TSRESOL;
+    memcpy(&idb[8], &u16, 2);
+    u16 = 1;
+    memcpy(&idb[10], &u16, 2);
+    idb[12] = 9;                            /* 10^-9 s */
+
+    x = pcapng_block(fp, PCAPNG_SHB, shb, sizeof shb, NULL, 0);
+    x |= pcapng_block(fp, PCAPNG_IDB, idb, sizeof idb, NULL, 0);
+
+    while (x == 0 && capture_reader_next(&cr, &rec) == 1) {
+        loratap_header(data, &rec.pkt);
+        memcpy(&data[LORATAP_HDR_LEN], rec.pkt.payload, rec.pkt.size);
+
+        u32 = 0;                            /* interface ID */
+        memcpy(&epb[0], &u32, 4);
+        u32 = (uint32_t)(rec.time_ns >> 32);
+        memcpy(&epb[4], &u32, 4);
+        u32 = (uint32_t)rec.time_ns;
+        memcpy(&epb[8], &u32, 4);
+        u32 = LORATAP_HDR_LEN + rec.pkt.size;
+        memcpy(&epb[12], &u32, 4);          /* captured length */
+        memcpy(&epb[16], &u32, 4);          /* original length */
+
+        x = pcapng_block(fp, PCAPNG_EPB, epb, sizeof epb, data, LORATAP_HDR_LEN + rec.pkt.size);
+        nb++;
+    }
+
+    capture_reader_close(&cr);
+    if (fclose(fp) != 0 || x != 0) {
+        return -1;
+    }
+
+    return nb;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,272 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Description:
+    Channel aggregation in fixed time buckets per (frequency, datarate).
+    Cells live in a small open addressing table and are listed in the order
+    they started, so emitting and clearing a bucket only touches the active
+    cells. Distinct DevAddrs are counted with a HyperLogLog sketch per cell,
+    with the linear counting correction for small counts.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdlib.h>     /* calloc free */
+#include <string.h>     /* memset */
+#include <time.h>       /* gmtime_r strftime */
+#include <math.h>       /* ldexp log */
+
+#include "json_emit.h"
+#include "chan_agg.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define CHAN_HASH_MULT      0x9E3779B1U /* 2^32 / golden ratio */
+
+/* JSON key fields for channel buckets */
+#define JSON_TIME           "@timestamp"
+#define JSON_TYPE           "type"
+#define JSON_PERIOD         "Period"
+#define JSON_FREQ           "Freq"
+#define JSON_SF             "SF"
+#define JSON_PACKETS        "Packets"
+#define JSON_CRC_OK         "CRCOK"
+#define JSON_CRC_BAD        "CRCBad"
+#define JSON_AIRTIME        "Airtime"
+#define JSON_DUTY           "DutyCycle"
+#define JSON_RSSI_MIN       "RSSIMin"
+#define JSON_RSSI_AVG       "RSSIAvg"
+#define JSON_RSSI_MAX       "RSSIMax"
+#define JSON_SNR_MIN        "SNRMin"
+#define JSON_SNR_AVG        "SNRAvg"
+#define JSON_SNR_MAX        "SNRMax"
+#define JSON_DEVICES        "Devices"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* 64 bit finaliser of MurmurHash3, spreads every DevAddr bit over the hash */
+static inline uint64_t hash64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDULL;
+    k ^= k >> 33;
+    k *= 0xC4CEB9FE1A85EC53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static void hll_add(uint8_t *hll, uint32_t devaddr) {
+
+    uint64_t h = hash64(devaddr);
+    uint32_t idx = (uint32_t)(h >> (64 - CHAN_AGG_HLL_BITS));
+    uint64_t w = (h << CHAN_AGG_HLL_BITS) | (1ULL << (CHAN_AGG_HLL_BITS - 1)); /* guard bit bounds the rank */
+    uint8_t rank = (uint8_t)(__builtin_clzll(w) + 1);
+
+    if (rank > hll[idx]) {
+        hll[idx] = rank;
+    }
+}
+
+static chan_cell_t *cell_get(chan_agg_t *a, uint32_t freq_hz, uint32_t datarate) {
+
+    uint32_t i = ((freq_hz ^ (datarate << 24)) * CHAN_HASH_MULT) >> 24;    /* 8 bits for 256 slots */
+    chan_cell_t *c;
+
+    while (true) {
+        c = &a->cells[i];
+        if (c->nb_pkt == 0) {
+            break;
+        }
+        if (c->freq_hz == freq_hz && c->datarate == datarate) {
+            return c;
+        }
+        i = (i + 1) & (CHAN_AGG_SLOTS - 1);
+    }
+
+    /* new cell */
+    if (a->nb_used >= CHAN_AGG_MAX_CELLS) {
+        return NULL;
+    }
+    a->used[a->nb_used++] = (uint16_t)i;
+    c->freq_hz = freq_hz;
+    c->datarate = datarate;
+
+    return c;
+}
+
+static void format_time(time_t time, char *buf, size_t size) {
+    struct tm xt;
+
+    gmtime_r(&time, &xt);
+    strftime(buf, size, "%Y-%m-%dT%H:%M:%SZ", &xt);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int chan_agg_init(chan_agg_t *a, unsigned width) {
+
+    memset(a, 0, sizeof *a);
+
+    if (width == 0) {
+        return -1;
+    }
+
+    a->cells = calloc(CHAN_AGG_SLOTS, sizeof *a->cells);
+    if (a->cells == NULL) {
+        return -1;
+    }
+    a->width = width;
+
+    return 0;
+}
+
+void chan_agg_free(chan_agg_t *a) {
+    free(a->cells);
+    memset(a, 0, sizeof *a);
+}
+
+bool chan_agg_due(const chan_agg_t *a, time_t now) {
+    return (a->nb_used > 0) && (now >= a->start + (time_t)a->width);
+}
+
+int chan_agg_add(chan_agg_t *a, const struct lgw_pkt_rx_s *p, const ed_report_t *report, time_t now) {
+
+    chan_cell_t *c;
+
+    if (a->nb_used == 0) {
+        a->start = now - (now % a->width);
+    }
+
+    c = cell_get(a, p->freq_hz, p->datarate);
+    if (c == NULL) {
+        a->full++;
+        return -1;
+    }
+
+    if (c->nb_pkt == 0) {
+        c->rssi_min = c->rssi_max = report->rssi;
+        c->snr_min = c->snr_max = report->snr;
+    } else {
+        c->rssi_min = (report->rssi < c->rssi_min) ? report->rssi : c->rssi_min;
+        c->rssi_max = (report->rssi > c->rssi_max) ? report->rssi : c->rssi_max;
+        c->snr_min = (report->snr < c->snr_min) ? report->snr : c->snr_min;
+        c->snr_max = (report->snr > c->snr_max) ? report->snr : c->snr_max;
+    }
+    c->rssi_sum += report->rssi;
+    c->snr_sum += report->snr;
+    c->nb_pkt++;
+    c->airtime_us += (uint64_t)(report->toa * 1000.0f + 0.5f);
+
+    switch (p->status) {
+        case STAT_CRC_OK:
+            c->nb_crc_ok++;
+            if (!report->is_jr) {
+                hll_add(c->hll, report->devaddr);
+            }
+            break;
+        case STAT_CRC_BAD:
+            c->nb_crc_bad++;
+            break;
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+const chan_cell_t *chan_agg_next(const chan_agg_t *a, uint32_t *pos) {
+    return (*pos < a->nb_used) ? &a->cells[a->used[(*pos)++]] : NULL;
+}
+
+void chan_agg_reset(chan_agg_t *a) {
+
+    uint32_t i;
+
+    for (i = 0; i < a->nb_used; i++) {
+        memset(&a->cells[a->used[i]], 0, sizeof a->cells[0]);
+    }
+    a->nb_used = 0;
+    a->start = 0;
+}
+
+double chan_agg_devices(const chan_cell_t *c) {
+
+    const double m = CHAN_AGG_HLL_SIZE;
+    double sum = 0.0, estimate;
+    int i, zeros = 0;
+
+    for (i = 0; i < CHAN_AGG_HLL_SIZE; i++) {
+        sum += ldexp(1.0, -c->hll[i]);
+        zeros += (c->hll[i] == 0) ? 1 : 0;
+    }
+
+    estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+
+    /* small counts: linear counting on the empty registers is closer */
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros);
+    }
+
+    return estimate;
+}
+
+int chan_agg_encode(const chan_agg_t *a, const chan_cell_t *c, char *buf, size_t size) {
+
+    json_emit_t e;
+    char timestamp[ED_REPORT_TIME_LEN];
+    double n = (c->nb_pkt > 0) ? c->nb_pkt : 1;
+
+    format_time(a->start, timestamp, sizeof timestamp);
+
+    json_emit_begin(&e, buf, size);
+
+    json_emit_string(&e, JSON_TIME,     timestamp);
+    json_emit_string(&e, JSON_TYPE,     CHAN_AGG_TYPE);
+    json_emit_number(&e, JSON_PERIOD,   a->width);
+    json_emit_number(&e, JSON_FREQ,     (double)c->freq_hz / 1e6);
+    json_emit_number(&e, JSON_SF,       c->datarate);
+    json_emit_number(&e, JSON_PACKETS,  c->nb_pkt);
+    json_emit_number(&e, JSON_CRC_OK,   c->nb_crc_ok);
+    json_emit_number(&e, JSON_CRC_BAD,  c->nb_crc_bad);
+    json_emit_number(&e, JSON_AIRTIME,  (double)c->airtime_us / 1e3);
+    json_emit_number(&e, JSON_DUTY,     (double)c->airtime_us / (a->width * 1e4));    /* percent */
+    json_emit_number(&e, JSON_RSSI_MIN, c->rssi_min);
+    json_emit_number(&e, JSON_RSSI_AVG, c->rssi_sum / n);
+    json_emit_number(&e, JSON_RSSI_MAX, c->rssi_max);
+    json_emit_number(&e, JSON_SNR_MIN,  c->snr_min);
+    json_emit_number(&e, JSON_SNR_AVG,  c->snr_sum / n);
+    json_emit_number(&e, JSON_SNR_MAX,  c->snr_max);
+    json_emit_number(&e, JSON_DEVICES,  round(chan_agg_devices(c)));
+
+    return json_emit_end(&e);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
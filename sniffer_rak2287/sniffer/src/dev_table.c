@@ -0,0 +1,301 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Description:
+    Per device state, kept in an open addressing table keyed by DevAddr.
+    Linear probing from a multiplicative hash of the DevAddr (devices of a
+    network share the top bits), and backward shift deletion so removed
+    devices leave no tombstones behind.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdlib.h>     /* calloc free */
+#include <string.h>     /* memset strcmp */
+#include <time.h>       /* gmtime_r strftime */
+
+#include "json_emit.h"
+#include "dev_table.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEV_TABLE_MAX_SIZE  (1U << 24)  /* sanity limit on the number of slots */
+#define DEV_HASH_MULT       0x9E3779B1U /* 2^32 / golden ratio */
+
+/* JSON key fields for device summaries */
+#define JSON_TIME           "@timestamp"
+#define JSON_TYPE           "type"
+#define JSON_DEVADDR        "DevAddr"
+#define JSON_FCNT           "FCnt"
+#define JSON_FRAMES         "Frames"
+#define JSON_LOST           "Lost"
+#define JSON_DUP            "Dup"
+#define JSON_LOSS           "Loss"
+#define JSON_RESETS         "Resets"
+#define JSON_SF             "SF"
+#define JSON_ADR            "ADR"
+#define JSON_SF_CHANGES     "SFChanges"
+#define JSON_ADR_CHANGES    "ADRChanges"
+#define JSON_RSSI           "RSSI"
+#define JSON_SNR            "SNR"
+#define JSON_LAST_SEEN      "LastSeen"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static inline uint32_t dev_home(const dev_table_t *t, uint32_t devaddr) {
+    return (devaddr * DEV_HASH_MULT) >> t->shift;
+}
+
+static void format_time(time_t time, char *buf, size_t size) {
+    struct tm xt;
+
+    gmtime_r(&time, &xt);
+    strftime(buf, size, "%Y-%m-%dT%H:%M:%SZ", &xt);
+}
+
+/* track the FCnt sequence of a known device */
+static void dev_track_fcnt(dev_entry_t *d, uint16_t fcnt) {
+
+    uint16_t delta = (uint16_t)(fcnt - (uint16_t)d->fcnt);
+
+    if (delta == 0) {
+        /* retransmission, or heard twice */
+        d->nb_dup++;
+    } else if (delta < DEV_FCNT_MAX_GAP) {
+        /* ahead, possibly past a 16 bit rollover, the frames in between were missed */
+        d->fcnt += delta;
+        d->nb_lost += delta - 1;
+    } else {
+        /* back, or too far ahead to be a gap: the device started over */
+        d->fcnt = fcnt;
+        d->nb_reset++;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int dev_table_init(dev_table_t *t, uint32_t capacity) {
+
+    uint32_t size = 2, bits = 1;
+
+    memset(t, 0, sizeof *t);
+
+    if (capacity == 0 || capacity > DEV_TABLE_MAX_SIZE / 2) {
+        return -1;
+    }
+
+    while (size < 2 * capacity) {
+        size <<= 1;
+        bits++;
+    }
+
+    t->slots = calloc(size, sizeof *t->slots);
+    if (t->slots == NULL) {
+        return -1;
+    }
+
+    t->size = size;
+    t->mask = size - 1;
+    t->shift = 32 - bits;
+    t->capacity = capacity;
+
+    return 0;
+}
+
+void dev_table_free(dev_table_t *t) {
+    free(t->slots);
+    memset(t, 0, sizeof *t);
+}
+
+dev_entry_t *dev_table_find(dev_table_t *t, uint32_t devaddr) {
+
+    uint32_t i = dev_home(t, devaddr);
+
+    while (t->slots[i].used) {
+        if (t->slots[i].devaddr == devaddr) {
+            return &t->slots[i];
+        }
+        i = (i + 1) & t->mask;
+    }
+
+    return NULL;
+}
+
+int dev_table_update(dev_table_t *t, const ed_report_t *report, time_t now) {
+
+    dev_entry_t *d;
+    uint32_t i;
+
+    /* uplinks with a trusted frame header only */
+    if (report->is_jr || strcmp(report->crc, "OK") != 0 || report->mic == ED_MIC_BAD ||
+        (strcmp(report->mtype, "UDU") != 0 && strcmp(report->mtype, "CDU") != 0)) {
+        return 1;
+    }
+
+    /* probe for the device, or the free slot it goes to */
+    i = dev_home(t, report->devaddr);
+    while (t->slots[i].used && t->slots[i].devaddr != report->devaddr) {
+        i = (i + 1) & t->mask;
+    }
+    d = &t->slots[i];
+
+    if (d->used) {
+        dev_track_fcnt(d, (uint16_t)report->fcnt);
+        d->nb_sf_change += (d->sf != report->sf) ? 1 : 0;
+        d->nb_adr_change += (d->adr != report->adr) ? 1 : 0;
+        d->rssi += DEV_EWMA_WEIGHT * (report->rssi - d->rssi);
+        d->snr += DEV_EWMA_WEIGHT * (report->snr - d->snr);
+    } else {
+        if (t->count >= t->capacity) {
+            t->full++;
+            return -1;
+        }
+        memset(d, 0, sizeof *d);
+        d->used = true;
+        d->devaddr = report->devaddr;
+        d->fcnt = report->fcnt;
+        d->rssi = report->rssi;
+        d->snr = report->snr;
+        t->count++;
+    }
+
+    d->sf = report->sf;
+    d->adr = report->adr;
+    d->nb_rx++;
+    d->last_seen = now;
+
+    return 0;
+}
+
+dev_entry_t *dev_table_next(dev_table_t *t, uint32_t *pos) {
+
+    while (*pos < t->size) {
+        if (t->slots[(*pos)++].used) {
+            return &t->slots[*pos - 1];
+        }
+    }
+
+    return NULL;
+}
+
+uint32_t dev_table_expire(dev_table_t *t, time_t before) {
+
+    uint32_t i, j, k, hole, removed = 0;
+    uint32_t start;
+
+    /* start right after a free slot, so no probe run is cut in two */
+    for (start = 0; start < t->size && t->slots[start].used; start++) {
+    }
+    if (start == t->size) {
+        start = 0;
+    }
+
+    for (k = 0; k < t->size; k++) {
+        i = (start + k) & t->mask;
+        if (!t->slots[i].used || t->slots[i].last_seen >= before) {
+            continue;
+        }
+
+        /* shift the rest of the run back into the hole, unless it would move an entry before its home */
+        hole = i;
+        j = i;
+        while (true) {
+            j = (j + 1) & t->mask;
+            if (!t->slots[j].used) {
+                break;
+            }
+            if (((j - dev_home(t, t->slots[j].devaddr)) & t->mask) >= ((j - hole) & t->mask)) {
+                t->slots[hole] = t->slots[j];
+                hole = j;
+            }
+        }
+        t->slots[hole].used = false;
+        t->count--;
+        removed++;
+
+        /* an entry may have been shifted into this slot, look at it again */
+        if (hole != i) {
+            k--;
+        }
+    }
+
+    return removed;
+}
+
+void dev_table_reset_period(dev_entry_t *d) {
+    d->nb_rx = 0;
+    d->nb_lost = 0;
+    d->nb_dup = 0;
+    d->nb_sf_change = 0;
+    d->nb_adr_change = 0;
+    d->nb_reset = 0;
+}
+
+float dev_table_loss_rate(const dev_entry_t *d) {
+
+    uint32_t sent = d->nb_rx - d->nb_dup + d->nb_lost;
+
+    return (sent == 0) ? 0.0f : (float)d->nb_lost / (float)sent;
+}
+
+int dev_table_encode(const dev_entry_t *d, time_t now, char *buf, size_t size) {
+
+    json_emit_t e;
+    char timestamp[ED_REPORT_TIME_LEN];
+    char last_seen[ED_REPORT_TIME_LEN];
+
+    format_time(now, timestamp, sizeof timestamp);
+    format_time(d->last_seen, last_seen, sizeof last_seen);
+
+    json_emit_begin(&e, buf, size);
+
+    json_emit_string(&e, JSON_TIME,         timestamp);
+    json_emit_string(&e, JSON_TYPE,         DEV_TABLE_TYPE);
+    json_emit_hex(&e, JSON_DEVADDR,         d->devaddr, 8);
+    json_emit_number(&e, JSON_FCNT,         d->fcnt);
+    json_emit_number(&e, JSON_FRAMES,       d->nb_rx);
+    json_emit_number(&e, JSON_LOST,         d->nb_lost);
+    json_emit_number(&e, JSON_DUP,          d->nb_dup);
+    json_emit_number(&e, JSON_LOSS,         dev_table_loss_rate(d));
+    json_emit_number(&e, JSON_RESETS,       d->nb_reset);
+    json_emit_number(&e, JSON_SF,           d->sf);
+    json_emit_bool(&e, JSON_ADR,            d->adr);
+    json_emit_number(&e, JSON_SF_CHANGES,   d->nb_sf_change);
+    json_emit_number(&e, JSON_ADR_CHANGES,  d->nb_adr_change);
+    json_emit_number(&e, JSON_RSSI,         d->rssi);
+    json_emit_number(&e, JSON_SNR,          d->snr);
+    json_emit_string(&e, JSON_LAST_SEEN,    last_seen);
+
+    return json_emit_end(&e);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,239 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    End device reports, filled and serialised without heap allocation.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* snprintf */
+#include <string.h>     /* memcpy memset strcpy */
+#include <time.h>       /* gmtime_r strftime */
+
+#include "loragw_aux.h"
+#include "base64.h"
+#include "async_log.h"
+#include "json_emit.h"
+#include "ed_report.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+/* JSON key fields for device report information */
+#define JSON_TIME           "@timestamp"
+#define JSON_TYPE           "type"
+#define JSON_DEVADDR        "DevAddr"
+#define JSON_SNR            "SNR"
+#define JSON_RSSI           "RSSI"
+#define JSON_TOA            "ToA"
+#define JSON_ADR            "ADR"
+#define JSON_MTYPE          "MType"
+#define JSON_CRC            "CRC"
+#define JSON_FCNT           "FCnt"
+#define JSON_FREQ           "Freq"
+#define JSON_SF             "SF"
+#define JSON_FPORT          "FPort"
+#define JSON_FRMLEN         "FRMLen"
+#define JSON_MAC_CMDS       "MACCmds"
+#define JSON_MAC_ERROR      "MACError"
+#define JSON_BATTERY        "Battery"
+#define JSON_MARGIN         "Margin"
+#define JSON_MIC            "MIC"
+#define JSON_DATA           "Data"
+
+#define LORAWAN_PREAMBLE    8           /* Preamble length (symbols) of LoRaWAN uplinks */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void ed_report_write(ed_report_t *report, const struct lgw_pkt_rx_s *p, const struct timespec *fetch_time) {
+
+    /* time on air, in microseconds */
+    uint32_t toa_us;
+
+    /* timestamp, gmtime_r keeps it off the static gmtime buffer */
+    struct tm xt;
+    size_t n;
+
+    uint8_t mote_mhdr = 0;
+    bool uplink = false;
+
+    memset(report, 0, sizeof *report);
+
+    /* Timestamp - ISO 8601 format */
+    gmtime_r(&fetch_time->tv_sec, &xt);
+    n = strftime(report->timestamp, sizeof report->timestamp, "%Y-%m-%dT%H:%M:%S", &xt);
+    snprintf(report->timestamp + n, sizeof report->timestamp - n, ".%03iZ", (int)(fetch_time->tv_nsec / 1000000));
+    report->time_ms = (uint64_t)fetch_time->tv_sec * 1000 + (uint64_t)(fetch_time->tv_nsec / 1000000);
+
+    /* MHDR and Message Type */
+    mote_mhdr = p->payload[0];
+
+    /* CRC status */
+    switch(p->status) {
+        case STAT_CRC_OK:       strcpy(report->crc, "OK");      break;
+        case STAT_CRC_BAD:      strcpy(report->crc, "BAD");     break;
+        case STAT_NO_CRC:       strcpy(report->crc, "NONE");    break;
+        case STAT_UNDEFINED:    strcpy(report->crc, "UNDEF");   break;
+        default:                strcpy(report->crc, "ERR");
+    }
+
+    /* General packet statistics - Freq, SF, SNR, RSSI, ToA, */
+    report->freq = ((double)p->freq_hz / 1e6);
+    report->sf = p->datarate;
+    report->snr = p->snr;
+    report->rssi = p->rssis;
+
+    /* Time on air, uplinks always have an explicit header */
+    toa_us = lora_packet_toa_lookup(p->bandwidth, p->datarate, p->coderate, LORAWAN_PREAMBLE, false, (p->status == STAT_NO_CRC), p->size);
+    if (toa_us == 0) {
+        log_printf("ERROR: Unknown spreading factor found");
+    }
+    report->toa = toa_us / 1e3; // In ms
+
+    /* Join request case... very important */
+    if (mote_mhdr >> 5 == 0b000) {
+        // Special case for JR
+        report->is_jr = true;
+        strcpy(report->mtype, "JR");
+
+        // First 8 bytes are the APP EUI, second 8 bytes are the Dev EUI
+        report->app_eui = (uint64_t)p->payload[1] | (uint64_t)p->payload[2] << 8 | (uint64_t)p->payload[3] << 16 | (uint64_t)p->payload[4] << 24 | (uint64_t)p->payload[5] << 32 | (uint64_t)p->payload[6] << 40 | (uint64_t)p->payload[7] << 48 | (uint64_t)p->payload[8] << 56;
+        report->dev_eui = (uint64_t)p->payload[9] | (uint64_t)p->payload[10] << 8 | (uint64_t)p->payload[11] << 16 | (uint64_t)p->payload[12] << 24 | (uint64_t)p->payload[13] << 32 | (uint64_t)p->payload[14] << 40 | (uint64_t)p->payload[15] << 48 | (uint64_t)p->payload[16] << 56;
+
+        // Then there are 2 DevNonce fields
+        // Uploading this for a check - JR should be (at max) 19 bytes?
+        report->frmlength = p->size;
+
+        return;
+    }
+
+    switch(mote_mhdr >> 5) {
+        // case 0b001 : JA, not used as this results in a different message type
+        case 0b010 : strcpy(report->mtype, "UDU"); uplink = true; break;
+        case 0b011 : strcpy(report->mtype, "UDD"); break;
+        case 0b100 : strcpy(report->mtype, "CDU"); uplink = true; break;
+        case 0b101 : strcpy(report->mtype, "CDD"); break;
+        case 0b110 : strcpy(report->mtype, "RFU"); break;
+        case 0b111 : strcpy(report->mtype, "PRP"); break;
+    }
+
+    /* FHDR breakdown - DevAddr, FCtrl, FCnt, FOpts */
+    report->devaddr = (uint32_t)p->payload[1] | (uint32_t)p->payload[2] << 8 | (uint32_t)p->payload[3] << 16 | (uint32_t)p->payload[4] << 24;
+
+    /* FCtrl - ADR, ACK, FOptsLen */
+    report->adr = (p->payload[5] & 0x80) ? true : false;
+    report->ack = (p->payload[5] & 0x20) ? true : false;
+    report->foptslen = p->payload[5] & 0x0F;
+
+    /* FOptsLen can not be trusted on a bad frame, keep FOpts within the received bytes */
+    if (8 + report->foptslen > p->size) {
+        report->foptslen = (p->size > 8) ? p->size - 8 : 0;
+    }
+
+    /* FCnt */
+    report->fcnt = p->payload[6] | p->payload[7] << 8;
+
+    /* FOpts - kept raw, they start right after FCnt */
+    memcpy(report->fopts, &p->payload[8], report->foptslen);
+
+    /* and decoded for data frames, FOpts of LoRaWAN 1.0 are not encrypted */
+    if (strcmp(report->mtype, "RFU") && strcmp(report->mtype, "PRP")) {
+        report->nb_mac_cmds = mac_cmd_parse(report->fopts, report->foptslen, uplink, report->mac_cmds, ED_REPORT_FOPTS_LEN, &report->mac_status);
+    }
+
+    /* FPort follows FOpts, if there is a payload at all */
+    report->fport = (p->size <= 8 + report->foptslen) ? -1 : p->payload[8 + report->foptslen];
+
+    if (p->size < 8) {
+        report->frmlength = 0;
+    } else if (report->fport == -1) {
+        report->frmlength = p->size - 8 - report->foptslen; // 8 is (7 FHDR + 1 MHDR)
+    } else {
+        report->frmlength = p->size - 8 - report->foptslen - 1; // 8 is (7 FHDR + 1 MHDR) and 1 is FPORT
+    }
+}
+
+int ed_report_encode(const ed_report_t *report, char *buf, size_t size) {
+
+    json_emit_t e;
+    char names[ED_REPORT_FOPTS_LEN * MAC_CMD_NAME_MAX];
+    char data[((ED_REPORT_DATA_LEN + 2) / 3) * 4 + 1];
+    const mac_cmd_t *c;
+    int i;
+
+    json_emit_begin(&e, buf, size);
+
+    // Write the consistent fields first
+    json_emit_string(&e, JSON_TIME,     report->timestamp);
+    json_emit_string(&e, JSON_TYPE,     ED_REPORT_TYPE);
+    json_emit_string(&e, JSON_MTYPE,    report->mtype);
+    json_emit_string(&e, JSON_CRC,      report->crc);
+    json_emit_number(&e, JSON_FREQ,     report->freq);
+    json_emit_number(&e, JSON_SF,       report->sf);
+    json_emit_number(&e, JSON_RSSI,     report->rssi);
+    json_emit_number(&e, JSON_TOA,      report->toa);
+    json_emit_number(&e, JSON_FRMLEN,   report->frmlength);
+    json_emit_number(&e, JSON_SNR,      report->snr);
+
+    // Join requests stop here, other message types carry the frame header
+    if (!report->is_jr) {
+        json_emit_number(&e, JSON_FCNT,     report->fcnt);
+        json_emit_hex(&e, JSON_DEVADDR,     report->devaddr, 8);
+        json_emit_bool(&e, JSON_ADR,        report->adr);
+        json_emit_number(&e, JSON_FPORT,    report->fport);
+        if (report->nb_mac_cmds > 0 || report->mac_status != MAC_CMD_OK) {
+            mac_cmd_list(report->mac_cmds, report->nb_mac_cmds, names, sizeof names);
+            json_emit_string(&e, JSON_MAC_CMDS, names);
+            if (report->mac_status != MAC_CMD_OK) {
+                json_emit_string(&e, JSON_MAC_ERROR, mac_cmd_status_str(report->mac_status));
+            }
+        }
+        // Battery and margin of the last DevStatusAns of the frame
+        for (i = report->nb_mac_cmds - 1; i >= 0; i--) {
+            c = &report->mac_cmds[i];
+            if (c->uplink && c->cid == MAC_CID_DEV_STATUS) {
+                json_emit_number(&e, JSON_BATTERY,  c->u.dev_status_ans.battery);
+                json_emit_number(&e, JSON_MARGIN,   c->u.dev_status_ans.margin);
+                break;
+            }
+        }
+        // Session key items, for known devices only
+        if (report->mic != ED_MIC_NONE) {
+            json_emit_string(&e, JSON_MIC,  (report->mic == ED_MIC_OK) ? "OK" : "BAD");
+        }
+        if (report->datalen > 0 && bin_to_b64(report->data, report->datalen, data, sizeof data) >= 0) {
+            json_emit_string(&e, JSON_DATA, data);
+        }
+    }
+
+    return json_emit_end(&e);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,292 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    In-process HTTP uploader built on the libcurl easy interface. A single
+    handle is kept for the life of the program so the connection (and TLS
+    session) to the dashboard is reused between uploads. Responses are
+    collected in memory rather than through an output file.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdio.h>      /* fopen fread snprintf */
+#include <stdlib.h>     /* realloc free */
+#include <string.h>     /* memcpy memset strlen */
+
+#include "http_uploader.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define HTTP_BUF_MIN        1024    /* smallest allocation made for a buffer */
+#define HTTP_HEADER_LEN     (HTTP_BEARER_LEN + 32)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static size_t http_write_cb(char *ptr, size_t size, size_t nmemb, void *userdata);
+
+static void http_reset(http_uploader_t *h);
+
+static int http_perform(http_uploader_t *h);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/**
+ * libcurl write callback, appends the response to the uploader's response buffer.
+*/
+static size_t http_write_cb(char *ptr, size_t size, size_t nmemb, void *userdata) {
+
+    http_buf_t *buf = (http_buf_t*)userdata;
+    size_t n = size * nmemb;
+
+    if (http_buf_reserve(buf, buf->len + n)) {
+        return 0; /* tells libcurl to abort the transfer */
+    }
+
+    memcpy(buf->data + buf->len, ptr, n);
+    buf->len += n;
+    buf->data[buf->len] = '\0';
+
+    return n;
+}
+
+/**
+ * Clear the per-request state of the handle, keeping the connection cache.
+ *
+ * @param h Uploader
+*/
+static void http_reset(http_uploader_t *h) {
+
+    curl_easy_reset(h->curl);
+
+    h->response.len = 0;
+    if (h->response.data != NULL) {
+        h->response.data[0] = '\0';
+    }
+    h->status = 0;
+    h->error[0] = '\0';
+
+    curl_easy_setopt(h->curl, CURLOPT_CONNECTTIMEOUT, h->connect_timeout);
+    curl_easy_setopt(h->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(h->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(h->curl, CURLOPT_ERRORBUFFER, h->error);
+    curl_easy_setopt(h->curl, CURLOPT_WRITEFUNCTION, http_write_cb);
+    curl_easy_setopt(h->curl, CURLOPT_WRITEDATA, &h->response);
+}
+
+/**
+ * Run the configured request and record its HTTP status.
+ *
+ * @param h Uploader
+ * @return  libcurl code
+*/
+static int http_perform(http_uploader_t *h) {
+
+    CURLcode res;
+
+    res = curl_easy_perform(h->curl);
+    curl_easy_getinfo(h->curl, CURLINFO_RESPONSE_CODE, &h->status);
+
+    return (int)res;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int http_global_init(void) {
+
+    return (curl_global_init(CURL_GLOBAL_DEFAULT) == CURLE_OK) ? 0 : -1;
+}
+
+void http_global_cleanup(void) {
+
+    curl_global_cleanup();
+}
+
+int http_init(http_uploader_t *h, long connect_timeout) {
+
+    memset(h, 0, sizeof *h);
+
+    h->curl = curl_easy_init();
+    if (h->curl == NULL) {
+        return -1;
+    }
+
+    h->connect_timeout = connect_timeout;
+
+    if (http_buf_reserve(&h->response, HTTP_BUF_MIN)) {
+        curl_easy_cleanup(h->curl);
+        h->curl = NULL;
+        return -1;
+    }
+    h->response.data[0] = '\0';
+
+    return 0;
+}
+
+void http_cleanup(http_uploader_t *h) {
+
+    if (h->curl != NULL) {
+        curl_easy_cleanup(h->curl);
+        h->curl = NULL;
+    }
+
+    http_buf_free(&h->request);
+    http_buf_free(&h->response);
+}
+
+int http_set_bearer(http_uploader_t *h, const char *token) {
+
+    if (strlen(token) >= sizeof h->bearer) {
+        return -1;
+    }
+
+    strcpy(h->bearer, token);
+
+    return 0;
+}
+
+int http_post(http_uploader_t *h, const char *url, const char *content_type, int authorised, const void *body, size_t len) {
+
+    return http_post_encoded(h, url, content_type, NULL, authorised, body, len);
+}
+
+int http_post_encoded(http_uploader_t *h, const char *url, const char *content_type, const char *content_encoding, int authorised, const void *body, size_t len) {
+
+    int res;
+    char auth[HTTP_HEADER_LEN];
+    struct curl_slist *headers = NULL;
+
+    if (body == NULL) {
+        body = "";
+        len = 0;
+    }
+
+    http_reset(h);
+
+    headers = curl_slist_append(headers, content_type);
+    if (content_encoding != NULL) {
+        headers = curl_slist_append(headers, content_encoding);
+    }
+    if (authorised) {
+        snprintf(auth, sizeof auth, "Authorization: Bearer %s", h->bearer);
+        headers = curl_slist_append(headers, auth);
+    }
+
+    curl_easy_setopt(h->curl, CURLOPT_URL, url);
+    curl_easy_setopt(h->curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(h->curl, CURLOPT_POSTFIELDS, body);
+    curl_easy_setopt(h->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)len);
+
+    res = http_perform(h);
+
+    curl_slist_free_all(headers);
+
+    return res;
+}
+
+int http_post_file(http_uploader_t *h, const char *url, const char *content_type, int authorised, const char *file_name) {
+
+    if (http_buf_load(&h->request, file_name)) {
+        return CURLE_READ_ERROR;
+    }
+
+    return http_post(h, url, content_type, authorised, h->request.data, h->request.len);
+}
+
+int http_get(http_uploader_t *h, const char *url) {
+
+    http_reset(h);
+
+    curl_easy_setopt(h->curl, CURLOPT_URL, url);
+    curl_easy_setopt(h->curl, CURLOPT_HTTPGET, 1L);
+
+    return http_perform(h);
+}
+
+int http_buf_load(http_buf_t *buf, const char *file_name) {
+
+    FILE *fp;
+    long size;
+
+    fp = fopen(file_name, "rb");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET)) {
+        fclose(fp);
+        return -1;
+    }
+
+    if (http_buf_reserve(buf, (size_t)size)) {
+        fclose(fp);
+        return -1;
+    }
+
+    buf->len = fread(buf->data, 1, (size_t)size, fp);
+    buf->data[buf->len] = '\0';
+    fclose(fp);
+
+    return (buf->len == (size_t)size) ? 0 : -1;
+}
+
+int http_buf_reserve(http_buf_t *buf, size_t size) {
+
+    size_t cap;
+    char *data;
+
+    if (size + 1 <= buf->cap) {
+        return 0;
+    }
+
+    cap = (buf->cap < HTTP_BUF_MIN) ? HTTP_BUF_MIN : buf->cap;
+    while (cap < size + 1) {
+        cap *= 2;
+    }
+
+    data = realloc(buf->data, cap);
+    if (data == NULL) {
+        return -1;
+    }
+
+    buf->data = data;
+    buf->cap = cap;
+
+    return 0;
+}
+
+void http_buf_free(http_buf_t *buf) {
+
+    free(buf->data);
+    memset(buf, 0, sizeof *buf);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
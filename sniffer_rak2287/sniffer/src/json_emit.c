@@ -0,0 +1,263 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Single pass JSON emitter for flat report objects.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* snprintf */
+#include <string.h>     /* memcpy */
+#include <math.h>       /* floor fabs signbit */
+
+#include "json_emit.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NUM_FORMAT          "%.3f"      /* non integer numbers, as parson DOUBLE_SERIALIZATION_FORMAT */
+#define NUM_FAST_MAX        1e6         /* below this, num * 1000 is within 1e-7 of its exact value */
+#define NUM_TIE_MARGIN      1e-6        /* closer to a rounding tie than this, leave it to snprintf */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* second character of the escape sequence for each byte, 0 if copied as is */
+static const char escape[256] = {
+    ['\"'] = '\"', ['\\'] = '\\', ['/'] = '/',
+    ['\b'] = 'b', ['\f'] = 'f', ['\n'] = 'n', ['\r'] = 'r', ['\t'] = 't'
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* room for len bytes plus the null terminator, NULL once the buffer is full */
+static char *reserve(json_emit_t *e, size_t len) {
+
+    char *p;
+
+    if (e->full || len >= e->size - e->len) {
+        e->full = true;
+        return NULL;
+    }
+
+    p = e->buf + e->len;
+    e->len += len;
+
+    return p;
+}
+
+static void put_raw(json_emit_t *e, const char *s, size_t len) {
+
+    char *p = reserve(e, len);
+
+    if (p != NULL) {
+        memcpy(p, s, len);
+    }
+}
+
+static void put_string(json_emit_t *e, const char *s) {
+
+    const char *run = s;
+
+    put_raw(e, "\"", 1);
+    for (; *s != '\0'; s++) {
+        if (escape[(uint8_t)*s] != 0) {
+            put_raw(e, run, (size_t)(s - run));
+            put_raw(e, "\\", 1);
+            put_raw(e, &escape[(uint8_t)*s], 1);
+            run = s + 1;
+        }
+    }
+    put_raw(e, run, (size_t)(s - run));
+    put_raw(e, "\"", 1);
+}
+
+static void put_key(json_emit_t *e, const char *key) {
+
+    if (!e->first) {
+        put_raw(e, ",", 1);
+    }
+    e->first = false;
+    put_string(e, key);
+    put_raw(e, ":", 1);
+}
+
+/* decimal digits of v, most significant first, returns their count */
+static int put_digits(char *dest, uint64_t v) {
+
+    char tmp[20];
+    int n = 0, i;
+
+    do {
+        tmp[n++] = (char)('0' + (v % 10));
+        v /= 10;
+    } while (v != 0);
+
+    for (i = 0; i < n; i++) {
+        dest[i] = tmp[n - 1 - i];
+    }
+
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void json_emit_begin(json_emit_t *e, char *buf, size_t size) {
+
+    e->buf = buf;
+    e->size = size;
+    e->len = 0;
+    e->first = true;
+    e->full = (size == 0);
+
+    put_raw(e, "{", 1);
+}
+
+int json_emit_end(json_emit_t *e) {
+
+    put_raw(e, "}", 1);
+
+    if (e->full) {
+        if (e->size > 0) {
+            e->buf[0] = '\0';
+        }
+        return -1;
+    }
+    e->buf[e->len] = '\0';
+
+    return (int)e->len;
+}
+
+void json_emit_string(json_emit_t *e, const char *key, const char *value) {
+
+    put_key(e, key);
+    put_string(e, value);
+}
+
+void json_emit_hex(json_emit_t *e, const char *key, uint64_t value, int digits) {
+
+    char tmp[18];
+    int n = 16, i = 17;
+
+    put_key(e, key);
+
+    tmp[i] = '\"';
+    while ((value != 0 || (17 - i) < digits) && n > 0) {
+        tmp[--i] = hex_digits[value & 0xF];
+        value >>= 4;
+        n--;
+    }
+    if (i == 17) {
+        tmp[--i] = '0';
+    }
+    tmp[--i] = '\"';
+
+    put_raw(e, &tmp[i], (size_t)(18 - i));
+}
+
+void json_emit_number(json_emit_t *e, const char *key, double num) {
+
+    int n;
+
+    put_key(e, key);
+    if (e->full) {
+        return;
+    }
+
+    n = json_format_number(e->buf + e->len, e->size - e->len, num);
+    if (n < 0) {
+        e->full = true;
+        return;
+    }
+    e->len += (size_t)n;
+}
+
+void json_emit_bool(json_emit_t *e, const char *key, bool value) {
+
+    put_key(e, key);
+    if (value) {
+        put_raw(e, "true", 4);
+    } else {
+        put_raw(e, "false", 5);
+    }
+}
+
+int json_format_number(char *dest, size_t size, double num) {
+
+    char tmp[32];
+    int n = 0;
+    double scaled, whole, frac;
+    uint64_t milli;
+
+    /* parson tests num == (double)(int)num, the range check keeps the cast defined */
+    if (num > -2147483649.0 && num < 2147483648.0 && num == (double)(int)num) {
+        if (num < 0) {
+            tmp[n++] = '-';
+            n += put_digits(&tmp[n], (uint64_t)(-(int64_t)num));
+        } else {
+            n += put_digits(&tmp[n], (uint64_t)num);
+        }
+    } else if (fabs(num) < NUM_FAST_MAX) {
+        /* round to thousandths as printf does, unless too close to a tie to be sure */
+        scaled = fabs(num) * 1000.0;
+        whole = floor(scaled);
+        frac = scaled - whole;
+        if (fabs(frac - 0.5) < NUM_TIE_MARGIN) {
+            n = snprintf(dest, size, NUM_FORMAT, num);
+            return (n < 0 || (size_t)n >= size) ? -1 : n;
+        }
+        milli = (uint64_t)whole + ((frac > 0.5) ? 1 : 0);
+        if (signbit(num)) {
+            tmp[n++] = '-';
+        }
+        n += put_digits(&tmp[n], milli / 1000);
+        tmp[n++] = '.';
+        tmp[n++] = (char)('0' + (milli / 100) % 10);
+        tmp[n++] = (char)('0' + (milli / 10) % 10);
+        tmp[n++] = (char)('0' + milli % 10);
+    } else {
+        /* large values, infinities and NaN */
+        n = snprintf(dest, size, NUM_FORMAT, num);
+        return (n < 0 || (size_t)n >= size) ? -1 : n;
+    }
+
+    if ((size_t)n >= size) {
+        return -1;
+    }
+    memcpy(dest, tmp, (size_t)n);
+    dest[n] = '\0';
+
+    return n;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,324 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Session keys of known devices, MIC check and FRMPayload decryption of
+    LoRaWAN 1.0.x data frames. Devices are held in an array sorted by
+    DevAddr, filled once from the key file, so a lookup is a binary search.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdlib.h>     /* calloc free qsort */
+#include <string.h>     /* memcmp memset strcmp strlen */
+
+#include "parson.h"
+#include "mac_cmd.h"
+#include "key_store.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define B0_MIC              0x49        /* first byte of the MIC block */
+#define A_CRYPT             0x01        /* first byte of the encryption blocks */
+
+#define FHDR_END            8           /* MHDR and FHDR without FOpts */
+#define FCNT_STEP           0x10000U    /* the frame carries the low 16 bits of FCnt */
+#define NB_FCNT_TRIES       3
+
+/* JSON key fields of the key file */
+#define JSON_DEVICES        "devices"
+#define JSON_DEVADDR        "DevAddr"
+#define JSON_NWKSKEY        "NwkSKey"
+#define JSON_APPSKEY        "AppSKey"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int compare_devaddr(const void *a, const void *b) {
+    uint32_t x = ((const key_entry_t *)a)->devaddr;
+    uint32_t y = ((const key_entry_t *)b)->devaddr;
+
+    return (x > y) - (x < y);
+}
+
+/* hex string of exactly 2 * len digits to bytes, most significant first */
+static int parse_hex(const char *str, uint8_t *out, size_t len) {
+    size_t i;
+    int d, v;
+
+    if (str == NULL || strlen(str) != 2 * len) {
+        return -1;
+    }
+    for (i = 0; i < 2 * len; i++) {
+        d = str[i];
+        if (d >= '0' && d <= '9') {
+            v = d - '0';
+        } else if (d >= 'a' && d <= 'f') {
+            v = d - 'a' + 10;
+        } else if (d >= 'A' && d <= 'F') {
+            v = d - 'A' + 10;
+        } else {
+            return -1;
+        }
+        out[i / 2] = (uint8_t)((i % 2) ? (out[i / 2] | v) : (v << 4));
+    }
+
+    return 0;
+}
+
+/* block shared by the MIC and the encryption: DevAddr, FCnt and direction */
+static void frame_block(uint8_t b[AES128_BLOCK_SIZE], uint8_t first, bool uplink, uint32_t devaddr, uint32_t fcnt, uint8_t last) {
+    b[0] = first;
+    b[1] = 0;
+    b[2] = 0;
+    b[3] = 0;
+    b[4] = 0;
+    b[5] = uplink ? 0 : 1;
+    b[6] = (uint8_t)devaddr;
+    b[7] = (uint8_t)(devaddr >> 8);
+    b[8] = (uint8_t)(devaddr >> 16);
+    b[9] = (uint8_t)(devaddr >> 24);
+    b[10] = (uint8_t)fcnt;
+    b[11] = (uint8_t)(fcnt >> 8);
+    b[12] = (uint8_t)(fcnt >> 16);
+    b[13] = (uint8_t)(fcnt >> 24);
+    b[14] = 0;
+    b[15] = last;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int key_store_load(key_store_t *ks, const char *path) {
+
+    JSON_Value *root_val;
+    JSON_Array *devices;
+    JSON_Object *dev;
+    key_entry_t *e;
+    uint8_t addr[4], key[AES128_KEY_SIZE];
+    size_t i, nb;
+
+    memset(ks, 0, sizeof *ks);
+
+    root_val = json_parse_file_with_comments(path);
+    if (root_val == NULL) {
+        return -1;
+    }
+    devices = json_object_get_array(json_value_get_object(root_val), JSON_DEVICES);
+    nb = json_array_get_count(devices);
+    if (devices == NULL || nb > KEY_STORE_MAX_DEVICES) {
+        json_value_free(root_val);
+        return -1;
+    }
+
+    ks->entries = calloc((nb > 0) ? nb : 1, sizeof *ks->entries);
+    if (ks->entries == NULL) {
+        json_value_free(root_val);
+        return -1;
+    }
+    ks->count = (uint32_t)nb;
+
+    for (i = 0; i < nb; i++) {
+        dev = json_array_get_object(devices, i);
+        e = &ks->entries[i];
+        if (parse_hex(json_object_get_string(dev, JSON_DEVADDR), addr, sizeof addr)) {
+            break;
+        }
+        e->devaddr = (uint32_t)addr[0] << 24 | (uint32_t)addr[1] << 16 | (uint32_t)addr[2] << 8 | (uint32_t)addr[3];
+        if (parse_hex(json_object_get_string(dev, JSON_NWKSKEY), key, sizeof key)) {
+            break;
+        }
+        aes128_set_key(&e->nwk_skey, key);
+        if (parse_hex(json_object_get_string(dev, JSON_APPSKEY), key, sizeof key)) {
+            break;
+        }
+        aes128_set_key(&e->app_skey, key);
+    }
+    memset(key, 0, sizeof key);
+    json_value_free(root_val);
+
+    /* sorted for the lookups, a DevAddr given twice is a broken file */
+    if (i == nb) {
+        qsort(ks->entries, nb, sizeof *ks->entries, compare_devaddr);
+        for (i = 1; i < nb; i++) {
+            if (ks->entries[i].devaddr == ks->entries[i - 1].devaddr) {
+                break;
+            }
+        }
+    }
+    if (i < nb && nb > 0) {
+        key_store_free(ks);
+        return -1;
+    }
+
+    return (int)nb;
+}
+
+void key_store_free(key_store_t *ks) {
+    if (ks->entries != NULL) {
+        /* no keys left behind in the heap */
+        memset(ks->entries, 0, ks->count * sizeof *ks->entries);
+        free(ks->entries);
+    }
+    ks->entries = NULL;
+    ks->count = 0;
+}
+
+key_entry_t *key_store_find(key_store_t *ks, uint32_t devaddr) {
+
+    uint32_t lo = 0, hi = ks->count, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ks->entries[mid].devaddr < devaddr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return (lo < ks->count && ks->entries[lo].devaddr == devaddr) ? &ks->entries[lo] : NULL;
+}
+
+int key_store_process(key_store_t *ks, const struct lgw_pkt_rx_s *p, ed_report_t *report) {
+
+    key_entry_t *e;
+    bool uplink;
+    bool *seen;
+    uint32_t *last;
+    uint32_t tries[NB_FCNT_TRIES];
+    uint32_t fcnt = 0;
+    uint8_t mic[KEY_MIC_LEN];
+    uint8_t plain[ED_REPORT_DATA_LEN];
+    size_t msg_len, start, len;
+    int i;
+
+    report->mic = ED_MIC_NONE;
+
+    /* data frames long enough for a MIC, from a known device */
+    if (report->is_jr || p->size < FHDR_END + KEY_MIC_LEN) {
+        return ED_MIC_NONE;
+    }
+    if (!strcmp(report->mtype, "UDU") || !strcmp(report->mtype, "CDU")) {
+        uplink = true;
+    } else if (!strcmp(report->mtype, "UDD") || !strcmp(report->mtype, "CDD")) {
+        uplink = false;
+    } else {
+        return ED_MIC_NONE;
+    }
+    e = key_store_find(ks, report->devaddr);
+    if (e == NULL) {
+        return ED_MIC_NONE;
+    }
+
+    /* 32 bits FCnt: same upper bits as the last one, or the next ones, or a restart */
+    seen = uplink ? &e->seen_up : &e->seen_down;
+    last = uplink ? &e->fcnt_up : &e->fcnt_down;
+    tries[0] = (*last & ~(FCNT_STEP - 1)) | (report->fcnt & 0xFFFF);
+    tries[1] = tries[0] + FCNT_STEP;
+    if (*seen && tries[0] < *last && (*last - tries[0]) >= FCNT_STEP / 2) {
+        tries[1] = tries[0];
+        tries[0] += FCNT_STEP;
+    }
+    tries[2] = report->fcnt & 0xFFFF;
+
+    msg_len = p->size - KEY_MIC_LEN;
+    report->mic = ED_MIC_BAD;
+    for (i = 0; i < NB_FCNT_TRIES; i++) {
+        if (i == 2 && (tries[2] == tries[0] || tries[2] == tries[1])) {
+            break;
+        }
+        key_store_mic(&e->nwk_skey, p->payload, msg_len, uplink, report->devaddr, tries[i], mic);
+        if (memcmp(mic, &p->payload[msg_len], KEY_MIC_LEN) == 0) {
+            report->mic = ED_MIC_OK;
+            fcnt = tries[i];
+            break;
+        }
+    }
+    if (report->mic == ED_MIC_BAD) {
+        atomic_fetch_add_explicit(&ks->nb_mic_bad, 1, memory_order_relaxed);
+        return ED_MIC_BAD;
+    }
+    atomic_fetch_add_explicit(&ks->nb_mic_ok, 1, memory_order_relaxed);
+    *last = fcnt;
+    *seen = true;
+    report->fcnt = fcnt;
+
+    /* FRMPayload, between FPort and the MIC */
+    if (report->fport < 0) {
+        return ED_MIC_OK;
+    }
+    start = FHDR_END + report->foptslen + 1;
+    if (start >= msg_len) {
+        return ED_MIC_OK;
+    }
+    len = msg_len - start;
+    key_store_crypt((report->fport == 0) ? &e->nwk_skey : &e->app_skey, &p->payload[start], len, uplink, report->devaddr, fcnt, plain);
+    atomic_fetch_add_explicit(&ks->nb_decrypted, 1, memory_order_relaxed);
+
+    if (report->fport == 0) {
+        /* MAC commands, FOpts must be empty when they are sent on port 0 */
+        if (report->foptslen == 0) {
+            report->nb_mac_cmds = mac_cmd_parse(plain, len, uplink, report->mac_cmds, ED_REPORT_FOPTS_LEN, &report->mac_status);
+        }
+    } else if (ks->keep_data) {
+        memcpy(report->data, plain, len);
+        report->datalen = (uint8_t)len;
+    }
+
+    return ED_MIC_OK;
+}
+
+void key_store_mic(const aes128_ctx_t *nwk_skey, const uint8_t *msg, size_t len, bool uplink, uint32_t devaddr, uint32_t fcnt, uint8_t mic[KEY_MIC_LEN]) {
+
+    uint8_t b0[AES128_BLOCK_SIZE];
+    uint8_t cmac[AES128_BLOCK_SIZE];
+
+    frame_block(b0, B0_MIC, uplink, devaddr, fcnt, (uint8_t)len);
+    aes128_cmac(nwk_skey, b0, sizeof b0, msg, len, cmac);
+    memcpy(mic, cmac, KEY_MIC_LEN);
+}
+
+void key_store_crypt(const aes128_ctx_t *key, const uint8_t *in, size_t len, bool uplink, uint32_t devaddr, uint32_t fcnt, uint8_t *out) {
+
+    uint8_t a[AES128_BLOCK_SIZE];
+    uint8_t s[AES128_BLOCK_SIZE];
+    size_t pos, j;
+    uint8_t i = 1;
+
+    for (pos = 0; pos < len; pos += AES128_BLOCK_SIZE, i++) {
+        frame_block(a, A_CRYPT, uplink, devaddr, fcnt, i);
+        aes128_encrypt(key, a, s);
+        for (j = 0; j < AES128_BLOCK_SIZE && pos + j < len; j++) {
+            out[pos + j] = in[pos + j] ^ s[j];
+        }
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
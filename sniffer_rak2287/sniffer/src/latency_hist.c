@@ -0,0 +1,172 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Latency histograms with bounded relative error. A value with its highest
+    set bit at position msb >= LATENCY_SUB_BITS is shifted right until it
+    fits in LATENCY_SUB_BITS bits; the shift and the remaining bits give the
+    bucket, so the bucket index grows with the value and no search is needed.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <string.h>     /* memset */
+#include <math.h>       /* ceil */
+
+#include "latency_hist.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SUB_HALF    (1U << (LATENCY_SUB_BITS - 1))     /* buckets per power of two */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/**
+ * Find the bucket of a value.
+ *
+ * @param value Value
+ * @return      Bucket index
+*/
+static inline unsigned bucket_of(uint64_t value) {
+
+    unsigned shift;
+
+    if (value < (1U << LATENCY_SUB_BITS)) {
+        return (unsigned)value;
+    }
+
+    shift = (unsigned)(63 - __builtin_clzll(value)) - LATENCY_SUB_BITS + 1;
+    return shift * SUB_HALF + (unsigned)(value >> shift);
+}
+
+/**
+ * Find the range of values counted by a bucket.
+ *
+ * @param idx   Bucket index
+ * @param low   Set to the lowest value of the bucket
+ * @param high  Set to the highest value of the bucket
+*/
+static void bucket_range(unsigned idx, uint64_t *low, uint64_t *high) {
+
+    unsigned shift;
+
+    if (idx < (1U << LATENCY_SUB_BITS)) {
+        *low = idx;
+        *high = idx;
+        return;
+    }
+
+    shift = idx / SUB_HALF - 1;
+    *low = (uint64_t)(idx - shift * SUB_HALF) << shift;
+    *high = *low + ((1ULL << shift) - 1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void latency_hist_reset(latency_hist_t *h) {
+
+    memset(h, 0, sizeof *h);
+    h->min = UINT64_MAX;
+}
+
+void latency_hist_record(latency_hist_t *h, uint64_t value) {
+
+    h->buckets[bucket_of(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void latency_hist_merge(latency_hist_t *dst, const latency_hist_t *src) {
+
+    unsigned i;
+
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+uint64_t latency_hist_percentile(const latency_hist_t *h, double percentile) {
+
+    uint64_t rank, seen = 0;
+    uint64_t low, high, value;
+    unsigned i;
+
+    if (h->count == 0) {
+        return 0;
+    }
+
+    /* rank of the value wanted, from 1 to count */
+    if (percentile <= 0) {
+        return h->min;
+    }
+    rank = (uint64_t)ceil(percentile / 100.0 * (double)h->count);
+    if (rank >= h->count) {
+        return h->max;
+    }
+
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+
+    bucket_range(i, &low, &high);
+    value = low + (high - low) / 2;
+    if (value < h->min) {
+        value = h->min;
+    }
+    if (value > h->max) {
+        value = h->max;
+    }
+
+    return value;
+}
+
+double latency_hist_mean(const latency_hist_t *h) {
+
+    return (h->count > 0) ? (double)h->sum / (double)h->count : 0.0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
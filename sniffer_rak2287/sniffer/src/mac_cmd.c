@@ -0,0 +1,305 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    LoRaWAN MAC commands, split and decoded from a table indexed by
+    direction and CID. Every command length is known from its CID, and is
+    checked against the bytes left before anything is read.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <string.h>     /* memcpy memset strlen */
+
+#include "mac_cmd.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DIR_DOWN            0           /* sent by the network */
+#define DIR_UP              1           /* sent by the end device */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef void (*mac_decode_t)(const uint8_t *payload, mac_cmd_t *cmd);
+
+/* a command in one direction, a NULL name means the CID is not used in that direction */
+struct mac_cmd_def_s {
+    const char *name;
+    uint8_t len;                        /* payload length in bytes */
+    mac_decode_t decode;                /* NULL to keep the payload raw */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void decode_minor(const uint8_t *b, mac_cmd_t *c);
+static void decode_link_check_ans(const uint8_t *b, mac_cmd_t *c);
+static void decode_link_adr_req(const uint8_t *b, mac_cmd_t *c);
+static void decode_link_adr_ans(const uint8_t *b, mac_cmd_t *c);
+static void decode_duty_cycle_req(const uint8_t *b, mac_cmd_t *c);
+static void decode_rx_param_setup_req(const uint8_t *b, mac_cmd_t *c);
+static void decode_rx_param_setup_ans(const uint8_t *b, mac_cmd_t *c);
+static void decode_dev_status_ans(const uint8_t *b, mac_cmd_t *c);
+static void decode_new_channel_req(const uint8_t *b, mac_cmd_t *c);
+static void decode_new_channel_ans(const uint8_t *b, mac_cmd_t *c);
+static void decode_rx_timing_setup_req(const uint8_t *b, mac_cmd_t *c);
+static void decode_tx_param_setup_req(const uint8_t *b, mac_cmd_t *c);
+static void decode_dl_channel_req(const uint8_t *b, mac_cmd_t *c);
+static void decode_dl_channel_ans(const uint8_t *b, mac_cmd_t *c);
+static void decode_device_time_ans(const uint8_t *b, mac_cmd_t *c);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* LoRaWAN 1.0.4 and 1.1 MAC commands, class B commands included */
+static const struct mac_cmd_def_s mac_cmd_defs[2][MAC_CID_NB] = {
+    [DIR_DOWN] = {
+        [MAC_CID_RESET]                 = {"ResetConf",             1, decode_minor},
+        [MAC_CID_LINK_CHECK]            = {"LinkCheckAns",          2, decode_link_check_ans},
+        [MAC_CID_LINK_ADR]              = {"LinkADRReq",            4, decode_link_adr_req},
+        [MAC_CID_DUTY_CYCLE]            = {"DutyCycleReq",          1, decode_duty_cycle_req},
+        [MAC_CID_RX_PARAM_SETUP]        = {"RXParamSetupReq",       4, decode_rx_param_setup_req},
+        [MAC_CID_DEV_STATUS]            = {"DevStatusReq",          0, NULL},
+        [MAC_CID_NEW_CHANNEL]           = {"NewChannelReq",         5, decode_new_channel_req},
+        [MAC_CID_RX_TIMING_SETUP]       = {"RXTimingSetupReq",      1, decode_rx_timing_setup_req},
+        [MAC_CID_TX_PARAM_SETUP]        = {"TxParamSetupReq",       1, decode_tx_param_setup_req},
+        [MAC_CID_DL_CHANNEL]            = {"DlChannelReq",          4, decode_dl_channel_req},
+        [MAC_CID_REKEY]                 = {"RekeyConf",             1, decode_minor},
+        [MAC_CID_ADR_PARAM_SETUP]       = {"ADRParamSetupReq",      1, NULL},
+        [MAC_CID_DEVICE_TIME]           = {"DeviceTimeAns",         5, decode_device_time_ans},
+        [MAC_CID_FORCE_REJOIN]          = {"ForceRejoinReq",        2, NULL},
+        [MAC_CID_REJOIN_PARAM_SETUP]    = {"RejoinParamSetupReq",   1, NULL},
+        [MAC_CID_PING_SLOT_INFO]        = {"PingSlotInfoAns",       0, NULL},
+        [MAC_CID_PING_SLOT_CHANNEL]     = {"PingSlotChannelReq",    4, NULL},
+        [MAC_CID_BEACON_TIMING]         = {"BeaconTimingAns",       3, NULL},
+        [MAC_CID_BEACON_FREQ]           = {"BeaconFreqReq",         3, NULL},
+        [MAC_CID_DEVICE_MODE]           = {"DeviceModeConf",        1, NULL},
+    },
+    [DIR_UP] = {
+        [MAC_CID_RESET]                 = {"ResetInd",              1, decode_minor},
+        [MAC_CID_LINK_CHECK]            = {"LinkCheckReq",          0, NULL},
+        [MAC_CID_LINK_ADR]              = {"LinkADRAns",            1, decode_link_adr_ans},
+        [MAC_CID_DUTY_CYCLE]            = {"DutyCycleAns",          0, NULL},
+        [MAC_CID_RX_PARAM_SETUP]        = {"RXParamSetupAns",       1, decode_rx_param_setup_ans},
+        [MAC_CID_DEV_STATUS]            = {"DevStatusAns",          2, decode_dev_status_ans},
+        [MAC_CID_NEW_CHANNEL]           = {"NewChannelAns",         1, decode_new_channel_ans},
+        [MAC_CID_RX_TIMING_SETUP]       = {"RXTimingSetupAns",      0, NULL},
+        [MAC_CID_TX_PARAM_SETUP]        = {"TxParamSetupAns",       0, NULL},
+        [MAC_CID_DL_CHANNEL]            = {"DlChannelAns",          1, decode_dl_channel_ans},
+        [MAC_CID_REKEY]                 = {"RekeyInd",              1, decode_minor},
+        [MAC_CID_ADR_PARAM_SETUP]       = {"ADRParamSetupAns",      0, NULL},
+        [MAC_CID_DEVICE_TIME]           = {"DeviceTimeReq",         0, NULL},
+        [MAC_CID_REJOIN_PARAM_SETUP]    = {"RejoinParamSetupAns",   1, NULL},
+        [MAC_CID_PING_SLOT_INFO]        = {"PingSlotInfoReq",       1, NULL},
+        [MAC_CID_PING_SLOT_CHANNEL]     = {"PingSlotChannelAns",    1, NULL},
+        [MAC_CID_BEACON_TIMING]         = {"BeaconTimingReq",       0, NULL},
+        [MAC_CID_BEACON_FREQ]           = {"BeaconFreqAns",         1, NULL},
+        [MAC_CID_DEVICE_MODE]           = {"DeviceModeInd",         1, NULL},
+    },
+};
+
+static const char *status_str[] = {"ok", "unknown", "truncated", "too many"};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* 24 bits little endian frequency, in steps of 100 Hz */
+static inline uint32_t get_freq(const uint8_t *b) {
+    return ((uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16) * 100;
+}
+
+static void decode_minor(const uint8_t *b, mac_cmd_t *c) {
+    c->u.minor = b[0] & 0x0F;
+}
+
+static void decode_link_check_ans(const uint8_t *b, mac_cmd_t *c) {
+    c->u.link_check_ans.margin = b[0];
+    c->u.link_check_ans.gw_cnt = b[1];
+}
+
+static void decode_link_adr_req(const uint8_t *b, mac_cmd_t *c) {
+    c->u.link_adr_req.datarate = b[0] >> 4;
+    c->u.link_adr_req.tx_power = b[0] & 0x0F;
+    c->u.link_adr_req.ch_mask = (uint16_t)(b[1] | b[2] << 8);
+    c->u.link_adr_req.ch_mask_cntl = (b[3] >> 4) & 0x07;
+    c->u.link_adr_req.nb_trans = b[3] & 0x0F;
+}
+
+static void decode_link_adr_ans(const uint8_t *b, mac_cmd_t *c) {
+    c->u.link_adr_ans.power_ack = (b[0] & 0x04) ? true : false;
+    c->u.link_adr_ans.datarate_ack = (b[0] & 0x02) ? true : false;
+    c->u.link_adr_ans.ch_mask_ack = (b[0] & 0x01) ? true : false;
+}
+
+static void decode_duty_cycle_req(const uint8_t *b, mac_cmd_t *c) {
+    c->u.duty_cycle_req.max_dcycle = b[0] & 0x0F;
+}
+
+static void decode_rx_param_setup_req(const uint8_t *b, mac_cmd_t *c) {
+    c->u.rx_param_setup_req.rx1_dr_offset = (b[0] >> 4) & 0x07;
+    c->u.rx_param_setup_req.rx2_datarate = b[0] & 0x0F;
+    c->u.rx_param_setup_req.freq_hz = get_freq(&b[1]);
+}
+
+static void decode_rx_param_setup_ans(const uint8_t *b, mac_cmd_t *c) {
+    c->u.rx_param_setup_ans.rx1_dr_offset_ack = (b[0] & 0x04) ? true : false;
+    c->u.rx_param_setup_ans.rx2_datarate_ack = (b[0] & 0x02) ? true : false;
+    c->u.rx_param_setup_ans.channel_ack = (b[0] & 0x01) ? true : false;
+}
+
+static void decode_dev_status_ans(const uint8_t *b, mac_cmd_t *c) {
+    c->u.dev_status_ans.battery = b[0];
+    /* 6 bits two's complement */
+    c->u.dev_status_ans.margin = (int8_t)(((b[1] & 0x3F) ^ 0x20) - 0x20);
+}
+
+static void decode_new_channel_req(const uint8_t *b, mac_cmd_t *c) {
+    c->u.new_channel_req.ch_index = b[0];
+    c->u.new_channel_req.freq_hz = get_freq(&b[1]);
+    c->u.new_channel_req.max_dr = b[4] >> 4;
+    c->u.new_channel_req.min_dr = b[4] & 0x0F;
+}
+
+static void decode_new_channel_ans(const uint8_t *b, mac_cmd_t *c) {
+    c->u.new_channel_ans.datarate_ok = (b[0] & 0x02) ? true : false;
+    c->u.new_channel_ans.channel_freq_ok = (b[0] & 0x01) ? true : false;
+}
+
+static void decode_rx_timing_setup_req(const uint8_t *b, mac_cmd_t *c) {
+    c->u.rx_timing_setup_req.delay = b[0] & 0x0F;
+}
+
+static void decode_tx_param_setup_req(const uint8_t *b, mac_cmd_t *c) {
+    c->u.tx_param_setup_req.downlink_dwell = (b[0] & 0x20) ? true : false;
+    c->u.tx_param_setup_req.uplink_dwell = (b[0] & 0x10) ? true : false;
+    c->u.tx_param_setup_req.max_eirp = b[0] & 0x0F;
+}
+
+static void decode_dl_channel_req(const uint8_t *b, mac_cmd_t *c) {
+    c->u.dl_channel_req.ch_index = b[0];
+    c->u.dl_channel_req.freq_hz = get_freq(&b[1]);
+}
+
+static void decode_dl_channel_ans(const uint8_t *b, mac_cmd_t *c) {
+    c->u.dl_channel_ans.uplink_freq_exists = (b[0] & 0x02) ? true : false;
+    c->u.dl_channel_ans.channel_freq_ok = (b[0] & 0x01) ? true : false;
+}
+
+static void decode_device_time_ans(const uint8_t *b, mac_cmd_t *c) {
+    c->u.device_time_ans.seconds = (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+    c->u.device_time_ans.fraction = b[4];
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int mac_cmd_parse(const uint8_t *buf, size_t len, bool uplink, mac_cmd_t *cmds, int max, uint8_t *status) {
+
+    const struct mac_cmd_def_s *defs = mac_cmd_defs[uplink ? DIR_UP : DIR_DOWN];
+    const struct mac_cmd_def_s *def;
+    mac_cmd_t *c;
+    size_t pos = 0;
+    int nb = 0;
+    uint8_t cid;
+
+    *status = MAC_CMD_OK;
+
+    while (pos < len) {
+        cid = buf[pos];
+        if (cid >= MAC_CID_NB || defs[cid].name == NULL) {
+            *status = MAC_CMD_UNKNOWN;
+            break;
+        }
+        def = &defs[cid];
+        if (def->len > len - pos - 1) {
+            *status = MAC_CMD_TRUNCATED;
+            break;
+        }
+        if (nb >= max) {
+            *status = MAC_CMD_TOO_MANY;
+            break;
+        }
+
+        c = &cmds[nb++];
+        memset(c, 0, sizeof *c);
+        c->cid = cid;
+        c->uplink = uplink;
+        c->len = def->len;
+        if (def->decode != NULL) {
+            def->decode(&buf[pos + 1], c);
+        } else {
+            memcpy(c->u.raw, &buf[pos + 1], def->len);
+        }
+        pos += 1 + def->len;
+    }
+
+    return nb;
+}
+
+const char *mac_cmd_name(uint8_t cid, bool uplink) {
+    return (cid < MAC_CID_NB) ? mac_cmd_defs[uplink ? DIR_UP : DIR_DOWN][cid].name : NULL;
+}
+
+const char *mac_cmd_status_str(uint8_t status) {
+    return (status < sizeof status_str / sizeof status_str[0]) ? status_str[status] : "error";
+}
+
+int mac_cmd_list(const mac_cmd_t *cmds, int nb, char *buf, size_t size) {
+
+    const char *name;
+    size_t len = 0, n;
+    int i;
+
+    if (size == 0) {
+        return -1;
+    }
+    buf[0] = '\0';
+
+    for (i = 0; i < nb; i++) {
+        name = mac_cmd_name(cmds[i].cid, cmds[i].uplink);
+        if (name == NULL) {
+            name = "Unknown";
+        }
+        n = strlen(name);
+        if (len + (i > 0) + n + 1 > size) {
+            buf[0] = '\0';
+            return -1;
+        }
+        if (i > 0) {
+            buf[len++] = ',';
+        }
+        memcpy(&buf[len], name, n + 1);
+        len += n;
+    }
+
+    return (int)len;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,338 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Runtime metrics in the Prometheus text exposition format, and the
+    server thread answering scrapes. Connections are served one at a time
+    and closed after the response, which is all a scraper needs.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 700
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdio.h>      /* snprintf vsnprintf */
+#include <stdarg.h>     /* va_list */
+#include <stdlib.h>     /* realloc free */
+#include <string.h>     /* memset strstr strncmp */
+#include <unistd.h>     /* close read */
+#include <poll.h>       /* poll */
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "metrics.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define REQUEST_LEN         2048        /* request head kept, the rest is ignored */
+#define ACCEPT_POLL_MS      500         /* how often the server thread checks if it must stop */
+#define CLIENT_TIMEOUT_S    2           /* read and write timeout of a scrape */
+
+/* upper bounds of the histogram buckets (us) */
+static const uint64_t hist_bounds_us[METRICS_HIST_BOUNDS] = {
+    1, 5, 10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000, 10000000
+};
+
+/* the same bounds as they are printed in the le label (s) */
+static const char *hist_bounds_s[METRICS_HIST_BOUNDS] = {
+    "1e-06", "5e-06", "1e-05", "5e-05", "0.0001", "0.0005", "0.001", "0.005", "0.01", "0.05", "0.1", "0.5", "1", "5", "10"
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/**
+ * Append formatted text to the page, growing it as needed.
+ *
+ * @param out   Page
+ * @param fmt   printf format
+*/
+static void out_printf(metrics_out_t *out, const char *fmt, ...) {
+
+    va_list ap;
+    int n;
+    size_t cap;
+    char *data;
+
+    if (out->full) {
+        return;
+    }
+
+    while (1) {
+        va_start(ap, fmt);
+        n = vsnprintf(out->data + out->len, out->cap - out->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            out->full = true;
+            return;
+        }
+        if (out->data != NULL && out->len + (size_t)n < out->cap) {
+            out->len += (size_t)n;
+            return;
+        }
+
+        /* grow, leaving room for the terminator */
+        cap = (out->cap > 0) ? out->cap * 2 : 4096;
+        while (cap < out->len + (size_t)n + 1) {
+            cap *= 2;
+        }
+        if (cap > METRICS_OUT_MAX) {
+            out->full = true;
+            return;
+        }
+        data = realloc(out->data, cap);
+        if (data == NULL) {
+            out->full = true;
+            return;
+        }
+        out->data = data;
+        out->cap = cap;
+    }
+}
+
+/**
+ * Write a whole buffer to a socket. A scraper that hangs up early only fails
+ * the write, it does not raise SIGPIPE.
+ *
+ * @param fd    Socket
+ * @param buf   Data
+ * @param len   Length of the data
+ * @return      0 on success, -1 otherwise
+*/
+static int write_all(int fd, const char *buf, size_t len) {
+
+    ssize_t n;
+
+    while (len > 0) {
+        n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+
+    return 0;
+}
+
+/**
+ * Answer one scrape: read the request head, render the page and send it back.
+ *
+ * @param srv   Server
+ * @param fd    Connection
+*/
+static void serve(metrics_server_t *srv, int fd) {
+
+    char req[REQUEST_LEN + 1];
+    char head[160];
+    size_t have = 0;
+    ssize_t n;
+    int len;
+    const char *status = "200 OK";
+
+    /* request line and headers, bodies are not expected */
+    while (have < REQUEST_LEN) {
+        n = read(fd, req + have, REQUEST_LEN - have);
+        if (n <= 0) {
+            return;
+        }
+        have += (size_t)n;
+        req[have] = '\0';
+        if (strstr(req, "\r\n\r\n") != NULL || strstr(req, "\n\n") != NULL) {
+            break;
+        }
+    }
+    req[have] = '\0';
+
+    srv->out.len = 0;
+    srv->out.full = false;
+
+    if (strncmp(req, "GET /metrics ", 13) != 0 && strncmp(req, "GET /metrics?", 13) != 0 && strncmp(req, "GET / ", 6) != 0) {
+        status = "404 Not Found";
+        out_printf(&srv->out, "not found, metrics are at /metrics\n");
+    } else if (srv->render(&srv->out, srv->arg) != 0 || srv->out.full) {
+        status = "500 Internal Server Error";
+        srv->out.len = 0;
+        srv->out.full = false;
+        out_printf(&srv->out, "metrics could not be rendered\n");
+    } else {
+        atomic_fetch_add_explicit(&srv->scrapes, 1, memory_order_relaxed);
+    }
+
+    len = snprintf(head, sizeof head, "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+                   status, METRICS_CONTENT_TYPE, (unsigned long)srv->out.len);
+    if (write_all(fd, head, (size_t)len) == 0 && srv->out.len > 0) {
+        write_all(fd, srv->out.data, srv->out.len);
+    }
+}
+
+static void *server_thread(void *arg) {
+
+    metrics_server_t *srv = (metrics_server_t *)arg;
+    struct pollfd pfd;
+    struct timeval tv = {CLIENT_TIMEOUT_S, 0};
+    int fd;
+
+    pfd.fd = srv->fd;
+    pfd.events = POLLIN;
+
+    while (!atomic_load(&srv->stop)) {
+        if (poll(&pfd, 1, ACCEPT_POLL_MS) <= 0) {
+            continue;
+        }
+        fd = accept(srv->fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        /* a stuck scraper must not hold the server */
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+        serve(srv, fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void metrics_hist_observe(metrics_hist_t *h, uint64_t us) {
+
+    int i = 0;
+
+    while (i < METRICS_HIST_BOUNDS && us > hist_bounds_us[i]) {
+        i++;
+    }
+    atomic_fetch_add_explicit(&h->buckets[i], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_us, us, memory_order_relaxed);
+}
+
+void metrics_family(metrics_out_t *out, const char *name, const char *type, const char *help) {
+
+    out_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_sample(metrics_out_t *out, const char *name, const char *labels, double value) {
+
+    if (labels != NULL && labels[0] != '\0') {
+        out_printf(out, "%s{%s} %.15g\n", name, labels, value);
+    } else {
+        out_printf(out, "%s %.15g\n", name, value);
+    }
+}
+
+void metrics_sample_hist(metrics_out_t *out, const char *name, const char *labels, metrics_hist_t *h) {
+
+    int i;
+    uint64_t count = 0;
+    const char *sep = (labels != NULL && labels[0] != '\0') ? "," : "";
+
+    if (labels == NULL) {
+        labels = "";
+    }
+
+    /* buckets are read one by one, a scrape can see a value in the count but not yet in the sum */
+    for (i = 0; i <= METRICS_HIST_BOUNDS; i++) {
+        count += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        out_printf(out, "%s_bucket{%s%sle=\"%s\"} %llu\n", name, labels, sep,
+                   (i < METRICS_HIST_BOUNDS) ? hist_bounds_s[i] : "+Inf", (unsigned long long)count);
+    }
+    if (labels[0] != '\0') {
+        out_printf(out, "%s_sum{%s} %.15g\n%s_count{%s} %llu\n", name, labels,
+                   atomic_load_explicit(&h->sum_us, memory_order_relaxed) / 1e6, name, labels, (unsigned long long)count);
+    } else {
+        out_printf(out, "%s_sum %.15g\n%s_count %llu\n", name,
+                   atomic_load_explicit(&h->sum_us, memory_order_relaxed) / 1e6, name, (unsigned long long)count);
+    }
+}
+
+int metrics_server_start(metrics_server_t *srv, const char *addr, uint16_t port, metrics_render_t render, void *arg) {
+
+    struct sockaddr_in sa;
+    socklen_t len = sizeof sa;
+    int one = 1;
+
+    memset(srv, 0, sizeof *srv);
+    srv->fd = -1;
+    atomic_init(&srv->stop, false);
+    atomic_init(&srv->scrapes, 0);
+    srv->render = render;
+    srv->arg = arg;
+
+    memset(&sa, 0, sizeof sa);
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    if (render == NULL || inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+        return -1;
+    }
+
+    srv->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (srv->fd < 0) {
+        return -1;
+    }
+    setsockopt(srv->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (bind(srv->fd, (struct sockaddr *)&sa, sizeof sa) || listen(srv->fd, 8) || getsockname(srv->fd, (struct sockaddr *)&sa, &len)) {
+        close(srv->fd);
+        srv->fd = -1;
+        return -1;
+    }
+    srv->port = ntohs(sa.sin_port);
+
+    if (pthread_create(&srv->thrid, NULL, server_thread, srv)) {
+        close(srv->fd);
+        srv->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+void metrics_server_stop(metrics_server_t *srv) {
+
+    if (srv->fd < 0) {
+        return;
+    }
+
+    atomic_store(&srv->stop, true);
+    pthread_join(srv->thrid, NULL);
+    close(srv->fd);
+    srv->fd = -1;
+    free(srv->out.data);
+    memset(&srv->out, 0, sizeof srv->out);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
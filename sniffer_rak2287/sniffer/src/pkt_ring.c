@@ -0,0 +1,165 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Lock-free single-producer/single-consumer ring of received packets.
+    The producer publishes slots with a release store of the head, and the
+    consumer hands them back with a release store of the tail, so each side
+    only ever writes its own index.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdlib.h>     /* calloc free */
+#include <string.h>     /* memcpy memset */
+
+#include "pkt_ring.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PKT_RING_MAX_SIZE   (1U << 20)  /* sanity limit on the number of slots */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int pkt_ring_init(pkt_ring_t *r, uint32_t capacity) {
+
+    uint32_t size = 1;
+
+    memset(r, 0, sizeof *r);
+
+    if (capacity == 0 || capacity > PKT_RING_MAX_SIZE) {
+        return -1;
+    }
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    r->slots = calloc(size, sizeof *r->slots);
+    if (r->slots == NULL) {
+        return -1;
+    }
+
+    r->size = size;
+    r->mask = size - 1;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->overflow, 0);
+    atomic_init(&r->high_water, 0);
+
+    return 0;
+}
+
+void pkt_ring_free(pkt_ring_t *r) {
+
+    free(r->slots);
+    r->slots = NULL;
+    r->size = 0;
+    r->mask = 0;
+}
+
+uint32_t pkt_ring_write_span(pkt_ring_t *r, struct lgw_pkt_rx_s **slots) {
+
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    uint32_t free_slots = r->size - (head - tail);
+    uint32_t to_end = r->size - (head & r->mask);
+
+    *slots = &r->slots[head & r->mask];
+
+    return (free_slots < to_end) ? free_slots : to_end;
+}
+
+void pkt_ring_commit(pkt_ring_t *r, uint32_t nb) {
+
+    uint32_t head, tail, used;
+
+    if (nb == 0) {
+        return;
+    }
+
+    head = atomic_load_explicit(&r->head, memory_order_relaxed) + nb;
+    atomic_store_explicit(&r->head, head, memory_order_release);
+
+    /* Only the producer writes the high water mark */
+    tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    used = head - tail;
+    if (used > atomic_load_explicit(&r->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&r->high_water, used, memory_order_relaxed);
+    }
+}
+
+int pkt_ring_push(pkt_ring_t *r, const struct lgw_pkt_rx_s *pkt) {
+
+    struct lgw_pkt_rx_s *slot;
+
+    if (pkt_ring_write_span(r, &slot) == 0) {
+        pkt_ring_drop(r, 1);
+        return -1;
+    }
+
+    memcpy(slot, pkt, sizeof *slot);
+    pkt_ring_commit(r, 1);
+
+    return 0;
+}
+
+void pkt_ring_drop(pkt_ring_t *r, uint32_t nb) {
+
+    atomic_fetch_add_explicit(&r->overflow, nb, memory_order_relaxed);
+}
+
+struct lgw_pkt_rx_s *pkt_ring_peek(pkt_ring_t *r) {
+
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    if (head == tail) {
+        return NULL;
+    }
+
+    return &r->slots[tail & r->mask];
+}
+
+void pkt_ring_release(pkt_ring_t *r) {
+
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+uint32_t pkt_ring_count(pkt_ring_t *r) {
+
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    return head - tail;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
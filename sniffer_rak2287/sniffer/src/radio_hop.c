@@ -0,0 +1,191 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Description:
+    Radio group hopping schedule of one concentrator card.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <string.h>     /* memset */
+
+#include "radio_hop.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int radio_hop_init(radio_hop_t *h, int nb_groups, int first, int mode, uint32_t dwell_ms,
+                   uint32_t dwell_min_ms, uint32_t dwell_max_ms, uint64_t now_us) {
+
+    int i;
+
+    if (nb_groups < 1 || nb_groups > RADIO_HOP_MAX_GROUPS || first < 0 || first >= nb_groups) {
+        return -1;
+    }
+    if ((mode != RADIO_HOP_FIXED && mode != RADIO_HOP_TRAFFIC) || dwell_ms == 0 || dwell_min_ms == 0 || dwell_min_ms > dwell_max_ms) {
+        return -1;
+    }
+
+    memset(h, 0, sizeof *h);
+
+    h->nb_groups = nb_groups;
+    h->mode = mode;
+    h->dwell_ms = dwell_ms;
+    h->dwell_min_ms = dwell_min_ms;
+    h->dwell_max_ms = dwell_max_ms;
+    h->start_us = now_us;
+
+    for (i = 0; i < RADIO_HOP_MAX_GROUPS; i++) {
+        h->left_us[i] = now_us; /* unheard since the start */
+        h->rate[i] = -1.0;
+        atomic_init(&h->packets[i], 0);
+        atomic_init(&h->listen_us[i], 0);
+        atomic_init(&h->visits[i], 0);
+        atomic_init(&h->gap_max_us[i], 0);
+    }
+    atomic_init(&h->current, first);
+    atomic_init(&h->since_us, now_us);
+    atomic_init(&h->hops, 0);
+    atomic_init(&h->dead_us, 0);
+
+    h->due_us = now_us + (uint64_t)radio_hop_dwell_ms(h, first) * 1000;
+
+    return 0;
+}
+
+void radio_hop_count(radio_hop_t *h, int group, uint32_t nb_pkt) {
+
+    if (group >= 0 && group < h->nb_groups) {
+        atomic_fetch_add_explicit(&h->packets[group], nb_pkt, memory_order_relaxed);
+    }
+}
+
+uint32_t radio_hop_dwell_ms(const radio_hop_t *h, int group) {
+
+    double sum = 0.0, dwell;
+    int i;
+
+    if (h->mode == RADIO_HOP_FIXED) {
+        return h->dwell_ms;
+    }
+
+    /* first round: every group gets the same dwell until its traffic is known */
+    for (i = 0; i < h->nb_groups; i++) {
+        if (h->rate[i] < 0.0) {
+            return h->dwell_ms;
+        }
+        sum += h->rate[i] + RADIO_HOP_RATE_FLOOR;
+    }
+
+    /* share of a round proportional to the traffic of the group, a round lasting nb_groups * dwell_ms */
+    dwell = (double)h->dwell_ms * h->nb_groups * (h->rate[group] + RADIO_HOP_RATE_FLOOR) / sum;
+    if (dwell < h->dwell_min_ms) {
+        return h->dwell_min_ms;
+    }
+    if (dwell > h->dwell_max_ms) {
+        return h->dwell_max_ms;
+    }
+
+    return (uint32_t)dwell;
+}
+
+int radio_hop_next(const radio_hop_t *h, uint64_t now_us) {
+
+    if (h->nb_groups < 2 || now_us < h->due_us) {
+        return -1;
+    }
+
+    return (atomic_load_explicit(&h->current, memory_order_relaxed) + 1) % h->nb_groups;
+}
+
+void radio_hop_tuned(radio_hop_t *h, int group, uint64_t start_us, uint64_t end_us) {
+
+    int old = atomic_load_explicit(&h->current, memory_order_relaxed);
+    uint64_t since = atomic_load_explicit(&h->since_us, memory_order_relaxed);
+    uint64_t packets, listened, gap;
+    double rate;
+
+    /* end of the visit of the current group */
+    if (start_us > since) {
+        listened = start_us - since;
+        packets = atomic_load_explicit(&h->packets[old], memory_order_relaxed) - h->seen[old];
+        rate = packets * 1e6 / listened;
+        h->rate[old] = (h->rate[old] < 0.0) ? rate : (h->rate[old] + rate) / 2;
+        atomic_fetch_add_explicit(&h->listen_us[old], listened, memory_order_relaxed);
+        atomic_fetch_add_explicit(&h->visits[old], 1, memory_order_relaxed);
+    }
+    h->left_us[old] = start_us;
+
+    /* the new group went unheard since it was left */
+    if (end_us > h->left_us[group]) {
+        gap = end_us - h->left_us[group];
+        if (gap > atomic_load_explicit(&h->gap_max_us[group], memory_order_relaxed)) {
+            atomic_store_explicit(&h->gap_max_us[group], gap, memory_order_relaxed);
+        }
+    }
+
+    if (end_us > start_us) {
+        atomic_fetch_add_explicit(&h->dead_us, end_us - start_us, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&h->hops, 1, memory_order_relaxed);
+
+    h->seen[group] = atomic_load_explicit(&h->packets[group], memory_order_relaxed);
+    atomic_store_explicit(&h->current, group, memory_order_relaxed);
+    atomic_store_explicit(&h->since_us, end_us, memory_order_relaxed);
+    h->due_us = end_us + (uint64_t)radio_hop_dwell_ms(h, group) * 1000;
+}
+
+void radio_hop_stats(radio_hop_t *h, uint64_t now_us, radio_hop_stats_t *s) {
+
+    uint64_t since;
+    int i;
+
+    memset(s, 0, sizeof *s);
+
+    s->nb_groups = h->nb_groups;
+    s->current = atomic_load_explicit(&h->current, memory_order_relaxed);
+    since = atomic_load_explicit(&h->since_us, memory_order_relaxed);
+    s->elapsed_us = (now_us > h->start_us) ? now_us - h->start_us : 0;
+    s->hops = atomic_load_explicit(&h->hops, memory_order_relaxed);
+    s->dead_us = atomic_load_explicit(&h->dead_us, memory_order_relaxed);
+
+    for (i = 0; i < h->nb_groups; i++) {
+        s->packets[i] = atomic_load_explicit(&h->packets[i], memory_order_relaxed);
+        s->listen_us[i] = atomic_load_explicit(&h->listen_us[i], memory_order_relaxed);
+        s->visits[i] = atomic_load_explicit(&h->visits[i], memory_order_relaxed);
+        s->gap_max_us[i] = atomic_load_explicit(&h->gap_max_us[i], memory_order_relaxed);
+        if (i == s->current && now_us > since) {
+            s->listen_us[i] += now_us - since; /* visit in progress */
+        }
+        if (s->listen_us[i] > 0 || i == s->current) {
+            s->covered++;
+        }
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,117 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Replay of raw packet captures, paced from count_us.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <string.h>     /* memset */
+
+#include "replay.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int replay_open(replay_t *rp, const char *path, double speed) {
+
+    memset(rp, 0, sizeof *rp);
+    if (speed < 0) {
+        return -1;
+    }
+    rp->speed = speed;
+
+    return capture_reader_open(&rp->cr, path);
+}
+
+int replay_next(replay_t *rp, capture_rec_t *rec, uint64_t *due_us) {
+
+    int x;
+    uint8_t c;
+    int32_t count_gap_us;
+    int64_t wall_gap_us;
+    uint64_t t_us;
+
+    x = capture_reader_next(&rp->cr, rec);
+    if (x != 1) {
+        return x;
+    }
+
+    if (!rp->started) {
+        rp->started = true;
+        rp->first_ns = rec->time_ns;
+    }
+
+    c = rec->card;
+    if (!rp->card_seen[c]) {
+        /* first packet of a card, placed by its fetch time */
+        rp->card_seen[c] = true;
+        t_us = (rec->time_ns > rp->first_ns) ? (rec->time_ns - rp->first_ns) / 1000 : 0;
+    } else {
+        /* same card, spaced as the concentrator counter saw it unless the wall clock disagrees,
+           packets fetched together can come slightly out of counter order */
+        count_gap_us = (int32_t)(rec->pkt.count_us - rp->card_count_us[c]);
+        wall_gap_us = ((int64_t)rec->time_ns - (int64_t)rp->card_ns[c]) / 1000;
+        if (wall_gap_us < 0) {
+            wall_gap_us = 0;
+        }
+        if ((int64_t)count_gap_us > wall_gap_us + REPLAY_RESYNC_US || (int64_t)count_gap_us + REPLAY_RESYNC_US < wall_gap_us) {
+            t_us = rp->card_us[c] + (uint64_t)wall_gap_us;
+            rp->resyncs++;
+        } else if (count_gap_us < 0 && (uint64_t)(-(int64_t)count_gap_us) > rp->card_us[c]) {
+            t_us = 0;
+        } else {
+            t_us = (uint64_t)((int64_t)rp->card_us[c] + count_gap_us);
+        }
+    }
+    rp->card_count_us[c] = rec->pkt.count_us;
+    rp->card_ns[c] = rec->time_ns;
+    rp->card_us[c] = t_us;
+
+    /* records come out in capture order, the schedule never goes back */
+    if (t_us > rp->capture_us) {
+        rp->capture_us = t_us;
+    }
+
+    if (rp->speed > 0) {
+        *due_us = (uint64_t)(rp->capture_us / rp->speed);
+    } else {
+        *due_us = 0;
+    }
+    rp->packets++;
+
+    return 1;
+}
+
+void replay_close(replay_t *rp) {
+
+    capture_reader_close(&rp->cr);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,624 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Binary encoding of the end device reports, CBOR maps with integer keys
+    framed with COBS over the newline byte, and the reference decoder.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#define _GNU_SOURCE     /* getline */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* fopen getline fwrite snprintf */
+#include <stdlib.h>     /* free */
+#include <string.h>     /* memcpy memset strcmp strcpy */
+#include <math.h>       /* lround */
+#include <time.h>       /* gmtime_r strftime */
+
+#include "mac_cmd.h"
+#include "report_cbor.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+/* CBOR major types */
+#define MAJOR_UINT          0
+#define MAJOR_NEG           1
+#define MAJOR_BYTES         2
+#define MAJOR_TEXT          3
+#define MAJOR_MAP           5
+#define MAJOR_TAG           6
+#define MAJOR_SIMPLE        7
+
+#define CBOR_FALSE          20
+#define CBOR_TRUE           21
+#define CBOR_TAG_SELF       55799       /* self-described CBOR, d9 d9 f7 */
+
+#define CBOR_RAW_MAX        384         /* longest unframed record: 20 members, 15 bytes FOpts, 255 bytes data */
+#define FRAME_XOR           0x0A        /* framed records never hold this byte, the segment line separator */
+
+/* map keys */
+#define KEY_VERSION         0
+#define KEY_TIME            1
+#define KEY_MTYPE           2
+#define KEY_CRC             3
+#define KEY_FREQ            4
+#define KEY_SF              5
+#define KEY_RSSI            6
+#define KEY_TOA             7
+#define KEY_FRMLEN          8
+#define KEY_SNR             9
+#define KEY_FCNT            10
+#define KEY_DEVADDR         11
+#define KEY_ADR             12
+#define KEY_ACK             13
+#define KEY_FPORT           14
+#define KEY_FOPTS           15
+#define KEY_MIC             16
+#define KEY_DATA            17
+#define KEY_APP_EUI         18
+#define KEY_DEV_EUI         19
+#define KEY_NB              20
+
+/* members every record of a kind carries */
+#define KEYS_COMMON         ((1U << KEY_VERSION) | (1U << KEY_TIME) | (1U << KEY_MTYPE) | (1U << KEY_CRC) | (1U << KEY_FREQ) | \
+                             (1U << KEY_SF) | (1U << KEY_RSSI) | (1U << KEY_TOA) | (1U << KEY_FRMLEN) | (1U << KEY_SNR))
+#define KEYS_JR             (KEYS_COMMON | (1U << KEY_APP_EUI) | (1U << KEY_DEV_EUI))
+#define KEYS_FRAME          (KEYS_COMMON | (1U << KEY_FCNT) | (1U << KEY_DEVADDR) | (1U << KEY_ADR) | (1U << KEY_ACK))
+
+#define MTYPE_JR            0
+#define MTYPE_RFU           6
+#define MTYPE_PRP           7
+
+/* MType strings of ed_report_write, in MHDR.MType order, join accepts are left empty */
+static const char *mtype_names[8] = {"JR", "", "UDU", "UDD", "CDU", "CDD", "RFU", "PRP"};
+
+/* CRC strings of ed_report_write */
+static const char *crc_names[5] = {"OK", "BAD", "NONE", "UNDEF", "ERR"};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* CBOR reader over an unframed record */
+typedef struct cbor_reader_s {
+    const uint8_t *p;
+    const uint8_t *end;
+} cbor_reader_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static inline uint8_t *put_head(uint8_t *p, uint8_t major, uint64_t v) {
+
+    int i;
+
+    major = (uint8_t)(major << 5);
+    if (v < 24) {
+        *p++ = major | (uint8_t)v;
+    } else if (v <= 0xFF) {
+        *p++ = major | 24;
+        *p++ = (uint8_t)v;
+    } else if (v <= 0xFFFF) {
+        *p++ = major | 25;
+        *p++ = (uint8_t)(v >> 8);
+        *p++ = (uint8_t)v;
+    } else if (v <= 0xFFFFFFFF) {
+        *p++ = major | 26;
+        *p++ = (uint8_t)(v >> 24);
+        *p++ = (uint8_t)(v >> 16);
+        *p++ = (uint8_t)(v >> 8);
+        *p++ = (uint8_t)v;
+    } else {
+        *p++ = major | 27;
+        for (i = 56; i >= 0; i -= 8) {
+            *p++ = (uint8_t)(v >> i);
+        }
+    }
+
+    return p;
+}
+
+static inline uint8_t *put_int(uint8_t *p, int64_t v) {
+    return (v < 0) ? put_head(p, MAJOR_NEG, (uint64_t)(-1 - v)) : put_head(p, MAJOR_UINT, (uint64_t)v);
+}
+
+static inline uint8_t *put_bytes(uint8_t *p, const uint8_t *data, size_t len) {
+    p = put_head(p, MAJOR_BYTES, len);
+    memcpy(p, data, len);
+    return p + len;
+}
+
+static uint8_t mtype_code(const ed_report_t *report) {
+
+    uint8_t i;
+
+    if (report->is_jr) {
+        return MTYPE_JR;
+    }
+    for (i = 1; i < 8; i++) {
+        if (strcmp(report->mtype, mtype_names[i]) == 0) {
+            return i;
+        }
+    }
+    return 1;
+}
+
+static uint8_t crc_code(const ed_report_t *report) {
+
+    /* the CRC strings differ by their first letter */
+    switch (report->crc[0]) {
+        case 'O':   return 0;
+        case 'B':   return 1;
+        case 'N':   return 2;
+        case 'U':   return 3;
+        default:    return 4;
+    }
+}
+
+/* COBS without 0x00, then every byte XORed so 0x0A is the byte that never appears */
+static int frame(const uint8_t *raw, size_t len, uint8_t *buf, size_t size) {
+
+    size_t i, o = 1, code_pos = 0;
+    uint8_t code = 1;
+
+    if (size < len + len / 254 + 2) {
+        return -1;
+    }
+
+    for (i = 0; i < len; i++) {
+        if (raw[i] == 0) {
+            buf[code_pos] = code ^ FRAME_XOR;
+            code_pos = o++;
+            code = 1;
+        } else {
+            buf[o++] = raw[i] ^ FRAME_XOR;
+            code++;
+            if (code == 0xFF) {
+                buf[code_pos] = code ^ FRAME_XOR;
+                code_pos = o++;
+                code = 1;
+            }
+        }
+    }
+    buf[code_pos] = code ^ FRAME_XOR;
+
+    return (int)o;
+}
+
+static long unframe(const uint8_t *rec, size_t len, uint8_t *raw, size_t size) {
+
+    size_t i = 0, o = 0;
+    uint8_t code, j;
+
+    while (i < len) {
+        code = rec[i++] ^ FRAME_XOR;
+        if (code == 0) {
+            return -1;
+        }
+        for (j = 1; j < code; j++) {
+            if (i >= len || o >= size) {
+                return -1;
+            }
+            raw[o++] = rec[i++] ^ FRAME_XOR;
+        }
+        if (code != 0xFF && i < len) {
+            if (o >= size) {
+                return -1;
+            }
+            raw[o++] = 0;
+        }
+    }
+
+    return (long)o;
+}
+
+static int get_head(cbor_reader_t *rd, uint8_t *major, uint64_t *v) {
+
+    uint8_t ai;
+    int i, n;
+
+    if (rd->p >= rd->end) {
+        return -1;
+    }
+    *major = *rd->p >> 5;
+    ai = *rd->p++ & 0x1F;
+    if (ai < 24) {
+        *v = ai;
+        return 0;
+    }
+    if (ai > 27) {
+        return -1;  /* indefinite lengths and reserved values are not used */
+    }
+    n = 1 << (ai - 24);
+    if (rd->end - rd->p < n) {
+        return -1;
+    }
+    *v = 0;
+    for (i = 0; i < n; i++) {
+        *v = (*v << 8) | *rd->p++;
+    }
+
+    return 0;
+}
+
+static int get_int(cbor_reader_t *rd, int64_t *v) {
+
+    uint8_t major;
+    uint64_t u;
+
+    if (get_head(rd, &major, &u) || (major != MAJOR_UINT && major != MAJOR_NEG) || u > INT64_MAX) {
+        return -1;
+    }
+    *v = (major == MAJOR_UINT) ? (int64_t)u : -1 - (int64_t)u;
+
+    return 0;
+}
+
+static int get_bool(cbor_reader_t *rd, bool *v) {
+
+    uint8_t major;
+    uint64_t u;
+
+    if (get_head(rd, &major, &u) || major != MAJOR_SIMPLE || (u != CBOR_FALSE && u != CBOR_TRUE)) {
+        return -1;
+    }
+    *v = (u == CBOR_TRUE);
+
+    return 0;
+}
+
+static int get_bytes(cbor_reader_t *rd, uint8_t *dest, size_t max, size_t *len) {
+
+    uint8_t major;
+    uint64_t u;
+
+    if (get_head(rd, &major, &u) || major != MAJOR_BYTES || u > max || u > (uint64_t)(rd->end - rd->p)) {
+        return -1;
+    }
+    memcpy(dest, rd->p, (size_t)u);
+    rd->p += u;
+    *len = (size_t)u;
+
+    return 0;
+}
+
+/* members of a later schema are skipped, as long as they are plain values */
+static int skip_value(cbor_reader_t *rd) {
+
+    uint8_t major;
+    uint64_t u;
+
+    if (get_head(rd, &major, &u)) {
+        return -1;
+    }
+    switch (major) {
+        case MAJOR_UINT:
+        case MAJOR_NEG:
+        case MAJOR_SIMPLE:
+            return 0;
+        case MAJOR_BYTES:
+        case MAJOR_TEXT:
+            if (u > (uint64_t)(rd->end - rd->p)) {
+                return -1;
+            }
+            rd->p += u;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int report_cbor_encode(const ed_report_t *report, uint8_t *buf, size_t size) {
+
+    uint8_t raw[CBOR_RAW_MAX];
+    uint8_t *p = raw;
+    uint64_t nb;
+
+    if (report->is_jr) {
+        nb = 12;
+    } else {
+        nb = 14 + (report->fport >= 0) + (report->foptslen > 0) + (report->mic != ED_MIC_NONE) + (report->datalen > 0);
+    }
+
+    /* header: self-described CBOR, then the schema version as the first member */
+    p = put_head(p, MAJOR_TAG, CBOR_TAG_SELF);
+    p = put_head(p, MAJOR_MAP, nb);
+    *p++ = KEY_VERSION;
+    p = put_head(p, MAJOR_UINT, REPORT_CBOR_VERSION);
+
+    *p++ = KEY_TIME;
+    p = put_head(p, MAJOR_UINT, report->time_ms);
+    *p++ = KEY_MTYPE;
+    p = put_head(p, MAJOR_UINT, mtype_code(report));
+    *p++ = KEY_CRC;
+    p = put_head(p, MAJOR_UINT, crc_code(report));
+    *p++ = KEY_FREQ;
+    p = put_head(p, MAJOR_UINT, (uint64_t)lround((double)report->freq * 1e6));
+    *p++ = KEY_SF;
+    p = put_head(p, MAJOR_UINT, report->sf);
+    *p++ = KEY_RSSI;
+    p = put_int(p, lround((double)report->rssi * 100.0));
+    *p++ = KEY_TOA;
+    p = put_head(p, MAJOR_UINT, (uint64_t)lround((double)report->toa * 1e3));
+    *p++ = KEY_FRMLEN;
+    p = put_head(p, MAJOR_UINT, report->frmlength);
+    *p++ = KEY_SNR;
+    p = put_int(p, lround((double)report->snr * 100.0));
+
+    if (report->is_jr) {
+        *p++ = KEY_APP_EUI;
+        p = put_head(p, MAJOR_UINT, report->app_eui);
+        *p++ = KEY_DEV_EUI;
+        p = put_head(p, MAJOR_UINT, report->dev_eui);
+    } else {
+        *p++ = KEY_FCNT;
+        p = put_head(p, MAJOR_UINT, report->fcnt);
+        *p++ = KEY_DEVADDR;
+        p = put_head(p, MAJOR_UINT, report->devaddr);
+        *p++ = KEY_ADR;
+        *p++ = (MAJOR_SIMPLE << 5) | (report->adr ? CBOR_TRUE : CBOR_FALSE);
+        *p++ = KEY_ACK;
+        *p++ = (MAJOR_SIMPLE << 5) | (report->ack ? CBOR_TRUE : CBOR_FALSE);
+        if (report->fport >= 0) {
+            *p++ = KEY_FPORT;
+            p = put_head(p, MAJOR_UINT, (uint64_t)report->fport);
+        }
+        if (report->foptslen > 0) {
+            *p++ = KEY_FOPTS;
+            p = put_bytes(p, report->fopts, report->foptslen);
+        }
+        if (report->mic != ED_MIC_NONE) {
+            *p++ = KEY_MIC;
+            p = put_head(p, MAJOR_UINT, report->mic);
+        }
+        if (report->datalen > 0) {
+            *p++ = KEY_DATA;
+            p = put_bytes(p, report->data, report->datalen);
+        }
+    }
+
+    return frame(raw, (size_t)(p - raw), buf, size);
+}
+
+int report_cbor_decode(const uint8_t *rec, size_t len, ed_report_t *report) {
+
+    uint8_t raw[CBOR_RAW_MAX];
+    cbor_reader_t rd;
+    uint8_t major, mtype = 0, crc = 0;
+    uint64_t key, u, nb, i;
+    int64_t v = 0;
+    uint32_t seen = 0;
+    size_t n;
+    bool uplink;
+    time_t t;
+    struct tm xt;
+    long raw_len;
+    int ret = 0;
+
+    raw_len = unframe(rec, len, raw, sizeof raw);
+    if (raw_len <= 0) {
+        return -1;
+    }
+    rd.p = raw;
+    rd.end = raw + raw_len;
+
+    /* header */
+    if (get_head(&rd, &major, &u) || major != MAJOR_TAG || u != CBOR_TAG_SELF) {
+        return -1;
+    }
+    if (get_head(&rd, &major, &nb) || major != MAJOR_MAP || nb == 0) {
+        return -1;
+    }
+    if (get_head(&rd, &major, &u) || major != MAJOR_UINT || u != KEY_VERSION) {
+        return -1;
+    }
+    if (get_head(&rd, &major, &u) || major != MAJOR_UINT || u != REPORT_CBOR_VERSION) {
+        return -1;
+    }
+    seen = 1U << KEY_VERSION;
+
+    memset(report, 0, sizeof *report);
+    report->fport = -1;
+
+    for (i = 1; i < nb && ret == 0; i++) {
+        if (get_head(&rd, &major, &key) || major != MAJOR_UINT) {
+            return -1;
+        }
+        if (key < KEY_NB) {
+            if (seen & (1U << key)) {
+                return -1;  /* duplicate member */
+            }
+            seen |= 1U << key;
+        }
+        switch (key) {
+            case KEY_TIME:
+                ret = get_int(&rd, &v) || v < 0;
+                report->time_ms = (uint64_t)v;
+                break;
+            case KEY_MTYPE:
+                ret = get_int(&rd, &v) || v < 0 || v > 7;
+                mtype = (uint8_t)v;
+                break;
+            case KEY_CRC:
+                ret = get_int(&rd, &v) || v < 0 || v > 4;
+                crc = (uint8_t)v;
+                break;
+            case KEY_FREQ:
+                ret = get_int(&rd, &v) || v < 0 || v > UINT32_MAX;
+                report->freq = (float)((double)v / 1e6);
+                break;
+            case KEY_SF:
+                ret = get_int(&rd, &v) || v < 0 || v > UINT8_MAX;
+                report->sf = (uint8_t)v;
+                break;
+            case KEY_RSSI:
+                ret = get_int(&rd, &v) || v < INT32_MIN || v > INT32_MAX;
+                report->rssi = (float)((double)v / 100.0);
+                break;
+            case KEY_TOA:
+                ret = get_int(&rd, &v) || v < 0 || v > UINT32_MAX;
+                report->toa = (float)((double)v / 1e3);
+                break;
+            case KEY_FRMLEN:
+                ret = get_int(&rd, &v) || v < 0 || v > UINT8_MAX;
+                report->frmlength = (uint8_t)v;
+                break;
+            case KEY_SNR:
+                ret = get_int(&rd, &v) || v < INT32_MIN || v > INT32_MAX;
+                report->snr = (float)((double)v / 100.0);
+                break;
+            case KEY_FCNT:
+                ret = get_int(&rd, &v) || v < 0 || v > UINT32_MAX;
+                report->fcnt = (uint32_t)v;
+                break;
+            case KEY_DEVADDR:
+                ret = get_int(&rd, &v) || v < 0 || v > UINT32_MAX;
+                report->devaddr = (uint32_t)v;
+                break;
+            case KEY_ADR:
+                ret = get_bool(&rd, &report->adr);
+                break;
+            case KEY_ACK:
+                ret = get_bool(&rd, &report->ack);
+                break;
+            case KEY_FPORT:
+                ret = get_int(&rd, &v) || v < 0 || v > UINT8_MAX;
+                report->fport = (int)v;
+                break;
+            case KEY_FOPTS:
+                ret = get_bytes(&rd, report->fopts, ED_REPORT_FOPTS_LEN, &n);
+                report->foptslen = (uint8_t)n;
+                break;
+            case KEY_MIC:
+                ret = get_int(&rd, &v) || v < ED_MIC_NONE || v > ED_MIC_BAD;
+                report->mic = (uint8_t)v;
+                break;
+            case KEY_DATA:
+                ret = get_bytes(&rd, report->data, ED_REPORT_DATA_LEN - 1, &n);
+                report->datalen = (uint8_t)n;
+                break;
+            case KEY_APP_EUI:
+            case KEY_DEV_EUI:
+                /* EUIs use all 64 bits */
+                ret = get_head(&rd, &major, &u) || major != MAJOR_UINT;
+                if (key == KEY_APP_EUI) {
+                    report->app_eui = u;
+                } else {
+                    report->dev_eui = u;
+                }
+                break;
+            default:
+                ret = skip_value(&rd);
+        }
+    }
+    if (ret || rd.p != rd.end) {
+        return -1;
+    }
+
+    report->is_jr = (mtype == MTYPE_JR);
+    if ((seen & (report->is_jr ? KEYS_JR : KEYS_FRAME)) != (report->is_jr ? KEYS_JR : KEYS_FRAME)) {
+        return -1;
+    }
+
+    /* strings as ed_report_write sets them */
+    t = (time_t)(report->time_ms / 1000);
+    gmtime_r(&t, &xt);
+    n = strftime(report->timestamp, sizeof report->timestamp, "%Y-%m-%dT%H:%M:%S", &xt);
+    snprintf(report->timestamp + n, sizeof report->timestamp - n, ".%03iZ", (int)(report->time_ms % 1000));
+    strcpy(report->mtype, mtype_names[mtype]);
+    strcpy(report->crc, crc_names[crc]);
+
+    /* MAC commands, from the raw FOpts */
+    if (!report->is_jr && mtype != MTYPE_RFU && mtype != MTYPE_PRP) {
+        uplink = (mtype == 2) || (mtype == 4);
+        report->nb_mac_cmds = (uint8_t)mac_cmd_parse(report->fopts, report->foptslen, uplink, report->mac_cmds, ED_REPORT_FOPTS_LEN, &report->mac_status);
+    }
+
+    return 0;
+}
+
+long report_cbor_export_ndjson(const char *segment_file, const char *ndjson_file) {
+
+    FILE *in, *out;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    ed_report_t report;
+    char json[ED_REPORT_JSON_MAX];
+    int n;
+    long nb = 0;
+
+    in = fopen(segment_file, "r");
+    if (in == NULL) {
+        return -1;
+    }
+    out = fopen(ndjson_file, "w");
+    if (out == NULL) {
+        fclose(in);
+        return -1;
+    }
+
+    while (nb >= 0 && (len = getline(&line, &cap, in)) > 0) {
+        if (line[len - 1] == '\n') {
+            len--;
+        }
+        if (len == 0) {
+            continue;
+        }
+        if (line[0] == '{') {
+            /* summaries, channel buckets and reports written as JSON */
+            if (fwrite(line, 1, (size_t)len, out) != (size_t)len || fputc('\n', out) == EOF) {
+                nb = -1;
+            }
+        } else if ((uint8_t)line[0] != REPORT_CBOR_LEAD || report_cbor_decode((const uint8_t *)line, (size_t)len, &report)) {
+            nb = -1;
+        } else {
+            n = ed_report_encode(&report, json, sizeof json);
+            if (n < 0 || fwrite(json, 1, (size_t)n, out) != (size_t)n || fputc('\n', out) == EOF) {
+                nb = -1;
+            }
+        }
+        if (nb >= 0) {
+            nb++;
+        }
+    }
+
+    free(line);
+    fclose(in);
+    if (fclose(out) == EOF) {
+        nb = -1;
+    }
+
+    return nb;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
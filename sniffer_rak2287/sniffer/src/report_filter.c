@@ -0,0 +1,487 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Report filter, rules compiled from match expressions into flat
+    conditions, then checked in order on the raw packet.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdlib.h>     /* calloc free strtod strtoul */
+#include <string.h>     /* memset strcmp strncmp strlen */
+#include <stdio.h>      /* snprintf */
+#include <ctype.h>      /* isalnum isspace */
+#include <math.h>       /* INFINITY nextafterf */
+
+#include "report_filter.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define TERM_LEN            64          /* longest term of a match expression */
+#define FILTER_HASH_MULT    0x9E3779B97F4A7C15ULL   /* 2^64 / golden ratio */
+#define FNV_OFFSET          0xCBF29CE484222325ULL
+#define FNV_PRIME           0x100000001B3ULL
+#define KEY_NO_DEVADDR      (1ULL << 32)            /* limit key shared by the frames without DevAddr */
+
+#define CRC_BIT_OK          0x01
+#define CRC_BIT_BAD         0x02
+#define CRC_BIT_NONE        0x04
+#define CRC_BIT_OTHER       0x08
+
+/* comparison operators of a term */
+#define OP_EQ               0
+#define OP_NE               1
+#define OP_LT               2
+#define OP_LE               3
+#define OP_GT               4
+#define OP_GE               5
+
+/* MType names, in MHDR.MType order */
+static const char *mtype_names[8] = {"JR", "JA", "UDU", "UDD", "CDU", "CDD", "RFU", "PRP"};
+
+/* NwkID length of each NetID type (LoRaWAN backend interfaces) */
+static const uint8_t nwkid_bits[8] = {6, 6, 9, 11, 12, 13, 15, 17};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static inline uint32_t slot_index(uint64_t key) {
+    return (uint32_t)((key * FILTER_HASH_MULT) >> (64 - FILTER_STATE_BITS));
+}
+
+static inline bool rule_drop(report_filter_t *f, filter_rule_t *r) {
+    atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&f->nb_dropped, 1, memory_order_relaxed);
+    return false;
+}
+
+/* FNV-1a of the payload, duplicates heard by several concentrators are byte identical */
+static uint64_t payload_hash(const struct lgw_pkt_rx_s *p) {
+    uint64_t h = FNV_OFFSET ^ p->size;
+    uint16_t i;
+
+    for (i = 0; i < p->size; i++) {
+        h = (h ^ p->payload[i]) * FNV_PRIME;
+    }
+    return h;
+}
+
+/* comma separated list of names, bit n for names[n] */
+static int parse_names(const char *list, const char **names, int nb_names, uint32_t *set) {
+    const char *end;
+    size_t len;
+    int i;
+
+    *set = 0;
+    while (*list != '\0') {
+        end = strchr(list, ',');
+        len = (end != NULL) ? (size_t)(end - list) : strlen(list);
+        for (i = 0; i < nb_names; i++) {
+            if (strlen(names[i]) == len && strncmp(names[i], list, len) == 0) {
+                break;
+            }
+        }
+        if (i == nb_names) {
+            return -1;
+        }
+        *set |= 1U << i;
+        list += len + ((end != NULL) ? 1 : 0);
+    }
+    return (*set != 0) ? 0 : -1;
+}
+
+/* comma separated list of spreading factors, or a bound */
+static int parse_sf(const char *value, int op, uint32_t *set) {
+    char *end;
+    unsigned long sf;
+    int i;
+
+    *set = 0;
+    do {
+        sf = strtoul(value, &end, 10);
+        if (end == value || sf < DR_LORA_SF5 || sf > DR_LORA_SF12 || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        if (op == OP_EQ || op == OP_NE) {
+            *set |= 1U << sf;
+        } else {
+            if (*end != '\0') {
+                return -1;
+            }
+            for (i = DR_LORA_SF5; i <= DR_LORA_SF12; i++) {
+                if ((op == OP_LT && i < (int)sf) || (op == OP_LE && i <= (int)sf) || (op == OP_GT && i > (int)sf) || (op == OP_GE && i >= (int)sf)) {
+                    *set |= 1U << i;
+                }
+            }
+        }
+        value = end + 1;
+    } while (*end == ',');
+
+    *set = (op == OP_NE) ? ~*set : *set;
+    return 0;
+}
+
+/* number range, bounds included */
+static int parse_range(const char *value, int op, float *min, float *max) {
+    char *end;
+    float x = strtof(value, &end);
+
+    if (end == value || *end != '\0' || op == OP_NE) {
+        return -1;
+    }
+    switch (op) {
+        case OP_LT: *max = fminf(*max, nextafterf(x, -INFINITY)); break;
+        case OP_LE: *max = fminf(*max, x); break;
+        case OP_GT: *min = fmaxf(*min, nextafterf(x, INFINITY)); break;
+        case OP_GE: *min = fmaxf(*min, x); break;
+        default:    *min = fmaxf(*min, x); *max = fminf(*max, x);
+    }
+    return 0;
+}
+
+/* DevAddr prefix, hex value and optional prefix length */
+static int parse_devaddr(const char *value, uint32_t *mask, uint32_t *addr) {
+    char *end;
+    unsigned long v, bits = 32;
+
+    v = strtoul(value, &end, 16);
+    if (end == value || v > 0xFFFFFFFFUL) {
+        return -1;
+    }
+    if (*end == '/') {
+        value = end + 1;
+        bits = strtoul(value, &end, 10);
+        if (end == value || bits > 32) {
+            return -1;
+        }
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *mask = (bits == 0) ? 0 : 0xFFFFFFFFU << (32 - bits);
+    *addr = (uint32_t)v & *mask;
+    return 0;
+}
+
+/* DevAddr prefix of a NetID: type prefix, then NwkID */
+static int parse_netid(const char *value, uint32_t *mask, uint32_t *addr) {
+    char *end;
+    unsigned long netid;
+    unsigned type, bits;
+    uint32_t nwkid;
+
+    netid = strtoul(value, &end, 16);
+    if (end == value || *end != '\0' || netid > 0xFFFFFFUL) {
+        return -1;
+    }
+    type = (unsigned)(netid >> 21);
+    nwkid = (uint32_t)netid & ((1U << nwkid_bits[type]) - 1);
+    bits = type + 1 + nwkid_bits[type];
+    *mask = 0xFFFFFFFFU << (32 - bits);
+    *addr = ((0xFFU << (8 - type)) & 0xFFU) << 24 | nwkid << (32 - bits);
+    return 0;
+}
+
+static int parse_term(filter_rule_t *r, const char *term) {
+    static const char *ops[] = {"!=", "<=", ">=", "=", "<", ">"};
+    static const int op_codes[] = {OP_NE, OP_LE, OP_GE, OP_EQ, OP_LT, OP_GT};
+    static const char *crc_names[] = {"OK", "BAD", "NONE", "UNDEF"};
+    char key[TERM_LEN];
+    const char *value = NULL;
+    size_t k, i;
+    int op = OP_EQ;
+    uint32_t set, mask, addr;
+
+    /* key, operator, value */
+    for (k = 0; term[k] != '\0' && value == NULL; k++) {
+        for (i = 0; i < sizeof ops / sizeof ops[0]; i++) {
+            if (strncmp(&term[k], ops[i], strlen(ops[i])) == 0) {
+                op = op_codes[i];
+                value = &term[k + strlen(ops[i])];
+                break;
+            }
+        }
+    }
+    if (value == NULL || k < 2 || k > sizeof key) {
+        return -1;
+    }
+    memcpy(key, term, k - 1);
+    key[k - 1] = '\0';
+
+    if (strcmp(key, "mtype") == 0 || strcmp(key, "crc") == 0) {
+        if ((op != OP_EQ && op != OP_NE) || parse_names(value, (key[0] == 'm') ? mtype_names : crc_names, (key[0] == 'm') ? 8 : 4, &set)) {
+            return -1;
+        }
+        set = (op == OP_NE) ? ~set : set;
+        if (key[0] == 'm') {
+            r->mtypes = (r->conds & FILTER_COND_MTYPE) ? (r->mtypes & set) : (uint8_t)set;
+            r->conds |= FILTER_COND_MTYPE;
+        } else {
+            r->crcs = (r->conds & FILTER_COND_CRC) ? (r->crcs & set) : (uint8_t)(set & 0x0F);
+            r->conds |= FILTER_COND_CRC;
+        }
+    } else if (strcmp(key, "sf") == 0) {
+        if (parse_sf(value, op, &set)) {
+            return -1;
+        }
+        r->sfs = (r->conds & FILTER_COND_SF) ? (r->sfs & set) : set;
+        r->conds |= FILTER_COND_SF;
+    } else if (strcmp(key, "devaddr") == 0 || strcmp(key, "netid") == 0) {
+        if ((r->conds & FILTER_COND_DEVADDR) || (op != OP_EQ && op != OP_NE)) {
+            return -1;
+        }
+        if ((key[0] == 'd') ? parse_devaddr(value, &mask, &addr) : parse_netid(value, &mask, &addr)) {
+            return -1;
+        }
+        r->devaddr_mask = mask;
+        r->devaddr_value = addr;
+        r->devaddr_not = (op == OP_NE);
+        r->conds |= FILTER_COND_DEVADDR;
+    } else if (strcmp(key, "rssi") == 0) {
+        if (parse_range(value, op, &r->rssi_min, &r->rssi_max)) {
+            return -1;
+        }
+        r->conds |= FILTER_COND_RSSI;
+    } else if (strcmp(key, "snr") == 0) {
+        if (parse_range(value, op, &r->snr_min, &r->snr_max)) {
+            return -1;
+        }
+        r->conds |= FILTER_COND_SNR;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parse_action(filter_rule_t *r, const char *action) {
+    char word[8];
+    unsigned long a = 0, b = 0;
+    int n;
+
+    n = sscanf(action, "%7s %lu/%lu", word, &a, &b);
+    if (n >= 1 && strcmp(word, "drop") == 0 && n == 1) {
+        r->action = FILTER_DROP;
+    } else if (n >= 1 && strcmp(word, "keep") == 0 && n == 1) {
+        r->action = FILTER_KEEP;
+    } else if (n == 2 && strcmp(word, "sample") == 0 && a > 0 && strchr(action, '/') == NULL) {
+        r->action = FILTER_SAMPLE;
+        r->n = (uint32_t)a;
+    } else if (n == 3 && strcmp(word, "limit") == 0 && a > 0 && b > 0) {
+        r->action = FILTER_LIMIT;
+        r->n = (uint32_t)a;
+        r->period = (uint32_t)b;
+    } else if (n == 2 && strcmp(word, "dedup") == 0 && a > 0 && strchr(action, '/') == NULL) {
+        r->action = FILTER_DEDUP;
+        r->period = (uint32_t)a;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int report_filter_init(report_filter_t *f, int max_rules) {
+
+    memset(f, 0, sizeof *f);
+
+    if (max_rules <= 0) {
+        return -1;
+    }
+
+    f->rules = calloc((size_t)max_rules, sizeof *f->rules);
+    if (f->rules == NULL) {
+        return -1;
+    }
+    f->max_rules = max_rules;
+
+    return 0;
+}
+
+void report_filter_free(report_filter_t *f) {
+    int i;
+
+    for (i = 0; i < f->nb_rules; i++) {
+        free(f->rules[i].slots);
+    }
+    free(f->rules);
+    memset(f, 0, sizeof *f);
+}
+
+int report_filter_add(report_filter_t *f, const char *name, const char *match, const char *action) {
+
+    filter_rule_t *r;
+    char term[TERM_LEN];
+    size_t i, len;
+
+    if (f->nb_rules >= f->max_rules || action == NULL) {
+        return -1;
+    }
+    r = &f->rules[f->nb_rules];
+    memset(r, 0, sizeof *r);
+    r->rssi_min = -INFINITY;
+    r->rssi_max = INFINITY;
+    r->snr_min = -INFINITY;
+    r->snr_max = INFINITY;
+
+    /* name, it goes in the metric labels as is, so nothing that needs escaping there (quote, backslash, new line) */
+    if (name == NULL) {
+        snprintf(r->name, sizeof r->name, "rule%d", f->nb_rules);
+    } else {
+        len = strlen(name);
+        if (len == 0 || len >= sizeof r->name) {
+            return -1;
+        }
+        for (i = 0; i < len; i++) {
+            if (!isalnum((unsigned char)name[i]) && name[i] != '_' && name[i] != '-') {
+                return -1;
+            }
+        }
+        memcpy(r->name, name, len + 1);
+    }
+
+    /* terms, one after the other */
+    while (match != NULL && *match != '\0') {
+        while (isspace((unsigned char)*match)) {
+            match++;
+        }
+        for (len = 0; match[len] != '\0' && !isspace((unsigned char)match[len]); len++);
+        if (len == 0) {
+            break;
+        }
+        if (len >= sizeof term) {
+            return -1;
+        }
+        memcpy(term, match, len);
+        term[len] = '\0';
+        if (parse_term(r, term)) {
+            return -1;
+        }
+        match += len;
+    }
+
+    if (parse_action(r, action)) {
+        return -1;
+    }
+    if (r->action == FILTER_LIMIT || r->action == FILTER_DEDUP) {
+        r->slots = calloc(FILTER_STATE_SLOTS, sizeof *r->slots);
+        if (r->slots == NULL) {
+            return -1;
+        }
+    }
+
+    f->nb_rules += 1;
+    return 0;
+}
+
+bool report_filter_check(report_filter_t *f, const struct lgw_pkt_rx_s *p, time_t now) {
+
+    filter_rule_t *r;
+    filter_slot_t *s;
+    uint8_t mtype_bit = 0, crc_bit;
+    uint32_t sf_bit, devaddr = 0;
+    bool has_devaddr = false;
+    uint64_t key;
+    int i;
+
+    /* packet fields, straight from the PHY payload */
+    if (p->size > 0) {
+        mtype_bit = (uint8_t)(1U << (p->payload[0] >> 5));
+        /* data frames only, MType 2 to 5 */
+        has_devaddr = (p->size >= 5) && (mtype_bit & 0x3C);
+        if (has_devaddr) {
+            devaddr = (uint32_t)p->payload[1] | (uint32_t)p->payload[2] << 8 | (uint32_t)p->payload[3] << 16 | (uint32_t)p->payload[4] << 24;
+        }
+    }
+    switch (p->status) {
+        case STAT_CRC_OK:   crc_bit = CRC_BIT_OK;       break;
+        case STAT_CRC_BAD:  crc_bit = CRC_BIT_BAD;      break;
+        case STAT_NO_CRC:   crc_bit = CRC_BIT_NONE;     break;
+        default:            crc_bit = CRC_BIT_OTHER;
+    }
+    sf_bit = (p->datarate < 32) ? 1U << p->datarate : 0;
+
+    for (i = 0; i < f->nb_rules; i++) {
+        r = &f->rules[i];
+
+        if (((r->conds & FILTER_COND_MTYPE) && !(r->mtypes & mtype_bit)) ||
+            ((r->conds & FILTER_COND_CRC) && !(r->crcs & crc_bit)) ||
+            ((r->conds & FILTER_COND_SF) && !(r->sfs & sf_bit)) ||
+            ((r->conds & FILTER_COND_RSSI) && (p->rssis < r->rssi_min || p->rssis > r->rssi_max)) ||
+            ((r->conds & FILTER_COND_SNR) && (p->snr < r->snr_min || p->snr > r->snr_max))) {
+            continue;
+        }
+        if ((r->conds & FILTER_COND_DEVADDR) && (!has_devaddr || (((devaddr & r->devaddr_mask) == r->devaddr_value) == r->devaddr_not))) {
+            continue;
+        }
+        atomic_fetch_add_explicit(&r->hits, 1, memory_order_relaxed);
+
+        switch (r->action) {
+            case FILTER_DROP:
+                return rule_drop(f, r);
+            case FILTER_KEEP:
+                atomic_fetch_add_explicit(&f->nb_kept, 1, memory_order_relaxed);
+                return true;
+            case FILTER_SAMPLE:
+                if ((r->seq++ % r->n) != 0) {
+                    return rule_drop(f, r);
+                }
+                break;
+            case FILTER_LIMIT:
+                key = has_devaddr ? devaddr : KEY_NO_DEVADDR;
+                s = &r->slots[slot_index(key)];
+                if (s->start == 0 || s->key != key || now - s->start >= (time_t)r->period) {
+                    s->key = key;
+                    s->start = now;
+                    s->count = 0;
+                }
+                if (++s->count > r->n) {
+                    return rule_drop(f, r);
+                }
+                break;
+            case FILTER_DEDUP:
+                key = payload_hash(p);
+                s = &r->slots[slot_index(key)];
+                if (s->start != 0 && s->key == key && now - s->start < (time_t)r->period) {
+                    return rule_drop(f, r);
+                }
+                s->key = key;
+                s->start = now;
+                break;
+        }
+    }
+
+    atomic_fetch_add_explicit(&f->nb_kept, 1, memory_order_relaxed);
+    return true;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,915 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Rolling report segments. Encoded reports are appended as one record per
+    line (newline delimited JSON) to an open segment file, which is sealed once
+    it grows past a size limit or gets too old. Sealed segments are numbered
+    sequentially and are what the uploader ships, the journal keeps track of
+    them across restarts.
+
+    Journal entries, one per line, each ending with the CRC-32 of the text
+    before it so a partial last line is told apart:
+        S <seq> <bytes> <crc>   segment sealed, size and CRC-32 of its content
+        A <seq_end>             segments below seq_end acknowledged
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* fopen fwrite rename snprintf */
+#include <stdlib.h>     /* realloc free strtoul */
+#include <string.h>     /* memset strncpy memchr */
+#include <time.h>       /* time difftime clock_gettime */
+#include <unistd.h>     /* fsync fdatasync truncate */
+#include <fcntl.h>      /* open */
+#include <dirent.h>     /* opendir readdir */
+
+#include "report_segment.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SEGMENT_READ_CHUNK  4096    /* read size used when scanning a segment */
+#define JOURNAL_LINE_LEN    64      /* longest journal entry */
+#define JOURNAL_COMPACT     16384   /* journal size (bytes) past which it is rewritten once nothing is pending */
+
+/* CRC-32, reflected polynomial 0xEDB88320, four bits at a time */
+static const uint32_t crc32_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* a sealed segment, as journaled */
+typedef struct seal_entry_s {
+    uint32_t seq;
+    long bytes;
+    uint32_t crc;
+} seal_entry_t;
+
+/* sealed segments read back from the journal and the directory */
+typedef struct seal_list_s {
+    seal_entry_t *entries;
+    size_t count;
+    size_t size;
+} seal_list_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static int segment_open_locked(segment_writer_t *sw);
+
+static int segment_seal_locked(segment_writer_t *sw);
+
+static bool segment_aged_locked(segment_writer_t *sw, time_t now);
+
+static uint64_t monotonic_ms(void);
+
+static int sync_dir(const char *prefix);
+
+static int segment_sync_locked(segment_writer_t *sw);
+
+static int journal_write_locked(segment_writer_t *sw, FILE *fp, const char *entry);
+
+static int journal_ack_locked(segment_writer_t *sw);
+
+static int journal_compact_locked(segment_writer_t *sw, const seal_list_t *list);
+
+static DIR *segment_dir_open(const segment_writer_t *sw, const char **base);
+
+static const char *segment_dir_entry(const char *d_name, const char *base, unsigned long *seq);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/**
+ * Open a new segment file under the current sequence number. Caller holds the lock.
+ *
+ * @param sw    Segment writer
+ * @return      0 on success, -1 otherwise
+*/
+static int segment_open_locked(segment_writer_t *sw) {
+
+    char name[SEGMENT_NAME_LEN];
+
+    segment_name(name, sizeof name, sw->prefix, sw->seq, false);
+
+    sw->fp = fopen(name, "w");
+    if (sw->fp == NULL) {
+        return -1;
+    }
+
+    sw->bytes = 0;
+    sw->records = 0;
+    sw->crc = 0;
+    sw->opened = time(NULL);
+
+    return 0;
+}
+
+/**
+ * Close the open segment and rename it to its sealed name. Caller holds the lock.
+ *
+ * @param sw    Segment writer
+ * @return      0 on success, -1 otherwise
+*/
+static int segment_seal_locked(segment_writer_t *sw) {
+
+    char name_open[SEGMENT_NAME_LEN];
+    char name_sealed[SEGMENT_NAME_LEN];
+    char entry[JOURNAL_LINE_LEN];
+    int ret = 0;
+
+    if (sw->fp == NULL) {
+        return 0;
+    }
+
+    /* a journaled segment is on disk before its sealed name is */
+    if (sw->journal != NULL && (fflush(sw->fp) == EOF || fsync(fileno(sw->fp)))) {
+        ret = -1;
+    }
+    if (fclose(sw->fp) == EOF) {
+        ret = -1;
+    }
+    sw->fp = NULL;
+
+    segment_name(name_open, sizeof name_open, sw->prefix, sw->seq, false);
+    segment_name(name_sealed, sizeof name_sealed, sw->prefix, sw->seq, true);
+
+    if (rename(name_open, name_sealed)) {
+        ret = -1;
+    } else if (sw->journal != NULL) {
+        snprintf(entry, sizeof entry, "S %u %lu %08x", sw->seq, (unsigned long)sw->bytes, sw->crc);
+        if (sync_dir(sw->prefix) || journal_write_locked(sw, sw->journal, entry)) {
+            ret = -1;
+        }
+    }
+
+    /* The sequence always moves on, a segment that failed to seal is never reused */
+    sw->seq++;
+    atomic_store_explicit(&sw->sealed_end, sw->seq, memory_order_release);
+
+    return ret;
+}
+
+/**
+ * Check if the open segment has exceeded its maximum age. Caller holds the lock.
+ *
+ * @param sw    Segment writer
+ * @param now   Current time
+ * @return      true if the segment should be sealed
+*/
+static bool segment_aged_locked(segment_writer_t *sw, time_t now) {
+
+    if (sw->fp == NULL || sw->max_age == 0) {
+        return false;
+    }
+
+    return difftime(now, sw->opened) >= sw->max_age;
+}
+
+static uint64_t monotonic_ms(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * Sync the directory holding the segments, so renames are durable.
+ *
+ * @param prefix    File name prefix of the segments
+ * @return          0 on success, -1 otherwise
+*/
+static int sync_dir(const char *prefix) {
+
+    char dir[SEGMENT_PREFIX_LEN];
+    const char *slash = strrchr(prefix, '/');
+    int fd, ret;
+
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else {
+        snprintf(dir, sizeof dir, "%.*s", (int)(slash - prefix + 1), prefix);
+    }
+
+    fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -1;
+    }
+    ret = fsync(fd);
+    close(fd);
+
+    return ret ? -1 : 0;
+}
+
+/**
+ * Sync the open segment and the journal if anything was written since the last
+ * group commit. Caller holds the lock.
+ *
+ * @param sw    Segment writer
+ * @return      0 on success, -1 otherwise
+*/
+static int segment_sync_locked(segment_writer_t *sw) {
+
+    int ret = journal_ack_locked(sw);
+
+    sw->synced_ms = monotonic_ms();
+    if (sw->journal == NULL || !sw->dirty) {
+        return 0;
+    }
+
+    if (sw->fp != NULL && (fflush(sw->fp) == EOF || fdatasync(fileno(sw->fp)))) {
+        ret = -1;
+    }
+    if (sw->journal != NULL && (fflush(sw->journal) == EOF || fdatasync(fileno(sw->journal)))) {
+        ret = -1;
+    }
+    sw->dirty = false;
+    atomic_fetch_add_explicit(&sw->nb_syncs, 1, memory_order_relaxed);
+
+    return ret;
+}
+
+/**
+ * Append an entry to a journal, followed by its own CRC. Caller holds the lock.
+ *
+ * @param sw    Segment writer
+ * @param fp    Journal file
+ * @param entry Entry text
+ * @return      0 on success, -1 otherwise
+*/
+static int journal_write_locked(segment_writer_t *sw, FILE *fp, const char *entry) {
+
+    int len;
+
+    len = fprintf(fp, "%s %08x\n", entry, segment_crc32(0, entry, strlen(entry)));
+    if (len < 0) {
+        return -1;
+    }
+    sw->journal_bytes += len;
+    sw->dirty = true;
+
+    return 0;
+}
+
+/**
+ * Journal the acknowledged end published by the uploader, if it moved. Caller holds the lock.
+ *
+ * @param sw    Segment writer
+ * @return      0 on success, -1 otherwise
+*/
+static int journal_ack_locked(segment_writer_t *sw) {
+
+    char entry[JOURNAL_LINE_LEN];
+    uint32_t seq_end = atomic_load_explicit(&sw->ack_end, memory_order_relaxed);
+    int ret;
+
+    if (sw->journal == NULL || seq_end <= sw->seq_acked) {
+        return 0;
+    }
+    sw->seq_acked = seq_end;
+    snprintf(entry, sizeof entry, "A %u", seq_end);
+    ret = journal_write_locked(sw, sw->journal, entry);
+
+    /* nothing pending, the journal can start over */
+    if (sw->seq_acked >= sw->seq && sw->journal_bytes > JOURNAL_COMPACT) {
+        ret |= journal_compact_locked(sw, NULL);
+    }
+
+    return ret;
+}
+
+/**
+ * Read a journal entry back.
+ *
+ * @param line  Journal line, with its newline
+ * @param type  Entry type, 'S' or 'A'
+ * @param e     Sealed segment of an 'S' entry, or acknowledged end of an 'A' entry in e->seq
+ * @return      0 on success, -1 if the line is partial or damaged
+*/
+static int journal_parse(const char *line, char *type, seal_entry_t *e) {
+
+    const char *end = strchr(line, '\n');
+    const char *sep;
+    unsigned long seq, bytes, crc;
+    int n;
+
+    if (end == NULL) {
+        return -1;
+    }
+    for (sep = end; sep > line && *sep != ' '; sep--);
+    if (sep == line || strtoul(sep + 1, NULL, 16) != segment_crc32(0, line, (size_t)(sep - line))) {
+        return -1;
+    }
+
+    *type = line[0];
+    if (*type == 'S' && sscanf(line, "S %lu %lu %lx%n", &seq, &bytes, &crc, &n) == 3 && line + n == sep) {
+        e->seq = (uint32_t)seq;
+        e->bytes = (long)bytes;
+        e->crc = (uint32_t)crc;
+        return 0;
+    }
+    if (*type == 'A' && sscanf(line, "A %lu%n", &seq, &n) == 1 && line + n == sep) {
+        e->seq = (uint32_t)seq;
+        return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * Add or replace a sealed segment in a list kept in sequence order.
+ *
+ * @return  0 on success, -1 if out of memory
+*/
+static int seal_list_put(seal_list_t *list, const seal_entry_t *e) {
+
+    seal_entry_t *grown;
+    size_t i;
+
+    for (i = list->count; i > 0 && list->entries[i - 1].seq >= e->seq; i--);
+    if (i < list->count && list->entries[i].seq == e->seq) {
+        list->entries[i] = *e;
+        return 0;
+    }
+
+    if (list->count == list->size) {
+        grown = realloc(list->entries, (list->size + 64) * sizeof *grown);
+        if (grown == NULL) {
+            return -1;
+        }
+        list->entries = grown;
+        list->size += 64;
+    }
+    memmove(&list->entries[i + 1], &list->entries[i], (list->count - i) * sizeof *e);
+    list->entries[i] = *e;
+    list->count++;
+
+    return 0;
+}
+
+static seal_entry_t *seal_list_find(const seal_list_t *list, uint32_t seq) {
+
+    size_t i;
+
+    for (i = 0; i < list->count; i++) {
+        if (list->entries[i].seq == seq) {
+            return &list->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Read a segment file: its size, and the size and CRC of its whole records.
+ *
+ * @param name      Segment file
+ * @param size      Size of the file
+ * @param bytes     Size up to the end of its last record
+ * @param crc       CRC of the records
+ * @return          0 on success, -1 if the file could not be read
+*/
+static int segment_scan(const char *name, long *size, long *bytes, uint32_t *crc) {
+
+    FILE *fp;
+    char buf[SEGMENT_READ_CHUNK];
+    size_t n;
+    char *nl;
+    uint32_t crc_all = 0;
+
+    fp = fopen(name, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    *size = 0;
+    *bytes = 0;
+    *crc = 0;
+    while ((n = fread(buf, 1, sizeof buf, fp)) > 0) {
+        for (nl = &buf[n - 1]; nl >= buf && *nl != '\n'; nl--);
+        if (nl >= buf) {
+            *crc = segment_crc32(crc_all, buf, (size_t)(nl - buf + 1));
+            *bytes = *size + (nl - buf + 1);
+            crc_all = segment_crc32(*crc, nl + 1, n - (size_t)(nl - buf + 1));
+        } else {
+            crc_all = segment_crc32(crc_all, buf, n);
+        }
+        *size += (long)n;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * Put a damaged sealed segment aside, under SEGMENT_SUFFIX_BAD.
+ *
+ * @param sw    Segment writer
+ * @param seq   Number of the segment
+*/
+static void segment_quarantine(segment_writer_t *sw, uint32_t seq) {
+
+    char name[SEGMENT_NAME_LEN];
+    char name_bad[SEGMENT_NAME_LEN];
+
+    segment_name(name, sizeof name, sw->prefix, seq, true);
+    snprintf(name_bad, sizeof name_bad, "%s_%u%s", sw->prefix, seq, SEGMENT_SUFFIX_BAD);
+    rename(name, name_bad);
+}
+
+/**
+ * Cut the open segment left by a crash back to its last whole record and seal it.
+ *
+ * @param sw    Segment writer
+ * @param seq   Number of the open segment
+ * @param e     Sealed segment, filled on success
+ * @return      1 if sealed, 0 if it held no whole record and was removed, -1 on error
+*/
+static int segment_repair(segment_writer_t *sw, uint32_t seq, seal_entry_t *e) {
+
+    char name_open[SEGMENT_NAME_LEN];
+    char name_sealed[SEGMENT_NAME_LEN];
+    long size;
+    int fd, ret;
+
+    segment_name(name_open, sizeof name_open, sw->prefix, seq, false);
+    segment_name(name_sealed, sizeof name_sealed, sw->prefix, seq, true);
+
+    if (segment_scan(name_open, &size, &e->bytes, &e->crc)) {
+        return -1;
+    }
+    if (e->bytes == 0) {
+        return remove(name_open) ? -1 : 0;
+    }
+
+    fd = open(name_open, O_WRONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    ret = (ftruncate(fd, e->bytes) || fsync(fd)) ? -1 : 0;
+    close(fd);
+    if (ret || rename(name_open, name_sealed)) {
+        return -1;
+    }
+
+    e->seq = seq;
+    return 1;
+}
+
+/**
+ * Rewrite the journal with the acknowledged end and the sealed segments still
+ * pending, then switch to it. Caller holds the lock.
+ *
+ * @param sw    Segment writer
+ * @param list  Sealed segments, the ones below sw->seq_acked are left out
+ * @return      0 on success, -1 otherwise
+*/
+static int journal_compact_locked(segment_writer_t *sw, const seal_list_t *list) {
+
+    char name[SEGMENT_NAME_LEN];
+    char name_tmp[SEGMENT_NAME_LEN + 4];
+    char entry[JOURNAL_LINE_LEN];
+    FILE *fp;
+    size_t i;
+    int ret = 0;
+
+    snprintf(name, sizeof name, "%s%s", sw->prefix, SEGMENT_SUFFIX_JOURNAL);
+    snprintf(name_tmp, sizeof name_tmp, "%s.tmp", name);
+
+    fp = fopen(name_tmp, "w");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    sw->journal_bytes = 0;
+    snprintf(entry, sizeof entry, "A %u", sw->seq_acked);
+    ret |= journal_write_locked(sw, fp, entry);
+    for (i = 0; list != NULL && i < list->count; i++) {
+        if (list->entries[i].seq >= sw->seq_acked) {
+            snprintf(entry, sizeof entry, "S %u %lu %08x", list->entries[i].seq, (unsigned long)list->entries[i].bytes, list->entries[i].crc);
+            ret |= journal_write_locked(sw, fp, entry);
+        }
+    }
+    if (fflush(fp) == EOF || fsync(fileno(fp))) {
+        ret = -1;
+    }
+    if (fclose(fp) == EOF || ret || rename(name_tmp, name) || sync_dir(sw->prefix)) {
+        remove(name_tmp);
+        return -1;
+    }
+
+    /* entries from now on go to the new journal */
+    if (sw->journal != NULL) {
+        fclose(sw->journal);
+    }
+    sw->journal = fopen(name, "a");
+    sw->dirty = false;
+
+    return (sw->journal != NULL) ? 0 : -1;
+}
+
+/**
+ * Open the directory holding the segments of a writer.
+ *
+ * @param sw    Segment writer
+ * @param base  File name prefix, without its directory
+ * @return      Directory stream, NULL if it could not be opened
+*/
+static DIR *segment_dir_open(const segment_writer_t *sw, const char **base) {
+
+    char dir[SEGMENT_PREFIX_LEN];
+
+    *base = strrchr(sw->prefix, '/');
+    if (*base == NULL) {
+        *base = sw->prefix;
+        strcpy(dir, ".");
+    } else {
+        snprintf(dir, sizeof dir, "%.*s", (int)(*base - sw->prefix + 1), sw->prefix);
+        (*base)++;
+    }
+    return opendir(dir);
+}
+
+/**
+ * Read the number of a segment file found in the directory.
+ *
+ * @param d_name    File name
+ * @param base      File name prefix, without its directory
+ * @param seq       Number of the segment
+ * @return          Suffix following the number, NULL if the file is not a segment
+*/
+static const char *segment_dir_entry(const char *d_name, const char *base, unsigned long *seq) {
+
+    size_t base_len = strlen(base);
+    char *end;
+
+    if (strncmp(d_name, base, base_len) || d_name[base_len] != '_') {
+        return NULL;
+    }
+    *seq = strtoul(&d_name[base_len + 1], &end, 10);
+    if (end == &d_name[base_len + 1] || *seq > UINT32_MAX) {
+        return NULL;
+    }
+    if (strcmp(end, SEGMENT_SUFFIX_OPEN) && strcmp(end, SEGMENT_SUFFIX_SEALED) && strcmp(end, SEGMENT_SUFFIX_BAD)) {
+        return NULL;
+    }
+    return end;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int segment_init(segment_writer_t *sw, const char *prefix, size_t max_bytes, unsigned max_age) {
+
+    if (sw == NULL || prefix == NULL || max_bytes == 0) {
+        return -1;
+    }
+
+    memset(sw, 0, sizeof *sw);
+
+    if (pthread_mutex_init(&sw->mx, NULL)) {
+        return -1;
+    }
+
+    strncpy(sw->prefix, prefix, sizeof sw->prefix);
+    sw->prefix[sizeof sw->prefix - 1] = '\0'; /* ensure string termination */
+    sw->max_bytes = max_bytes;
+    sw->max_age = max_age;
+
+    return 0;
+}
+
+int segment_append(segment_writer_t *sw, const char *record, size_t len) {
+
+    int ret = 0;
+
+    pthread_mutex_lock(&sw->mx);
+
+    /* Seal first if this record would push the segment over either limit */
+    if (sw->fp != NULL) {
+        if ((sw->bytes > 0 && sw->bytes + len + 1 > sw->max_bytes) || segment_aged_locked(sw, time(NULL))) {
+            ret = segment_seal_locked(sw);
+        }
+    }
+
+    if (sw->fp == NULL && segment_open_locked(sw)) {
+        pthread_mutex_unlock(&sw->mx);
+        return -1;
+    }
+
+    if (fwrite(record, 1, len, sw->fp) != len || fputc('\n', sw->fp) == EOF) {
+        ret = -1;
+    } else {
+        sw->bytes += len + 1;
+        sw->records++;
+        sw->crc = segment_crc32(segment_crc32(sw->crc, record, len), "\n", 1);
+        sw->dirty = true;
+    }
+
+    pthread_mutex_unlock(&sw->mx);
+
+    return ret;
+}
+
+int segment_journal_open(segment_writer_t *sw, unsigned sync_ms, segment_recovery_t *rec) {
+
+    char name[SEGMENT_NAME_LEN];
+    char line[JOURNAL_LINE_LEN];
+    const char *base;
+    seal_list_t list = {NULL, 0, 0};
+    seal_entry_t e, *found;
+    FILE *fp;
+    DIR *d;
+    struct dirent *de;
+    const char *end;
+    char type;
+    unsigned long seq;
+    uint32_t seq_next = 0;
+    size_t i;
+    long size, bytes;
+    uint32_t crc;
+    int ret = 0;
+
+    memset(rec, 0, sizeof *rec);
+
+    pthread_mutex_lock(&sw->mx);
+    sw->sync_ms = sync_ms;
+    sw->seq_acked = 0;
+
+    /* replay the journal, up to a partial last entry */
+    snprintf(name, sizeof name, "%s%s", sw->prefix, SEGMENT_SUFFIX_JOURNAL);
+    fp = fopen(name, "r");
+    if (fp != NULL) {
+        while (fgets(line, sizeof line, fp) != NULL) {
+            if (journal_parse(line, &type, &e)) {
+                rec->torn_journal = true;
+                break;
+            }
+            if (type == 'A') {
+                sw->seq_acked = (e.seq > sw->seq_acked) ? e.seq : sw->seq_acked;
+            } else if (seal_list_put(&list, &e)) {
+                ret = -1;
+            }
+        }
+        fclose(fp);
+    }
+    for (i = 0; i < list.count; i++) {
+        seq_next = (list.entries[i].seq >= seq_next) ? list.entries[i].seq + 1 : seq_next;
+    }
+
+    /* segments of the directory: sealed ones the journal missed, the open one of a crash */
+    d = segment_dir_open(sw, &base);
+    while (d != NULL && (de = readdir(d)) != NULL) {
+        end = segment_dir_entry(de->d_name, base, &seq);
+        if (end == NULL) {
+            continue;
+        }
+        if (strcmp(end, SEGMENT_SUFFIX_OPEN) == 0) {
+            segment_name(name, sizeof name, sw->prefix, (uint32_t)seq, true);
+            if (access(name, F_OK) == 0) {
+                /* sealed under the same number already, what is left is stale */
+                segment_name(name, sizeof name, sw->prefix, (uint32_t)seq, false);
+                remove(name);
+            } else {
+                switch (segment_repair(sw, (uint32_t)seq, &e)) {
+                    case 1:     rec->repaired++; ret |= seal_list_put(&list, &e); break;
+                    case 0:     break;
+                    default:    ret = -1;
+                }
+            }
+        } else if (strcmp(end, SEGMENT_SUFFIX_SEALED) == 0) {
+            if (seq >= sw->seq_acked && seal_list_find(&list, (uint32_t)seq) == NULL) {
+                segment_name(name, sizeof name, sw->prefix, (uint32_t)seq, true);
+                e.seq = (uint32_t)seq;
+                if (segment_scan(name, &size, &e.bytes, &e.crc)) {
+                    ret = -1;
+                } else if (size > 0 && size == e.bytes) {
+                    rec->adopted++;
+                    ret |= seal_list_put(&list, &e);
+                } else {
+                    /* sealed by a run without journal and cut short by a power loss */
+                    segment_quarantine(sw, (uint32_t)seq);
+                    rec->quarantined++;
+                }
+            }
+        }
+        seq_next = (seq >= seq_next) ? (uint32_t)seq + 1 : seq_next;
+    }
+    if (d != NULL) {
+        closedir(d);
+    }
+
+    /* pending segments must match their journal entry */
+    for (i = 0; i < list.count; i++) {
+        found = &list.entries[i];
+        if (found->seq < sw->seq_acked) {
+            continue;
+        }
+        segment_name(name, sizeof name, sw->prefix, found->seq, true);
+        if (segment_scan(name, &size, &bytes, &crc)) {
+            rec->missing++;
+        } else if (size != found->bytes || bytes != found->bytes || crc != found->crc) {
+            segment_quarantine(sw, found->seq);
+            rec->quarantined++;
+        } else {
+            rec->pending++;
+        }
+    }
+
+    /* numbering goes on after everything found, nothing on disk is overwritten */
+    sw->seq = (seq_next > sw->seq_acked) ? seq_next : sw->seq_acked;
+    rec->seq_acked = sw->seq_acked;
+    atomic_store_explicit(&sw->ack_end, sw->seq_acked, memory_order_relaxed);
+    atomic_store_explicit(&sw->sealed_end, sw->seq, memory_order_release);
+
+    if (journal_compact_locked(sw, &list)) {
+        ret = -1;
+    }
+    sw->synced_ms = monotonic_ms();
+    pthread_mutex_unlock(&sw->mx);
+
+    free(list.entries);
+    return ret ? -1 : 0;
+}
+
+int segment_skip_existing(segment_writer_t *sw, uint32_t *found) {
+
+    const char *base;
+    DIR *d;
+    struct dirent *de;
+    unsigned long seq;
+    uint32_t seq_next = 0;
+
+    *found = 0;
+
+    pthread_mutex_lock(&sw->mx);
+    d = segment_dir_open(sw, &base);
+    if (d == NULL) {
+        pthread_mutex_unlock(&sw->mx);
+        return -1;
+    }
+    while ((de = readdir(d)) != NULL) {
+        if (segment_dir_entry(de->d_name, base, &seq) != NULL) {
+            (*found)++;
+            seq_next = (seq >= seq_next) ? (uint32_t)seq + 1 : seq_next;
+        }
+    }
+    closedir(d);
+
+    /* nothing to upload below seq, the segments found are left as they are */
+    sw->seq = seq_next;
+    sw->seq_acked = seq_next;
+    atomic_store_explicit(&sw->ack_end, seq_next, memory_order_relaxed);
+    atomic_store_explicit(&sw->sealed_end, seq_next, memory_order_release);
+    pthread_mutex_unlock(&sw->mx);
+
+    return 0;
+}
+
+void segment_ack(segment_writer_t *sw, uint32_t seq_end) {
+
+    atomic_store_explicit(&sw->ack_end, seq_end, memory_order_relaxed);
+}
+
+void segment_request_seal(segment_writer_t *sw) {
+
+    atomic_store_explicit(&sw->seal_req, true, memory_order_relaxed);
+}
+
+bool segment_seal_pending(segment_writer_t *sw) {
+
+    return atomic_load_explicit(&sw->seal_req, memory_order_acquire);
+}
+
+int segment_sync(segment_writer_t *sw) {
+
+    int ret;
+
+    pthread_mutex_lock(&sw->mx);
+    ret = segment_sync_locked(sw);
+    pthread_mutex_unlock(&sw->mx);
+
+    return ret;
+}
+
+int segment_seal(segment_writer_t *sw) {
+
+    int ret;
+
+    pthread_mutex_lock(&sw->mx);
+    ret = segment_seal_locked(sw);
+    pthread_mutex_unlock(&sw->mx);
+
+    return ret;
+}
+
+int segment_poll(segment_writer_t *sw) {
+
+    int ret = 0;
+
+    pthread_mutex_lock(&sw->mx);
+    if (atomic_load_explicit(&sw->seal_req, memory_order_relaxed)) {
+        ret = segment_seal_locked(sw);
+        atomic_store_explicit(&sw->seal_req, false, memory_order_release);
+    } else if (segment_aged_locked(sw, time(NULL))) {
+        ret = segment_seal_locked(sw);
+    }
+    ret |= journal_ack_locked(sw);
+    if (sw->journal != NULL && sw->dirty && monotonic_ms() - sw->synced_ms >= sw->sync_ms) {
+        ret |= segment_sync_locked(sw);
+    }
+    pthread_mutex_unlock(&sw->mx);
+
+    return ret;
+}
+
+uint32_t segment_sealed_end(segment_writer_t *sw) {
+
+    return atomic_load_explicit(&sw->sealed_end, memory_order_acquire);
+}
+
+void segment_close(segment_writer_t *sw) {
+
+    segment_seal(sw);
+    if (sw->journal != NULL) {
+        segment_sync(sw);
+        fclose(sw->journal);
+        sw->journal = NULL;
+    }
+    pthread_mutex_destroy(&sw->mx);
+}
+
+void segment_name(char *dest, size_t size, const char *prefix, uint32_t seq, bool sealed) {
+
+    snprintf(dest, size, "%s_%u%s", prefix, seq, sealed ? SEGMENT_SUFFIX_SEALED : SEGMENT_SUFFIX_OPEN);
+}
+
+uint32_t segment_crc32(uint32_t crc, const void *buf, size_t len) {
+
+    const uint8_t *p = buf;
+
+    crc = ~crc;
+    while (len-- > 0) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+long segment_count_records(const char *file_name) {
+
+    FILE *fp;
+    char buf[SEGMENT_READ_CHUNK];
+    size_t n;
+    char *p;
+    long records = 0;
+
+    fp = fopen(file_name, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    while ((n = fread(buf, 1, sizeof buf, fp)) > 0) {
+        p = buf;
+        while ((p = memchr(p, '\n', n - (p - buf))) != NULL) {
+            records++;
+            p++;
+        }
+    }
+
+    fclose(fp);
+
+    return records;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
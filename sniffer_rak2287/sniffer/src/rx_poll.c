@@ -0,0 +1,123 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Adaptive polling schedule for the concentrator RX buffer.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <string.h>     /* memset */
+
+#include "rx_poll.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void rx_poll_init(rx_poll_t *p, uint32_t min_us, uint32_t max_us) {
+
+    memset(p, 0, sizeof *p);
+
+    p->min_us = (min_us > 0) ? min_us : RX_POLL_MIN_US;
+    p->max_us = (max_us > 0) ? max_us : RX_POLL_MAX_US;
+    if (p->max_us < p->min_us) {
+        p->max_us = p->min_us;
+    }
+    p->delay_us = p->min_us;
+
+    atomic_init(&p->polls, 0);
+    atomic_init(&p->polls_empty, 0);
+    atomic_init(&p->polls_full, 0);
+    atomic_init(&p->packets, 0);
+    atomic_init(&p->sleep_us, 0);
+    atomic_init(&p->gap_sum_us, 0);
+    atomic_init(&p->gap_max_us, 0);
+}
+
+uint32_t rx_poll_update(rx_poll_t *p, uint64_t now_us, int nb_pkt, int max_pkt) {
+
+    uint32_t delay;
+    uint64_t gap;
+
+    atomic_fetch_add_explicit(&p->polls, 1, memory_order_relaxed);
+
+    if (nb_pkt <= 0) {
+        /* quiet, back off exponentially: min, 2*min, 4*min ... max */
+        atomic_fetch_add_explicit(&p->polls_empty, 1, memory_order_relaxed);
+        delay = p->delay_us;
+        p->delay_us = (p->delay_us > p->max_us / 2) ? p->max_us : p->delay_us * 2;
+    } else {
+        atomic_fetch_add_explicit(&p->packets, (uint64_t)nb_pkt, memory_order_relaxed);
+
+        /* packets may have sat in the buffer for as long as we were away */
+        if (p->last_us != 0 && now_us > p->last_us) {
+            gap = now_us - p->last_us;
+            if (gap > UINT32_MAX) {
+                gap = UINT32_MAX;
+            }
+            atomic_fetch_add_explicit(&p->gap_sum_us, gap, memory_order_relaxed);
+            if ((uint32_t)gap > atomic_load_explicit(&p->gap_max_us, memory_order_relaxed)) {
+                atomic_store_explicit(&p->gap_max_us, (uint32_t)gap, memory_order_relaxed);
+            }
+        }
+
+        p->delay_us = p->min_us;
+
+        if (nb_pkt >= max_pkt) {
+            /* more are waiting, re-poll at once */
+            atomic_fetch_add_explicit(&p->polls_full, 1, memory_order_relaxed);
+            delay = 0;
+        } else if (2 * nb_pkt >= max_pkt) {
+            /* buffer is filling, keep polling */
+            delay = 0;
+        } else {
+            delay = p->min_us;
+        }
+    }
+
+    p->last_us = now_us;
+    atomic_fetch_add_explicit(&p->sleep_us, delay, memory_order_relaxed);
+
+    return delay;
+}
+
+void rx_poll_stats(rx_poll_t *p, rx_poll_stats_t *s) {
+
+    uint64_t polls_data;
+
+    s->polls = atomic_load_explicit(&p->polls, memory_order_relaxed);
+    s->polls_empty = atomic_load_explicit(&p->polls_empty, memory_order_relaxed);
+    s->polls_full = atomic_load_explicit(&p->polls_full, memory_order_relaxed);
+    s->packets = atomic_load_explicit(&p->packets, memory_order_relaxed);
+    s->sleep_us = atomic_load_explicit(&p->sleep_us, memory_order_relaxed);
+    s->gap_max_us = atomic_load_explicit(&p->gap_max_us, memory_order_relaxed);
+
+    polls_data = s->polls - s->polls_empty;
+    s->gap_avg_us = (polls_data > 0) ? (uint32_t)(atomic_load_explicit(&p->gap_sum_us, memory_order_relaxed) / polls_data) : 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -50,54 +50,56 @@ Maintainer: Sylvain Miermont
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf sprintf fopen fputs getline */
 
-#include <string.h>     /* memset */
+#include <string.h>     /* memset memchr memcmp */
 #include <signal.h>     /* sigaction */
 #include <time.h>       /* time clock_gettime strftime gmtime clock_nanosleep*/
 #include <unistd.h>     /* getopt access fork */
 #include <stdlib.h>     /* atoi, malloc */
+#include <stdatomic.h>  /* C11 atomics */
 #include <errno.h>      /* error messages */
 #include <math.h>       /* round */
 
 #include <pthread.h>
-#include <sys/queue.h>  /* STAILQ queue */
 #include <sys/sendfile.h>
 
 #include <ctype.h>      /* isdigit */
 
 #include "parson.h"
 #include "base64.h"
+#include "async_log.h"
 #include "loragw_hal.h"
+#include "loragw_ctx.h"
 #include "loragw_aux.h"
 #include "loragw_gps.h"
+#include "loragw_sim.h"
+
+#include "report_segment.h"
+#include "http_uploader.h"
+#include "bulk_upload.h"
+#include "pkt_ring.h"
+#include "rx_poll.h"
+#include "ed_report.h"
+#include "capture.h"
+#include "replay.h"
+#include "metrics.h"
+#include "dev_table.h"
+#include "chan_agg.h"
+#include "key_store.h"
+#include "report_filter.h"
+#include "upload_compress.h"
+#include "report_cbor.h"
+#include "radio_hop.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
 
 #define ARRAY_SIZE(a)   (sizeof(a) / sizeof((a)[0]))
 
-/* message macros that utilise the wider logging function */
-#define MSG_INFO(format, ...)   print_log("INFO: " format __VA_OPT__(,) __VA_ARGS__)
-#define MSG_WARN(format, ...)   print_log("WARNING: " format __VA_OPT__(,) __VA_ARGS__)
-#define MSG_ERR(format, ...)    print_log("ERROR: " format __VA_OPT__(,) __VA_ARGS__)
-#define MSG_LOG(format, ...)    print_log("LOG: " format __VA_OPT__(,) __VA_ARGS__)
-
-/* Logging macro function */
-#define print_log(format, ...) {                                                                    \
-    int i = 0;                                                                                      \
-    log_file = fopen(log_file_name, "a");                                                           \
-    time_t ltime = time(NULL);                                                                      \
-    char *time_str = ctime(&ltime);                                                                 \
-    time_str[strlen(time_str)-1] = '\0';                                                            \
-    if (verbose) {                                                                                  \
-        fprintf(stdout, format __VA_OPT__(,) __VA_ARGS__);                                          \
-    }                                                                                               \
-    fprintf(log_file, "%s - " format , time_str __VA_OPT__(,) __VA_ARGS__);                         \
-    i = fclose(log_file);                                                                           \
-    if (i < 0) {                                                                                    \
-        printf("Failed to close log file\n");                                                       \
-        sniffer_exit();                                                                             \
-    }                                                                                               \
-}                                                                                                   \
+/* message macros that utilise the asynchronous logger */
+#define MSG_INFO(format, ...)   log_printf("INFO: " format __VA_OPT__(,) __VA_ARGS__)
+#define MSG_WARN(format, ...)   log_printf("WARNING: " format __VA_OPT__(,) __VA_ARGS__)
+#define MSG_ERR(format, ...)    log_printf("ERROR: " format __VA_OPT__(,) __VA_ARGS__)
+#define MSG_LOG(format, ...)    log_printf("LOG: " format __VA_OPT__(,) __VA_ARGS__)
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
@@ -106,7 +108,7 @@ Maintainer: Sylvain Miermont
     #define VERSION_STRING "undefined"
 #endif
 
-#define OPTION_ARGS         ":acdhv"
+#define OPTION_ARGS         ":acdhvx:j:r:s:"
 
 #define JSON_CONF_DEFAULT   "conf.json"
 
@@ -114,69 +116,44 @@ Maintainer: Sylvain Miermont
 #define FILE_RAM_INFO       "/proc/meminfo"
 #define FILE_WLAN0_STATS    "/proc/net/dev"
 
-#define JSON_REPORT_SUFFIX  ".json"
-
 #define JSON_REPORT_ED      "device"
 
-/* JSON key fields for device and channel report information*/
-#define JSON_TIME           "@timestamp"
-#define JSON_TYPE           "type"
-#define JSON_DEVADDR        "DevAddr"
-#define JSON_SNR            "SNR"
-#define JSON_RSSI           "RSSI"
-#define JSON_TOA            "ToA"
-#define JSON_ADR            "ADR"
-#define JSON_MTYPE          "MType"
-#define JSON_CRC            "CRC"
-#define JSON_FCNT           "FCnt"
-#define JSON_FREQ           "Freq"
-#define JSON_SF             "SF"
-#define JSON_FPORT          "FPort"
-#define JSON_FRMLEN         "FRMLen"
-#define JSON_APPEUI         "AppEui"
-#define JSON_DEVEUI         "DevEui"
-
 /* JSON key fields for gateway report information */
 #define JSON_TMP_CPU        "temp_cpu"
 #define JSON_TMP_CON        "temp_con"
 #define JSON_RAM_TOTL       "ram_totl"
 #define JSON_RAM_AVAL       "ram_aval"
 
-#define JSON_TIME_LEN       80          /* Max length of the timestamp string, including null terminator */
-#define JSON_DEVADDR_LEN    9           /* Max length of the device address string, including null terminator */
-#define JSON_MTYPE_LEN      4           /* Max length of the message type string, including null terminator */
-#define JSON_CRC_LEN        6           /* Max length of the CRC string, including null terminator */
-#define JSON_FOPT_LEN       10           /* Max length of an Fopt argument, 0x prefix, max 5 bytes, CID and null terminator */
-
-#define JSON_JR_DATA_LEN    17          /* Max length for two 64bit hex strings - used for AppEui and DevEui, including terminator */
-
-
-#define MAX_FOPTS_FIELDS    15          /* Maximum number of frame options */
-
 #define MS_CONV             1000        /* conversion define to go from seconds to milliseconds*/
 #define UPLOAD_SLEEP        1           /* sleep time of the upload thread to check if its time to upload */
 #define DEFAULT_INT_REPORT  900         /* default time interval (seconds) for report uploading */
 #define DEFAULT_INT_LOG     1800        /* default time interval (seconds) for log usage */
 #define DEFAULT_INT_STATS   4           /* default number of stats generated per log file */
+#define LOG_NAME            "sniffer_log"   /* log files are sniffer_log_<yyyymmddThhmmssZ>.txt */
+#define DEFAULT_SEG_BYTES   262144      /* default size (bytes) at which a report segment is sealed */
+#define DEFAULT_SEG_AGE     300         /* default age (seconds) at which a report segment is sealed */
+#define DEFAULT_SPOOL_SYNC  1000        /* default time (ms) between group commits of the report spool */
+#define DEFAULT_COMP_LEVEL  6           /* default zlib level of compressed uploads */
+#define DEFAULT_DICTIONARY  "mapping.json"  /* default index mapping the deflate dictionary is built from */
+#define SEAL_WAIT_MS        1000        /* longest wait (ms) for the encoder to seal the open segment before an upload */
+#define DEFAULT_RX_RING     1024        /* default number of packets buffered between the listener and encoder */
+#define MAX_CARDS           4           /* concentrators driven by one sniffer, SX130x_conf then SX130x_conf_1... */
+#define DEFAULT_CAP_BYTES   67108864    /* default size (bytes) at which a raw capture file is rotated */
+#define DEFAULT_CAP_KEEP    4           /* default number of rotated raw capture files kept */
+#define DEFAULT_METRICS_BIND "127.0.0.1" /* default address the metrics are served on */
+#define DEFAULT_DEV_TABLE   4096        /* default number of devices tracked */
+#define DEFAULT_DEV_SUMMARY 300         /* default interval (seconds) between device summaries */
+#define DEFAULT_DEV_EXPIRY  86400       /* default time (seconds) after which a silent device is forgotten */
 
 #define SF_COUNT            6           /* Number of spreading factors to be used */ 
 #define SF_BASE             7           /* Lowest SF (7->12) */
 #define DEFAULT_GROUP_COUNT 2           /* Number of radio groups */
 #define DEFAULT_GROUP       1           /* Default radio group */
+#define DEFAULT_GROUP_DWELL 10          /* default time (seconds) spent on a radio group when swapping */
+#define DEFAULT_DWELL_MIN   2           /* default shortest traffic weighted dwell (seconds) */
+#define DEFAULT_DWELL_MAX   60          /* default longest traffic weighted dwell (seconds) */
+#define HOP_SLEEP_MS        100         /* sleep time (ms) of the hopping thread between dwell checks */
 
-#define BITRATE_DR0         250         /* Bitrate(bit/sec) for SF12@125KHz*/
-#define BITRATE_DR1         440         /* Bitrate(bit/sec) for SF11@125KHz*/
-#define BITRATE_DR2         980         /* Bitrate(bit/sec) for SF10@125KHz*/
-#define BITRATE_DR3         1760        /* Bitrate(bit/sec) for SF9@125KHz*/
-#define BITRATE_DR4         3125        /* Bitrate(bit/sec) for SF8@125KHz*/
-#define BITRATE_DR5         5470        /* Bitrate(bit/sec) for SF7@125KHz*/
-
-#define EXTRA_PREAMBLE      8           /* Bytes allocated to LoRa transmission preamble */
-#define EXTRA_SYNCWORD      4.25        /* Bytes allocated to LoRa transmission synchronisation word */
-#define EXTRA_PHDR          8           /* Bytes allocated to LoRa transmission PHDR and PHDR_CRC */
-#define EXTRA_CRC           2           /* Bytes allocated to LoRa transmission CRC */
-
-#define CID_UNKNOWN         "CID_UNKWN" /* Error string used for an unknown CID*/
 
 /* defines for AUTH0 and HTTP POST curl-ing */
 #define CURL_TARGET_DASH    0
@@ -186,16 +163,24 @@ Maintainer: Sylvain Miermont
 #define CURL_RERUN          1
 #define CURL_FAILURE        3
 
-#define CURL_SYS_SHIFT      8
-
 #define CURL_TIMEOUT_MIN    3
 #define CURL_TIMEOUT_MAX    5
 #define CURL_ERRORS_MIN     3
 #define CURL_ERRORS_MAX     7
 
-#define CURL_OUTPUT         "out.json"
-#define CURL_PREFIX         "curl --connect-timeout 15 -o out.json -s -H \"Content-Type:application/json\""
-#define CURL_TEST           "curl --connect-timeout 15 -s"
+#define HTTP_CONNECT_TIMEOUT 15         /* connection timeout (seconds) of the uploader */
+
+/* upload modes for sealed device report segments */
+#define UPLOAD_MODE_SEGMENT 0           /* POST each segment as-is */
+#define UPLOAD_MODE_BULK    1           /* POST all pending reports as one Elasticsearch style _bulk request */
+
+/* encodings of the device reports in the segments */
+#define REPORT_FORMAT_JSON  0           /* one JSON line per report */
+#define REPORT_FORMAT_CBOR  1           /* one framed CBOR record per report, see report_cbor.h */
+
+#define DEFAULT_BULK_BYTES  5242880     /* default size (bytes) at which no more segments are added to a _bulk request */
+#define BULK_RETRY_FILE     "device_retry.ndjson"       /* documents to resend with the next _bulk request */
+#define BULK_REJECT_FILE    "device_rejected.ndjson"    /* documents the server refused for good */
 
 /* curl errors we actively deal with */
 #define CURL_ERR_SUCCESS    0
@@ -207,43 +192,36 @@ Maintainer: Sylvain Miermont
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE TYPES -------------------------------------------------------- */
 
-/* end device report - structured like a data frame! */
-typedef struct ed_report_s {
-    /* Auxiliary metrics */
-    char* timestamp;
-    float freq;
-    uint8_t sf;
-    float snr;
-    float rssi;
-    float toa;
-    /* Fields structured like a data frame! */
-    char* mtype;
-    char* devaddr;
-    bool adr;
-    bool ack;
-    uint8_t foptslen;
-    uint32_t fcnt;
-    char** fopts;
-    int fport;
-    uint8_t frmlength;
-    char* crc;
-    /* Special JR request items */
-    char* appEUI;
-    char* devEUI;
-    uint8_t size;
-} ed_report_t;
-
 /* struct for holding radio information configuration */
 typedef struct if_info_s {
     uint8_t radio;
     int32_t freq_if;
 } if_info_t;
 
-/* message queue struct type */
-struct entry {
-    struct lgw_pkt_rx_s rx_pkt;
-    STAILQ_ENTRY(entry) entries;
-};
+/* one concentrator card, with its own HAL context, listener and packet ring */
+typedef struct card_s {
+    int index;                              /* 0 for SX130x_conf, n for SX130x_conf_n */
+    lgw_ctx_t *ctx;                         /* HAL context of the card */
+    lgw_com_type_t com_type;                /* Interface type */
+    struct lgw_sim_conf_s simconf;          /* packet source, if com_type is SIM */
+    pkt_ring_t rx_ring;                     /* packet ring between the listener of the card and the encoder */
+    rx_poll_t rx_poll;                      /* listener polling schedule */
+    pthread_t thrid_listen;
+    int8_t antenna_gain;                    /* Gateway specificities */
+    if_info_t if_info[LGW_MULTI_NB];        /* Radio configuration structs */
+    bool radio_group_swapping;
+    int radio_group_current;                /* Current radio group in use, changed and read under the HAL context lock */
+    int radio_group_count;
+    struct lgw_conf_rxrf_s **rfconf;        /* Matrix of radio groups [group][radio config] */
+    int radio_group_dwell_mode;             /* RADIO_HOP_FIXED or RADIO_HOP_TRAFFIC */
+    uint32_t radio_group_dwell_ms;          /* time spent on a group, average over a round when traffic weighted */
+    uint32_t radio_group_dwell_min_ms;      /* shortest traffic weighted dwell */
+    uint32_t radio_group_dwell_max_ms;      /* longest traffic weighted dwell */
+    radio_hop_t hop;                        /* radio group schedule and per group statistics */
+    _Atomic uint64_t pkt_sf[SF_COUNT + 1];  /* packets encoded per SF, SF7 first, then any other datarate */
+    _Atomic uint64_t pkt_chain[LGW_IF_CHAIN_NB];    /* packets encoded per IF chain */
+    _Atomic uint64_t pkt_crc[4];            /* packets encoded per CRC status: OK, bad, none, other */
+} card_t;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
@@ -258,59 +236,103 @@ struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
 static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
 static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
 
-/* STAILQ messaging head and initialisation */
-static pthread_mutex_t mx_report_dev = PTHREAD_MUTEX_INITIALIZER; /* control access to the device message queue */
-STAILQ_HEAD(stailhead, entry);
-static struct stailhead head;
+/* concentrator cards, each one has a listener feeding its own ring, the encoder merges the rings */
+static card_t cards[MAX_CARDS];
+static int nb_cards = 0;
+static uint32_t rx_ring_size = DEFAULT_RX_RING;
+
+/* radio group hopping, on the cards with group swapping enabled and more than one group */
+static bool radio_hopping = false;
+
+/* listener polling schedule */
+static uint32_t rx_poll_min_us = RX_POLL_MIN_US;
+static uint32_t rx_poll_max_us = RX_POLL_MAX_US;
 
 /* configuration variables needed by the application  */
 static uint64_t lgwm = 0; /* LoRa gateway MAC address */
 
 /* clock, log file, and statistics management */
-static pthread_mutex_t mx_log = PTHREAD_MUTEX_INITIALIZER;  /* control access to the log file */
-static int ed_reports_total = 0;                            /* statistics variables */
-static uint32_t packets_caught = 0;                         /* Total packets caught */
+static _Atomic uint32_t ed_reports_total = 0;               /* statistics variables, written by the uploader only */
+static _Atomic uint32_t packets_caught = 0;                 /* Total packets caught, written by the listeners or the replay only */
 static bool verbose = false;
 static bool continuous = false;
-static FILE * log_file = NULL;
-static char log_file_name[128];
+static size_t log_max_bytes = 0;                            /* size (bytes) at which a new log file is started, 0 for no limit */
 
 /* uploading files, auth0 authorisation and HTTP post variables */
 static uint8_t failed_curls = 0;
 static char file_client_key[80];   /* holds the client_key file string */
 static char url_auth0[80];         /* auth0 url for token collection */
 static char url_dash[80];          /* desired dashboard url */
-static char auth_key[800];         /* holds the bearer token string */
-
-/* hardware access control and correction */
-static pthread_mutex_t mx_concent = PTHREAD_MUTEX_INITIALIZER; /* control access to the concentrator */
-
-/* Gateway specificities */
-static int8_t antenna_gain = 0;
-
+static char url_bulk[80];          /* _bulk endpoint url, defaults to the dashboard url */
+static char bulk_index[40];        /* index named in the _bulk action lines, empty to leave it to the url */
+static int upload_mode = UPLOAD_MODE_SEGMENT;
+static int report_format = REPORT_FORMAT_JSON;
+static size_t bulk_max_bytes = DEFAULT_BULK_BYTES;
+static bulk_req_t bulk;            /* _bulk request, reused every report interval */
+static http_buf_t bulk_scratch;    /* segment being added to the _bulk request */
+static http_buf_t client_key;      /* holds the client_key file contents, sent for every auth0 request */
+static http_uploader_t uploader;   /* persistent HTTP connection, holds the bearer token and last response */
+static compress_t upload_compress; /* compressor of the report upload bodies */
+static int upload_compression = COMPRESS_NONE;
+static int upload_compress_level = DEFAULT_COMP_LEVEL;
+static char upload_dictionary[80] = DEFAULT_DICTIONARY; /* index mapping the deflate dictionary is built from */
+
+/* hardware access is serialized by the HAL contexts of the cards */
 static struct lgw_conf_debug_s debugconf;
 static uint32_t nb_pkt_received_ref[16];
 
-/* Interface type */
-static lgw_com_type_t com_type = LGW_COM_USB;
-
-/* Radio configuration structs */
-static if_info_t if_info[LGW_MULTI_NB];
-static bool radio_group_swapping;
-static int radio_group_current; /* Current radio group in use */
-static int radio_group_count;
-static struct lgw_conf_rxrf_s **rfconf; /* Matrix of radio groups [group][radio config] */
-
 /* JSON writing management and control */
-/* the two sets of reports counters and mutexes should allow us to read and move the json encoded ED reports */
-/* almost certainly a better way to do this but oh well */
-static pthread_mutex_t mx_ed_report_0 = PTHREAD_MUTEX_INITIALIZER; /* control access to the ed_report_0 counter */
-static pthread_mutex_t mx_ed_report_1 = PTHREAD_MUTEX_INITIALIZER; /* control access to the ed_report_1 counter */
-static char report_string[100];
-static int ed_reports_0 = 0;
-static int ed_reports_1 = 0;
-static int ed_uploads_0 = 0;
-static int ed_uploads_1 = 0;
+/* encoded ED reports are appended to rolling NDJSON segments, the uploader ships whole sealed segments */
+static segment_writer_t ed_segment;
+static size_t segment_max_bytes = DEFAULT_SEG_BYTES;        /* size (in bytes) at which a segment is sealed */
+static unsigned segment_max_age = DEFAULT_SEG_AGE;          /* age (in sec) at which a segment is sealed */
+static char report_string[SEGMENT_NAME_LEN];                /* segment currently being uploaded */
+static bool spool_journal = true;                           /* segments and acknowledgements survive a restart */
+static unsigned spool_sync_ms = DEFAULT_SPOOL_SYNC;         /* time (in ms) between group commits of the spool */
+static uint32_t spool_resume = 0;                           /* first segment not acknowledged, where the uploader starts */
+
+/* per device state, owned by the encoder, summaries go to the device segments */
+static dev_table_t dev_table;
+static uint32_t dev_table_size = DEFAULT_DEV_TABLE;         /* devices tracked */
+static unsigned dev_summary_interval = DEFAULT_DEV_SUMMARY; /* time (in sec) between device summaries, 0 for none */
+static unsigned dev_expiry = DEFAULT_DEV_EXPIRY;            /* time (in sec) after which a silent device is forgotten */
+static bool device_reports = true;                          /* one report per packet, on top of the summaries */
+
+/* per channel and SF time buckets, owned by the encoder, they go to the device segments too */
+static chan_agg_t chan_agg;
+static unsigned channel_bucket = 0;                         /* bucket length (in sec), 0 for no buckets */
+
+/* session keys of known devices, the encoder checks their MIC and decrypts their payloads */
+static key_store_t key_store;
+static bool key_store_enabled = false;
+static char key_file[80];                                   /* key file path, empty for no key store */
+static bool key_data = false;                               /* decrypted application payloads go in the reports */
+
+/* report filter, the encoder runs it on every packet before its device report is appended */
+static report_filter_t report_filter;
+static bool report_filter_enabled = false;
+
+/* raw packet capture, written by the encoder next to the device reports */
+static capture_writer_t capture;
+static bool capture_enabled = false;
+static char capture_path[CAPTURE_PREFIX_LEN];               /* capture file path without suffix, empty for no capture */
+static size_t capture_max_bytes = DEFAULT_CAP_BYTES;        /* size (in bytes) at which the capture file is rotated */
+static unsigned capture_keep = DEFAULT_CAP_KEEP;            /* rotated capture files kept */
+
+/* replay of a raw capture in place of the concentrators */
+static const char *replay_file = NULL;                      /* capture to replay, NULL to listen to the concentrators */
+static double replay_speed = 1.0;                           /* 1 real time, N times faster, 0 as fast as possible */
+
+/* runtime metrics, served in Prometheus text format */
+static metrics_server_t metrics_server;
+static char metrics_bind[16] = DEFAULT_METRICS_BIND;        /* IPv4 address the metrics are served on */
+static unsigned metrics_port = 0;                           /* TCP port the metrics are served on, 0 to disable */
+static time_t start_time;
+static metrics_hist_t metric_receive;                       /* lgw_receive durations, from the HAL time measures */
+static metrics_hist_t metric_encode;                        /* time to report, encode and append one packet */
+static metrics_hist_t metric_upload;                        /* duration of the report upload requests */
+static _Atomic uint64_t metric_uploads = 0;                 /* report upload requests sent */
+static _Atomic uint64_t metric_curl_failures = 0;           /* curl requests that failed, timeouts included */
 
 /* Curl failure prevention variables */
 static int curl_failures = 0;
@@ -335,30 +357,17 @@ static float stat_get_ram_total (void);
 
 static float stat_get_temp_cpu (void);
 
-static float stat_get_temp_lgw (void);
+static float stat_get_temp_lgw (card_t *card);
 
 static int stat_get_wlan0_rx_tx (long *rx, long *tx);
 
-/* Special functions for caught data frame parsing and handling */
-static int fopts_get_mac_len (uint8_t cid);
-
-static int write_cid_ed_report (ed_report_t* report, int index, char* string);
-
-/* End device report writing object handlers */
-static ed_report_t* create_ed_report(void);
-
-static void write_ed_report(ed_report_t* report, struct lgw_pkt_rx_s *p, struct tm *xt, struct timespec *fetch_time);
-
-static void reset_ed_report(ed_report_t* report);
-
-static void destroy_ed_report(ed_report_t* report);
+static void generate_sniffer_stats(void);
 
-/* Report object encoding functions */
-static void create_file_string(char* dest, char* file_type, int index_mutex, int index_file);
+static int render_metrics(metrics_out_t *out, void *arg);
 
-static void encode_ed_report(ed_report_t *info, int index_mutex, int index_file);
+static void meas_time_hook(int debug_level, const char *str, uint32_t time_us);
 
-static void generate_sniffer_stats(void);
+static uint64_t monotonic_us(void);
 
 /* Auxilliary help functions */
 
@@ -369,12 +378,14 @@ static int sniffer_stop(void);
 static void sniffer_exit(void);
 
 /* Radio configuration functions */
-static int init_radio_group(int group);
+static int init_radio_group(card_t *card, int group, bool restart);
+
+static bool card_hops(const card_t *card);
 
 static void stat_cleanup(void);
 
 /* Configuration parsing files */
-static int parse_SX130x_configuration(const char * conf_file);
+static int parse_SX130x_configuration(const char * conf_file, const char * conf_obj_name, card_t *card);
 
 static int parse_gateway_configuration(const char * conf_file);
 
@@ -386,7 +397,7 @@ static int parse_upload_configuration(const char * conf_file);
 static void log_open (void);
 
 /* curl HTTP post handling functions */
-static int curl_read_system (int system_output);
+static int curl_read_result (int curl_code);
 
 static int curl_handle_timeout (char* url_to_check);
 
@@ -396,16 +407,36 @@ static int curl_parse (JSON_Value *root_val, int curl_target);
 
 static int curl_get_auth0 (void);
 
+static bool dash_unauthorized (void);
+
 static int curl_upload_file (const char * upload_file);
 
-static int save_unknown_response (const char* file_in);
+static int curl_upload_bulk (uint32_t *seq_upload, uint32_t seq_sealed, bool *sent);
+
+static int upload_post (const char * url, const char * content_type, const void * body, size_t len);
+
+static bool record_is_device_report (const char *rec, size_t len);
+
+static long count_device_reports (const char *file_name);
+
+static size_t bulk_device_reports (const bulk_req_t *b, bool all);
+
+static void encode_device_summaries (time_t now);
+
+static void encode_channel_buckets (void);
+
+static int save_unknown_response (const char* response, size_t len);
+
+static int save_unknown_file (const char* file_in);
 
 /* threads */
-void thread_listen(void);
+void *thread_listen(void *arg);
 void thread_gps(void);
 void thread_valid(void);
 void thread_spectral_scan(void);
 void thread_encode(void);
+void thread_hop(void);
+void *thread_replay(void *arg);
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS  ----------------------------------------- */
@@ -415,11 +446,15 @@ static void usage( void )
     printf("~~~ Library version string~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
     printf(" %s\n", lgw_version_info());
     printf("~~~ Available options ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
-    printf(" -a keep all logs\n");
+    printf(" -a keep all logs and uploaded report segments\n");
     printf(" -c <filename>  use config file other than 'conf.json'\n");
     printf(" -d create process as daemon\n");
     printf(" -h print this help\n");
     printf(" -v print all log messages to stdout\n");
+    printf(" -x <capture> export a raw capture to <capture>.pcapng (LoRaTap) and exit\n");
+    printf(" -j <segment> decode the CBOR device reports of a segment to <segment>.decoded.ndjson and exit\n");
+    printf(" -r <capture> replay a raw capture instead of listening to the concentrators, exit at its end\n");
+    printf(" -s <float> replay speed, 1 for real time, N for N times faster, 0 for as fast as possible [1]\n");
     printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
 }
 
@@ -602,19 +637,18 @@ static float stat_get_temp_cpu (void) {
 /**
  * Gets the temperature of the lora gateway concentrator card.
  * 
+ * @param card  Concentrator card to read
  * @return Returns the termpature as a float, 0 on error otherwise
 */
-static float stat_get_temp_lgw (void) {
+static float stat_get_temp_lgw (card_t *card) {
 
     int i;
     float temp = 0;
 
-    pthread_mutex_lock(&mx_concent);
-    i = lgw_get_temperature(&temp);
-    pthread_mutex_unlock(&mx_concent);
+    i = lgw_ctx_get_temperature(card->ctx, &temp);
 
     if (i == LGW_HAL_ERROR) {
-        MSG_ERR("Failed to acquire concentrator temp\n");
+        MSG_ERR("Failed to acquire concentrator %d temp\n", card->index);
         temp = 0;
     }
 
@@ -671,379 +705,329 @@ static int stat_get_wlan0_rx_tx (long *rx, long *tx) {
 }
 
 /**
- * Returns the expected length of the MAC command data fields given some CID. Returns an 
- * error if the CID provides a value that cannot be handled (i.e. invalid CIDs 0 or 1, RFU,
- * or proprietary)
- * 
- * @param cid   The command identifier
- * @return      -1 if the CID
+ * Gather all stats relative to the sniffer and print them.
+ *
+ * Currently acquires:
+ *  - Pi CPU temp
+ *  - LGW concentrator temp
+ *  - Total system ram
+ *  - Total available system ram
 */
-static int fopts_get_mac_len (uint8_t cid) {
-
-    static const uint8_t mac_len[] = {
-        -1, -1, 2, 4, 1, 4, 2, 5, 1, 1, 5, -1, -1, 5, -1, -1, -1
-    };
-
-    if (cid > 0x80)
-        return -1;
+static void generate_sniffer_stats (void) {
 
-    return mac_len[cid];
-}
+    int i, g;
+    card_t *card;
+    float temp_cpu, ram_total, ram_available;
+    long rx = 0;
+    long tx = 0;
+    rx_poll_stats_t poll_stats;
+    radio_hop_stats_t hop_stats;
+    double elapsed, heard;
 
-/**
- * Write a CID entry to the ed_report struct.
- * Allocates space at the given index and copies the string in.
- * @param report    Report object pointer
- * @param index     Index to write to
- * @param string    String to enter
- * @return          0 on success, -1 otherwise
-*/
-static int write_cid_ed_report (ed_report_t* report, int index, char* string) {
+    temp_cpu = stat_get_temp_cpu();
+    ram_total = stat_get_ram_total();
+    ram_available = stat_get_ram_available();
 
-    int ret = 0;
+    stat_get_wlan0_rx_tx(&rx, &tx);
 
-    report->fopts[index] = malloc(sizeof(char) * JSON_FOPT_LEN);
+    MSG_INFO("Pi Temp: %fC\n", temp_cpu);
+    MSG_INFO("Total RAM: %fMiB\n", ram_total);
+    MSG_INFO("Available RAM %fMiB\n", ram_available);
+    MSG_INFO("WLAN0 RX: %lu\n", rx);
+    MSG_INFO("WLAN0 TX: %lu\n", tx);
+    MSG_INFO("Total packets caught %lu\n", (unsigned long)packets_caught);
+    MSG_INFO("Log messages dropped %lu\n", (unsigned long)log_dropped());
 
-    if (report->fopts[index] == NULL) {
-        MSG_ERR("[write_cid_ed_report] Unable to allocate memory to write CID\n");
-        return -1;
+    for (i = 0; i < nb_cards; i++) {
+        card = &cards[i];
+        rx_poll_stats(&card->rx_poll, &poll_stats);
+        if (replay_file == NULL) {
+            MSG_INFO("LGW %d Temp: %fC\n", card->index, stat_get_temp_lgw(card));
+        }
+        MSG_INFO("LGW %d packets dropped on a full ring %lu\n", card->index, (unsigned long)atomic_load(&card->rx_ring.overflow));
+        MSG_INFO("LGW %d RX polls %llu (empty %llu, full %llu), %llu packets\n", card->index, (unsigned long long)poll_stats.polls,
+                (unsigned long long)poll_stats.polls_empty, (unsigned long long)poll_stats.polls_full, (unsigned long long)poll_stats.packets);
+        MSG_INFO("LGW %d RX buffer wait before fetch avg %luus, max %luus\n", card->index, (unsigned long)poll_stats.gap_avg_us, (unsigned long)poll_stats.gap_max_us);
+        MSG_INFO("LGW %d ring high water mark %lu of %lu\n", card->index, (unsigned long)atomic_load(&card->rx_ring.high_water), (unsigned long)card->rx_ring.size);
+        if (radio_hopping && card_hops(card)) {
+            radio_hop_stats(&card->hop, monotonic_us(), &hop_stats);
+            elapsed = hop_stats.elapsed_us / 1e6;
+            MSG_INFO("LGW %d radio groups covered %d of %d, %llu hops, %.1fs of %.1fs spent retuning (%.2f%%)\n", card->index,
+                     hop_stats.covered, hop_stats.nb_groups, (unsigned long long)hop_stats.hops, hop_stats.dead_us / 1e6, elapsed,
+                     (elapsed > 0) ? hop_stats.dead_us / 1e4 / elapsed : 0.0);
+            for (g = 0; g < hop_stats.nb_groups; g++) {
+                heard = hop_stats.listen_us[g] / 1e6;
+                MSG_INFO("LGW %d radio group %d heard %.1fs (%.1f%%) over %llu visits, %llu packets (%.2f pkt/s), unheard for %.1fs at most\n",
+                         card->index, g, heard, (elapsed > 0) ? 100.0 * heard / elapsed : 0.0, (unsigned long long)hop_stats.visits[g],
+                         (unsigned long long)hop_stats.packets[g], (heard > 0) ? hop_stats.packets[g] / heard : 0.0, hop_stats.gap_max_us[g] / 1e6);
+            }
+        }
     }
-
-    ret = sprintf(report->fopts[index], string);
-
-    if (ret < 0) {
-        MSG_ERR("[write_cid_ed_report] Failed to sprintf CID string to e_report\n");
-        return -1;
+    MSG_INFO("Total packets uploaded %lu\n", (unsigned long)ed_reports_total);
+    if (capture_enabled) {
+        MSG_INFO("Raw packets captured %llu, capture write errors %llu\n", (unsigned long long)capture.records, (unsigned long long)capture.errors);
     }
 
-    return 0;
 }
 
 /**
- * Create the appropriate string for a JSON file. User can define if the 
- * file is for a channel or device report, as well as its number.
- * 
- * @param dest          Char* to allocate the string to
- * @param file_type     prefix of the file type (i.e. JSON_REPORT_ED)
- * @param index_mutex   Index of the mutex to use
- * @param index_file    Index of the file
+ * Get a monotonic time, for durations.
+ *
+ * @return  Time in microseconds
 */
-static void create_file_string(char* dest, char* file_type, int index_mutex, int index_file) {
-
-    char number[20];
-    memset(dest, 0, 100);
-    sprintf(number, "%d_%d", index_mutex, index_file);
-    strcat(dest, file_type);
-    strcat(dest, number);
-    strcat(dest, JSON_REPORT_SUFFIX);
-}
+static uint64_t monotonic_us(void) {
 
-/**
- * Create (allocate memory) for an ED report object.
- * 
- * @return  Pointer to an ed_report_t object
-*/
-static ed_report_t* create_ed_report(void) {
-
-    ed_report_t *ed_report =    (ed_report_t*)calloc(1, sizeof(ed_report_t));
-    ed_report->timestamp =      (char*)calloc(JSON_TIME_LEN, sizeof(char));
-    ed_report->devaddr =        (char*)calloc(JSON_DEVADDR_LEN, sizeof(char));
-    ed_report->mtype =          (char*)calloc(JSON_MTYPE_LEN, sizeof(char));
-    ed_report->crc =            (char*)calloc(JSON_CRC_LEN, sizeof(char));
-    ed_report->fopts =          (char**)calloc(MAX_FOPTS_FIELDS, sizeof(char*));
-    ed_report->appEUI =         (char*)calloc(JSON_JR_DATA_LEN, sizeof(char));
-    ed_report->devEUI =         (char*)calloc(JSON_JR_DATA_LEN, sizeof(char));
-    ed_report->foptslen = 0; // Foptslen on creation MUST be 0
-    return ed_report;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
 }
 
 /**
- * Fill an ed_report_t object with the appropriate data given the lgw_pkt_rx_s and timestamp.
- * 
- * @param report    Pointer to the ed_report_t object to fill
- * @param p         Pointer to the lgw_pkt_rx_s containing the incoming transmission data
- * @param timestamp Pointer to a tm struct timestamp object
- * 
- * @return          None
+ * Write every runtime metric in Prometheus text format. Called from the metrics
+ * server thread, so only atomics and values set before it started are read.
+ *
+ * @param out   Page to write to
+ * @param arg   Unused
+ * @return      0
 */
-static void write_ed_report(ed_report_t* report, struct lgw_pkt_rx_s *p, struct tm *xt, struct timespec *fetch_time) {
-
-    /* airtime calculation variable */
-    float airtime = 0;
-
-    /* CID sprintf array */
-    char number[JSON_FOPT_LEN];
-
-    /* recieved packet variables that require a bit of shifting */
-    uint64_t mote_mac_cmd = 0;
-    uint64_t dev_eui, app_eui;
-    uint32_t mote_addr = 0;
-    int mac_len = 0;
-    uint8_t mote_mhdr = 0;
-    uint8_t mote_cid = 0;
-    uint8_t offset = 0;
-
-    /* Timestamp */
-    sprintf(report->timestamp, "%04i-%02i-%02iT%02i:%02i:%02i.%03liZ",(xt->tm_year)+1900,(xt->tm_mon)+1,xt->tm_mday,xt->tm_hour,xt->tm_min,xt->tm_sec,(fetch_time->tv_nsec)/1000000); /* ISO 8601 format */
-    
-    /* MHDR and Message Type */
-    mote_mhdr = p->payload[0];
-    
-    /* CRC status */
-    switch(p->status) {
-        case STAT_CRC_OK:       sprintf(report->crc, "OK");     break;
-        case STAT_CRC_BAD:      sprintf(report->crc, "BAD");    break;
-        case STAT_NO_CRC:       sprintf(report->crc, "NONE");   break;
-        case STAT_UNDEFINED:    sprintf(report->crc, "UNDEF");  break;
-        default:                sprintf(report->crc, "ERR");
+static int render_metrics(metrics_out_t *out, void *arg) {
+
+    static const char *crc_name[4] = {"ok", "bad", "none", "other"};
+    char labels[64];
+    card_t *card;
+    rx_poll_stats_t poll_stats;
+    radio_hop_stats_t hop_stats[MAX_CARDS];
+    uint64_t raw, sent;
+    int i, j;
+
+    (void)arg;
+
+    metrics_family(out, "sniffer_build_info", "gauge", "Sniffer version");
+    snprintf(labels, sizeof labels, "version=\"%s\"", VERSION_STRING);
+    metrics_sample(out, "sniffer_build_info", labels, 1);
+    metrics_family(out, "sniffer_start_time_seconds", "gauge", "Start time of the sniffer since the epoch");
+    metrics_sample(out, "sniffer_start_time_seconds", NULL, (double)start_time);
+
+    metrics_family(out, "sniffer_packets_caught_total", "counter", "Packets fetched from the concentrators");
+    metrics_sample(out, "sniffer_packets_caught_total", NULL, atomic_load(&packets_caught));
+    metrics_family(out, "sniffer_reports_uploaded_total", "counter", "Device reports accepted by the dashboard");
+    metrics_sample(out, "sniffer_reports_uploaded_total", NULL, atomic_load(&ed_reports_total));
+
+    metrics_family(out, "sniffer_packets_sf_total", "counter", "Packets encoded per spreading factor");
+    for (i = 0; i < nb_cards; i++) {
+        for (j = 0; j <= SF_COUNT; j++) {
+            if (j < SF_COUNT) {
+                snprintf(labels, sizeof labels, "card=\"%d\",sf=\"%d\"", cards[i].index, SF_BASE + j);
+            } else {
+                snprintf(labels, sizeof labels, "card=\"%d\",sf=\"other\"", cards[i].index);
+            }
+            metrics_sample(out, "sniffer_packets_sf_total", labels, atomic_load_explicit(&cards[i].pkt_sf[j], memory_order_relaxed));
+        }
+    }
+    metrics_family(out, "sniffer_packets_channel_total", "counter", "Packets encoded per IF chain");
+    for (i = 0; i < nb_cards; i++) {
+        for (j = 0; j < LGW_IF_CHAIN_NB; j++) {
+            snprintf(labels, sizeof labels, "card=\"%d\",channel=\"%d\"", cards[i].index, j);
+            metrics_sample(out, "sniffer_packets_channel_total", labels, atomic_load_explicit(&cards[i].pkt_chain[j], memory_order_relaxed));
+        }
+    }
+    metrics_family(out, "sniffer_packets_crc_total", "counter", "Packets encoded per CRC status");
+    for (i = 0; i < nb_cards; i++) {
+        for (j = 0; j < 4; j++) {
+            snprintf(labels, sizeof labels, "card=\"%d\",crc=\"%s\"", cards[i].index, crc_name[j]);
+            metrics_sample(out, "sniffer_packets_crc_total", labels, atomic_load_explicit(&cards[i].pkt_crc[j], memory_order_relaxed));
+        }
     }
 
-    /* General packet statistics - Freq, SF, SNR, RSSI, ToA, */
-    report->freq = ((double)p->freq_hz / 1e6);
-
-    
-
-    report->sf = p->datarate;
-    report->snr = p->snr;
-    report->rssi = p->rssis;
-
-    /* Time on air calculation */
-    airtime = (p->size + EXTRA_PREAMBLE + EXTRA_SYNCWORD + EXTRA_PHDR + EXTRA_CRC) * 8;
-    switch (p->datarate) {
-        case DR_LORA_SF7:   airtime = airtime / BITRATE_DR5; break;
-        case DR_LORA_SF8:   airtime = airtime / BITRATE_DR4; break;
-        case DR_LORA_SF9:   airtime = airtime / BITRATE_DR3; break;
-        case DR_LORA_SF10:  airtime = airtime / BITRATE_DR2; break;
-        case DR_LORA_SF11:  airtime = airtime / BITRATE_DR1; break;
-        case DR_LORA_SF12:  airtime = airtime / BITRATE_DR0; break;
-        default:            MSG_ERR("Unknown spreading factor found");
-    }
-    report->toa = airtime * 1e3; // In ms 
-
-    /* Join request case... very important */
-    if (mote_mhdr >> 5 == 0b000) {
-        // Special case for JR
-        sprintf(report->mtype, "JR");
-
-        // First 8 bytes are the APP EUI
-        app_eui = (uint64_t)p->payload[1] | (uint64_t)p->payload[2] << 8 | (uint64_t)p->payload[3] << 16 | (uint64_t)p->payload[4] << 24 | (uint64_t)p->payload[5] << 32 | (uint64_t)p->payload[6] << 40 | (uint64_t)p->payload[7] << 48 | (uint64_t)p->payload[8] << 56;
-        sprintf(report->appEUI, "%.16llx", app_eui);
-        
-        // Second 8 bytes are the Dev EUI
-        dev_eui = (uint64_t)p->payload[9] | (uint64_t)p->payload[10] << 8 | (uint64_t)p->payload[11] << 16 | (uint64_t)p->payload[12] << 24 | (uint64_t)p->payload[13] << 32 | (uint64_t)p->payload[14] << 40 | (uint64_t)p->payload[15] << 48 | (uint64_t)p->payload[16] << 56;
-        sprintf(report->devEUI, "%.16llx", dev_eui);
+    if (key_store_enabled) {
+        metrics_family(out, "sniffer_mic_total", "counter", "Frames of devices with known session keys, per MIC check result");
+        metrics_sample(out, "sniffer_mic_total", "result=\"ok\"", atomic_load_explicit(&key_store.nb_mic_ok, memory_order_relaxed));
+        metrics_sample(out, "sniffer_mic_total", "result=\"bad\"", atomic_load_explicit(&key_store.nb_mic_bad, memory_order_relaxed));
+        metrics_family(out, "sniffer_payloads_decrypted_total", "counter", "FRMPayloads decrypted with session keys");
+        metrics_sample(out, "sniffer_payloads_decrypted_total", NULL, atomic_load_explicit(&key_store.nb_decrypted, memory_order_relaxed));
+    }
 
-        // Then there are 2 DevNonce fields
-        // Uploading this for a check - JR should be (at max) 19 bytes?
-        report->frmlength = p->size;
-        
-        return;
-    }
-
-    switch(mote_mhdr >> 5) {
-        // case 0b000 : sprintf(report->mtype, "JR");  break; // Not used as this results in a different message type
-        // case 0b001 : sprintf(report->mtype, "JA");  break; // Not used as this results in a different message type
-        case 0b010 : sprintf(report->mtype, "UDU"); break;
-        case 0b011 : sprintf(report->mtype, "UDD"); break;
-        case 0b100 : sprintf(report->mtype, "CDU"); break;
-        case 0b101 : sprintf(report->mtype, "CDD"); break;
-        case 0b110 : sprintf(report->mtype, "RFU"); break;
-        case 0b111 : sprintf(report->mtype, "PRP"); break;
-    }
-
-    /* FHDR breakdown - DevAddr, FCtrl, FCnt, FOpts */
-    /* DevAddr */
-    mote_addr = p->payload[1] | p->payload[2] << 8 | p->payload[3] << 16 | p->payload[4] << 24;
-    sprintf(report->devaddr, "%.8x", mote_addr);
-
-    /* FCtrl - ADR, ACK, FOptsLen */
-    report->adr = (p->payload[5] & 0x80) ? true : false;
-    report->ack = (p->payload[5] & 0x20) ? true : false;
-    report->foptslen = p->payload[5] & 0x0F;
-
-    /* FCnt */
-    report->fcnt = p->payload[6] | p->payload[7] << 8;
-
-    /* FOpts - if any */
-    // if (report->foptslen && p->status ==STAT_CRC_OK) {
-    //     MSG_INFO("Device was %s\n", report->devaddr);
-    //     MSG_INFO("ADR was %s\n", report->adr ? "TRUE" : "FALSE");
-    //     MSG_INFO("ACK was %s\n", report->ack ? "TRUE" : "FALSE");
-    //     MSG_INFO("FOptslen was %d\n", report->foptslen);
-    //     MSG_INFO("FOPTS were: \n");
-
-    //     for (int i = 0; i < report->foptslen; i++) {
-
-    //         mote_cid = p->payload[8 + offset];
-    //         sprintf(number, "0x%.2x", mote_cid);
-    //         //DEBUG LINES
-    //         MSG_INFO("%s\n", number);
-    //         offset++;
-
-    //         memset(number, 10, sizeof(char));
-    //     }
-    // } else if (p->status == STAT_CRC_OK && report->ack) {
-    //     MSG_INFO("I noticed device %s sent an ACK...\n", report->devaddr);
-    // }
-
-    /* FPort and Foptslen */
-    report->fport = (p->size == 8 + report->foptslen) ? -1 : p->payload[8 + offset];
-
-    if (report->fport == -1) {
-        report->frmlength = p->size - 8 - report->foptslen; // 8 is (7 FHDR + 1 MHDR)
-    } else {
-        report->frmlength = p->size - 8 - report->foptslen - 1; // 8 is (7 FHDR + 1 MHDR) and 1 is FPORT
+    if (report_filter_enabled) {
+        metrics_family(out, "sniffer_filter_packets_total", "counter", "Packets run through the report filter, per outcome");
+        metrics_sample(out, "sniffer_filter_packets_total", "result=\"kept\"", atomic_load_explicit(&report_filter.nb_kept, memory_order_relaxed));
+        metrics_sample(out, "sniffer_filter_packets_total", "result=\"dropped\"", atomic_load_explicit(&report_filter.nb_dropped, memory_order_relaxed));
+        metrics_family(out, "sniffer_filter_hits_total", "counter", "Packets matching each report filter rule");
+        for (i = 0; i < report_filter.nb_rules; i++) {
+            snprintf(labels, sizeof labels, "rule=\"%s\"", report_filter.rules[i].name);
+            metrics_sample(out, "sniffer_filter_hits_total", labels, atomic_load_explicit(&report_filter.rules[i].hits, memory_order_relaxed));
+        }
+        metrics_family(out, "sniffer_filter_dropped_total", "counter", "Packets dropped by each report filter rule");
+        for (i = 0; i < report_filter.nb_rules; i++) {
+            snprintf(labels, sizeof labels, "rule=\"%s\"", report_filter.rules[i].name);
+            metrics_sample(out, "sniffer_filter_dropped_total", labels, atomic_load_explicit(&report_filter.rules[i].dropped, memory_order_relaxed));
+        }
     }
 
-    // if (report->foptslen && p->status ==STAT_CRC_OK) {
-    //     MSG_INFO("FPort was %d\n", report->fport);
-    //     MSG_INFO("Payload original size was %d and FRM is %d\n", p->size, report->frmlength);
-    //     MSG_INFO("\n");
-    // }
-}
+    metrics_family(out, "sniffer_ring_depth", "gauge", "Packets waiting for the encoder");
+    for (i = 0; i < nb_cards; i++) {
+        snprintf(labels, sizeof labels, "card=\"%d\"", cards[i].index);
+        metrics_sample(out, "sniffer_ring_depth", labels, pkt_ring_count(&cards[i].rx_ring));
+    }
+    metrics_family(out, "sniffer_ring_high_water", "gauge", "Most packets ever waiting for the encoder");
+    for (i = 0; i < nb_cards; i++) {
+        snprintf(labels, sizeof labels, "card=\"%d\"", cards[i].index);
+        metrics_sample(out, "sniffer_ring_high_water", labels, atomic_load(&cards[i].rx_ring.high_water));
+    }
+    metrics_family(out, "sniffer_ring_dropped_total", "counter", "Packets dropped on a full ring");
+    for (i = 0; i < nb_cards; i++) {
+        snprintf(labels, sizeof labels, "card=\"%d\"", cards[i].index);
+        metrics_sample(out, "sniffer_ring_dropped_total", labels, atomic_load(&cards[i].rx_ring.overflow));
+    }
 
-/**
- * Set memory of pointers within ed_report_t object to 0.
- * 
- * @param report    Pointer to the ed_report_t object to clear
-*/
-static void reset_ed_report(ed_report_t* report) {
+    if (radio_hopping) {
+        for (i = 0; i < nb_cards; i++) {
+            radio_hop_stats(&cards[i].hop, monotonic_us(), &hop_stats[i]);
+        }
+        metrics_family(out, "sniffer_radio_group_current", "gauge", "Radio group each swapping card listens to");
+        for (i = 0; i < nb_cards; i++) {
+            if (card_hops(&cards[i])) {
+                snprintf(labels, sizeof labels, "card=\"%d\"", cards[i].index);
+                metrics_sample(out, "sniffer_radio_group_current", labels, hop_stats[i].current);
+            }
+        }
+        metrics_family(out, "sniffer_radio_group_listen_seconds_total", "counter", "Time spent listening to each radio group");
+        for (i = 0; i < nb_cards; i++) {
+            for (j = 0; j < hop_stats[i].nb_groups && card_hops(&cards[i]); j++) {
+                snprintf(labels, sizeof labels, "card=\"%d\",group=\"%d\"", cards[i].index, j);
+                metrics_sample(out, "sniffer_radio_group_listen_seconds_total", labels, hop_stats[i].listen_us[j] / 1e6);
+            }
+        }
+        metrics_family(out, "sniffer_radio_group_packets_total", "counter", "Packets fetched on each radio group");
+        for (i = 0; i < nb_cards; i++) {
+            for (j = 0; j < hop_stats[i].nb_groups && card_hops(&cards[i]); j++) {
+                snprintf(labels, sizeof labels, "card=\"%d\",group=\"%d\"", cards[i].index, j);
+                metrics_sample(out, "sniffer_radio_group_packets_total", labels, hop_stats[i].packets[j]);
+            }
+        }
+        metrics_family(out, "sniffer_radio_group_visits_total", "counter", "Completed visits of each radio group");
+        for (i = 0; i < nb_cards; i++) {
+            for (j = 0; j < hop_stats[i].nb_groups && card_hops(&cards[i]); j++) {
+                snprintf(labels, sizeof labels, "card=\"%d\",group=\"%d\"", cards[i].index, j);
+                metrics_sample(out, "sniffer_radio_group_visits_total", labels, hop_stats[i].visits[j]);
+            }
+        }
+        metrics_family(out, "sniffer_radio_group_unheard_max_seconds", "gauge", "Longest time each radio group went unheard");
+        for (i = 0; i < nb_cards; i++) {
+            for (j = 0; j < hop_stats[i].nb_groups && card_hops(&cards[i]); j++) {
+                snprintf(labels, sizeof labels, "card=\"%d\",group=\"%d\"", cards[i].index, j);
+                metrics_sample(out, "sniffer_radio_group_unheard_max_seconds", labels, hop_stats[i].gap_max_us[j] / 1e6);
+            }
+        }
+        metrics_family(out, "sniffer_radio_group_coverage_ratio", "gauge", "Share of the radio groups listened to at least once");
+        for (i = 0; i < nb_cards; i++) {
+            if (card_hops(&cards[i])) {
+                snprintf(labels, sizeof labels, "card=\"%d\"", cards[i].index);
+                metrics_sample(out, "sniffer_radio_group_coverage_ratio", labels, (double)hop_stats[i].covered / hop_stats[i].nb_groups);
+            }
+        }
+        metrics_family(out, "sniffer_radio_group_hops_total", "counter", "Radio group retunes");
+        for (i = 0; i < nb_cards; i++) {
+            if (card_hops(&cards[i])) {
+                snprintf(labels, sizeof labels, "card=\"%d\"", cards[i].index);
+                metrics_sample(out, "sniffer_radio_group_hops_total", labels, hop_stats[i].hops);
+            }
+        }
+        metrics_family(out, "sniffer_radio_group_dead_seconds_total", "counter", "Time spent retuning, no radio group heard");
+        for (i = 0; i < nb_cards; i++) {
+            if (card_hops(&cards[i])) {
+                snprintf(labels, sizeof labels, "card=\"%d\"", cards[i].index);
+                metrics_sample(out, "sniffer_radio_group_dead_seconds_total", labels, hop_stats[i].dead_us / 1e6);
+            }
+        }
+    }
 
-    /* Set all allocated memory sections to zero */
-    memset(report->timestamp, 0, sizeof(char) * JSON_TIME_LEN);
-    memset(report->devaddr, 0, sizeof(char) * JSON_DEVADDR_LEN);
-    memset(report->mtype, 0, sizeof(char) * JSON_MTYPE_LEN);
-    memset(report->crc, 0, sizeof(char) * JSON_CRC_LEN);
-    memset(report->appEUI, 0, sizeof(char) * JSON_JR_DATA_LEN);
-    memset(report->devEUI, 0, sizeof(char) * JSON_JR_DATA_LEN);
+    metrics_family(out, "sniffer_lgw_receive_calls_total", "counter", "lgw_receive calls by the listener");
+    for (i = 0; i < nb_cards; i++) {
+        card = &cards[i];
+        rx_poll_stats(&card->rx_poll, &poll_stats);
+        snprintf(labels, sizeof labels, "card=\"%d\",result=\"empty\"", card->index);
+        metrics_sample(out, "sniffer_lgw_receive_calls_total", labels, poll_stats.polls_empty);
+        snprintf(labels, sizeof labels, "card=\"%d\",result=\"packets\"", card->index);
+        metrics_sample(out, "sniffer_lgw_receive_calls_total", labels, poll_stats.polls - poll_stats.polls_empty);
+    }
+    metrics_family(out, "sniffer_lgw_receive_seconds", "histogram", "lgw_receive call durations, all concentrators");
+    metrics_sample_hist(out, "sniffer_lgw_receive_seconds", NULL, &metric_receive);
+    metrics_family(out, "sniffer_encode_seconds", "histogram", "Time to report, encode and append one packet");
+    metrics_sample_hist(out, "sniffer_encode_seconds", NULL, &metric_encode);
+
+    metrics_family(out, "sniffer_uploads_total", "counter", "Report upload requests sent");
+    metrics_sample(out, "sniffer_uploads_total", NULL, atomic_load(&metric_uploads));
+    metrics_family(out, "sniffer_upload_seconds", "histogram", "Report upload request durations");
+    metrics_sample_hist(out, "sniffer_upload_seconds", NULL, &metric_upload);
+    metrics_family(out, "sniffer_curl_failures_total", "counter", "Curl requests that failed, timeouts included");
+    metrics_sample(out, "sniffer_curl_failures_total", NULL, atomic_load(&metric_curl_failures));
+    if (upload_compression != COMPRESS_NONE) {
+        raw = atomic_load_explicit(&upload_compress.bytes_in, memory_order_relaxed);
+        sent = atomic_load_explicit(&upload_compress.bytes_out, memory_order_relaxed);
+        metrics_family(out, "sniffer_upload_body_bytes_total", "counter", "Report upload bodies before and after compression");
+        metrics_sample(out, "sniffer_upload_body_bytes_total", "stage=\"raw\"", raw);
+        metrics_sample(out, "sniffer_upload_body_bytes_total", "stage=\"compressed\"", sent);
+        metrics_family(out, "sniffer_upload_compression_ratio", "gauge", "Raw over compressed bytes of the report uploads");
+        metrics_sample(out, "sniffer_upload_compression_ratio", NULL, (sent > 0) ? (double)raw / sent : 0.0);
+        metrics_family(out, "sniffer_upload_compress_seconds_total", "counter", "CPU time spent compressing report uploads");
+        metrics_sample(out, "sniffer_upload_compress_seconds_total", NULL, atomic_load_explicit(&upload_compress.cpu_us, memory_order_relaxed) / 1e6);
+    }
+    if (spool_journal) {
+        metrics_family(out, "sniffer_spool_syncs_total", "counter", "Group commits of the report spool to disk");
+        metrics_sample(out, "sniffer_spool_syncs_total", NULL, atomic_load_explicit(&ed_segment.nb_syncs, memory_order_relaxed));
+    }
+
+    metrics_family(out, "sniffer_log_dropped_total", "counter", "Log messages dropped");
+    metrics_sample(out, "sniffer_log_dropped_total", NULL, log_dropped());
+    metrics_family(out, "sniffer_metrics_scrapes_total", "counter", "Metrics pages served before this one");
+    metrics_sample(out, "sniffer_metrics_scrapes_total", NULL, atomic_load(&metrics_server.scrapes));
 
-    /* Free the Fopt strings, they may not be needed for the next packet */
-    for (int i = 0; i < report->foptslen; i++) {
-        free((void*)report->fopts[i]);
-    }
+    return 0;
 }
 
 /**
- * Destroy the allocated memory associated with a ed_report_t object
- * 
- * @param report    Pointer to the ed_report_t object to free 
+ * Collect the lgw_receive durations measured by the HAL.
+ *
+ * @param debug_level   Debug level of the measure, 1 for the lgw_* entry points
+ * @param str           Measured function
+ * @param time_us       Duration of the call
 */
-static void destroy_ed_report(ed_report_t* report) {
-
-    /* Free general strings */
-    free((void*)report->timestamp);
-    free((void*)report->devaddr);
-    free((void*)report->mtype);
-    free((void*)report->crc);
-    free((void*)report->appEUI);
-    free((void*)report->devEUI);
+static void meas_time_hook(int debug_level, const char *str, uint32_t time_us) {
 
-    /* Free the Fopt strings and its parent pointer */
-    for (int i = 0; i < report->foptslen; i++) {
-        free((void*)report->fopts[i]);
+    if (debug_level == 1 && strcmp(str, "lgw_receive") == 0) {
+        metrics_hist_observe(&metric_receive, time_us);
     }
-    free((void*)report->fopts);
-
-    /* Free the entire report */
-    free((void*)report);
 }
 
 /**
- * Create a JSON report for a given end device information struct.
+ * Checks if any of the concentrator cards is on SPI, and so needs the reset script.
  * 
- * @param info          ed_report_t containing all relevant transmission information
- * @param index_mutex   Index of the mutex to use
- * @param index_file    Index of the file
-*/
-static void encode_ed_report(ed_report_t *info, int index_mutex, int index_file) {
-
-    JSON_Value* root_value;
-    JSON_Object* root_object;
-    FILE* file;
-    char* serialized_string = NULL;
-    char report_string[100];
-
-    create_file_string(report_string, JSON_REPORT_ED, index_mutex, index_file);
+ * @return  true if at least one card uses SPI
+ */
+static bool sniffer_has_spi(void) {
 
-    file = fopen(report_string, "w");
+    int i;
 
-    root_value = json_value_init_object();
-    root_object = json_value_get_object(root_value);
-    // Write the consistent fields first
-    json_object_set_string(root_object, JSON_TIME,      info->timestamp);
-    json_object_set_string(root_object, JSON_TYPE,      JSON_REPORT_ED);
-    
-    json_object_set_string(root_object, JSON_MTYPE,     info->mtype);
-    json_object_set_string(root_object, JSON_CRC,       info->crc);
-    json_object_set_number(root_object, JSON_FREQ,      info->freq);
-    json_object_set_number(root_object, JSON_SF,        info->sf);
-    json_object_set_number(root_object, JSON_RSSI,      info->rssi);
-    json_object_set_number(root_object, JSON_TOA,       info->toa);
-    json_object_set_number(root_object, JSON_FRMLEN,    info->frmlength);
-    json_object_set_number(root_object, JSON_SNR,       info->snr);
-
-    // If the message type is a JR
-    if (!strcmp("JR", info->mtype)) {
-        json_object_set_string(root_object, JSON_MTYPE,     info->mtype);
-        json_object_set_string(root_object, JSON_CRC,       info->crc);
-    } else {
-        // If the message type is other
-        json_object_set_number(root_object, JSON_FCNT,      info->fcnt);
-        json_object_set_string(root_object, JSON_DEVADDR,   info->devaddr);
-        json_object_set_boolean(root_object, JSON_ADR,      info->adr);
-        json_object_set_number(root_object, JSON_FPORT,     info->fport);
+    for (i = 0; i < nb_cards; i++) {
+        if (cards[i].com_type == LGW_COM_SPI) {
+            return true;
+        }
     }
-    serialized_string = json_serialize_to_string(root_value);
-    fputs(serialized_string, file);
-
-    json_free_serialized_string(serialized_string);
-    json_value_free(root_value);
-    fclose(file);
-}
-
-/**
- * Gather all stats relative to the sniffer and print them.
- *
- * Currently acquires:
- *  - Pi CPU temp
- *  - LGW concentrator temp
- *  - Total system ram
- *  - Total available system ram
-*/
-static void generate_sniffer_stats (void) {
-
-    float temp_cpu, temp_con, ram_total, ram_available;
-    long rx = 0;
-    long tx = 0;
-
-    temp_cpu = stat_get_temp_cpu();
-    temp_con = stat_get_temp_lgw();
-    ram_total = stat_get_ram_total();
-    ram_available = stat_get_ram_available();
-
-    stat_get_wlan0_rx_tx(&rx, &tx);
-
-    MSG_INFO("Pi Temp: %fC\n", temp_cpu);
-    MSG_INFO("LGW Temp: %fC\n", temp_con);
-    MSG_INFO("Total RAM: %fMiB\n", ram_total);
-    MSG_INFO("Available RAM %fMiB\n", ram_available);
-    MSG_INFO("WLAN0 RX: %lu\n", rx);
-    MSG_INFO("WLAN0 TX: %lu\n", tx);
-    MSG_INFO("Total packets caught %lu\n", (unsigned long)packets_caught);
-    MSG_INFO("Total packets uploaded %d\n", ed_reports_total);
 
+    return false;
 }
 
 /**
- * Wrapper function for starting concentrator. Prints stuff nicely :)
+ * Wrapper function for starting concentrators. Prints stuff nicely :)
  * 
  * @return  -1 on failure, otherwise 0
  */
 static int sniffer_start(void) {
 
-    int i;
+    int i, j;
 
-    if (com_type == LGW_COM_SPI) {
+    if (sniffer_has_spi()) {
         /* Board reset */
         if (system("./reset_lgw.sh start") != 0) {
             printf("ERROR: failed to reset SX1302, check your reset_lgw.sh script\n");
@@ -1051,13 +1035,21 @@ static int sniffer_start(void) {
         }
     }
 
-    i = lgw_start();
+    for (j = 0; j < nb_cards; j++) {
+        /* the packet source of a simulated card is taken when it is opened */
+        if ((cards[j].com_type == LGW_COM_SIM) && (lgw_sim_setconf(&cards[j].simconf) != LGW_SIM_SUCCESS)) {
+            MSG_ERR("failed to configure simulated concentrator %d\n", cards[j].index);
+            return -1;
+        }
 
-    if (i == LGW_HAL_SUCCESS) {
-        MSG_INFO("concentrator started, packet can now be received\n");
-    } else {
-        MSG_ERR("failed to start the concentrator\n");
-        return -1;
+        i = lgw_ctx_start(cards[j].ctx);
+
+        if (i == LGW_HAL_SUCCESS) {
+            MSG_INFO("concentrator %d started, packet can now be received\n", cards[j].index);
+        } else {
+            MSG_ERR("failed to start the concentrator %d\n", cards[j].index);
+            return -1;
+        }
     }
 
     return 0;
@@ -1070,18 +1062,24 @@ static int sniffer_start(void) {
  */
 static int sniffer_stop(void) {
 
-    int i;
+    int i, j, err = 0;
 
-    i = lgw_stop();
+    for (j = 0; j < nb_cards; j++) {
+        i = lgw_ctx_stop(cards[j].ctx);
 
-    if (i == LGW_HAL_SUCCESS) {
-        MSG_INFO("Concentrator stopped successfully\n");
-    } else {
-        MSG_WARN("Failed to stop concentrator successfully\n");
+        if (i == LGW_HAL_SUCCESS) {
+            MSG_INFO("Concentrator %d stopped successfully\n", cards[j].index);
+        } else {
+            MSG_WARN("Failed to stop concentrator %d successfully\n", cards[j].index);
+            err = -1;
+        }
+    }
+
+    if (err) {
         return -1;
     }
 
-    if (com_type == LGW_COM_SPI) {
+    if (sniffer_has_spi()) {
         /* Board reset */
         if (system("./reset_lgw.sh stop") != 0) {
             printf("ERROR: failed to reset SX1302, check your reset_lgw.sh script\n");
@@ -1109,43 +1107,97 @@ static void sniffer_exit(void) {
  */
 static void stat_cleanup(void) {
 
-    int i;
+    int i, j;
 
-    /* cleanup radio configuration */
-    for (i = 0; i < radio_group_count; i++) {
-        free(rfconf[i]);
+    for (j = 0; j < nb_cards; j++) {
+        /* cleanup radio configuration */
+        for (i = 0; i < cards[j].radio_group_count; i++) {
+            free(cards[j].rfconf[i]);
+        }
+
+        free(cards[j].rfconf);
+        cards[j].rfconf = NULL;
+
+        lgw_ctx_free(cards[j].ctx);
+        cards[j].ctx = NULL;
     }
-        
-    free(rfconf);
 }
 
 /**
  * Initialise the given radio group for use. Initialises both radios 0 and 1 of the 
- * concentrator. 
- * @param group Radio group to initialise
- * @return      -1 on failure, 0 on success
+ * concentrator. The radios of a started concentrator cannot be configured, so a
+ * running card is stopped, retuned and started again. This is done under the HAL
+ * context lock, the listener never finds the card stopped and reads the group the
+ * packets it fetched were received on. That lock is shared by every card, so only
+ * a single card sniffer swaps groups.
+ * @param card      Concentrator card to configure
+ * @param group     Radio group to initialise
+ * @param restart   true if the concentrator is started
+ * @return          -1 on failure, 0 on success
  */
-static int init_radio_group (int group) {
+static int init_radio_group (card_t *card, int group, bool restart) {
 
-    int i;
+    int i, err = 0;
 
-    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
-        if (lgw_rxrf_setconf(i, &rfconf[group][i]) != LGW_HAL_SUCCESS) {
-            MSG_ERR("invalid configuration for radio %i\n", i);
-            return -1;
-        } else {
-            MSG_INFO("Group %d radio %d configured correctly\n", group, i);
+    lgw_ctx_enter(card->ctx);
+
+    if (restart && lgw_stop() != LGW_HAL_SUCCESS) {
+        MSG_ERR("failed to stop card %d for radio group %d\n", card->index, group);
+        err = -1;
+    }
+
+    for (i = 0; i < LGW_RF_CHAIN_NB && !err; i++) {
+        if (lgw_rxrf_setconf(i, &card->rfconf[group][i]) != LGW_HAL_SUCCESS) {
+            MSG_ERR("invalid configuration for card %d radio %i\n", card->index, i);
+            err = -1;
+        } else if (!restart) {
+            MSG_INFO("Card %d group %d radio %d configured correctly\n", card->index, group, i);
         }
     }
 
-    return 0;
+    if (restart && !err) {
+        /* the packet source of a simulated card is taken when it is opened */
+        if (card->com_type == LGW_COM_SIM) {
+            lgw_sim_setconf(&card->simconf);
+        }
+        if (lgw_start() != LGW_HAL_SUCCESS) {
+            MSG_ERR("failed to restart card %d on radio group %d\n", card->index, group);
+            err = -1;
+        }
+    }
+
+    if (!err) {
+        card->radio_group_current = group;
+    }
+
+    lgw_ctx_leave(card->ctx);
+
+    return err;
+}
+
+/**
+ * Checks if a card swaps between radio groups.
+ *
+ * @param card  Concentrator card
+ * @return      true if group swapping is enabled and there is more than one group
+ */
+static bool card_hops(const card_t *card) {
+
+    return card->radio_group_swapping && card->radio_group_count > 1;
 }
 
-static int parse_SX130x_configuration(const char * conf_file) {
+/**
+ * Parse the configuration of one concentrator card and submit it to the HAL context of the card.
+ * 
+ * @param conf_file     JSON configuration file
+ * @param conf_obj_name Name of the object holding the card configuration
+ * @param card          Card to configure, its HAL context is created here
+ * @return              0 on success, 1 if there is no such object, -1 on invalid configuration
+ */
+static int parse_SX130x_configuration(const char * conf_file, const char * conf_obj_name, card_t *card) {
     int i, j, number;
     char param_name[40]; /* used to generate variable parameter names */
     const char *str; /* used to store string value from JSON object */
-    const char conf_obj_name[] = "SX130x_conf";
     JSON_Value *root_val = NULL;
     JSON_Value *val = NULL;
     JSON_Object *conf_obj = NULL;
@@ -1171,11 +1223,18 @@ static int parse_SX130x_configuration(const char * conf_file) {
     conf_obj = json_object_get_object(json_value_get_object(root_val), conf_obj_name);
     if (conf_obj == NULL) {
         MSG_INFO("%s does not contain a JSON object named %s\n", conf_file, conf_obj_name);
-        return -1;
+        json_value_free(root_val);
+        return 1;
     } else {
         MSG_INFO("%s does contain a JSON object named %s, parsing SX1302 parameters\n", conf_file, conf_obj_name);
     }
 
+    card->ctx = lgw_ctx_new();
+    if (card->ctx == NULL) {
+        MSG_ERR("Failed to allocate HAL context for %s\n", conf_obj_name);
+        return -1;
+    }
+
     /* set board configuration */
     memset(&boardconf, 0, sizeof boardconf); /* initialize configuration structure */
     str = json_object_get_string(conf_obj, "com_type");
@@ -1186,11 +1245,13 @@ static int parse_SX130x_configuration(const char * conf_file) {
         boardconf.com_type = LGW_COM_SPI;
     } else if (!strncmp(str, "USB", 3) || !strncmp(str, "usb", 3)) {
         boardconf.com_type = LGW_COM_USB;
+    } else if (!strncmp(str, "SIM", 3) || !strncmp(str, "sim", 3)) {
+        boardconf.com_type = LGW_COM_SIM;
     } else {
-        MSG_ERR("invalid com type: %s (should be SPI or USB)\n", str);
+        MSG_ERR("invalid com type: %s (should be SPI, USB or SIM)\n", str);
         return -1;
     }
-    com_type = boardconf.com_type;
+    card->com_type = boardconf.com_type;
     str = json_object_get_string(conf_obj, "com_path");
     if (str != NULL) {
         strncpy(boardconf.com_path, str, sizeof boardconf.com_path);
@@ -1220,9 +1281,30 @@ static int parse_SX130x_configuration(const char * conf_file) {
         MSG_WARN("Data type for full_duplex seems wrong, please check\n");
         boardconf.full_duplex = false;
     }
-    MSG_INFO("com_type %s, com_path %s, lorawan_public %d, clksrc %d, full_duplex %d\n", (boardconf.com_type == LGW_COM_SPI) ? "SPI" : "USB", boardconf.com_path, boardconf.lorawan_public, boardconf.clksrc, boardconf.full_duplex);
+    MSG_INFO("com_type %s, com_path %s, lorawan_public %d, clksrc %d, full_duplex %d\n", (boardconf.com_type == LGW_COM_SPI) ? "SPI" : ((boardconf.com_type == LGW_COM_USB) ? "USB" : "SIM"), boardconf.com_path, boardconf.lorawan_public, boardconf.clksrc, boardconf.full_duplex);
+
+    /* Simulated concentrator: com_path is a RX buffer dump to replay, or "synthetic" */
+    if (boardconf.com_type == LGW_COM_SIM) {
+        memset(&card->simconf, 0, sizeof card->simconf);
+        card->simconf.rate = 10.0;
+        card->simconf.poisson = true;
+        card->simconf.seed = 1 + card->index; /* distinct traffic on each simulated card */
+        val = json_object_get_value(conf_obj, "sim_rate"); /* packets per second (optional) */
+        if (json_value_get_type(val) == JSONNumber) {
+            card->simconf.rate = json_value_get_number(val);
+        }
+        val = json_object_get_value(conf_obj, "sim_nb_pkt"); /* stop after that many packets (optional) */
+        if (json_value_get_type(val) == JSONNumber) {
+            card->simconf.nb_pkt = (uint32_t)json_value_get_number(val);
+        }
+        val = json_object_get_value(conf_obj, "sim_poisson"); /* random or fixed arrivals (optional) */
+        if (json_value_get_type(val) == JSONBoolean) {
+            card->simconf.poisson = (bool)json_value_get_boolean(val);
+        }
+        MSG_INFO("sim_rate %.1f pkt/s, sim_nb_pkt %u, sim_poisson %d\n", card->simconf.rate, card->simconf.nb_pkt, card->simconf.poisson);
+    }
     /* all parameters parsed, submitting configuration to the HAL */
-    if (lgw_board_setconf(&boardconf) != LGW_HAL_SUCCESS) {
+    if (lgw_ctx_board_setconf(card->ctx, &boardconf) != LGW_HAL_SUCCESS) {
         MSG_ERR("Failed to configure board\n");
         return -1;
     }
@@ -1231,13 +1313,13 @@ static int parse_SX130x_configuration(const char * conf_file) {
     val = json_object_get_value(conf_obj, "antenna_gain"); /* fetch value (if possible) */
     if (val != NULL) {
         if (json_value_get_type(val) == JSONNumber) {
-            antenna_gain = (int8_t)json_value_get_number(val);
+            card->antenna_gain = (int8_t)json_value_get_number(val);
         } else {
             MSG_WARN("Data type for antenna_gain seems wrong, please check\n");
-            antenna_gain = 0;
+            card->antenna_gain = 0;
         }
     }
-    MSG_INFO("antenna_gain %d dBi\n", antenna_gain);
+    MSG_INFO("antenna_gain %d dBi\n", card->antenna_gain);
 
     /* set timestamp configuration */
     conf_ts_obj = json_object_get_object(conf_obj, "fine_timestamp");
@@ -1267,7 +1349,7 @@ static int parse_SX130x_configuration(const char * conf_file) {
             MSG_INFO("Configuring precision timestamp with %s mode\n", str);
 
             /* all parameters parsed, submitting configuration to the HAL */
-            if (lgw_ftime_setconf(&tsconf) != LGW_HAL_SUCCESS) {
+            if (lgw_ctx_ftime_setconf(card->ctx, &tsconf) != LGW_HAL_SUCCESS) {
                 MSG_ERR("Failed to configure fine timestamp\n");
                 return -1;
             }
@@ -1299,7 +1381,7 @@ static int parse_SX130x_configuration(const char * conf_file) {
         }
 
         /* all parameters parsed, submitting configuration to the HAL */
-        if (lgw_sx1261_setconf(&sx1261conf) != LGW_HAL_SUCCESS) {
+        if (lgw_ctx_sx1261_setconf(card->ctx, &sx1261conf) != LGW_HAL_SUCCESS) {
             MSG_ERR("Failed to configure the SX1261 radio\n");
             return -1;
         }
@@ -1308,40 +1390,90 @@ static int parse_SX130x_configuration(const char * conf_file) {
     /* Radio group swapping configuration */
     val = json_object_dotget_value(conf_obj, "group_swapping");
     if (json_value_get_type(val) == JSONBoolean) {
-        radio_group_swapping = (bool)json_value_get_boolean(val);
-        MSG_INFO("Radio group swapping is %s\n", radio_group_swapping ? "enabled" : "disabled");
+        card->radio_group_swapping = (bool)json_value_get_boolean(val);
+        MSG_INFO("Radio group swapping is %s\n", card->radio_group_swapping ? "enabled" : "disabled");
     } else {
         MSG_INFO("No group swapping configuration, assuming false\n");
     }
 
     val = json_object_dotget_value(conf_obj, "default_group");
     if (json_value_get_type(val) == JSONNumber) {
-        radio_group_current = (int)json_value_get_number(val);
-        MSG_INFO("Custom radio group %d selected\n", radio_group_current);
+        card->radio_group_current = (int)json_value_get_number(val);
+        MSG_INFO("Custom radio group %d selected\n", card->radio_group_current);
     } else {
-        radio_group_current = DEFAULT_GROUP;
-        MSG_INFO("Utilising default radio group %d\n", radio_group_current);
+        card->radio_group_current = DEFAULT_GROUP;
+        MSG_INFO("Utilising default radio group %d\n", card->radio_group_current);
     }
 
     val = json_object_dotget_value(conf_obj, "radio_groups");
     if (json_value_get_type(val) == JSONNumber) {
-        radio_group_count = (int)json_value_get_number(val);
-        MSG_INFO("%d radio groups given\n", radio_group_count);
+        card->radio_group_count = (int)json_value_get_number(val);
+        MSG_INFO("%d radio groups given\n", card->radio_group_count);
+    } else {
+        card->radio_group_count = DEFAULT_GROUP_COUNT;
+        MSG_INFO("Utilising default radio group count %d\n", card->radio_group_count);
+    }
+
+    if (card->radio_group_count < 1 || card->radio_group_count > RADIO_HOP_MAX_GROUPS) {
+        MSG_ERR("invalid radio group count %d (should be 1 to %d)\n", card->radio_group_count, RADIO_HOP_MAX_GROUPS);
+        return -1;
+    }
+    if (card->radio_group_current < 0 || card->radio_group_current >= card->radio_group_count) {
+        MSG_ERR("invalid default radio group %d (should be 0 to %d)\n", card->radio_group_current, card->radio_group_count - 1);
+        return -1;
+    }
+
+    /* time spent on each radio group when swapping */
+    val = json_object_dotget_value(conf_obj, "group_dwell");
+    if (json_value_get_type(val) == JSONNumber && json_value_get_number(val) > 0) {
+        card->radio_group_dwell_ms = (uint32_t)(json_value_get_number(val) * MS_CONV);
+    } else {
+        card->radio_group_dwell_ms = DEFAULT_GROUP_DWELL * MS_CONV;
+    }
+    val = json_object_dotget_value(conf_obj, "group_dwell_min");
+    if (json_value_get_type(val) == JSONNumber && json_value_get_number(val) > 0) {
+        card->radio_group_dwell_min_ms = (uint32_t)(json_value_get_number(val) * MS_CONV);
+    } else {
+        card->radio_group_dwell_min_ms = DEFAULT_DWELL_MIN * MS_CONV;
+    }
+    val = json_object_dotget_value(conf_obj, "group_dwell_max");
+    if (json_value_get_type(val) == JSONNumber && json_value_get_number(val) > 0) {
+        card->radio_group_dwell_max_ms = (uint32_t)(json_value_get_number(val) * MS_CONV);
+    } else {
+        card->radio_group_dwell_max_ms = DEFAULT_DWELL_MAX * MS_CONV;
+    }
+    if (card->radio_group_dwell_max_ms < card->radio_group_dwell_min_ms) {
+        MSG_WARN("group_dwell_max below group_dwell_min, using %ums for both\n", card->radio_group_dwell_min_ms);
+        card->radio_group_dwell_max_ms = card->radio_group_dwell_min_ms;
+    }
+    str = json_object_dotget_string(conf_obj, "group_dwell_mode");
+    if (str == NULL || !strcmp(str, "fixed")) {
+        card->radio_group_dwell_mode = RADIO_HOP_FIXED;
+    } else if (!strcmp(str, "traffic")) {
+        card->radio_group_dwell_mode = RADIO_HOP_TRAFFIC;
     } else {
-        radio_group_count = DEFAULT_GROUP_COUNT;
-        MSG_INFO("Utilising default radio group count %d\n", radio_group_count);
+        MSG_WARN("invalid group dwell mode: %s (should be fixed or traffic), using fixed\n", str);
+        card->radio_group_dwell_mode = RADIO_HOP_FIXED;
+    }
+    if (card_hops(card)) {
+        if (card->radio_group_dwell_mode == RADIO_HOP_TRAFFIC) {
+            MSG_INFO("Radio groups swapped with traffic weighted dwells, %ums on average, %ums to %ums\n",
+                     card->radio_group_dwell_ms, card->radio_group_dwell_min_ms, card->radio_group_dwell_max_ms);
+        } else {
+            MSG_INFO("Radio groups swapped every %ums\n", card->radio_group_dwell_ms);
+        }
     }
 
     
     /* Allocate and initialise memory for the radio information structs and statistics */
-    rfconf = (struct lgw_conf_rxrf_s**)calloc(radio_group_count, sizeof(struct lgw_conf_rxrf_s*));
-    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
-        rfconf[i] = (struct lgw_conf_rxrf_s*)calloc(LGW_RF_CHAIN_NB, sizeof(struct lgw_conf_rxrf_s));
+    card->rfconf = (struct lgw_conf_rxrf_s**)calloc(card->radio_group_count, sizeof(struct lgw_conf_rxrf_s*));
+    for (i = 0; i < card->radio_group_count; i++) {
+        card->rfconf[i] = (struct lgw_conf_rxrf_s*)calloc(LGW_RF_CHAIN_NB, sizeof(struct lgw_conf_rxrf_s));
     }
     
     /* set configuration for RF chains */
     number = 0;
-    for (i = 0; i < radio_group_count; i++) {
+    for (i = 0; i < card->radio_group_count; i++) {
         for (j = 0; j < LGW_RF_CHAIN_NB; j++) {
             snprintf(param_name, sizeof param_name, "radio_%d_%d", i, j); /* compose parameter path inside JSON structure */
             val = json_object_get_value(conf_obj, param_name); /* fetch value (if possible) */
@@ -1354,61 +1486,61 @@ static int parse_SX130x_configuration(const char * conf_file) {
             snprintf(param_name, sizeof param_name, "radio_%d_%d.enable", i, j);
             val = json_object_dotget_value(conf_obj, param_name);
             if (json_value_get_type(val) == JSONBoolean) {
-                rfconf[i][j].enable = (bool)json_value_get_boolean(val);
+                card->rfconf[i][j].enable = (bool)json_value_get_boolean(val);
             } else {
-                rfconf[i][j].enable = false;
+                card->rfconf[i][j].enable = false;
             }
-            if (rfconf[i][j].enable == false) { /* radio disabsled, nothing else to parse */
+            if (card->rfconf[i][j].enable == false) { /* radio disabsled, nothing else to parse */
                 MSG_INFO("Group %d radio %i disabled\n", i, j);
             } else  { /* radio enabled, will parse the other parameters */
                 snprintf(param_name, sizeof param_name, "radio_%d_%d.freq", i, j);
-                rfconf[i][j].freq_hz = (uint32_t)json_object_dotget_number(conf_obj, param_name);
+                card->rfconf[i][j].freq_hz = (uint32_t)json_object_dotget_number(conf_obj, param_name);
                 snprintf(param_name, sizeof param_name, "radio_%d_%d.rssi_offset", i, j);
-                rfconf[i][j].rssi_offset = (float)json_object_dotget_number(conf_obj, param_name);
+                card->rfconf[i][j].rssi_offset = (float)json_object_dotget_number(conf_obj, param_name);
                 snprintf(param_name, sizeof param_name, "radio_%d_%d.rssi_tcomp.coeff_a", i, j);
-                rfconf[i][j].rssi_tcomp.coeff_a = (float)json_object_dotget_number(conf_obj, param_name);
+                card->rfconf[i][j].rssi_tcomp.coeff_a = (float)json_object_dotget_number(conf_obj, param_name);
                 snprintf(param_name, sizeof param_name, "radio_%d_%d.rssi_tcomp.coeff_b", i, j);
-                rfconf[i][j].rssi_tcomp.coeff_b = (float)json_object_dotget_number(conf_obj, param_name);
+                card->rfconf[i][j].rssi_tcomp.coeff_b = (float)json_object_dotget_number(conf_obj, param_name);
                 snprintf(param_name, sizeof param_name, "radio_%d_%d.rssi_tcomp.coeff_c", i, j);
-                rfconf[i][j].rssi_tcomp.coeff_c = (float)json_object_dotget_number(conf_obj, param_name);
+                card->rfconf[i][j].rssi_tcomp.coeff_c = (float)json_object_dotget_number(conf_obj, param_name);
                 snprintf(param_name, sizeof param_name, "radio_%d_%d.rssi_tcomp.coeff_d", i, j);
-                rfconf[i][j].rssi_tcomp.coeff_d = (float)json_object_dotget_number(conf_obj, param_name);
+                card->rfconf[i][j].rssi_tcomp.coeff_d = (float)json_object_dotget_number(conf_obj, param_name);
                 snprintf(param_name, sizeof param_name, "radio_%d_%d.rssi_tcomp.coeff_e", i, j);
-                rfconf[i][j].rssi_tcomp.coeff_e = (float)json_object_dotget_number(conf_obj, param_name);
+                card->rfconf[i][j].rssi_tcomp.coeff_e = (float)json_object_dotget_number(conf_obj, param_name);
                 snprintf(param_name, sizeof param_name, "radio_%d_%d.type", i, j);
                 str = json_object_dotget_string(conf_obj, param_name);
                 if (!strncmp(str, "SX1255", 6)) {
-                    rfconf[i][j].type = LGW_RADIO_TYPE_SX1255;
+                    card->rfconf[i][j].type = LGW_RADIO_TYPE_SX1255;
                 } else if (!strncmp(str, "SX1257", 6)) {
-                    rfconf[i][j].type = LGW_RADIO_TYPE_SX1257;
+                    card->rfconf[i][j].type = LGW_RADIO_TYPE_SX1257;
                 } else if (!strncmp(str, "SX1250", 6)) {
-                    rfconf[i][j].type = LGW_RADIO_TYPE_SX1250;
+                    card->rfconf[i][j].type = LGW_RADIO_TYPE_SX1250;
                 } else {
                     MSG_WARN("invalid radio type: %s (should be SX1255 or SX1257 or SX1250)\n", str);
                 }
                 snprintf(param_name, sizeof param_name, "radio_%d_%d.single_input_mode", i, j);
                 val = json_object_dotget_value(conf_obj, param_name);
                 if (json_value_get_type(val) == JSONBoolean) {
-                    rfconf[i][j].single_input_mode = (bool)json_value_get_boolean(val);
+                    card->rfconf[i][j].single_input_mode = (bool)json_value_get_boolean(val);
                 } else {
-                    rfconf[i][j].single_input_mode = false;
+                    card->rfconf[i][j].single_input_mode = false;
                 }
 
-                MSG_INFO("Group %d radio %d enabled (type %s), center frequency %u, RSSI offset %f\n", i, j, str, rfconf[i][j].freq_hz, rfconf[i][j].rssi_offset);
+                MSG_INFO("Group %d radio %d enabled (type %s), center frequency %u, RSSI offset %f\n", i, j, str, card->rfconf[i][j].freq_hz, card->rfconf[i][j].rssi_offset);
             }
         }
     }
 
     /* initialise the specific radio group */
-    if (number == LGW_RF_CHAIN_NB * radio_group_count) {
+    if (number == LGW_RF_CHAIN_NB * card->radio_group_count) {
         MSG_ERR("No valid radio configurations given\n");
         return -1;
     } else {
         MSG_INFO("%d radios configured\n", number);
     }
 
-    if (init_radio_group(radio_group_current)) {
-        MSG_ERR("Failed to initialise radio group %d\n", i);
+    if (init_radio_group(card, card->radio_group_current, false)) {
+        MSG_ERR("Failed to initialise radio group %d\n", card->radio_group_current);
         return -1;
     }
 
@@ -1436,7 +1568,7 @@ static int parse_SX130x_configuration(const char * conf_file) {
             demodconf.multisf_datarate = 0xFF; /* enable all SFs */
         }
         /* all parameters parsed, submitting configuration to the HAL */
-        if (lgw_demod_setconf(&demodconf) != LGW_HAL_SUCCESS) {
+        if (lgw_ctx_demod_setconf(card->ctx, &demodconf) != LGW_HAL_SUCCESS) {
             MSG_ERR("invalid configuration for demodulation parameters\n");
             return -1;
         }
@@ -1466,13 +1598,13 @@ static int parse_SX130x_configuration(const char * conf_file) {
             ifconf.rf_chain = (uint32_t)json_object_dotget_number(conf_obj, param_name);
             snprintf(param_name, sizeof param_name, "chan_multiSF_%i.if", i);
             ifconf.freq_hz = (int32_t)json_object_dotget_number(conf_obj, param_name);
-            if_info[i].radio = ifconf.rf_chain;
-            if_info[i].freq_if = ifconf.freq_hz;
+            card->if_info[i].radio = ifconf.rf_chain;
+            card->if_info[i].freq_if = ifconf.freq_hz;
             // TODO: handle individual SF enabling and disabling (spread_factor)
             MSG_INFO("Lora multi-SF channel %i>  radio %i, IF %i Hz, 125 kHz bw, SF 5 to 12\n", i, ifconf.rf_chain, ifconf.freq_hz);
         }
         /* all parameters parsed, submitting configuration to the HAL */
-        if (lgw_rxif_setconf(i, &ifconf) != LGW_HAL_SUCCESS) {
+        if (lgw_ctx_rxif_setconf(card->ctx, i, &ifconf) != LGW_HAL_SUCCESS) {
             MSG_ERR("invalid configuration for Lora multi-SF channel %i\n", i);
             return -1;
         }
@@ -1536,11 +1668,76 @@ static int parse_gateway_configuration(const char * conf_file) {
         MSG_INFO("%u statistic generations per log file\n", stats_per_log);
     }
 
-    /* free JSON parsing data structure */
-    json_value_free(root_val);
-    return 0;
-}
-
+    /* get size (in bytes) at which a new log file is started early (optional) */
+    val = json_object_get_value(conf_obj, "log_max_bytes");
+    if (val != NULL) {
+        log_max_bytes = (size_t)json_value_get_number(val);
+        MSG_INFO("log files are limited to %lu bytes\n", (unsigned long)log_max_bytes);
+    }
+
+    /* get number of packets buffered between the listener and encoder (optional) */
+    val = json_object_get_value(conf_obj, "rx_ring_size");
+    if (val != NULL) {
+        rx_ring_size = (uint32_t)json_value_get_number(val);
+        MSG_INFO("packet ring holds at least %u packets\n", rx_ring_size);
+    }
+
+    /* get delay (in us) between polls while packets trickle in (optional) */
+    val = json_object_get_value(conf_obj, "rx_poll_min_us");
+    if (val != NULL) {
+        rx_poll_min_us = (uint32_t)json_value_get_number(val);
+        MSG_INFO("RX polling delay under light traffic is %u us\n", rx_poll_min_us);
+    }
+
+    /* get longest delay (in us) between polls when idle (optional) */
+    val = json_object_get_value(conf_obj, "rx_poll_max_us");
+    if (val != NULL) {
+        rx_poll_max_us = (uint32_t)json_value_get_number(val);
+        MSG_INFO("RX polling backs off to %u us when idle\n", rx_poll_max_us);
+    }
+
+    /* get path of the raw packet capture, without suffix (optional) */
+    str = json_object_get_string(conf_obj, "capture_path");
+    if (str != NULL) {
+        strncpy(capture_path, str, sizeof capture_path);
+        capture_path[sizeof capture_path - 1] = '\0'; /* ensure string termination */
+        MSG_INFO("raw packets are captured to %s%s\n", capture_path, CAPTURE_SUFFIX);
+    }
+
+    /* get size (in bytes) at which the capture file is rotated (optional) */
+    val = json_object_get_value(conf_obj, "capture_max_bytes");
+    if (val != NULL) {
+        capture_max_bytes = (size_t)json_value_get_number(val);
+        MSG_INFO("capture files are rotated at %lu bytes\n", (unsigned long)capture_max_bytes);
+    }
+
+    /* get number of rotated capture files kept (optional) */
+    val = json_object_get_value(conf_obj, "capture_keep");
+    if (val != NULL) {
+        capture_keep = (unsigned)json_value_get_number(val);
+        MSG_INFO("%u rotated capture files are kept\n", capture_keep);
+    }
+
+    /* get TCP port the metrics are served on (optional) */
+    val = json_object_get_value(conf_obj, "metrics_port");
+    if (val != NULL) {
+        metrics_port = (unsigned)json_value_get_number(val);
+        MSG_INFO("metrics are served on port %u\n", metrics_port);
+    }
+
+    /* get address the metrics are served on (optional) */
+    str = json_object_get_string(conf_obj, "metrics_bind");
+    if (str != NULL) {
+        strncpy(metrics_bind, str, sizeof metrics_bind);
+        metrics_bind[sizeof metrics_bind - 1] = '\0'; /* ensure string termination */
+        MSG_INFO("metrics are served on %s\n", metrics_bind);
+    }
+
+    /* free JSON parsing data structure */
+    json_value_free(root_val);
+    return 0;
+}
+
 static int parse_debug_configuration(const char * conf_file) {
     int i;
     const char conf_obj_name[] = "debug_conf";
@@ -1598,11 +1795,13 @@ static int parse_debug_configuration(const char * conf_file) {
         MSG_INFO("setting debug log file name to %s\n", debugconf.log_file_name);
     }
 
-    /* Commit configuration */
-    if (lgw_debug_setconf(&debugconf) != LGW_HAL_SUCCESS) {
-        MSG_ERR("Failed to configure debug\n");
-        json_value_free(root_val);
-        return -1;
+    /* Commit configuration, the same for every card */
+    for (i = 0; i < nb_cards; i++) {
+        if (lgw_ctx_debug_setconf(cards[i].ctx, &debugconf) != LGW_HAL_SUCCESS) {
+            MSG_ERR("Failed to configure debug\n");
+            json_value_free(root_val);
+            return -1;
+        }
     }
 
     /* free JSON parsing data structure */
@@ -1615,7 +1814,11 @@ static int parse_upload_configuration(const char * conf_file) {
     const char conf_obj_name[] = "upload_conf";
     JSON_Object *conf_obj = NULL;
     JSON_Value *root_val = NULL;
+    JSON_Value *val = NULL; /* needed to detect the absence of some fields */
+    JSON_Array *conf_array = NULL;
+    JSON_Object *rule_obj = NULL;
     const char *str; /* pointer to sub-strings in the JSON data */
+    int i;
 
     root_val = json_parse_file_with_comments(conf_file);
     if (root_val == NULL) {
@@ -1656,57 +1859,238 @@ static int parse_upload_configuration(const char * conf_file) {
         url_dash[sizeof url_dash - 1] = '\0'; /* ensure string termination */
         MSG_INFO("dashboard endpoint url is %s\n", url_dash);
     }
+
+    /* Get upload mode (optional) */
+    str = json_object_get_string(conf_obj, "upload_mode");
+    if (str == NULL || !strncmp(str, "segment", 7)) {
+        upload_mode = UPLOAD_MODE_SEGMENT;
+    } else if (!strncmp(str, "bulk", 4)) {
+        upload_mode = UPLOAD_MODE_BULK;
+    } else {
+        MSG_WARN("invalid upload mode: %s (should be segment or bulk), using segment\n", str);
+        upload_mode = UPLOAD_MODE_SEGMENT;
+    }
+    MSG_INFO("upload mode is %s\n", (upload_mode == UPLOAD_MODE_BULK) ? "bulk" : "segment");
+
+    /* Get encoding of the device reports (optional) */
+    str = json_object_get_string(conf_obj, "report_format");
+    if (str == NULL || !strcmp(str, "json")) {
+        report_format = REPORT_FORMAT_JSON;
+    } else if (!strcmp(str, "cbor")) {
+        report_format = REPORT_FORMAT_CBOR;
+    } else {
+        MSG_WARN("invalid report format: %s (should be json or cbor), using json\n", str);
+        report_format = REPORT_FORMAT_JSON;
+    }
+    if (report_format == REPORT_FORMAT_CBOR && upload_mode == UPLOAD_MODE_BULK) {
+        MSG_WARN("_bulk requests only take JSON documents, device reports are encoded as json\n");
+        report_format = REPORT_FORMAT_JSON;
+    }
+    MSG_INFO("device reports are encoded as %s\n", (report_format == REPORT_FORMAT_CBOR) ? "cbor" : "json");
+
+    /* Get _bulk endpoint URL (optional) */
+    str = json_object_get_string(conf_obj, "bulk_url");
+    strncpy(url_bulk, (str != NULL) ? str : url_dash, sizeof url_bulk);
+    url_bulk[sizeof url_bulk - 1] = '\0'; /* ensure string termination */
+    if (upload_mode == UPLOAD_MODE_BULK) {
+        MSG_INFO("_bulk endpoint url is %s\n", url_bulk);
+    }
+
+    /* Get _bulk index name (optional) */
+    str = json_object_get_string(conf_obj, "bulk_index");
+    if (str != NULL) {
+        strncpy(bulk_index, str, sizeof bulk_index);
+        bulk_index[sizeof bulk_index - 1] = '\0'; /* ensure string termination */
+        MSG_INFO("_bulk index is %s\n", bulk_index);
+    }
+
+    /* Get compression of the report uploads (optional) */
+    str = json_object_get_string(conf_obj, "upload_compression");
+    if (str == NULL || !strcmp(str, "none")) {
+        upload_compression = COMPRESS_NONE;
+    } else if (!strcmp(str, "gzip")) {
+        upload_compression = COMPRESS_GZIP;
+    } else if (!strcmp(str, "deflate")) {
+        upload_compression = COMPRESS_DEFLATE_DICT;
+    } else {
+        MSG_WARN("invalid upload compression: %s (should be none, gzip or deflate), using none\n", str);
+        upload_compression = COMPRESS_NONE;
+    }
+    if (upload_compression != COMPRESS_NONE) {
+        MSG_INFO("report uploads are compressed with %s\n", str);
+    }
+
+    /* get zlib level of the compressed uploads (optional) */
+    val = json_object_get_value(conf_obj, "upload_compress_level");
+    if (val != NULL) {
+        upload_compress_level = (int)json_value_get_number(val);
+        if (upload_compress_level < Z_BEST_SPEED || upload_compress_level > Z_BEST_COMPRESSION) {
+            MSG_WARN("invalid upload compression level: %d (should be 1 to 9), using %d\n", upload_compress_level, DEFAULT_COMP_LEVEL);
+            upload_compress_level = DEFAULT_COMP_LEVEL;
+        }
+        MSG_INFO("upload compression level is %d\n", upload_compress_level);
+    }
+
+    /* Get index mapping the deflate dictionary is built from (optional) */
+    str = json_object_get_string(conf_obj, "upload_dictionary");
+    if (str != NULL) {
+        strncpy(upload_dictionary, str, sizeof upload_dictionary);
+        upload_dictionary[sizeof upload_dictionary - 1] = '\0'; /* ensure string termination */
+        MSG_INFO("deflate dictionary is built from %s\n", upload_dictionary);
+    }
+
+    /* get size (in bytes) at which a _bulk request stops taking segments (optional) */
+    val = json_object_get_value(conf_obj, "bulk_max_bytes");
+    if (val != NULL) {
+        bulk_max_bytes = (size_t)json_value_get_number(val);
+        MSG_INFO("_bulk requests are capped at %lu bytes\n", (unsigned long)bulk_max_bytes);
+    }
+
+    /* get size (in bytes) at which report segments are sealed (optional) */
+    val = json_object_get_value(conf_obj, "segment_max_bytes");
+    if (val != NULL) {
+        segment_max_bytes = (size_t)json_value_get_number(val);
+        MSG_INFO("report segments are sealed at %lu bytes\n", (unsigned long)segment_max_bytes);
+    }
+
+    /* get age (in seconds) at which report segments are sealed (optional) */
+    val = json_object_get_value(conf_obj, "segment_max_age");
+    if (val != NULL) {
+        segment_max_age = (unsigned)json_value_get_number(val);
+        MSG_INFO("report segments are sealed after %u seconds\n", segment_max_age);
+    }
+
+    /* get whether the report spool is journaled to survive restarts (optional) */
+    val = json_object_get_value(conf_obj, "spool_journal");
+    if (json_value_get_type(val) == JSONBoolean) {
+        spool_journal = (bool)json_value_get_boolean(val);
+        MSG_INFO("report spool journal is %s\n", spool_journal ? "enabled" : "disabled");
+    }
+
+    /* get time (in ms) between group commits of the report spool (optional) */
+    val = json_object_get_value(conf_obj, "spool_sync_ms");
+    if (val != NULL) {
+        spool_sync_ms = (unsigned)json_value_get_number(val);
+        MSG_INFO("report spool synced every %u ms\n", spool_sync_ms);
+    }
+
+    /* get whether a report is uploaded for every packet (optional) */
+    val = json_object_get_value(conf_obj, "device_reports");
+    if (json_value_get_type(val) == JSONBoolean) {
+        device_reports = (bool)json_value_get_boolean(val);
+        MSG_INFO("device reports are %s\n", device_reports ? "enabled" : "disabled, summaries only");
+    }
+
+    /* get interval (in seconds) between device summaries (optional) */
+    val = json_object_get_value(conf_obj, "device_summary_interval");
+    if (val != NULL) {
+        dev_summary_interval = (unsigned)json_value_get_number(val);
+        MSG_INFO("device summaries every %u seconds\n", dev_summary_interval);
+    }
+
+    /* get number of devices tracked for the summaries (optional) */
+    val = json_object_get_value(conf_obj, "device_table_size");
+    if (val != NULL) {
+        dev_table_size = (uint32_t)json_value_get_number(val);
+        MSG_INFO("up to %u devices are tracked\n", dev_table_size);
+    }
+
+    /* get time (in seconds) after which a silent device is forgotten (optional) */
+    val = json_object_get_value(conf_obj, "device_expiry");
+    if (val != NULL) {
+        dev_expiry = (unsigned)json_value_get_number(val);
+        MSG_INFO("devices are forgotten after %u silent seconds\n", dev_expiry);
+    }
+
+    /* get length (in seconds) of the per channel and SF buckets (optional) */
+    val = json_object_get_value(conf_obj, "channel_bucket");
+    if (val != NULL) {
+        channel_bucket = (unsigned)json_value_get_number(val);
+        MSG_INFO("channel buckets of %u seconds\n", channel_bucket);
+    }
+
+    /* get path of the session key file (optional) */
+    str = json_object_get_string(conf_obj, "key_file");
+    if (str != NULL) {
+        strncpy(key_file, str, sizeof key_file);
+        key_file[sizeof key_file - 1] = '\0'; /* ensure string termination */
+        MSG_INFO("session keys are read from %s\n", key_file);
+    }
+
+    /* get whether decrypted payloads are reported (optional) */
+    val = json_object_get_value(conf_obj, "key_data");
+    if (json_value_get_type(val) == JSONBoolean) {
+        key_data = (bool)json_value_get_boolean(val);
+        MSG_INFO("decrypted payloads are %s\n", key_data ? "reported" : "not reported");
+    }
+
+    /* get report filter rules, compiled in order, an invalid rule is left out (optional) */
+    conf_array = json_object_get_array(conf_obj, "report_filters");
+    if (conf_array != NULL && json_array_get_count(conf_array) > 0) {
+        if (report_filter_init(&report_filter, (int)json_array_get_count(conf_array))) {
+            MSG_ERR("failed to allocate the report filter\n");
+        } else {
+            for (i = 0; i < (int)json_array_get_count(conf_array); i++) {
+                rule_obj = json_array_get_object(conf_array, i);
+                str = json_object_get_string(rule_obj, "match");
+                if (report_filter_add(&report_filter, json_object_get_string(rule_obj, "name"), (str != NULL) ? str : "", json_object_get_string(rule_obj, "action"))) {
+                    MSG_ERR("invalid report filter rule %d, left out (names are letters, digits, '_' and '-' only)\n", i);
+                    continue;
+                }
+                MSG_INFO("report filter rule %s: match \"%s\", %s\n", report_filter.rules[report_filter.nb_rules - 1].name, (str != NULL) ? str : "", json_object_get_string(rule_obj, "action"));
+            }
+            report_filter_enabled = true;
+        }
+    }
     
     json_value_free(root_val);
     return 0;
 }
 
 /**
- * Open new log file. This log file is written to by all "MSG_" logging functions,
- * regardless of verbose status.
+ * Start the logger on a new log file. This log file is written to by all "MSG_" logging functions,
+ * regardless of verbose status. Later files are started by the logger itself every log_interval.
 */
 static void log_open (void) {
 
-    struct timespec now_utc_time;
-    char iso_date[40];
-    
-    clock_gettime(CLOCK_REALTIME, &now_utc_time);
-    strftime(iso_date, ARRAY_SIZE(iso_date),"%Y%m%dT%H%M%SZ", gmtime(&now_utc_time.tv_sec)); /* format yyyymmddThhmmssZ */
+    log_conf_t conf = {
+        .name = LOG_NAME,
+        .time_fmt = NULL, /* ctime() style */
+        .stamped = true,
+        .truncate = false,
+        .verbose = verbose,
+        .max_bytes = 0,
+        .max_age = 0
+    };
 
-    sprintf(log_file_name, "sniffer_log_%s.txt", iso_date);
-    log_file = fopen(log_file_name, "a"); /* create log file to check if its possible */
-    if (log_file == NULL) {
-        printf("impossible to create log file %s\n", log_file_name);
-        sniffer_exit();
+    if (log_start(&conf)) {
+        printf("impossible to start logging to %s files\n", LOG_NAME);
+        exit(EXIT_FAILURE);
     }
 
-    fclose(log_file);
-
-    MSG_INFO("Now writing to log file %s\n", log_file_name);
     return;
 }
 
 /**
- * Function used to specifically read the output given by a curl string run within the 
- * "system" function.
- * 
- * Curl error codes bizzarely shifted 8 places left by system output. Need to move
- * and then parse.
+ * Function used to specifically read the result of a libcurl request made by the uploader.
  * 
  * Returns the curl output if it succeeds or can be dealt with.
  * 
- * @param system_output The system code to analyse
+ * @param curl_code     The libcurl code to analyse
  * @return              The curl return code that can be handled, either CURL_ERR_SUCCESS or CURL_ERR_TIMEOUT
 */
-static int curl_read_system (int system_output) {
+static int curl_read_result (int curl_code) {
 
     int status;
-    int curl_output = system_output >> CURL_SYS_SHIFT; // Get only 8 bits
+
+    if (curl_code != CURL_ERR_SUCCESS) {
+        atomic_fetch_add_explicit(&metric_curl_failures, 1, memory_order_relaxed);
+    }
 
     /* Check if the curl error code was something weird we can't handle */
-    if (curl_output != CURL_ERR_SUCCESS && curl_output != CURL_ERR_TIMEOUT) {
+    if (curl_code != CURL_ERR_SUCCESS && curl_code != CURL_ERR_TIMEOUT) {
         MSG_WARN("[uploader] Encountered curl error that cannot be dealth with\n");
-        MSG_WARN("[uploader] Curl code %d (system return code %d)\n", curl_output, system_output);
+        MSG_WARN("[uploader] Curl code %d (%s)\n", curl_code, uploader.error[0] ? uploader.error : curl_easy_strerror((CURLcode)curl_code));
 
         curl_failures++;
 
@@ -1727,7 +2111,7 @@ static int curl_read_system (int system_output) {
                 MSG_ERR("[uploader] Failed to reopen ifconfig tun0\n");
                 MSG_ERR("[uploader] Errno was %d\n", errno);
                 sniffer_exit();
-        }
+            }
         }
 
         /* Check if the curl has failed too many times sequentially */
@@ -1741,7 +2125,7 @@ static int curl_read_system (int system_output) {
 
     curl_failures = 0;
 
-    return curl_output;
+    return curl_code;
 }
 
 /**
@@ -1755,9 +2139,8 @@ static int curl_read_system (int system_output) {
 static int curl_handle_timeout (char* url_to_check) {
 
     int status, i;
-    char curl_string[120];
 
-    MSG_INFO("[uploader] Curl timeout occured after 15 seconds. Retrying connection to %s\n", url_to_check);
+    MSG_INFO("[uploader] Curl timeout occured after %d seconds. Retrying connection to %s\n", HTTP_CONNECT_TIMEOUT, url_to_check);
 
     /* First check the number of curl failures passes a certain threshold */
     if (failed_curls == CURL_TIMEOUT_MIN) {
@@ -1784,14 +2167,11 @@ static int curl_handle_timeout (char* url_to_check) {
         sniffer_exit();
     }
 
-    /* Create our curl string to test */
-    sprintf(curl_string, "%s %s", CURL_TEST, url_to_check);
-
     for (i = 0; i < 4; i++) {
         MSG_INFO("[uploader] Curl reestablish attempt %d\n", i);
 
-        status = system((const char*)curl_string); // Run curl
-        status = curl_read_system(status); // Parse system curl output
+        status = http_get(&uploader, url_to_check); // Probe the url
+        status = curl_read_result(status); // Parse curl output
 
         /* Check to see if the curl successfully returns */
         if (status == CURL_ERR_SUCCESS) {
@@ -1810,9 +2190,9 @@ static int curl_handle_timeout (char* url_to_check) {
 }
 
 /**
- * Check curl output of file upload.
+ * Check curl output of file upload, read from the uploader's in-memory response.
  * 
- * If the file is empty, the curl was successful; if not investigate.
+ * If the response is empty, the curl was successful; if not investigate.
  * 
  * If response recieves unauthorized error, acquire new key, else exit.
  * 
@@ -1823,25 +2203,21 @@ static int curl_handle_timeout (char* url_to_check) {
 static int curl_handle_output (int curl_target) {
 
     int i;
-    FILE* fp_out;
     JSON_Value *root_val = NULL;
-    
-    fp_out = fopen(CURL_OUTPUT, "r");
-    i = fgetc(fp_out);
-    fclose(fp_out);
 
-    /* Check if file is not empty */
-    if (i != EOF) {
+    /* Check if response is not empty */
+    if (uploader.response.len > 0) {
         /* Lets parse try to pass as JSON */
-        root_val = json_parse_file(CURL_OUTPUT);
+        root_val = json_parse_string(uploader.response.data);
 
         if (root_val != NULL) {
             i = curl_parse(root_val, curl_target);
+            json_value_free(root_val);
             if (i) return i;
         } else {
-            /* Not JSON file found, lets save it */
-            save_unknown_response(CURL_OUTPUT);
-            save_unknown_response(report_string);
+            /* Not JSON response found, lets save it */
+            save_unknown_response(uploader.response.data, uploader.response.len);
+            save_unknown_file(report_string);
             //return 0;
         }
     }
@@ -1868,8 +2244,8 @@ static int curl_parse (JSON_Value *root_val, int curl_target) {
 
         if (str == NULL || strncmp(str, "Unauthorized", 12)) {
             /* Unknown JSON response from dash, lets save it */
-            save_unknown_response(CURL_OUTPUT);
-            save_unknown_response(report_string);
+            save_unknown_response(uploader.response.data, uploader.response.len);
+            save_unknown_file(report_string);
             //return -1;
         } else {
             MSG_INFO("[curl_parse] Received response {\"message\":\"Unauthorized\"}. Acquiring new key.\n");
@@ -1892,14 +2268,16 @@ static int curl_parse (JSON_Value *root_val, int curl_target) {
         str = json_object_get_string(json_value_get_object(root_val), "access_token");
 
         if (str != NULL) {
-            /* we have found a bearer key, lets save it!!!!! */
-            memset(auth_key, 0, sizeof auth_key);
-            strcpy(auth_key, str);
-            MSG_INFO("[curl_parse] New AUTH key acquired\n");
+            /* we have found a bearer key, lets keep it in the uploader!!!!! */
+            if (http_set_bearer(&uploader, str)) {
+                MSG_ERR("[curl_parse] AUTH key too long (%lu characters), ignoring\n", (unsigned long)strlen(str));
+            } else {
+                MSG_INFO("[curl_parse] New AUTH key acquired\n");
+            }
         } else {
-            /* Not JSON file found, lets save it */
-            save_unknown_response(CURL_OUTPUT);
-            save_unknown_response(report_string);
+            /* Not JSON response found, lets save it */
+            save_unknown_response(uploader.response.data, uploader.response.len);
+            save_unknown_file(report_string);
             //return -1;
         }
     }
@@ -1907,6 +2285,27 @@ static int curl_parse (JSON_Value *root_val, int curl_target) {
     return 0;
 }
 
+/**
+ * Check if the dashboard answered the last request with {"message":"Unauthorized"}.
+ * 
+ * @return  true if a new key is needed
+*/
+static bool dash_unauthorized (void) {
+
+    JSON_Value *root_val;
+    const char* str;
+    bool unauthorized = false;
+
+    if (uploader.response.len > 0) {
+        root_val = json_parse_string(uploader.response.data);
+        str = json_object_get_string(json_value_get_object(root_val), "message");
+        unauthorized = (str != NULL && strncmp(str, "Unauthorized", 12) == 0);
+        json_value_free(root_val);
+    }
+
+    return unauthorized;
+}
+
 /**
  * Complete auth0 request to acquirer bearer key for dashboard HTTP POST.
  * 
@@ -1915,12 +2314,9 @@ static int curl_parse (JSON_Value *root_val, int curl_target) {
 static int curl_get_auth0 (void) {
 
     int status;                 /* return variable */
-    char curl_string[1500];     /* holds the full curl string */
-    
-    sprintf(curl_string, "%s -d @%s %s", CURL_PREFIX, file_client_key, url_auth0);
 
-    status = system((const char*)curl_string);
-    status = curl_read_system(status); // Parse system output
+    status = http_post(&uploader, url_auth0, HTTP_CONTENT_JSON, 0, client_key.data, client_key.len);
+    status = curl_read_result(status); // Parse curl output
 
     if (status == CURL_ERR_SUCCESS) {
         /* Successful curl, lets see the output */
@@ -1932,7 +2328,7 @@ static int curl_get_auth0 (void) {
         }
     } else {
         /* Unknown error, we are leaving */
-        MSG_ERR("[uploader] During auth0 client request, System failed to run with exit code %d\n", status);
+        MSG_ERR("[uploader] During auth0 client request, curl failed with code %d\n", status);
         sniffer_exit();
     }
 
@@ -1944,19 +2340,28 @@ static int curl_get_auth0 (void) {
  * 
  * Checks for a curl timeout and returns appropriately.
  * 
- * @param upload_file   File to upload.
+ * The segment is sent over the uploader's persistent connection, compressed
+ * if configured, so the newlines between records are kept.
+ * 
+ * @param upload_file   Sealed report segment to upload.
  * 
  * @return              -1 on a curl failure, 0 on success, 1 if a curl connection is reestablished
 */
 static int curl_upload_file (const char * upload_file) {
 
     int status;                 /* return variable */
-    char curl_string[1500];     /* holds the full curl string */
-    
-    sprintf(curl_string, "%s -H \"Authorization: Bearer %s\" -d @%s %s", CURL_PREFIX, auth_key, upload_file, url_dash);
+    uint64_t start_us;
+
+    if (http_buf_load(&uploader.request, upload_file)) {
+        MSG_ERR("[curl_upload_file] Failed to read %s\n", upload_file);
+        return -1;
+    }
 
-    status = system((const char*)curl_string);
-    status = curl_read_system(status);
+    start_us = monotonic_us();
+    status = upload_post(url_dash, (report_format == REPORT_FORMAT_CBOR) ? HTTP_CONTENT_REPORTS : HTTP_CONTENT_NDJSON, uploader.request.data, uploader.request.len);
+    metrics_hist_observe(&metric_upload, monotonic_us() - start_us);
+    atomic_fetch_add_explicit(&metric_uploads, 1, memory_order_relaxed);
+    status = curl_read_result(status);
 
     if (status == CURL_ERR_SUCCESS) {
         /* Successful curl, lets see the output */
@@ -1983,317 +2388,830 @@ static int curl_upload_file (const char * upload_file) {
 }
 
 /**
- * Special function for saving unknown curl responses.
+ * Check if a segment record is a device report rather than a summary or a channel bucket.
  * 
- * @param file_in   String of the file to copy.
- * @return          -1 on failure, 0 on success
+ * @param rec   Record, without its newline
+ * @param len   Length of the record
+ * @return      true for a CBOR record or a JSON line of type ED_REPORT_TYPE
 */
-static int save_unknown_response (const char* file_in) {
-
-    ssize_t i, j;
-    FILE* fp_in, *fp_out;
-    char bad_file[100];
-
-    sprintf(bad_file, "bad_file_%d.txt", bad_file_count++);
-
-    MSG_WARN("[save_unknown_response] NON-JSON response received, attempting to save as %s\n", bad_file);
+static bool record_is_device_report (const char *rec, size_t len) {
 
-    fp_in = fopen(file_in, "r");
-    fp_out = fopen(bad_file, "w");
+    static const char key[] = "\"type\":\"";
+    static const char device[] = ED_REPORT_TYPE "\"";
+    const char *p = rec;
+    const char *end = rec + len;
 
-    if (fp_in == NULL) {
-        MSG_WARN("[save_unknown_response] Failed to open %s for reading. Errno was %d. Skipping copy\n", file_in, errno);
-        return -1;
-    } else if (fp_out == NULL) {
-        MSG_WARN("[save_unknown_response] Failed to open %s for writing\n. Errno was %d. Skipping copy\n", bad_file, errno);
-        return -1;
+    /* only device reports are ever written as CBOR records */
+    if (len > 0 && (uint8_t)rec[0] == REPORT_CBOR_LEAD) {
+        return true;
     }
 
-    i = fgetc(fp_in);
-
-    do {
-        j = fputc(i, fp_out);
-
-        if (j == EOF) {
-            MSG_WARN("[save_unknown_response] Failed writing to %s\n. Errno was %d. Exiting copy\n", bad_file, errno);
-            return -1;
+    /* every kind writes its type right after the timestamp, so the first type key is the one */
+    while ((p = memchr(p, '"', (size_t)(end - p))) != NULL) {
+        if ((size_t)(end - p) >= sizeof key - 1 && memcmp(p, key, sizeof key - 1) == 0) {
+            p += sizeof key - 1;
+            return (size_t)(end - p) >= sizeof device - 1 && memcmp(p, device, sizeof device - 1) == 0;
         }
+        p++;
+    }
 
-        i = fgetc(fp_in);
-    } while (i != EOF);
-
-    i =  fclose(fp_in);
-    if (i == EOF)
-        MSG_WARN("[save_unknown_response] Failed closing %s\n. Errno was %d\n", file_in, errno);
-            
-    i = fclose(fp_out);
-    if (i == EOF)
-        MSG_WARN("[save_unknown_response] Failed closing %s\n. Errno was %d\n", bad_file, errno);
-
-    return 0;
+    return false;
 }
 
-/* -------------------------------------------------------------------------- */
-/* --- THREAD 1.0: RECEIVING PACKETS ------------------------------------------ */
-void thread_listen(void) {
-
-    int i; /* loop and temporary variables */
-
-    struct timespec sleep_time = {0, 3000000}; /* 3 ms */
-
-    /* allocate memory for packet fetching and processing */
-    struct lgw_pkt_rx_s rxpkt[16]; /* array containing up to 16 inbound packets metadata */
-    int nb_pkt;
+/**
+ * Count the device reports held by a sealed segment, leaving out summaries and channel buckets.
+ * 
+ * @param file_name Segment file to read
+ * @return          Number of device reports, -1 if the file could not be read
+*/
+static long count_device_reports (const char *file_name) {
 
-    /* struct for placing data into encoding queue */
-    struct entry *pkt_encode;
+    FILE *fp;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    long records = 0;
 
-    while (!exit_sig && !quit_sig) {
+    fp = fopen(file_name, "r");
+    if (fp == NULL) {
+        return -1;
+    }
 
-        /* fetch packets */
-        pthread_mutex_lock(&mx_concent);
-        nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
-        pthread_mutex_unlock(&mx_concent);
-        
-        if (nb_pkt == LGW_HAL_ERROR) {
-            MSG_ERR("[listener] failed packet fetch, exiting\n");
-            sniffer_exit();
-        } else if (nb_pkt == 0) {
-            clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-            continue; // reestart loop and check again
-        } else {
-            pthread_mutex_lock(&mx_report_dev);
-            for (i = 0; i < nb_pkt; ++i) {
-                pkt_encode = (struct entry*)malloc(sizeof(struct entry));
-                pkt_encode->rx_pkt = rxpkt[i];
-                STAILQ_INSERT_TAIL(&head, pkt_encode, entries);
-            }
-            packets_caught += nb_pkt;
-            pthread_mutex_unlock(&mx_report_dev);
+    while ((len = getline(&line, &size, fp)) > 0) {
+        if (line[len - 1] == '\n') {
+            len--;
         }
+        records += record_is_device_report(line, (size_t)len) ? 1 : 0;
     }
 
-    MSG_INFO("[listener] Packets caught: %lu\n", (unsigned long)packets_caught);
-    MSG_INFO("[listener] End of listening thread\n");
-}
+    free(line);
+    fclose(fp);
 
-/* -------------------------------------------------------------------------- */
-/* --- THREAD 1.1: JSON encoding for device packet info --------------------- */
-void thread_encode(void) {
+    return records;
+}
 
-    /* return holder variable */
-    int i = 0;
+/**
+ * Count the device reports a _bulk request delivered, leaving out summaries and channel buckets.
+ * 
+ * @param b     Bulk request, with its response mapped onto the documents
+ * @param all   true if the whole request was taken, whatever the item statuses
+ * @return      Number of device reports accepted
+*/
+static size_t bulk_device_reports (const bulk_req_t *b, bool all) {
 
-    /* mutex interaction variables and counters */
-    int mutex_current = 0;
-    int ed_reports = 0;
+    size_t i, nb = 0;
 
-    /* sleep managent value */
-    struct timespec sleep_time = {0, 3000000}; /* 0 s, 3ms */
+    for (i = 0; i < b->nb_docs; i++) {
+        if ((all || (b->docs[i].status >= 200 && b->docs[i].status < 300)) &&
+            record_is_device_report(b->body.data + b->docs[i].off, b->docs[i].len)) {
+            nb++;
+        }
+    }
 
-    /* Structs for traversing STAILQ*/
-    struct entry *pkt_encode, *pkt_next;
+    return nb;
+}
 
-    /* object for data encoding */
-    ed_report_t *report = create_ed_report();
+/**
+ * Curl POST every pending device report in one Elasticsearch style _bulk request.
+ * 
+ * Documents left over from a previous partial failure go first, then sealed segments
+ * are added in order until the request reaches bulk_max_bytes. Per item statuses are
+ * checked so only documents rejected with a retryable status are kept for the next
+ * request; documents refused for good are moved to BULK_REJECT_FILE.
+ * 
+ * @param seq_upload    Next sealed segment to upload, moved past the segments sent
+ * @param seq_sealed    End of the sealed segment range
+ * @param sent          Set if a request went out, segments holding no document send none
+ * @return              -1 on a curl failure, 0 on success, 1 if a curl connection is reestablished
+*/
+static int curl_upload_bulk (uint32_t *seq_upload, uint32_t seq_sealed, bool *sent) {
 
-    /* timestamp variables */
-    struct timespec pkt_utc_time;
-    struct tm *xt;
+    int status;                 /* return variable */
+    uint32_t seq, seq_end;
+    bool has_retry;
+    long written;
+    bulk_result_t result;
+    bool taken = false;         /* the whole request was taken without a _bulk response */
+    FILE *fp;
+    uint64_t start_us;
+
+    *sent = false;
+    bulk_reset(&bulk);
+
+    /* Documents rejected last time go first */
+    has_retry = (access(BULK_RETRY_FILE, R_OK) == 0);
+    if (has_retry) {
+        if (http_buf_load(&bulk_scratch, BULK_RETRY_FILE) || bulk_add_ndjson(&bulk, bulk_scratch.data, bulk_scratch.len) < 0) {
+            MSG_ERR("[curl_upload_bulk] Failed to read %s\n", BULK_RETRY_FILE);
+            return -1;
+        }
+    }
 
-    while (!exit_sig && !quit_sig) {
+    /* Always take at least one segment so a large retry file cannot stall the queue */
+    for (seq = *seq_upload; seq < seq_sealed && (seq == *seq_upload || bulk.body.len < bulk_max_bytes); seq++) {
+        segment_name(report_string, sizeof report_string, JSON_REPORT_ED, seq, true);
 
-        pthread_mutex_lock(&mx_report_dev);
+        if (http_buf_load(&bulk_scratch, report_string)) {
+            MSG_ERR("[curl_upload_bulk] Failed to open segment %s, skipping\n", report_string);
+            continue;
+        }
 
-        mutex_current = 0; /* reset this, it will change below if necessary */
-        i = pthread_mutex_trylock(&mx_ed_report_0);
-        if (i != 0) {
-            /* unable to get lock from above, lets get the other one */
-            pthread_mutex_lock(&mx_ed_report_1);
-            mutex_current = 1;
+        if (bulk_add_ndjson(&bulk, bulk_scratch.data, bulk_scratch.len) < 0) {
+            MSG_ERR("[curl_upload_bulk] Unable to allocate memory for _bulk request\n");
+            return -1;
+        }
+    }
+    seq_end = seq;
+
+    if (bulk.nb_docs > 0) {
+        start_us = monotonic_us();
+        status = upload_post(url_bulk, HTTP_CONTENT_NDJSON, bulk.body.data, bulk.body.len);
+        *sent = true;
+        metrics_hist_observe(&metric_upload, monotonic_us() - start_us);
+        atomic_fetch_add_explicit(&metric_uploads, 1, memory_order_relaxed);
+        status = curl_read_result(status);
+
+        if (status == CURL_ERR_TIMEOUT) {
+            /* Timeout status has returned, lets handle it and explore what went wrong */
+            MSG_WARN("[curl_upload_bulk] Curl timeout detected. Handling\n");
+            return curl_handle_timeout(url_bulk);
+        } else if (status != CURL_ERR_SUCCESS) {
+            /* Unknown curl error, we just skipping */
+            return -1;
         }
-        ed_reports = mutex_current ? ed_reports_1 : ed_reports_0;
 
-        pkt_encode = STAILQ_FIRST(&head);
+        if (bulk_parse_response(&bulk, uploader.response.data, &result)) {
+            /* Not a _bulk response: we need a new key, or the server refused the whole request */
+            if (dash_unauthorized()) {
+                MSG_INFO("[curl_upload_bulk] Received response {\"message\":\"Unauthorized\"}. Acquiring new key.\n");
+                return curl_get_auth0();
+            }
 
-        while (pkt_encode != NULL) {
+            save_unknown_response(uploader.response.data, uploader.response.len);
 
-            /* Clear data in report object*/
-            reset_ed_report(report);
+            /* The segments and the retry file hold every document of the request, keep them all */
+            if (uploader.status < 200 || uploader.status >= 300) {
+                MSG_WARN("[curl_upload_bulk] Server returned HTTP %ld, keeping reports for next period\n", uploader.status);
+                return -1;
+            }
 
-            /* Acquire timestamp data */
-            clock_gettime(CLOCK_REALTIME, &pkt_utc_time);
-            xt = gmtime(&(pkt_utc_time.tv_sec));
+            /* Accepted without a _bulk response, treat the documents as delivered like a single segment upload */
+            result.accepted = bulk.nb_docs;
+            result.retry = 0;
+            result.rejected = 0;
+            taken = true;
+        }
 
-            /* Write to report and encode t device json */
-            write_ed_report(report, &pkt_encode->rx_pkt, xt, &pkt_utc_time);
-            encode_ed_report(report, mutex_current, ed_reports++);
+        MSG_INFO("[curl_upload_bulk] %lu documents sent: %lu accepted, %lu to retry, %lu rejected\n", (unsigned long)bulk.nb_docs, (unsigned long)result.accepted, (unsigned long)result.retry, (unsigned long)result.rejected);
 
-            if (mutex_current == 0) {
-                ed_reports_0++;
-            } else {
-                ed_reports_1++;
+        /* Replace the retry file with whatever still needs sending */
+        if (result.retry > 0) {
+            fp = fopen(BULK_RETRY_FILE ".tmp", "w");
+            written = (fp != NULL) ? bulk_write_failed(&bulk, fp, true) : -1;
+            if (fp != NULL && (fflush(fp) == EOF || fsync(fileno(fp)))) {
+                written = -1;   /* it must be on disk before its segments are acknowledged */
             }
-
-            /* traverse STAILQ and cleanup old queue entry */
-            pkt_next = STAILQ_NEXT(pkt_encode, entries);
-            STAILQ_REMOVE(&head, pkt_encode, entry, entries);
-            free((void*)pkt_encode);
-            pkt_encode = pkt_next;
+            if (fp != NULL && fclose(fp) == EOF) {
+                written = -1;
+            }
+            if (written < 0 || rename(BULK_RETRY_FILE ".tmp", BULK_RETRY_FILE)) {
+                MSG_ERR("[curl_upload_bulk] Failed to write %s, keeping reports for next period\n", BULK_RETRY_FILE);
+                return -1;
+            }
+        } else if (has_retry && remove(BULK_RETRY_FILE)) {
+            MSG_ERR("[curl_upload_bulk] Failed to remove file %s\n", BULK_RETRY_FILE);
         }
 
-        if (mutex_current == 0) {
-            pthread_mutex_unlock(&mx_ed_report_0);
-        } else {
-            pthread_mutex_unlock(&mx_ed_report_1);
+        /* Refused documents will never be accepted, put them aside for inspection */
+        if (result.rejected > 0) {
+            fp = fopen(BULK_REJECT_FILE, "a");
+            if (fp == NULL || bulk_write_failed(&bulk, fp, false) < 0) {
+                MSG_WARN("[curl_upload_bulk] Failed to save rejected documents to %s\n", BULK_REJECT_FILE);
+            }
+            if (fp != NULL) {
+                fclose(fp);
+            }
         }
 
-        pthread_mutex_unlock(&mx_report_dev);
+        atomic_fetch_add_explicit(&ed_reports_total, (uint32_t)bulk_device_reports(&bulk, taken), memory_order_relaxed);
+    }
 
-        clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
+    /* Every segment in the request is now either delivered or in the retry file */
+    for (seq = *seq_upload; seq < seq_end; seq++) {
+        segment_name(report_string, sizeof report_string, JSON_REPORT_ED, seq, true);
+        if (!continuous && remove(report_string)) {
+            MSG_ERR("[curl_upload_bulk] Failed to remove file %s\n", report_string);
+        }
     }
+    *seq_upload = seq_end;
 
-    destroy_ed_report(report);
-    MSG_INFO("End of encoding thread\n");
+    return 0;
 }
 
-/* -------------------------------------------------------------------------- */
-/* --- THREAD 1.11: Channel aggregate encoding and uploading JSONs ---------- */
-void thread_upload(void) {
-    
-    time_t start, current;              /* Time management variables to ensure thread activates at the correct time*/
-    char report_string[100];            /* File for holding file name creation */
-    int success;                        /* Dummy return variables */
-    int uploads = 0;                    /* Handler variable for temporary connection outages */
-    int ed_reports = 0;                 /* Internal ed reports counter */
-    int mutex_current = -1;             /* current mutex index handler */
+/**
+ * POST a report upload body, compressed when upload compression is configured.
+ *
+ * A body that fails to compress is sent as-is, the server takes both.
+ *
+ * @param url           Destination url
+ * @param content_type  Full Content-Type header line
+ * @param body          Segment or _bulk body
+ * @param len           Length of the body
+ * @return              libcurl code (CURLE_OK on success)
+*/
+static int upload_post (const char * url, const char * content_type, const void * body, size_t len) {
 
-    start = time(NULL);
+    long clen;
 
-    while (!exit_sig && !quit_sig) {
+    if (upload_compression != COMPRESS_NONE) {
+        clen = compress_body(&upload_compress, body, len);
+        if (clen > 0) {
+            MSG_INFO("[uploader] %lu bytes compressed to %ld (%.1fx)\n", (unsigned long)len, clen, (double)len / clen);
+            return http_post_encoded(&uploader, url, content_type, compress_encoding(&upload_compress), 1, upload_compress.out.data, upload_compress.out.len);
+        }
+        MSG_WARN("[uploader] Failed to compress %lu bytes, sending them uncompressed\n", (unsigned long)len);
+    }
 
-        wait_ms(MS_CONV * UPLOAD_SLEEP);
-        current = time(NULL);
+    return http_post(&uploader, url, content_type, 1, body, len);
+}
 
-        /* check if upload interval time has elapsed */
-        if (difftime(current, start) > report_interval) {
-            MSG_INFO("[thread_upload] Upload timer expired. Beginning upload...\n");
-            /* Acquire channel and log locks */
-            pthread_mutex_lock(&mx_log);
-
-            /* Need to acquire each uploading mutex and then upload */
-
-            for (int z = 0; z < 2; z++) {
-                /* MUTEX HANDLING */
-                if (mutex_current == -1) {
-                    /* Mutex is not set, choose whichever we can grab first */
-                    success = pthread_mutex_trylock(&mx_ed_report_0);
-                    if (success != 0) {
-                        /* Couldn't get mutex 0, lets go mutex 1 */
-                        success = pthread_mutex_lock(&mx_ed_report_1);
-                        if (success) {
-                            MSG_WARN("[thread_upload] Failed to acquire lock 1 with error after failing to get lock 0 %d?\n", success);
-                            break;
-                        } 
-                        mutex_current = 1;
+/**
+ * Special function for saving unknown curl responses.
+ * 
+ * @param response  Response body to save.
+ * @param len       Length of the response body.
+ * @return          -1 on failure, 0 on success
+*/
+static int save_unknown_response (const char* response, size_t len) {
+
+    int i;
+    FILE* fp_out;
+    char bad_file[100];
+
+    sprintf(bad_file, "bad_file_%d.txt", bad_file_count++);
+
+    MSG_WARN("[save_unknown_response] NON-JSON response received, attempting to save as %s\n", bad_file);
+
+    fp_out = fopen(bad_file, "w");
+
+    if (fp_out == NULL) {
+        MSG_WARN("[save_unknown_response] Failed to open %s for writing\n. Errno was %d. Skipping copy\n", bad_file, errno);
+        return -1;
+    }
+
+    if (fwrite(response, 1, len, fp_out) != len) {
+        MSG_WARN("[save_unknown_response] Failed writing to %s\n. Errno was %d. Exiting copy\n", bad_file, errno);
+        fclose(fp_out);
+        return -1;
+    }
+
+    i = fclose(fp_out);
+    if (i == EOF)
+        MSG_WARN("[save_unknown_response] Failed closing %s\n. Errno was %d\n", bad_file, errno);
+
+    return 0;
+}
+
+/**
+ * Special function for saving the report file that caused an unknown curl response.
+ * 
+ * @param file_in   String of the file to copy.
+ * @return          -1 on failure, 0 on success
+*/
+static int save_unknown_file (const char* file_in) {
+
+    ssize_t i, j;
+    FILE* fp_in, *fp_out;
+    char bad_file[100];
+
+    sprintf(bad_file, "bad_file_%d.txt", bad_file_count++);
+
+    MSG_WARN("[save_unknown_file] Saving %s as %s\n", file_in, bad_file);
+
+    fp_in = fopen(file_in, "r");
+
+    if (fp_in == NULL) {
+        MSG_WARN("[save_unknown_file] Failed to open %s for reading. Errno was %d. Skipping copy\n", file_in, errno);
+        return -1;
+    }
+
+    fp_out = fopen(bad_file, "w");
+
+    if (fp_out == NULL) {
+        MSG_WARN("[save_unknown_file] Failed to open %s for writing\n. Errno was %d. Skipping copy\n", bad_file, errno);
+        fclose(fp_in);
+        return -1;
+    }
+
+    i = fgetc(fp_in);
+
+    while (i != EOF) {
+        j = fputc(i, fp_out);
+
+        if (j == EOF) {
+            MSG_WARN("[save_unknown_file] Failed writing to %s\n. Errno was %d. Exiting copy\n", bad_file, errno);
+            fclose(fp_in);
+            fclose(fp_out);
+            return -1;
+        }
+
+        i = fgetc(fp_in);
+    }
+
+    i =  fclose(fp_in);
+    if (i == EOF)
+        MSG_WARN("[save_unknown_file] Failed closing %s\n. Errno was %d\n", file_in, errno);
+            
+    i = fclose(fp_out);
+    if (i == EOF)
+        MSG_WARN("[save_unknown_file] Failed closing %s\n. Errno was %d\n", bad_file, errno);
+
+    return 0;
+}
+
+/**
+ * Append a summary of every device heard over the period to the open device segment,
+ * start a new period and forget the devices silent for too long. Called by the encoder.
+ *
+ * @param now   End of the period
+*/
+static void encode_device_summaries (time_t now) {
+
+    char line[DEV_SUMMARY_JSON_MAX];
+    dev_entry_t *d;
+    uint32_t pos = 0;
+    uint32_t nb_summaries = 0;
+    uint32_t nb_expired;
+    int len;
+
+    while ((d = dev_table_next(&dev_table, &pos)) != NULL) {
+        if (d->nb_rx == 0) {
+            continue;
+        }
+        len = dev_table_encode(d, now, line, sizeof line);
+        if ((len < 0) || segment_append(&ed_segment, line, (size_t)len)) {
+            MSG_ERR("[encoder] Failed to append summary to segment %s_%u\n", JSON_REPORT_ED, segment_sealed_end(&ed_segment));
+        }
+        dev_table_reset_period(d);
+        nb_summaries++;
+    }
+
+    nb_expired = (dev_expiry > 0) ? dev_table_expire(&dev_table, now - dev_expiry) : 0;
+
+    MSG_INFO("[encoder] %u device summaries, %u devices tracked, %u forgotten, %u refused (table full)\n",
+             nb_summaries, dev_table.count, nb_expired, dev_table.full);
+}
+
+/**
+ * Append the cells of the current channel bucket to the open device segment and
+ * start a new bucket. Called by the encoder.
+*/
+static void encode_channel_buckets (void) {
+
+    char line[CHAN_AGG_JSON_MAX];
+    const chan_cell_t *cell;
+    uint32_t pos = 0;
+    int len;
+
+    while ((cell = chan_agg_next(&chan_agg, &pos)) != NULL) {
+        len = chan_agg_encode(&chan_agg, cell, line, sizeof line);
+        if ((len < 0) || segment_append(&ed_segment, line, (size_t)len)) {
+            MSG_ERR("[encoder] Failed to append channel bucket to segment %s_%u\n", JSON_REPORT_ED, segment_sealed_end(&ed_segment));
+        }
+    }
+    if (chan_agg.full > 0) {
+        MSG_WARN("[encoder] %u packets left out of channel buckets, too many channels\n", chan_agg.full);
+        chan_agg.full = 0;
+    }
+
+    chan_agg_reset(&chan_agg);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 1.0: RECEIVING PACKETS ------------------------------------------ */
+void *thread_listen(void *arg) {
+
+    card_t *card = (card_t *)arg; /* card this listener drains */
+
+    struct timespec sleep_time = {0, 0};
+    struct timespec now;
+    uint32_t delay_us;
+
+    /* fallback buffer, only used to drain the concentrator when the ring is full */
+    struct lgw_pkt_rx_s rxpkt_drop[16];
+    struct lgw_pkt_rx_s *rxpkt; /* where lgw_receive writes, the free slots of the ring when there are any */
+    uint32_t span;
+    int nb_pkt;
+
+    while (!exit_sig && !quit_sig) {
+
+        /* fetch packets straight into the ring */
+        span = pkt_ring_write_span(&card->rx_ring, &rxpkt);
+        if (span == 0) {
+            rxpkt = rxpkt_drop;
+            span = ARRAY_SIZE(rxpkt_drop);
+        } else if (span > ARRAY_SIZE(rxpkt_drop)) {
+            span = ARRAY_SIZE(rxpkt_drop);
+        }
+
+        /* the packets are counted on the group they were received on, a retune holds the same lock */
+        lgw_ctx_enter(card->ctx);
+        nb_pkt = lgw_receive((uint8_t)span, rxpkt);
+        if (nb_pkt > 0) {
+            radio_hop_count(&card->hop, card->radio_group_current, (uint32_t)nb_pkt);
+        }
+        lgw_ctx_leave(card->ctx);
+
+        if (nb_pkt == LGW_HAL_ERROR) {
+            MSG_ERR("[listener %d] failed packet fetch, exiting\n", card->index);
+            sniffer_exit();
+        }
+
+        /* back off while idle, come straight back while the RX buffer is filling */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        delay_us = rx_poll_update(&card->rx_poll, (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000, nb_pkt, (int)span);
+
+        if (nb_pkt > 0) {
+            if (rxpkt == rxpkt_drop) {
+                pkt_ring_drop(&card->rx_ring, (uint32_t)nb_pkt); /* encoder is behind, nowhere to put them */
+            } else {
+                pkt_ring_commit(&card->rx_ring, (uint32_t)nb_pkt);
+            }
+            atomic_fetch_add_explicit(&packets_caught, (uint32_t)nb_pkt, memory_order_relaxed);
+        }
+
+        if (delay_us > 0) {
+            sleep_time.tv_sec = delay_us / 1000000;
+            sleep_time.tv_nsec = (long)(delay_us % 1000000) * 1000;
+            clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL);
+        }
+    }
+
+    MSG_INFO("[listener %d] Packets caught: %lu\n", card->index, (unsigned long)atomic_load(&card->rx_poll.packets));
+    MSG_INFO("[listener %d] End of listening thread\n", card->index);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 1 (REPLAY): recorded packets in place of the listeners -------- */
+void *thread_replay(void *arg) {
+
+    replay_t *rp = (replay_t *)arg;
+
+    /* replay clock */
+    struct timespec start, now, due, sleep_time = {0, 100000}; /* 0 s, 100us while the encoder is behind */
+    uint64_t due_us, late_us, late_max_us = 0;
+    double elapsed;
+
+    capture_rec_t rec;
+    pkt_ring_t *ring;
+    struct lgw_pkt_rx_s *slot;
+    int x;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (!exit_sig && !quit_sig && (x = replay_next(rp, &rec, &due_us)) == 1) {
+
+        /* wait until the packet is due, as it was received */
+        if (due_us > 0) {
+            due.tv_sec = start.tv_sec + (time_t)(due_us / 1000000);
+            due.tv_nsec = start.tv_nsec + (long)(due_us % 1000000) * 1000;
+            if (due.tv_nsec >= 1000000000) {
+                due.tv_sec += 1;
+                due.tv_nsec -= 1000000000;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            late_us = (uint64_t)((now.tv_sec - due.tv_sec) * 1000000 + (now.tv_nsec - due.tv_nsec) / 1000);
+            if ((int64_t)late_us > 0 && late_us > late_max_us) {
+                late_max_us = late_us;
+            }
+        }
+
+        /* packets go to the ring of the card they came from, nothing is dropped: wait for the encoder */
+        ring = &cards[(rec.card < nb_cards) ? rec.card : 0].rx_ring;
+        while (pkt_ring_write_span(ring, &slot) == 0 && !exit_sig && !quit_sig) {
+            clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL);
+        }
+        if (exit_sig || quit_sig) {
+            break;
+        }
+        memcpy(slot, &rec.pkt, sizeof *slot);
+        pkt_ring_commit(ring, 1);
+        atomic_fetch_add_explicit(&packets_caught, 1, memory_order_relaxed);
+    }
+
+    if (x < 0) {
+        MSG_ERR("[replay] Malformed record in %s after %llu packets\n", replay_file, (unsigned long long)rp->packets);
+    }
+
+    /* let the encoder catch up before reporting */
+    for (x = 0; x < nb_cards; x++) {
+        while (pkt_ring_count(&cards[x].rx_ring) > 0 && !exit_sig && !quit_sig) {
+            clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+
+    MSG_INFO("[replay] %llu packets replayed in %.3fs (%.0f pkt/s), %.3fs of capture, latest packet %lluus late, %llu count_us resyncs\n",
+            (unsigned long long)rp->packets, elapsed, (elapsed > 0) ? rp->packets / elapsed : 0.0, rp->capture_us / 1e6,
+            (unsigned long long)late_max_us, (unsigned long long)rp->resyncs);
+
+    /* the whole capture went through, stop as on SIGINT */
+    exit_sig = true;
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 1.2: RADIO GROUP HOPPING ------------------------------------------ */
+void thread_hop(void) {
+
+    struct timespec sleep_time = {0, HOP_SLEEP_MS * 1000000};
+    card_t *card;
+    uint64_t start_us, end_us, since_us, packets;
+    int i, from, group;
+
+    while (!exit_sig && !quit_sig) {
+
+        for (i = 0; i < nb_cards; i++) {
+            card = &cards[i];
+            if (!card_hops(card)) {
+                continue;
+            }
+
+            group = radio_hop_next(&card->hop, monotonic_us());
+            if (group < 0) {
+                continue;
+            }
+
+            /* what the group being left heard on this visit */
+            from = atomic_load_explicit(&card->hop.current, memory_order_relaxed);
+            since_us = atomic_load_explicit(&card->hop.since_us, memory_order_relaxed);
+            packets = atomic_load_explicit(&card->hop.packets[from], memory_order_relaxed) - card->hop.seen[from];
+
+            start_us = monotonic_us();
+            if (init_radio_group(card, group, true)) {
+                MSG_ERR("[hop %d] failed to tune radio group %d, exiting\n", card->index, group);
+                sniffer_exit();
+            }
+            end_us = monotonic_us();
+            radio_hop_tuned(&card->hop, group, start_us, end_us);
+
+            MSG_INFO("[hop %d] radio group %d -> %d after %.1fs and %llu packets, retuned in %lluus, staying %ums\n",
+                     card->index, from, group, (start_us - since_us) / 1e6, (unsigned long long)packets,
+                     (unsigned long long)(end_us - start_us), radio_hop_dwell_ms(&card->hop, group));
+        }
+
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL);
+    }
+
+    MSG_INFO("[hop] End of radio group hopping thread\n");
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 1.1: JSON encoding for device packet info --------------------- */
+void thread_encode(void) {
+
+    /* sleep managent value */
+    struct timespec sleep_time = {0, 3000000}; /* 0 s, 3ms */
+
+    /* oldest packet in the ring of a card */
+    int i;
+    struct lgw_pkt_rx_s *rx_pkt;
+    bool idle;
+
+    /* report and its JSON line or CBOR record, reused for every packet */
+    ed_report_t report;
+    char line[ED_REPORT_JSON_MAX];
+    uint8_t record[REPORT_CBOR_MAX];
+    int len;
+
+    /* timestamp variables */
+    struct timespec pkt_utc_time;
+    uint64_t start_us;
+
+    /* per card counters */
+    card_t *card;
+
+    /* device summaries */
+    time_t summary_time = time(NULL);
+    time_t now;
+
+    while (!exit_sig && !quit_sig) {
+
+        /* encode straight out of the ring slots, one card after the other */
+        idle = true;
+        for (i = 0; i < nb_cards; i++) {
+            card = &cards[i];
+            while ((rx_pkt = pkt_ring_peek(&card->rx_ring)) != NULL) {
+                idle = false;
+
+                /* Acquire timestamp data */
+                clock_gettime(CLOCK_REALTIME, &pkt_utc_time);
+                start_us = monotonic_us();
+
+                /* raw packet first, it holds everything the report is derived from */
+                if (capture_enabled) {
+                    capture_write(&capture, (uint8_t)i, (uint64_t)pkt_utc_time.tv_sec * 1000000000ULL + (uint64_t)pkt_utc_time.tv_nsec, rx_pkt);
+                }
+
+                /* Write to report and track its device, every packet counts towards the summaries and buckets */
+                ed_report_write(&report, rx_pkt, &pkt_utc_time);
+                if (key_store_enabled) {
+                    key_store_process(&key_store, rx_pkt, &report);
+                }
+                dev_table_update(&dev_table, &report, pkt_utc_time.tv_sec);
+                if (channel_bucket > 0) {
+                    if (chan_agg_due(&chan_agg, pkt_utc_time.tv_sec)) {
+                        encode_channel_buckets();
+                    }
+                    chan_agg_add(&chan_agg, rx_pkt, &report, pkt_utc_time.tv_sec);
+                }
+
+                /* append it to the open device segment, unless the filter drops the report */
+                if (device_reports && (!report_filter_enabled || report_filter_check(&report_filter, rx_pkt, pkt_utc_time.tv_sec))) {
+                    if (report_format == REPORT_FORMAT_CBOR) {
+                        len = report_cbor_encode(&report, record, sizeof record);
+                        if ((len < 0) || segment_append(&ed_segment, (const char *)record, (size_t)len)) {
+                            MSG_ERR("[encoder] Failed to append report to segment %s_%u\n", JSON_REPORT_ED, segment_sealed_end(&ed_segment));
+                        }
                     } else {
-                        /* We got mutex 0, lets set out variables*/
-                        mutex_current = 0;
+                        len = ed_report_encode(&report, line, sizeof line);
+                        if ((len < 0) || segment_append(&ed_segment, line, (size_t)len)) {
+                            MSG_ERR("[encoder] Failed to append report to segment %s_%u\n", JSON_REPORT_ED, segment_sealed_end(&ed_segment));
+                        }
                     }
-                } else if (mutex_current == 0) {
-                    /* Time to get mutex 0 */
-                    success = pthread_mutex_lock(&mx_ed_report_0);
-                    if (success) {
-                        MSG_WARN("[thread_upload] Failed to acquire lock 0 with error %d?\n", success);
-                        break;
-                    } 
-                } else if (mutex_current == 1) {
-                    /* Time to get mutex 1 */
-                    success = pthread_mutex_lock(&mx_ed_report_1);
-                    if (success) {
-                        MSG_WARN("[thread_upload] Failed to acquire lock 1 with error %d?\n", success);
-                        break;
-                    } 
+                }
+                metrics_hist_observe(&metric_encode, monotonic_us() - start_us);
+
+                /* packet counters, from the slot before it is handed back */
+                if (rx_pkt->datarate >= DR_LORA_SF7 && rx_pkt->datarate <= DR_LORA_SF12) {
+                    atomic_fetch_add_explicit(&card->pkt_sf[rx_pkt->datarate - SF_BASE], 1, memory_order_relaxed);
                 } else {
-                    MSG_ERR("[thread_upload] Mutex_current incorrectly set... exiting.\n");
-                    sniffer_exit();
+                    atomic_fetch_add_explicit(&card->pkt_sf[SF_COUNT], 1, memory_order_relaxed);
+                }
+                if (rx_pkt->if_chain < LGW_IF_CHAIN_NB) {
+                    atomic_fetch_add_explicit(&card->pkt_chain[rx_pkt->if_chain], 1, memory_order_relaxed);
+                }
+                switch (rx_pkt->status) {
+                    case STAT_CRC_OK:   atomic_fetch_add_explicit(&card->pkt_crc[0], 1, memory_order_relaxed); break;
+                    case STAT_CRC_BAD:  atomic_fetch_add_explicit(&card->pkt_crc[1], 1, memory_order_relaxed); break;
+                    case STAT_NO_CRC:   atomic_fetch_add_explicit(&card->pkt_crc[2], 1, memory_order_relaxed); break;
+                    default:            atomic_fetch_add_explicit(&card->pkt_crc[3], 1, memory_order_relaxed);
                 }
 
-                ed_reports = mutex_current ? ed_reports_1 : ed_reports_0;
-                uploads = mutex_current ? ed_uploads_1 : ed_uploads_0;
+                /* hand the slot back to the listener */
+                pkt_ring_release(&card->rx_ring);
+            }
+        }
 
-                MSG_INFO("[thread_upload] Utilising mutex %d\n", mutex_current);
+        /* summaries of the devices heard since the last ones */
+        now = time(NULL);
+        if (dev_summary_interval > 0 && difftime(now, summary_time) >= dev_summary_interval) {
+            encode_device_summaries(now);
+            summary_time = now;
+        }
+        if (channel_bucket > 0 && chan_agg_due(&chan_agg, now)) {
+            encode_channel_buckets();
+        }
 
-                MSG_INFO("[thread_upload] Expecting %d reports uploads\n", ed_reports - uploads);
-            
-                /* Handle all ED reports generated */
-                for (int i = uploads; i < ed_reports; i++) {
+        /* seal the open segment if it has been sitting around too long */
+        if (segment_poll(&ed_segment)) {
+            MSG_ERR("[encoder] Failed to seal aged report segment\n");
+        }
 
-                    //MSG_INFO("[debug] Uploading for mutex %d at index %d with uploads %d\n", mutex_current, i, uploads);
+        /* push captured packets to the file once the rings are drained */
+        if (capture_enabled && idle) {
+            capture_flush(&capture);
+        }
 
-                    create_file_string(report_string, JSON_REPORT_ED, mutex_current, i);
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
+    }
 
-                    // MSG_INFO("[debug] Generated file string was %s\n", report_string);
+    /* last period, it goes out with the last segment */
+    if (dev_summary_interval > 0) {
+        encode_device_summaries(time(NULL));
+    }
+    if (channel_bucket > 0) {
+        encode_channel_buckets();
+    }
 
-                    success = curl_upload_file(report_string);
+    MSG_INFO("End of encoding thread\n");
+}
 
-                    /* Check if there was a special curl return, either a timeout or a connection reestablish*/
-                    if (success == -1) {
-                        MSG_WARN("[thread_upload] Curl timeout occured. Waiting for next period.\n");
-                        break;
-                    } else if (success == 1) {
-                        MSG_WARN("[thread_upload] Curl timeout fixed or new auth acquired. Repeating upload attempt.\n");
-                        i--;
-                        continue;
-                    }
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 1.11: Channel aggregate encoding and uploading JSONs ---------- */
+void thread_upload(void) {
+    
+    time_t start, current;              /* Time management variables to ensure thread activates at the correct time*/
+    int success;                        /* Dummy return variables */
+    long records;                       /* Device reports held by the segment being uploaded */
+    int uploads = 0;                    /* Segments uploaded this period */
+    uint32_t seq_upload = spool_resume; /* Next sealed segment to upload */
+    uint32_t seq_sealed = 0;            /* End of the sealed segment range */
+    uint32_t seq_from;                  /* First segment of a _bulk request */
+    bool sent;                          /* A _bulk request went out */
+    unsigned waited;                    /* Time (ms) spent waiting for the encoder to seal */
 
-                    /* Remove the file to save space */
-                    success = remove(report_string);
+    start = time(NULL);
 
-                    if (success) {
-                        MSG_ERR("[thread_upload] Failed to remove file %s\n", report_string);
-                    }
+    while (!exit_sig && !quit_sig) {
+
+        wait_ms(MS_CONV * UPLOAD_SLEEP);
+        current = time(NULL);
 
-                    /* Increment our upload counter */
+        /* check if upload interval time has elapsed */
+        if (difftime(current, start) > report_interval) {
+            MSG_INFO("[thread_upload] Upload timer expired. Beginning upload...\n");
+
+            /* Have the encoder seal whatever has been written so far so it goes out this period */
+            segment_request_seal(&ed_segment);
+            for (waited = 0; segment_seal_pending(&ed_segment) && waited < SEAL_WAIT_MS && !exit_sig && !quit_sig; waited += 10) {
+                wait_ms(10);
+            }
+            seq_sealed = segment_sealed_end(&ed_segment);
+            uploads = 0;
+
+            MSG_INFO("[thread_upload] Expecting %u segment uploads\n", seq_sealed - seq_upload);
+
+            /* Handle all sealed ED segments in as few _bulk requests as possible */
+            while (upload_mode == UPLOAD_MODE_BULK) {
+
+                seq_from = seq_upload;
+                success = curl_upload_bulk(&seq_upload, seq_sealed, &sent);
+
+                if (success == -1) {
+                    MSG_WARN("[thread_upload] _bulk upload failed. Waiting for next period.\n");
+                    break;
+                } else if (success == 1) {
+                    MSG_WARN("[thread_upload] Curl timeout fixed or new auth acquired. Repeating upload attempt.\n");
+                    continue;
+                }
+
+                /* empty segments are passed over without a request, only acknowledged */
+                if (sent) {
                     uploads++;
                 }
+                if (seq_upload != seq_from) {
+                    segment_ack(&ed_segment, seq_upload);
+                }
 
-                /* Log data to file */
-                MSG_INFO("[thread_upload] Reports encoded: %d, uploaded: %d\n", ed_reports, uploads);
+                if (seq_upload == seq_sealed) {
+                    break;
+                }
+            }
 
-                /* reset upload count if all end device reports were uploaded */
-                if (uploads == ed_reports) {
+            /* Handle all sealed ED segments one by one */
+            while (upload_mode == UPLOAD_MODE_SEGMENT && seq_upload < seq_sealed) {
 
-                    /* all data uploaded successfully, lets reset our variables */
-                    uploads = 0;
+                segment_name(report_string, sizeof report_string, JSON_REPORT_ED, seq_upload, true);
 
-                    if (!continuous) {
-                        ed_reports_total += ed_reports;
-                        ed_reports = 0;
-                    }
+                records = count_device_reports(report_string);
+                if (records < 0) {
+                    MSG_ERR("[thread_upload] Failed to open segment %s, skipping\n", report_string);
+                    seq_upload++;
+                    segment_ack(&ed_segment, seq_upload);
+                    continue;
                 }
 
-                if (mutex_current == 0) {
-                    ed_uploads_0 = uploads;
-                    ed_reports_0 = ed_reports;
-                    pthread_mutex_unlock(&mx_ed_report_0);
-                } else {
-                    ed_uploads_1 = uploads;
-                    ed_reports_1 = ed_reports;
-                    pthread_mutex_unlock(&mx_ed_report_1);
+                success = curl_upload_file(report_string);
+
+                /* Check if there was a special curl return, either a timeout or a connection reestablish*/
+                if (success == -1) {
+                    MSG_WARN("[thread_upload] Curl timeout occured. Waiting for next period.\n");
+                    break;
+                } else if (success == 1) {
+                    MSG_WARN("[thread_upload] Curl timeout fixed or new auth acquired. Repeating upload attempt.\n");
+                    continue;
+                }
+
+                /* Remove the segment to save space, unless we are keeping everything */
+                if (!continuous) {
+                    success = remove(report_string);
+
+                    if (success) {
+                        MSG_ERR("[thread_upload] Failed to remove file %s\n", report_string);
+                    }
                 }
 
-                mutex_current = mutex_current ? 0 : 1; /* If mutex is currently 0, go to 1, and vice versa */
+                /* Increment our upload counters */
+                atomic_fetch_add_explicit(&ed_reports_total, (uint32_t)records, memory_order_relaxed);
+                uploads++;
+                seq_upload++;
+                segment_ack(&ed_segment, seq_upload);
             }
 
-            mutex_current = -1; /* Set mutex current variable to its not set state */
-            
-            pthread_mutex_unlock(&mx_log);
+            /* Log data to file */
+            MSG_INFO("[thread_upload] %s uploaded: %d, segments still pending: %u\n", (upload_mode == UPLOAD_MODE_BULK) ? "_bulk requests" : "Segments", uploads, seq_sealed - seq_upload);
+
             start = time(NULL);
         }
     }
 
-    MSG_INFO("[uploader] ED reports uploaded total: %d\n", ed_reports_total);
+    MSG_INFO("[uploader] ED reports uploaded total: %lu\n", (unsigned long)ed_reports_total);
     MSG_INFO("[uploader] End of uploading thread\n");
 }
 
@@ -2303,26 +3221,39 @@ void thread_upload(void) {
 int main(int argc, char **argv) {
 
     /* return management variable */
-    int i;
+    int i, j;
+    char conf_obj_name[20];
 
     /* configuration file related */
     const char defaut_conf_fname[] = JSON_CONF_DEFAULT;
     const char * conf_fname = defaut_conf_fname; /* pointer to a string we won't touch */
 
     unsigned sleep_time = 0;
-    uint8_t sleep_counter = 0;
 
     /* deamonise handling variables */
     pid_t pid;
     bool daemonise = false;
 
-    /* threads */
-    pthread_t thrid_listen;
+    /* raw capture export and replay */
+    char pcapng_name[CAPTURE_NAME_LEN + 8];
+    char decoded_name[SEGMENT_NAME_LEN + 16];
+    long nb_exported;
+    replay_t replay;
+    pthread_t thrid_replay;
+    unsigned slept;
+
+    /* report spool left by the last run */
+    segment_recovery_t spool_recovery;
+    uint32_t spool_found;
+
+    /* deflate dictionary of the uploads */
+    char compress_dict[COMPRESS_DICT_MAX];
+    long dict_len = 0;
+
+    /* threads, the listeners are held by the cards */
     pthread_t thrid_encode;
     pthread_t thrid_upload;
-
-    /* message queue initialisation */
-    STAILQ_INIT(&head);
+    pthread_t thrid_hop;
 
     /* parse command line options */
     while( (i = getopt( argc, argv, OPTION_ARGS )) != -1 )
@@ -2352,6 +3283,34 @@ int main(int argc, char **argv) {
             verbose =  true;
             break;
 
+        case 'x':
+            snprintf(pcapng_name, sizeof pcapng_name, "%s.pcapng", optarg);
+            nb_exported = capture_export_pcapng(optarg, pcapng_name);
+            if (nb_exported < 0) {
+                printf("ERROR: failed to export %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            printf("INFO: %ld packets exported to %s\n", nb_exported, pcapng_name);
+            return EXIT_SUCCESS;
+
+        case 'j':
+            snprintf(decoded_name, sizeof decoded_name, "%s.decoded.ndjson", optarg);
+            nb_exported = report_cbor_export_ndjson(optarg, decoded_name);
+            if (nb_exported < 0) {
+                printf("ERROR: failed to decode %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            printf("INFO: %ld records decoded to %s\n", nb_exported, decoded_name);
+            return EXIT_SUCCESS;
+
+        case 'r':
+            replay_file = optarg;
+            break;
+
+        case 's':
+            replay_speed = strtod(optarg, NULL);
+            break;
+
         default:
             printf("ERROR: argument parsing options, use -h option for help\n" );
             usage( );
@@ -2385,11 +3344,26 @@ int main(int argc, char **argv) {
     /* configuration files management */
     if (access(conf_fname, R_OK) == 0) { /* if there is a global conf, parse it  */
         MSG_INFO("[main] found configuration file %s, parsing it\n", conf_fname);
-        i = parse_SX130x_configuration(conf_fname);
+        i = parse_SX130x_configuration(conf_fname, "SX130x_conf", &cards[0]);
         if (i != 0) {
-            MSG_ERR("[main] No \"SX130x_conf\" field in the chosen (or default) JSON\n");
+            MSG_ERR("[main] No valid \"SX130x_conf\" field in the chosen (or default) JSON\n");
             exit(EXIT_FAILURE);
         }
+        nb_cards = 1;
+        /* extra concentrator cards (optional) */
+        for (j = 1; j < MAX_CARDS; j++) {
+            cards[j].index = j;
+            snprintf(conf_obj_name, sizeof conf_obj_name, "SX130x_conf_%d", j);
+            i = parse_SX130x_configuration(conf_fname, conf_obj_name, &cards[j]);
+            if (i > 0) {
+                break;
+            } else if (i < 0) {
+                MSG_ERR("[main] Invalid \"%s\" field in the chosen (or default) JSON\n", conf_obj_name);
+                exit(EXIT_FAILURE);
+            }
+            nb_cards = j + 1;
+        }
+        MSG_INFO("[main] %d concentrator card(s) configured\n", nb_cards);
         i = parse_gateway_configuration(conf_fname);
         if (i != 0) {
             MSG_ERR("[main] No \"gateway_conf\" field in the chosen (or default) JSON\n");
@@ -2412,8 +3386,148 @@ int main(int argc, char **argv) {
     /* Set our sleep time */
     sleep_time = log_interval / stats_per_log;
 
-    /* starting the concentrator */
-    if (sniffer_start()) {
+    /* the logger starts a new file every log interval, or earlier once it is too big */
+    log_set_rotation(log_max_bytes, log_interval);
+
+    /* persistent uploader, shared by every dashboard and auth0 request */
+    if (http_global_init() || http_init(&uploader, HTTP_CONNECT_TIMEOUT)) {
+        MSG_ERR("[main] Failed to initialise HTTP uploader\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (bulk_init(&bulk, bulk_index)) {
+        MSG_ERR("[main] Invalid _bulk index name %s\n", bulk_index);
+        exit(EXIT_FAILURE);
+    }
+
+    /* upload compression, the reports go uncompressed if it cannot be set up */
+    if (upload_compression == COMPRESS_DEFLATE_DICT) {
+        dict_len = compress_dict_from_mapping(upload_dictionary, compress_dict, sizeof compress_dict);
+        if (dict_len <= 0) {
+            MSG_WARN("[main] Unable to build a deflate dictionary from %s, using gzip\n", upload_dictionary);
+            upload_compression = COMPRESS_GZIP;
+        } else {
+            MSG_INFO("[main] Deflate dictionary of %ld bytes built from %s\n", dict_len, upload_dictionary);
+        }
+    }
+    if (upload_compression != COMPRESS_NONE && compress_init(&upload_compress, upload_compression, upload_compress_level, compress_dict, (size_t)dict_len)) {
+        MSG_ERR("[main] Failed to initialise upload compression, uploads are not compressed\n");
+        upload_compression = COMPRESS_NONE;
+    }
+
+    if (http_buf_load(&client_key, file_client_key)) {
+        MSG_WARN("[main] Unable to read auth0 client key file %s, auth0 requests will be empty\n", file_client_key);
+    }
+
+    for (j = 0; j < nb_cards; j++) {
+        /* listener polling schedule */
+        rx_poll_init(&cards[j].rx_poll, rx_poll_min_us, rx_poll_max_us);
+
+        /* radio group schedule, from the group the card is configured on, it counts packets even without swapping */
+        if (radio_hop_init(&cards[j].hop, cards[j].radio_group_count, cards[j].radio_group_current, cards[j].radio_group_dwell_mode,
+                           cards[j].radio_group_dwell_ms, cards[j].radio_group_dwell_min_ms, cards[j].radio_group_dwell_max_ms, monotonic_us())) {
+            MSG_ERR("[main] Invalid radio group schedule for card %d\n", cards[j].index);
+            exit(EXIT_FAILURE);
+        }
+        /* a retune holds the HAL context lock, shared by every card, for a whole stop and start */
+        if (card_hops(&cards[j]) && nb_cards > 1) {
+            MSG_ERR("[main] Group swapping of card %d disabled, retuning it would stall the listeners of the other cards\n", cards[j].index);
+            cards[j].radio_group_swapping = false;
+        }
+        if (card_hops(&cards[j]) && replay_file == NULL) {
+            radio_hopping = true;
+        }
+
+        /* packet ring, every slot is allocated here so the listener never has to */
+        if (pkt_ring_init(&cards[j].rx_ring, rx_ring_size)) {
+            MSG_ERR("[main] Failed to allocate packet ring of %u packets\n", rx_ring_size);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* time on air table, read by the encoder for every device report */
+    lora_packet_toa_init();
+
+    /* per device state */
+    if (dev_table_init(&dev_table, dev_table_size)) {
+        MSG_ERR("[main] Failed to allocate device table of %u devices\n", dev_table_size);
+        exit(EXIT_FAILURE);
+    }
+    if (channel_bucket > 0 && chan_agg_init(&chan_agg, channel_bucket)) {
+        MSG_ERR("[main] Failed to allocate channel buckets\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* session keys, the sniffer carries on without them if the file cannot be loaded */
+    if (key_file[0] != '\0') {
+        i = key_store_load(&key_store, key_file);
+        if (i < 0) {
+            MSG_ERR("[main] Failed to load session keys from %s, MIC checks disabled\n", key_file);
+        } else {
+            key_store.keep_data = key_data;
+            key_store_enabled = true;
+            MSG_INFO("[main] Session keys of %d devices loaded\n", i);
+        }
+    }
+
+    /* device report segments */
+    if (segment_init(&ed_segment, JSON_REPORT_ED, segment_max_bytes, segment_max_age)) {
+        MSG_ERR("[main] Failed to initialise device report segments\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* segments left by the last run, uploads resume at the first one not acknowledged */
+    if (spool_journal) {
+        if (segment_journal_open(&ed_segment, spool_sync_ms, &spool_recovery)) {
+            MSG_ERR("[main] Report spool recovery failed, segments left on disk may be uploaded again or not at all\n");
+        }
+        spool_resume = spool_recovery.seq_acked;
+        MSG_INFO("[main] Report spool: %u segments pending from %s_%u, %u taken in, %u repaired, %u put aside, %u missing%s\n",
+                 spool_recovery.pending, JSON_REPORT_ED, spool_resume, spool_recovery.adopted, spool_recovery.repaired,
+                 spool_recovery.quarantined, spool_recovery.missing, spool_recovery.torn_journal ? ", partial journal entry dropped" : "");
+    } else {
+        /* without journal nothing says what was uploaded, only the numbering goes on */
+        if (segment_skip_existing(&ed_segment, &spool_found)) {
+            MSG_ERR("[main] Failed to read the report spool directory, segments left on disk could be written over\n");
+            exit(EXIT_FAILURE);
+        }
+        spool_resume = segment_sealed_end(&ed_segment);
+        if (spool_found > 0) {
+            MSG_WARN("[main] Report spool: %u segment files left on disk without journal, not uploaded, numbering goes on from %s_%u\n",
+                     spool_found, JSON_REPORT_ED, spool_resume);
+        }
+    }
+
+    /* raw packet capture, the sniffer carries on without it if the file cannot be opened */
+    if (capture_path[0] != '\0' && replay_file == NULL) {
+        if (capture_open(&capture, capture_path, capture_max_bytes, capture_keep, lgwm)) {
+            MSG_ERR("[main] Failed to open raw capture %s%s, capture disabled\n", capture_path, CAPTURE_SUFFIX);
+        } else {
+            capture_enabled = true;
+        }
+    }
+
+    /* runtime metrics, the sniffer carries on without them if the port cannot be used */
+    start_time = time(NULL);
+    if (metrics_port > 0 && metrics_port <= UINT16_MAX) {
+        lgw_meas_time_set_hook(meas_time_hook); /* before the HAL is used from the listeners */
+        if (metrics_server_start(&metrics_server, metrics_bind, (uint16_t)metrics_port, render_metrics, NULL)) {
+            MSG_ERR("[main] Failed to serve metrics on %s:%u\n", metrics_bind, metrics_port);
+        } else {
+            MSG_INFO("[main] metrics served on http://%s:%u/metrics\n", metrics_bind, metrics_server.port);
+        }
+    } else {
+        metrics_server.fd = -1;
+    }
+
+    /* starting the concentrator, or opening the capture that stands in for it */
+    if (replay_file != NULL) {
+        if (replay_open(&replay, replay_file, replay_speed)) {
+            MSG_ERR("[main] Failed to open capture %s for replay\n", replay_file);
+            exit(EXIT_FAILURE);
+        }
+        MSG_INFO("[main] replaying %s at %s\n", replay_file, (replay_speed > 0) ? "capture pace" : "maximum speed");
+    } else if (sniffer_start()) {
         MSG_ERR("[main] Failed to start sniffer\n");
         exit(EXIT_FAILURE);
     }
@@ -2432,11 +3546,30 @@ int main(int argc, char **argv) {
         sniffer_exit();
     }
 
-    /* main listener for upstream */
-    i = pthread_create(&thrid_listen, NULL, (void * (*)(void *))thread_listen, NULL);
-    if (i != 0) {
-        MSG_ERR("[main] impossible to create listening thread\n");
-        sniffer_exit();
+    /* main listener for upstream, one per card, or the replay feeding their rings */
+    if (replay_file != NULL) {
+        i = pthread_create(&thrid_replay, NULL, thread_replay, &replay);
+        if (i != 0) {
+            MSG_ERR("[main] impossible to create replay thread\n");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        for (j = 0; j < nb_cards; j++) {
+            i = pthread_create(&cards[j].thrid_listen, NULL, thread_listen, &cards[j]);
+            if (i != 0) {
+                MSG_ERR("[main] impossible to create listening thread %d\n", j);
+                sniffer_exit();
+            }
+        }
+    }
+
+    /* radio group hopping, for the cards swapping groups */
+    if (radio_hopping) {
+        i = pthread_create(&thrid_hop, NULL, (void * (*)(void *))thread_hop, NULL);
+        if (i != 0) {
+            MSG_ERR("[main] impossible to create radio group hopping thread\n");
+            sniffer_exit();
+        }
     }
 
     /* configure signal handling */
@@ -2448,31 +3581,39 @@ int main(int argc, char **argv) {
     sigaction(SIGTERM, &sigact, NULL); /* default "kill" command */
 
     while (!exit_sig && !quit_sig) {
-        /* Sleep, then create new log once time is up */
-        wait_ms(MS_CONV * sleep_time);
-        pthread_mutex_lock(&mx_log);
-        pthread_mutex_lock(&mx_report_dev);
+        /* Sleep, then generate statistics, stats_per_log times per log file */
+        for (slept = 0; slept < sleep_time && !exit_sig && !quit_sig; slept++) {
+            wait_ms(MS_CONV);
+        }
 
-        /* close current log and open a new one only if no interrupt signals have been given */
+        /* only if no interrupt signals have been given */
         if (!exit_sig && !quit_sig) {
-            if (sleep_counter == stats_per_log) {
-                log_open();
-                sleep_counter = 0;
-            }
-            
-
             generate_sniffer_stats(); // Get our lovely gateway info going
-            sleep_counter++;
         }
-        
-        pthread_mutex_unlock(&mx_report_dev);
-        pthread_mutex_unlock(&mx_log);
     }
 
     /* Get all of our main concentrator listening threads to close */
-    i = pthread_join(thrid_listen, NULL);
-    if (i != 0) {
-        MSG_ERR("Failed to join LoRa listening upstream thread with %d - %s\n", i, strerror(errno));
+    if (replay_file != NULL) {
+        i = pthread_join(thrid_replay, NULL);
+        if (i != 0) {
+            MSG_ERR("Failed to join replay thread with %d - %s\n", i, strerror(errno));
+        }
+        replay_close(&replay);
+    } else {
+        for (j = 0; j < nb_cards; j++) {
+            i = pthread_join(cards[j].thrid_listen, NULL);
+            if (i != 0) {
+                MSG_ERR("Failed to join LoRa listening upstream thread %d with %d - %s\n", j, i, strerror(errno));
+            }
+        }
+    }
+
+    /* no retune once the concentrators are being stopped */
+    if (radio_hopping) {
+        i = pthread_join(thrid_hop, NULL);
+        if (i != 0) {
+            MSG_ERR("Failed to join radio group hopping thread with %d - %s\n", i, strerror(errno));
+        }
     }
 
     /* Wait for ED encoding thread to end */
@@ -2487,17 +3628,43 @@ int main(int argc, char **argv) {
         MSG_ERR("Failed to join uploading upstream thread with %d - %s\n", i, strerror(errno));
     }
 
+    /* stop serving metrics, they read the rings */
+    metrics_server_stop(&metrics_server);
+
+    /* seal the last segment so it is picked up on the next run */
+    segment_close(&ed_segment);
+    capture_close(&capture);
+
+    /* close the dashboard connection */
+    http_cleanup(&uploader);
+    http_buf_free(&client_key);
+    http_buf_free(&bulk_scratch);
+    bulk_free(&bulk);
+    compress_free(&upload_compress);
+    http_global_cleanup();
+
     if (exit_sig) {
-        /* clean up before leaving */
-        sniffer_stop();
+        /* clean up before leaving, the concentrators were never started for a replay */
+        if (replay_file == NULL) {
+            sniffer_stop();
+        }
         stat_cleanup();
     }
 
-    /* message queue deinitialisation */
-    STAILQ_INIT(&head);
+    /* packet ring deinitialisation */
+    for (j = 0; j < nb_cards; j++) {
+        pkt_ring_free(&cards[j].rx_ring);
+    }
+    dev_table_free(&dev_table);
+    chan_agg_free(&chan_agg);
+    key_store_free(&key_store);
+    report_filter_free(&report_filter);
 
     MSG_INFO("Successfully exited packet sniffer program\n");
 
+    /* write out whatever is still queued */
+    log_stop();
+
     return EXIT_SUCCESS;
 }
 
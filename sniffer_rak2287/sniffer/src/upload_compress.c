@@ -0,0 +1,223 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Compression of upload bodies with zlib, gzip or deflate with a preset
+    dictionary built from the index mapping.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memset memcpy strcmp strlen */
+#include <stdio.h>      /* snprintf */
+#include <time.h>       /* clock_gettime */
+
+#include "parson.h"
+#include "upload_compress.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define GZIP_WINDOW_BITS    (15 + 16)   /* 32 KiB window, gzip wrapper */
+#define ZLIB_WINDOW_BITS    15          /* 32 KiB window, zlib wrapper (carries the dictionary id) */
+#define ZLIB_MEM_LEVEL      8
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint64_t thread_cpu_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/* field names that are written as JSON strings get the opening quote of their value */
+static bool quoted_type(const char *type) {
+    return (type != NULL) && ((strcmp(type, "keyword") == 0) || (strcmp(type, "date") == 0) || (strcmp(type, "text") == 0));
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int compress_init(compress_t *c, int method, int level, const void *dict, size_t dict_len) {
+
+    int x;
+
+    memset(c, 0, sizeof *c);
+    atomic_init(&c->nb_bodies, 0);
+    atomic_init(&c->bytes_in, 0);
+    atomic_init(&c->bytes_out, 0);
+    atomic_init(&c->cpu_us, 0);
+
+    if ((level < Z_BEST_SPEED) || (level > Z_BEST_COMPRESSION)) {
+        return -1;
+    }
+    c->method = method;
+    c->level = level;
+
+    switch (method) {
+        case COMPRESS_GZIP:
+            x = deflateInit2(&c->zs, level, Z_DEFLATED, GZIP_WINDOW_BITS, ZLIB_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+            break;
+        case COMPRESS_DEFLATE_DICT:
+            if ((dict == NULL) || (dict_len == 0)) {
+                return -1;
+            }
+            /* only the last window of a longer dictionary is ever referenced */
+            if (dict_len > COMPRESS_DICT_MAX) {
+                dict = (const uint8_t *)dict + (dict_len - COMPRESS_DICT_MAX);
+                dict_len = COMPRESS_DICT_MAX;
+            }
+            c->dict = malloc(dict_len);
+            if (c->dict == NULL) {
+                return -1;
+            }
+            memcpy(c->dict, dict, dict_len);
+            c->dict_len = dict_len;
+            c->dict_id = (uint32_t)adler32(adler32(0L, Z_NULL, 0), c->dict, (uInt)dict_len);
+            x = deflateInit2(&c->zs, level, Z_DEFLATED, ZLIB_WINDOW_BITS, ZLIB_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+            break;
+        default:
+            return -1;
+    }
+
+    if (x != Z_OK) {
+        free(c->dict);
+        c->dict = NULL;
+        return -1;
+    }
+    c->ready = true;
+
+    return 0;
+}
+
+void compress_free(compress_t *c) {
+
+    if (c->ready) {
+        deflateEnd(&c->zs);
+        c->ready = false;
+    }
+    free(c->dict);
+    c->dict = NULL;
+    c->dict_len = 0;
+    http_buf_free(&c->out);
+}
+
+long compress_body(compress_t *c, const void *body, size_t len) {
+
+    int x;
+    uLong bound;
+    uint64_t t0;
+
+    if (!c->ready) {
+        return -1;
+    }
+
+    t0 = thread_cpu_us();
+
+    if (deflateReset(&c->zs) != Z_OK) {
+        return -1;
+    }
+    if ((c->dict != NULL) && (deflateSetDictionary(&c->zs, c->dict, (uInt)c->dict_len) != Z_OK)) {
+        return -1;
+    }
+
+    /* whole body in one call: the output buffer is sized for the worst case */
+    bound = deflateBound(&c->zs, (uLong)len);
+    if (http_buf_reserve(&c->out, bound)) {
+        return -1;
+    }
+    c->zs.next_in = (Bytef *)body;
+    c->zs.avail_in = (uInt)len;
+    c->zs.next_out = (Bytef *)c->out.data;
+    c->zs.avail_out = (uInt)bound;
+    x = deflate(&c->zs, Z_FINISH);
+    if (x != Z_STREAM_END) {
+        return -1;
+    }
+    c->out.len = c->zs.total_out;
+
+    atomic_fetch_add_explicit(&c->nb_bodies, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->bytes_in, len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->bytes_out, c->out.len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->cpu_us, thread_cpu_us() - t0, memory_order_relaxed);
+
+    return (long)c->out.len;
+}
+
+const char *compress_encoding(const compress_t *c) {
+
+    switch (c->method) {
+        case COMPRESS_GZIP:
+            return HTTP_ENCODING_GZIP;
+        case COMPRESS_DEFLATE_DICT:
+            return HTTP_ENCODING_DEFLATE;
+        default:
+            return NULL;
+    }
+}
+
+long compress_dict_from_mapping(const char *mapping_file, char *dict, size_t size) {
+
+    JSON_Value *root_val;
+    JSON_Object *props, *field;
+    const char *name;
+    size_t len = 0;
+    int i, nb, n;
+
+    root_val = json_parse_file_with_comments(mapping_file);
+    if (root_val == NULL) {
+        return -1;
+    }
+    props = json_object_get_object(json_value_get_object(root_val), "properties");
+    if (props == NULL) {
+        json_value_free(root_val);
+        return -1;
+    }
+
+    /* mappings list the main fields first, deflate finds the end of the dictionary closest */
+    nb = (int)json_object_get_count(props);
+    for (i = nb - 1; i >= 0; i--) {
+        name = json_object_get_name(props, i);
+        field = json_object_get_object(props, name);
+        n = snprintf(dict + len, size - len, "%s\"%s\":%s", (i == 0) ? "{" : ",", name,
+                     quoted_type(json_object_get_string(field, "type")) ? "\"" : "");
+        if ((n < 0) || ((size_t)n >= (size - len))) {
+            break;
+        }
+        len += (size_t)n;
+    }
+
+    json_value_free(root_val);
+
+    return (long)len;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
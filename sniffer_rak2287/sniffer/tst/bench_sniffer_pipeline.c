@@ -0,0 +1,747 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    End to end benchmark of the packet pipeline. Synthetic lgw_pkt_rx_s
+    bursts, standing in for lgw_receive, go through the same stages as in
+    the sniffer: listener into the packet ring, encoder (report, JSON line,
+    optional raw capture, segment append), then sealed segments shipped as
+    _bulk requests to a sink on loopback. Every packet is timed at each hand
+    off, and the time spent in each stage goes into a latency histogram.
+    Throughput and p50/p99/p999 per stage are printed, and written as NDJSON
+    (one summary line, then one line per stage) with -o so runs can be
+    compared across versions. The histograms are checked before the run.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 700
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fopen */
+#include <stdlib.h>     /* EXIT_FAILURE strtoul calloc */
+#include <string.h>     /* memset strstr */
+#include <time.h>       /* clock_gettime clock_nanosleep */
+#include <unistd.h>     /* getopt getpid read write */
+#include <stdatomic.h>  /* C11 atomics */
+#include <sched.h>      /* sched_yield */
+
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "pkt_ring.h"
+#include "ed_report.h"
+#include "capture.h"
+#include "report_segment.h"
+#include "http_uploader.h"
+#include "bulk_upload.h"
+#include "json_emit.h"
+#include "latency_hist.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#ifndef VERSION_STRING
+    #define VERSION_STRING "undefined"
+#endif
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_PACKETS     200000      /* packets pushed through the pipeline */
+#define DEFAULT_RATE        0.0         /* packets per second, 0 for as fast as the encoder takes them */
+#define DEFAULT_BURST       16          /* packets per lgw_receive, as the listener asks for */
+#define DEFAULT_INTERVAL    100         /* ms between uploads */
+#define DEFAULT_RING        1024        /* packet ring slots, as in the sniffer */
+#define DEFAULT_SEG_BYTES   262144      /* segment size, as in the sniffer */
+
+#define ENCODE_SLEEP_NS     3000000     /* idle wait of the encoder, as in the sniffer */
+#define SINK_HEAD_LEN       8192
+#define SINK_RESPONSE       "{\"took\":1,\"errors\":false,\"items\":[]}"
+#define NB_DEVICES          500         /* DevAddr population of the synthetic traffic */
+#define JSON_LINE_LEN       512
+
+/* stages, in packet order */
+enum stage_e {
+    STAGE_LISTEN,                       /* lgw_receive returned to packet committed in the ring */
+    STAGE_QUEUE,                        /* committed to picked by the encoder */
+    STAGE_REPORT,                       /* ed_report_write */
+    STAGE_ENCODE,                       /* ed_report_encode */
+    STAGE_CAPTURE,                      /* capture_write, with -c */
+    STAGE_APPEND,                       /* segment_append */
+    STAGE_UPLOAD,                       /* appended to acknowledged by the sink */
+    STAGE_TOTAL,                        /* lgw_receive returned to acknowledged by the sink */
+    NB_STAGES
+};
+
+static const char *stage_name[NB_STAGES] = {"listen", "queue", "report", "encode", "capture", "append", "upload", "total"};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* run options */
+static unsigned long nb_packets = DEFAULT_PACKETS;
+static double rate = DEFAULT_RATE;
+static unsigned burst = DEFAULT_BURST;
+static unsigned interval_ms = DEFAULT_INTERVAL;
+static uint32_t ring_size = DEFAULT_RING;
+static bool capture_enabled = false;
+
+/* pipeline */
+static pkt_ring_t ring;
+static segment_writer_t segment;
+static capture_writer_t capture;
+static char prefix[SEGMENT_PREFIX_LEN];
+static char url[64];
+
+/* hand off times of each packet (ns, monotonic), by sequence number */
+static uint64_t *t_rx;
+static uint64_t *t_ring;
+static uint64_t *t_appended;
+static uint32_t *order;                 /* sequence number of each appended record, in segment order */
+
+static _Atomic bool listen_done = false;
+static _Atomic bool encode_done = false;
+static _Atomic uint32_t appended = 0;   /* records appended, order and t_appended are valid below */
+
+/* one histogram per stage, each written by the thread running the stage */
+static latency_hist_t hist[NB_STAGES];
+
+/* outcome */
+static uint64_t t_start, t_listen_end, t_encode_end, t_upload_end;
+static unsigned long dropped = 0;
+static unsigned long uploaded = 0;
+static unsigned long requests = 0;
+static unsigned long upload_errors = 0;
+
+/* loopback sink */
+static int sink_fd = -1;
+static uint16_t sink_port = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h print this help\n");
+    printf(" -n <uint> packets pushed through the pipeline [%d]\n", DEFAULT_PACKETS);
+    printf(" -r <float> packets per second, 0 for as fast as the encoder takes them [%.0f]\n", DEFAULT_RATE);
+    printf(" -b <uint> packets per lgw_receive [%d]\n", DEFAULT_BURST);
+    printf(" -i <uint> ms between uploads [%d]\n", DEFAULT_INTERVAL);
+    printf(" -q <uint> packet ring slots [%d]\n", DEFAULT_RING);
+    printf(" -c capture raw packets as well\n");
+    printf(" -o <file> write the results as NDJSON\n");
+}
+
+static uint64_t now_ns(void) {
+
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+static void sleep_until_ns(uint64_t t) {
+
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)(t / 1000000000ULL);
+    ts.tv_nsec = (long)(t % 1000000000ULL);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/**
+ * Fill packets as lgw_receive would: unconfirmed uplinks of a fixed DevAddr
+ * population, sequence number in count_us.
+ *
+ * @param p     Packets to fill
+ * @param nb    Number of packets
+ * @param seq   Sequence number of the first packet
+*/
+static void synth_receive(struct lgw_pkt_rx_s *p, unsigned nb, uint32_t seq) {
+
+    unsigned i, j;
+    uint32_t devaddr, fcnt;
+
+    for (i = 0; i < nb; i++, seq++) {
+        devaddr = 0x26010000 + (seq * 7919) % NB_DEVICES;
+        fcnt = seq / NB_DEVICES;
+
+        memset(p, 0, offsetof(struct lgw_pkt_rx_s, payload));
+        p->freq_hz = 867100000 + (seq % 8) * 200000;
+        p->if_chain = seq % 8;
+        p->status = STAT_CRC_OK;
+        p->count_us = seq;
+        p->modulation = MOD_LORA;
+        p->bandwidth = BW_125KHZ;
+        p->datarate = DR_LORA_SF7 + (seq % 6);
+        p->coderate = CR_LORA_4_5;
+        p->rssic = -110.0f + (float)(seq % 40);
+        p->rssis = p->rssic - 1.0f;
+        p->snr = -10.0f + (float)(seq % 80) / 4.0f;
+        p->size = 13 + (seq % 40);
+        p->payload[0] = 0x40;           /* unconfirmed data up */
+        p->payload[1] = (uint8_t)(devaddr >> 0);
+        p->payload[2] = (uint8_t)(devaddr >> 8);
+        p->payload[3] = (uint8_t)(devaddr >> 16);
+        p->payload[4] = (uint8_t)(devaddr >> 24);
+        p->payload[5] = 0x80;           /* ADR, no FOpts */
+        p->payload[6] = (uint8_t)(fcnt >> 0);
+        p->payload[7] = (uint8_t)(fcnt >> 8);
+        p->payload[8] = 1;              /* FPort */
+        for (j = 9; j < p->size; j++) {
+            p->payload[j] = (uint8_t)(seq + j);
+        }
+        p++;
+    }
+}
+
+/**
+ * Read every request on one connection and acknowledge it as a fully accepted _bulk request.
+ *
+ * @param fd    Connection
+*/
+static void sink_serve(int fd) {
+
+    static char head[SINK_HEAD_LEN + 1];
+    static char body[65536];
+    char reply[256];
+    size_t have = 0, head_len, body_len, left, chunk;
+    ssize_t n;
+    char *end, *cl;
+
+    while (1) {
+        /* headers, part of the body may come with them */
+        while ((end = strstr(head, "\r\n\r\n")) == NULL) {
+            if (have >= SINK_HEAD_LEN) return;
+            n = read(fd, head + have, SINK_HEAD_LEN - have);
+            if (n <= 0) return;
+            have += n;
+            head[have] = '\0';
+        }
+        head_len = (end - head) + 4;
+        cl = strstr(head, "Content-Length:");
+        body_len = (cl != NULL && cl < end) ? strtoul(cl + 15, NULL, 10) : 0;
+
+        /* the body is thrown away */
+        left = (have - head_len < body_len) ? body_len - (have - head_len) : 0;
+        while (left > 0) {
+            chunk = (left < sizeof body) ? left : sizeof body;
+            n = read(fd, body, chunk);
+            if (n <= 0) return;
+            left -= n;
+        }
+
+        snprintf(reply, sizeof reply, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %u\r\n\r\n%s",
+                 (unsigned)strlen(SINK_RESPONSE), SINK_RESPONSE);
+        if (write(fd, reply, strlen(reply)) < 0) return;
+
+        /* keep whatever belongs to a pipelined follow-up */
+        if (have > head_len + body_len) {
+            memmove(head, head + head_len + body_len, have - head_len - body_len);
+            have -= head_len + body_len;
+        } else {
+            have = 0;
+        }
+        head[have] = '\0';
+    }
+}
+
+static void *sink_thread(void *arg) {
+
+    int fd;
+
+    (void)arg;
+
+    while ((fd = accept(sink_fd, NULL, NULL)) >= 0) {
+        sink_serve(fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static int sink_start(pthread_t *thr) {
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof addr;
+
+    sink_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sink_fd < 0) return -1;
+
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0; /* let the kernel pick */
+
+    if (bind(sink_fd, (struct sockaddr*)&addr, sizeof addr) || listen(sink_fd, 4)) return -1;
+    if (getsockname(sink_fd, (struct sockaddr*)&addr, &len)) return -1;
+    sink_port = ntohs(addr.sin_port);
+
+    return pthread_create(thr, NULL, sink_thread, NULL);
+}
+
+/**
+ * Listener: receive bursts straight into the ring slots, as the sniffer does.
+ * Paced at the requested rate, packets that find the ring full are dropped;
+ * unpaced, the listener waits for the encoder instead so nothing is lost.
+*/
+static void *thread_listen(void *arg) {
+
+    uint32_t seq = 0, span, nb, i;
+    struct lgw_pkt_rx_s *slots;
+    uint64_t t;
+
+    (void)arg;
+
+    while (seq < nb_packets) {
+        if (rate > 0) {
+            sleep_until_ns(t_start + (uint64_t)((double)seq / rate * 1e9));
+        }
+
+        nb = (nb_packets - seq < burst) ? (uint32_t)(nb_packets - seq) : burst;
+        span = pkt_ring_write_span(&ring, &slots);
+        if (span == 0 && rate > 0) {
+            dropped += nb; /* encoder is behind, nowhere to put them */
+            seq += nb;
+            continue;
+        }
+        while (span == 0) {
+            sched_yield();
+            span = pkt_ring_write_span(&ring, &slots);
+        }
+        if (nb > span) {
+            nb = span;
+        }
+
+        synth_receive(slots, nb, seq);
+        t = now_ns();
+        for (i = 0; i < nb; i++) {
+            t_rx[seq + i] = t;
+            t_ring[seq + i] = now_ns();
+        }
+        pkt_ring_commit(&ring, nb);
+        for (i = 0; i < nb; i++) {
+            latency_hist_record(&hist[STAGE_LISTEN], t_ring[seq + i] - t);
+        }
+        seq += nb;
+    }
+
+    t_listen_end = now_ns();
+    atomic_store(&listen_done, true);
+
+    return NULL;
+}
+
+/**
+ * Encoder: the loop of thread_encode, timed at every step.
+*/
+static void *thread_encode(void *arg) {
+
+    struct timespec sleep_time = {0, ENCODE_SLEEP_NS};
+    struct lgw_pkt_rx_s *rx_pkt;
+    struct timespec pkt_utc_time;
+    ed_report_t report;
+    char line[ED_REPORT_JSON_MAX];
+    int len;
+    uint32_t seq, k = 0;
+    uint64_t t0, t1, t2, t3, t4;
+    bool done, idle;
+
+    (void)arg;
+
+    while (1) {
+        done = atomic_load(&listen_done);
+        idle = true;
+
+        while ((rx_pkt = pkt_ring_peek(&ring)) != NULL) {
+            idle = false;
+            t0 = now_ns();
+            seq = rx_pkt->count_us;
+            latency_hist_record(&hist[STAGE_QUEUE], t0 - t_ring[seq]);
+
+            clock_gettime(CLOCK_REALTIME, &pkt_utc_time);
+            ed_report_write(&report, rx_pkt, &pkt_utc_time);
+            t1 = now_ns();
+            len = ed_report_encode(&report, line, sizeof line);
+            t2 = now_ns();
+            if (capture_enabled) {
+                capture_write(&capture, 0, (uint64_t)pkt_utc_time.tv_sec * 1000000000ULL + (uint64_t)pkt_utc_time.tv_nsec, rx_pkt);
+            }
+            t3 = now_ns();
+            order[k] = seq;
+            if (len < 0 || segment_append(&segment, line, (size_t)len)) {
+                printf("ERROR: failed to append packet %u\n", seq);
+            }
+            t4 = now_ns();
+            t_appended[seq] = t4;
+            atomic_store_explicit(&appended, ++k, memory_order_release);
+
+            pkt_ring_release(&ring);
+
+            latency_hist_record(&hist[STAGE_REPORT], t1 - t0);
+            latency_hist_record(&hist[STAGE_ENCODE], t2 - t1);
+            if (capture_enabled) {
+                latency_hist_record(&hist[STAGE_CAPTURE], t3 - t2);
+            }
+            latency_hist_record(&hist[STAGE_APPEND], t4 - t3);
+        }
+
+        if (done && pkt_ring_count(&ring) == 0) {
+            break;
+        }
+
+        segment_poll(&segment);
+        if (capture_enabled && idle) {
+            capture_flush(&capture);
+        }
+
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
+    }
+
+    t_encode_end = now_ns();
+    atomic_store(&encode_done, true);
+
+    return NULL;
+}
+
+/**
+ * Uploader: seal on every interval and ship the sealed segments in one _bulk request.
+*/
+static void *thread_upload(void *arg) {
+
+    http_uploader_t up;
+    bulk_req_t bulk;
+    bulk_result_t result;
+    http_buf_t scratch = {NULL, 0, 0};
+    char name[SEGMENT_NAME_LEN];
+    uint32_t seq_next = 0, seq_end, s;
+    unsigned long k, seq;
+    uint64_t t_ack, t_next;
+    bool done;
+    int status;
+
+    (void)arg;
+
+    if (http_init(&up, 5) || bulk_init(&bulk, NULL)) {
+        printf("ERROR: failed to initialise uploader\n");
+        atomic_store(&encode_done, true);
+        return NULL;
+    }
+
+    t_next = t_start;
+    while (1) {
+        done = atomic_load(&encode_done);
+        if (!done) {
+            t_next += (uint64_t)interval_ms * 1000000ULL;
+            sleep_until_ns(t_next);
+        }
+
+        segment_seal(&segment);
+        seq_end = segment_sealed_end(&segment);
+
+        bulk_reset(&bulk);
+        for (s = seq_next; s < seq_end; s++) {
+            segment_name(name, sizeof name, prefix, s, true);
+            if (http_buf_load(&scratch, name) || bulk_add_ndjson(&bulk, scratch.data, scratch.len) < 0) {
+                printf("ERROR: failed to add segment %s\n", name);
+            }
+        }
+
+        if (bulk.nb_docs > 0) {
+            status = http_post(&up, url, HTTP_CONTENT_NDJSON, 0, bulk.body.data, bulk.body.len);
+            requests++;
+            if (status != CURLE_OK || up.status != 200 || bulk_parse_response(&bulk, up.response.data, &result) ||
+                result.accepted != bulk.nb_docs) {
+                upload_errors++;
+                if (done) {
+                    break;
+                }
+                continue; /* same segments next interval */
+            }
+            t_ack = now_ns();
+
+            /* records are in append order, the encoder has published them all by now */
+            while (atomic_load_explicit(&appended, memory_order_acquire) < uploaded + bulk.nb_docs) {
+                sched_yield();
+            }
+            for (k = uploaded; k < uploaded + bulk.nb_docs; k++) {
+                seq = order[k];
+                latency_hist_record(&hist[STAGE_UPLOAD], t_ack - t_appended[seq]);
+                latency_hist_record(&hist[STAGE_TOTAL], t_ack - t_rx[seq]);
+            }
+            uploaded += bulk.nb_docs;
+            t_upload_end = t_ack;
+        }
+
+        for (s = seq_next; s < seq_end; s++) {
+            segment_name(name, sizeof name, prefix, s, true);
+            remove(name);
+        }
+        seq_next = seq_end;
+
+        if (done) {
+            break;
+        }
+    }
+
+    http_buf_free(&scratch);
+    bulk_free(&bulk);
+    http_cleanup(&up);
+
+    return NULL;
+}
+
+static double rate_of(unsigned long nb, uint64_t t_end) {
+    return (t_end > t_start) ? (double)nb / ((double)(t_end - t_start) / 1e9) : 0.0;
+}
+
+static int write_results(const char *file_name, double pps) {
+
+    FILE *fp;
+    json_emit_t e;
+    char line[JSON_LINE_LEN];
+    int i, len;
+
+    fp = fopen(file_name, "w");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    json_emit_begin(&e, line, sizeof line);
+    json_emit_string(&e, "bench", "pipeline");
+    json_emit_string(&e, "version", VERSION_STRING);
+    json_emit_number(&e, "packets", (double)nb_packets);
+    json_emit_number(&e, "rate", rate);
+    json_emit_number(&e, "burst", burst);
+    json_emit_number(&e, "interval_ms", interval_ms);
+    json_emit_number(&e, "ring", ring_size);
+    json_emit_bool(&e, "capture", capture_enabled);
+    json_emit_number(&e, "dropped", (double)dropped);
+    json_emit_number(&e, "uploaded", (double)uploaded);
+    json_emit_number(&e, "requests", (double)requests);
+    json_emit_number(&e, "errors", (double)upload_errors);
+    json_emit_number(&e, "listen_pps", rate_of(nb_packets - dropped, t_listen_end));
+    json_emit_number(&e, "encode_pps", rate_of(nb_packets - dropped, t_encode_end));
+    json_emit_number(&e, "pps", pps);
+    len = json_emit_end(&e);
+    if (len > 0) {
+        fprintf(fp, "%s\n", line);
+    }
+
+    for (i = 0; i < NB_STAGES; i++) {
+        if (hist[i].count == 0) {
+            continue;
+        }
+        json_emit_begin(&e, line, sizeof line);
+        json_emit_string(&e, "bench", "pipeline");
+        json_emit_string(&e, "stage", stage_name[i]);
+        json_emit_number(&e, "count", (double)hist[i].count);
+        json_emit_number(&e, "p50_us", latency_hist_percentile(&hist[i], 50.0) / 1e3);
+        json_emit_number(&e, "p99_us", latency_hist_percentile(&hist[i], 99.0) / 1e3);
+        json_emit_number(&e, "p999_us", latency_hist_percentile(&hist[i], 99.9) / 1e3);
+        json_emit_number(&e, "max_us", hist[i].max / 1e3);
+        json_emit_number(&e, "mean_us", latency_hist_mean(&hist[i]) / 1e3);
+        len = json_emit_end(&e);
+        if (len > 0) {
+            fprintf(fp, "%s\n", line);
+        }
+    }
+
+    return fclose(fp);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv) {
+
+    int failures = 0;
+    int i;
+    bool ok;
+    const char *json_file = NULL;
+    char name[CAPTURE_NAME_LEN];
+    latency_hist_t h, h2;
+    uint64_t v, p;
+    pthread_t thr_sink, thr_listen, thr_encode, thr_upload;
+    double pps;
+
+    while ((i = getopt(argc, argv, "hn:r:b:i:q:co:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'n':
+                nb_packets = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                rate = strtod(optarg, NULL);
+                break;
+            case 'b':
+                burst = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'i':
+                interval_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'q':
+                ring_size = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                capture_enabled = true;
+                break;
+            case 'o':
+                json_file = optarg;
+                break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+    if (nb_packets == 0 || nb_packets > UINT32_MAX || burst == 0 || interval_ms == 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    /* the histograms behind the percentiles */
+    latency_hist_reset(&h);
+    for (v = 0; v < 128; v++) {
+        latency_hist_record(&h, v);
+    }
+    CHECK(latency_hist_percentile(&h, 50.0) == 63 && latency_hist_percentile(&h, 100.0) == 127, "small values counted exactly");
+    latency_hist_reset(&h);
+    for (v = 1; v <= 1000000; v++) {
+        latency_hist_record(&h, v * 1000);
+    }
+    ok = true;
+    for (i = 1; i < 1000; i++) {
+        p = latency_hist_percentile(&h, i / 10.0);
+        ok = ok && (p > i * 1000000ULL * 0.99) && (p < i * 1000000ULL * 1.01);
+    }
+    CHECK(ok, "percentiles within 1% of the exact values");
+    CHECK(h.min == 1000 && h.max == 1000000000 && latency_hist_mean(&h) == 500000500.0, "min, max and mean");
+    latency_hist_reset(&h2);
+    latency_hist_record(&h2, UINT64_MAX);
+    latency_hist_merge(&h2, &h);
+    CHECK(h2.count == 1000001 && latency_hist_percentile(&h2, 100.0) == UINT64_MAX && latency_hist_percentile(&h2, 50.0) == latency_hist_percentile(&h, 50.0),
+          "merge, largest value");
+
+    /* pipeline */
+    snprintf(prefix, sizeof prefix, "/tmp/bench_pipe_%d", (int)getpid());
+    t_rx = calloc(nb_packets, sizeof *t_rx);
+    t_ring = calloc(nb_packets, sizeof *t_ring);
+    t_appended = calloc(nb_packets, sizeof *t_appended);
+    order = calloc(nb_packets, sizeof *order);
+    if (t_rx == NULL || t_ring == NULL || t_appended == NULL || order == NULL) {
+        printf("ERROR: failed to allocate %lu packet times\n", nb_packets);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < NB_STAGES; i++) {
+        latency_hist_reset(&hist[i]);
+    }
+    lora_packet_toa_init();
+    if (pkt_ring_init(&ring, ring_size) || segment_init(&segment, prefix, DEFAULT_SEG_BYTES, 0)) {
+        printf("ERROR: failed to initialise the packet ring or segments\n");
+        return EXIT_FAILURE;
+    }
+    if (capture_enabled && capture_open(&capture, prefix, 0, 0, 0)) {
+        printf("ERROR: failed to open capture\n");
+        return EXIT_FAILURE;
+    }
+    if (sink_start(&thr_sink) || http_global_init()) {
+        printf("ERROR: failed to start loopback sink\n");
+        return EXIT_FAILURE;
+    }
+    snprintf(url, sizeof url, "http://127.0.0.1:%u/_bulk", sink_port);
+
+    t_start = now_ns();
+    pthread_create(&thr_upload, NULL, thread_upload, NULL);
+    pthread_create(&thr_encode, NULL, thread_encode, NULL);
+    pthread_create(&thr_listen, NULL, thread_listen, NULL);
+    pthread_join(thr_listen, NULL);
+    pthread_join(thr_encode, NULL);
+    pthread_join(thr_upload, NULL);
+
+    pps = rate_of(uploaded, t_upload_end);
+    printf("Pipeline: %lu packets, %s, %u per receive, upload every %u ms%s\n", nb_packets,
+           (rate > 0) ? "paced" : "unpaced", burst, interval_ms, capture_enabled ? ", with capture" : "");
+    if (rate > 0) {
+        printf("Offered %.0f pkt/s, ", rate);
+    }
+    printf("listen %.0f pkt/s, encode %.0f pkt/s, end to end %.0f pkt/s; %lu dropped, %lu uploaded in %lu requests, %lu failed\n",
+           rate_of(nb_packets - dropped, t_listen_end), rate_of(nb_packets - dropped, t_encode_end), pps,
+           dropped, uploaded, requests, upload_errors);
+    printf("%-8s %9s %10s %10s %10s %10s %10s\n", "stage", "count", "p50 us", "p99 us", "p999 us", "max us", "mean us");
+    for (i = 0; i < NB_STAGES; i++) {
+        if (hist[i].count == 0) {
+            continue;
+        }
+        printf("%-8s %9llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", stage_name[i], (unsigned long long)hist[i].count,
+               latency_hist_percentile(&hist[i], 50.0) / 1e3, latency_hist_percentile(&hist[i], 99.0) / 1e3,
+               latency_hist_percentile(&hist[i], 99.9) / 1e3, hist[i].max / 1e3, latency_hist_mean(&hist[i]) / 1e3);
+    }
+
+    CHECK(uploaded + dropped == nb_packets && upload_errors == 0, "every packet uploaded or dropped");
+    CHECK(hist[STAGE_TOTAL].count == uploaded && hist[STAGE_QUEUE].count == uploaded, "every uploaded packet timed");
+    if (json_file != NULL) {
+        CHECK(write_results(json_file, pps) == 0, "results written");
+    }
+
+    segment_close(&segment);
+    if (capture_enabled) {
+        capture_close(&capture);
+        snprintf(name, sizeof name, "%s%s", prefix, CAPTURE_SUFFIX);
+        remove(name);
+    }
+    pkt_ring_free(&ring);
+    free(t_rx);
+    free(t_ring);
+    free(t_appended);
+    free(order);
+    http_global_cleanup();
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,347 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Description:
+    Check the asynchronous logger. Several threads log numbered lines, first
+    paced so the writer drains the queue lap after lap as they go, then
+    while the writer is held on a FIFO that nobody reads yet, so the queue
+    fills up and lines are dropped. Every line that got through must be
+    whole and in the order its thread logged it, and the drops reported in
+    the log must add up with the lines written to what was logged. Then a
+    log file is started again on size, on request and on age.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fopen */
+#include <stdlib.h>     /* EXIT_FAILURE mkdtemp realloc */
+#include <string.h>     /* memcmp strncmp strstr */
+#include <unistd.h>     /* chdir read close usleep rmdir */
+#include <fcntl.h>      /* open fcntl */
+#include <sys/stat.h>   /* mkfifo */
+
+#include <pthread.h>
+
+#include "async_log.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_THREADS          4           /* threads logging at once */
+#define NB_LINES            20000       /* lines logged by each thread, far more than the queue and FIFO hold */
+#define PAYLOAD_LEN         150         /* characters of a line after its number */
+#define PACE_LINES          100         /* lines logged between two pauses of a paced thread */
+#define PACE_US             1000        /* pause of a paced thread */
+#define ROT_BYTES           4096        /* size at which the rotation test file is started again */
+#define ROT_LINES           200         /* lines logged to each rotation test file */
+#define WAIT_MS             5000        /* longest wait for the writer to rotate */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* what a log file holds */
+typedef struct log_scan_s {
+    long lines;                         /* numbered lines */
+    long bad;                           /* lines cut short or not as logged */
+    long out_of_order;                  /* numbered lines before an earlier one of the same thread */
+    long first[NB_THREADS];             /* first number of each thread, -1 if none */
+    long next[NB_THREADS];              /* one past the last number of each thread */
+    unsigned long dropped;              /* drops reported */
+    int headers;                        /* files started */
+    int cut;                            /* lines cut at LOG_LINE_LEN */
+} log_scan_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static char pattern[26 + PAYLOAD_LEN + 1];  /* line payloads, starting at their number modulo 26 */
+static bool paced = false;              /* producers pause every PACE_LINES lines */
+static char *fifo_data = NULL;
+static size_t fifo_len = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void *thread_producer(void *arg) {
+
+    int t = (int)(intptr_t)arg;
+    long seq;
+
+    for (seq = 0; seq < NB_LINES; seq++) {
+        log_printf("T%d %ld %.*s\n", t, seq, PAYLOAD_LEN, &pattern[seq % 26]);
+        if (paced && seq % PACE_LINES == PACE_LINES - 1) {
+            usleep(PACE_US);
+        }
+    }
+    return NULL;
+}
+
+static void run_producers(void) {
+
+    pthread_t producers[NB_THREADS];
+    int i;
+
+    for (i = 0; i < NB_THREADS; i++) {
+        pthread_create(&producers[i], NULL, thread_producer, (void *)(intptr_t)i);
+    }
+    for (i = 0; i < NB_THREADS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+}
+
+/* read the FIFO until the writer closes it */
+static void *thread_reader(void *arg) {
+
+    int fd = (int)(intptr_t)arg;
+    size_t size = 0;
+    ssize_t n;
+    char *p;
+
+    for (;;) {
+        if (fifo_len + 65536 > size) {
+            size = 2 * size + 65536;
+            p = realloc(fifo_data, size);
+            if (p == NULL) {
+                break;
+            }
+            fifo_data = p;
+        }
+        n = read(fd, fifo_data + fifo_len, size - fifo_len - 1);
+        if (n <= 0) {
+            break;
+        }
+        fifo_len += (size_t)n;
+    }
+    if (fifo_data != NULL) {
+        fifo_data[fifo_len] = '\0';
+    }
+    return NULL;
+}
+
+static char *load_file(const char *name) {
+
+    FILE *fp;
+    char *data;
+    long len;
+
+    fp = fopen(name, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+    data = malloc((size_t)len + 1);
+    if (data != NULL) {
+        len = (long)fread(data, 1, (size_t)len, fp);
+        data[len] = '\0';
+    }
+    fclose(fp);
+    return data;
+}
+
+/**
+ * Go through the lines of a log, every one must be one of the logger or one logged by the test.
+*/
+static void scan_log(const char *data, log_scan_t *s) {
+
+    const char *line, *eol, *body;
+    unsigned long dropped;
+    long seq;
+    int t, n;
+
+    memset(s, 0, sizeof *s);
+    for (t = 0; t < NB_THREADS; t++) {
+        s->first[t] = -1;
+    }
+    for (line = data; data != NULL && *line != '\0'; line = eol + 1) {
+        eol = strchr(line, '\n');
+        if (eol == NULL) {
+            s->bad++;   /* partial last line */
+            break;
+        }
+        body = strstr(line, " - ");
+        if (body == NULL || body > eol) {
+            s->bad++;
+            continue;
+        }
+        body += 3;
+        if (strncmp(body, "INFO: Now writing to log file ", 30) == 0) {
+            s->headers++;
+        } else if (sscanf(body, "WARNING: %lu log messages dropped, queue full%n", &dropped, &n) == 1 && body + n == eol) {
+            s->dropped += dropped;
+        } else if (strncmp(body, "L ", 2) == 0 && eol - body == LOG_LINE_LEN - 2) {
+            s->cut++;
+        } else if (sscanf(body, "T%d %ld %n", &t, &seq, &n) == 2 && t >= 0 && t < NB_THREADS && seq >= 0 &&
+                   eol - (body + n) == PAYLOAD_LEN && memcmp(body + n, &pattern[seq % 26], PAYLOAD_LEN) == 0) {
+            s->lines++;
+            s->out_of_order += (seq < s->next[t]) ? 1 : 0;
+            s->first[t] = (s->first[t] < 0) ? seq : s->first[t];
+            s->next[t] = seq + 1;
+        } else {
+            s->bad++;
+        }
+    }
+}
+
+/* wait until a log file has been started at least nb times */
+static bool wait_headers(const char *name, int nb) {
+
+    log_scan_t s;
+    char *data;
+    int waited;
+
+    for (waited = 0; waited < WAIT_MS; waited += 10) {
+        data = load_file(name);
+        scan_log(data, &s);
+        free(data);
+        if (s.headers >= nb) {
+            return true;
+        }
+        usleep(10000);
+    }
+    return false;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    char dir[] = "/tmp/test_sniffer_log_XXXXXX";
+    char long_line[2 * LOG_LINE_LEN];
+    log_conf_t conf = {"mpsc", "%H:%M:%S", false, false, false, 0, 0};
+    pthread_t reader;
+    log_scan_t s;
+    char *data;
+    long seq;
+    int i, fd;
+
+    for (i = 0; i < (int)sizeof pattern - 1; i++) {
+        pattern[i] = (char)('a' + i % 26);
+    }
+    memset(long_line, 'x', sizeof long_line - 1);
+    long_line[sizeof long_line - 1] = '\0';
+
+    if (mkdtemp(dir) == NULL || chdir(dir)) {
+        printf("FAIL: scratch directory\n");
+        return EXIT_FAILURE;
+    }
+
+    /* producers and writer going round the queue together */
+    paced = true;
+    CHECK(log_start(&conf) == 0, "logger started");
+    run_producers();
+    log_stop();
+    data = load_file("mpsc.txt");
+    scan_log(data, &s);
+    free(data);
+    printf("INFO: paced, %d lines logged, %ld written, %lu dropped\n", NB_THREADS * NB_LINES, s.lines, (unsigned long)log_dropped());
+    CHECK(s.bad == 0, "every line whole");
+    CHECK(s.out_of_order == 0, "lines of each thread in the order logged");
+    CHECK(s.dropped == log_dropped() && s.lines + (long)s.dropped == NB_THREADS * NB_LINES, "every line written or counted as dropped");
+
+    /* the writer blocks once the FIFO is full, the producers run into a full queue */
+    paced = false;
+    conf.name = "fifo";
+    fd = -1;
+    if (mkfifo("fifo.txt", 0600) == 0) {
+        fd = open("fifo.txt", O_RDONLY | O_NONBLOCK);
+    }
+    CHECK(fd >= 0 && log_start(&conf) == 0, "logger started on a FIFO");
+    run_producers();
+    fcntl(fd, F_SETFL, 0);
+    pthread_create(&reader, NULL, thread_reader, (void *)(intptr_t)fd);
+    log_stop();
+    pthread_join(reader, NULL);
+    close(fd);
+
+    scan_log(fifo_data, &s);
+    printf("INFO: held, %d lines logged, %ld written, %lu dropped\n", NB_THREADS * NB_LINES, s.lines, (unsigned long)log_dropped());
+    CHECK(s.bad == 0 && s.out_of_order == 0, "lines whole and in order past a full queue");
+    CHECK(log_dropped() > 0, "queue overflowed while the writer was held");
+    CHECK(s.dropped == log_dropped(), "drops reported in the log");
+    CHECK(s.lines + (long)s.dropped == NB_THREADS * NB_LINES, "every line written or counted as dropped");
+    free(fifo_data);
+
+    /* started again on size: the same name, so each start adds a header to the file */
+    conf.name = "rot";
+    conf.max_bytes = ROT_BYTES;
+    CHECK(log_start(&conf) == 0 && log_dropped() == 0, "logger started again, drops cleared");
+    for (seq = 0; seq < ROT_LINES; seq++) {
+        log_printf("T0 %ld %.*s\n", seq, PAYLOAD_LEN, &pattern[seq % 26]);
+    }
+    log_printf("L %s\n", long_line);
+    CHECK(wait_headers("rot.txt", 2), "file started again past max_bytes");
+
+    /* on request, then on age */
+    log_set_rotation(0, 0);
+    CHECK(log_rotate("rot2") == 0, "rotation requested");
+    for (; seq < 2 * ROT_LINES; seq++) {
+        log_printf("T0 %ld %.*s\n", seq, PAYLOAD_LEN, &pattern[seq % 26]);
+    }
+    log_set_rotation(0, 1);
+    CHECK(wait_headers("rot2.txt", 2), "file started again once max_age old");
+    log_printf("T0 %ld %.*s\n", seq, PAYLOAD_LEN, &pattern[seq % 26]);
+    log_stop();
+
+    data = load_file("rot.txt");
+    scan_log(data, &s);
+    free(data);
+    CHECK(s.bad == 0 && s.cut == 1, "long line cut, still whole");
+    CHECK(s.lines == ROT_LINES && s.first[0] == 0 && s.next[0] == ROT_LINES && s.out_of_order == 0, "lines before the request in the first file");
+    data = load_file("rot2.txt");
+    scan_log(data, &s);
+    free(data);
+    CHECK(s.bad == 0 && s.lines == ROT_LINES + 1 && s.first[0] == ROT_LINES && s.next[0] == 2 * ROT_LINES + 1 && s.out_of_order == 0,
+          "lines after the request in the new file");
+
+    remove("mpsc.txt");
+    remove("fifo.txt");
+    remove("rot.txt");
+    remove("rot2.txt");
+    rmdir(dir);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,271 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Write raw packets to a capture, read them back through the memory map and
+    compare every field, then check appending to an existing capture, recovery
+    from a record cut short, rotation and the pcapng export. The cost of a
+    capture write and of reading a capture back is timed.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fopen */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memcmp memcpy */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getpid */
+#include <sys/stat.h>   /* stat */
+
+#include "loragw_hal.h"
+#include "capture.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_RECORDS          1000        /* packets written and read back */
+#define BENCH_RECORDS       200000      /* packets per timed run */
+#define BENCH_SIZE          23          /* payload size of the timed packets */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint32_t rng_state = 2463534242U;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void make_pkt(struct lgw_pkt_rx_s *p, int n) {
+
+    int i;
+
+    memset(p, 0, sizeof *p);
+    p->freq_hz = 867100000 + (rng_next() % 8) * 200000;
+    p->freq_offset = (int32_t)(rng_next() % 2001) - 1000;
+    p->if_chain = rng_next() % 10;
+    p->status = (n % 7 == 0) ? STAT_CRC_BAD : STAT_CRC_OK;
+    p->count_us = rng_next();
+    p->rf_chain = rng_next() % 2;
+    p->modem_id = rng_next() % 16;
+    p->modulation = MOD_LORA;
+    p->bandwidth = BW_125KHZ;
+    p->datarate = 7 + rng_next() % 6;
+    p->coderate = CR_LORA_4_5;
+    p->rssic = -120.0f + (rng_next() % 1000) / 10.0f;
+    p->rssis = p->rssic - 1.5f;
+    p->snr = -20.0f + (rng_next() % 160) / 4.0f;
+    p->snr_min = p->snr - 2;
+    p->snr_max = p->snr + 2;
+    p->crc = (uint16_t)rng_next();
+    p->size = (uint16_t)(n % 256);
+    for (i = 0; i < p->size; i++) {
+        p->payload[i] = (uint8_t)rng_next();
+    }
+    p->ftime_received = (n % 3 == 0);
+    p->ftime = p->ftime_received ? rng_next() % 1000000000 : 0;
+}
+
+static bool same_pkt(const struct lgw_pkt_rx_s *a, const struct lgw_pkt_rx_s *b) {
+    return a->freq_hz == b->freq_hz && a->freq_offset == b->freq_offset && a->if_chain == b->if_chain &&
+           a->status == b->status && a->count_us == b->count_us && a->rf_chain == b->rf_chain &&
+           a->modem_id == b->modem_id && a->modulation == b->modulation && a->bandwidth == b->bandwidth &&
+           a->datarate == b->datarate && a->coderate == b->coderate && a->rssic == b->rssic &&
+           a->rssis == b->rssis && a->snr == b->snr && a->snr_min == b->snr_min && a->snr_max == b->snr_max &&
+           a->crc == b->crc && a->size == b->size && memcmp(a->payload, b->payload, a->size) == 0 &&
+           a->ftime_received == b->ftime_received && a->ftime == b->ftime;
+}
+
+static long file_size(const char *name) {
+    struct stat st;
+    return (stat(name, &st) == 0) ? (long)st.st_size : -1;
+}
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    int i, n;
+    bool ok;
+    char prefix[CAPTURE_PREFIX_LEN];
+    char name[CAPTURE_NAME_LEN];
+    char name_1[CAPTURE_NAME_LEN];
+    char name_2[CAPTURE_NAME_LEN];
+    char pcapng[CAPTURE_NAME_LEN + 8];
+    static struct lgw_pkt_rx_s pkts[NB_RECORDS];
+    capture_writer_t cw;
+    capture_reader_t cr;
+    capture_rec_t rec;
+    FILE *fp;
+    long size, nb;
+    uint32_t block[8];
+    uint8_t loratap[15];
+    struct timespec t0, t1;
+    double ns_write, ns_read;
+
+    snprintf(prefix, sizeof prefix, "/tmp/test_capture_%d", (int)getpid());
+    snprintf(name, sizeof name, "%s%s", prefix, CAPTURE_SUFFIX);
+    snprintf(name_1, sizeof name_1, "%s.1%s", prefix, CAPTURE_SUFFIX);
+    snprintf(name_2, sizeof name_2, "%s.2%s", prefix, CAPTURE_SUFFIX);
+    snprintf(pcapng, sizeof pcapng, "%s.pcapng", name);
+
+    /* write and read back */
+    for (i = 0; i < NB_RECORDS; i++) {
+        make_pkt(&pkts[i], i);
+    }
+    CHECK(capture_open(&cw, prefix, 0, 0, 0x0016C001FF10A235ULL) == 0, "create capture");
+    ok = true;
+    for (i = 0; i < NB_RECORDS - 10; i++) {
+        ok = ok && (capture_write(&cw, (uint8_t)(i % 4), 1700000000000000000ULL + i, &pkts[i]) == 0);
+    }
+    capture_close(&cw);
+    CHECK(ok, "write packets");
+    size = CAPTURE_FILE_HDR_LEN;
+    for (i = 0; i < NB_RECORDS - 10; i++) {
+        size += CAPTURE_REC_HDR_LEN + pkts[i].size;
+    }
+    CHECK(file_size(name) == size, "records hold the payload size only");
+
+    CHECK(capture_open(&cw, prefix, 0, 0, 0) == 0, "reopen capture");
+    for (i = NB_RECORDS - 10; i < NB_RECORDS; i++) {
+        capture_write(&cw, (uint8_t)(i % 4), 1700000000000000000ULL + i, &pkts[i]);
+    }
+    capture_close(&cw);
+
+    CHECK(capture_reader_open(&cr, name) == 0, "map capture");
+    CHECK(cr.version == CAPTURE_VERSION && cr.gateway_id == 0x0016C001FF10A235ULL, "file header");
+    ok = true;
+    n = 0;
+    while (capture_reader_next(&cr, &rec) == 1) {
+        ok = ok && (n < NB_RECORDS) && same_pkt(&rec.pkt, &pkts[n]) && rec.card == n % 4 && rec.time_ns == 1700000000000000000ULL + n;
+        n++;
+    }
+    CHECK(ok && n == NB_RECORDS, "every field read back, appended records included");
+    capture_reader_rewind(&cr);
+    CHECK(capture_reader_next(&cr, &rec) == 1 && same_pkt(&rec.pkt, &pkts[0]), "rewind");
+    capture_reader_close(&cr);
+
+    /* a record cut short by a crash */
+    size = file_size(name);
+    fp = fopen(name, "ab");
+    fwrite(&pkts[5], 1, 40, fp);
+    fclose(fp);
+    CHECK(capture_reader_open(&cr, name) == 0, "map capture with a partial record");
+    n = 0;
+    while (capture_reader_next(&cr, &rec) == 1) {
+        n++;
+    }
+    capture_reader_close(&cr);
+    CHECK(n == NB_RECORDS, "partial record ignored by the reader");
+    CHECK(capture_open(&cw, prefix, 0, 0, 0) == 0 && file_size(name) == size, "partial record dropped by the writer");
+    capture_close(&cw);
+
+    /* pcapng export */
+    nb = capture_export_pcapng(name, pcapng);
+    CHECK(nb == NB_RECORDS, "pcapng export");
+    fp = fopen(pcapng, "rb");
+    ok = (fp != NULL) && fread(block, 4, 8, fp) == 8 && block[0] == 0x0A0D0D0A && block[2] == 0x1A2B3C4D;
+    ok = ok && fseek(fp, block[1], SEEK_SET) == 0 && fread(block, 4, 3, fp) == 3 && block[0] == 1 && (block[2] & 0xFFFF) == 270;
+    CHECK(ok, "pcapng section and LoRaTap interface");
+    ok = ok && fseek(fp, block[1] - 12, SEEK_CUR) == 0 && fread(block, 4, 7, fp) == 7 && block[0] == 6 &&
+         block[5] == 15u + pkts[0].size && fread(loratap, 1, 15, fp) == 15;
+    CHECK(ok && loratap[3] == 15 && (uint32_t)(loratap[4] << 24 | loratap[5] << 16 | loratap[6] << 8 | loratap[7]) == pkts[0].freq_hz &&
+          loratap[8] == 1 && loratap[9] == pkts[0].datarate && loratap[14] == 0x34, "LoRaTap header of the first packet");
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    remove(pcapng);
+    remove(name);
+
+    /* rotation */
+    CHECK(capture_open(&cw, prefix, 4096, 1, 0) == 0, "capture with rotation");
+    for (i = 0; i < 200; i++) {
+        capture_write(&cw, 0, i, &pkts[i % 64]);
+    }
+    capture_close(&cw);
+    CHECK(file_size(name) <= 4096 && file_size(name_1) > 0 && file_size(name_1) <= 4096 && file_size(name_2) < 0, "rotated, one older file kept");
+    remove(name);
+    remove(name_1);
+
+    /* cost */
+    make_pkt(&pkts[0], BENCH_SIZE);
+    capture_open(&cw, prefix, 0, 0, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_RECORDS; i++) {
+        capture_write(&cw, 0, i, &pkts[0]);
+        if (i % 64 == 63) {
+            capture_flush(&cw); /* the encoder flushes whenever the rings are drained */
+        }
+    }
+    capture_close(&cw);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_write = elapsed_ns(&t0, &t1) / BENCH_RECORDS;
+
+    capture_reader_open(&cr, name);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    n = 0;
+    while (capture_reader_next(&cr, &rec) == 1) {
+        n++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    capture_reader_close(&cr);
+    ns_read = elapsed_ns(&t0, &t1) / BENCH_RECORDS;
+
+    printf("Capture of %d byte packets: %ld bytes per record (lgw_pkt_rx_s is %lu), write %.0f ns, read %.0f ns\n",
+           BENCH_SIZE, (file_size(name) - CAPTURE_FILE_HDR_LEN) / BENCH_RECORDS, (unsigned long)sizeof(struct lgw_pkt_rx_s), ns_write, ns_read);
+    CHECK(n == BENCH_RECORDS, "timed records read back");
+    remove(name);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,232 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Description:
+    Check the per channel and SF buckets (alignment, counts, airtime, RSSI
+    and SNR statistics, cell limit), the distinct DevAddr estimates over a
+    wide range of counts, and the encoded buckets against parson. The cost
+    of counting a packet is timed.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memset strcpy strcmp */
+#include <time.h>       /* clock_gettime */
+#include <math.h>       /* fabs */
+
+#include "parson.h"
+#include "chan_agg.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define WIDTH               60          /* bucket length (seconds) */
+#define T0                  1699999990  /* 10 s into a bucket */
+#define NB_ADDS             2000000     /* packets timed */
+#define HLL_MAX_ERROR       0.20        /* about 3 standard errors */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/* CRC checked uplink of 1 ms on a channel */
+static void packet(struct lgw_pkt_rx_s *p, ed_report_t *r, uint32_t freq_hz, uint32_t sf, uint32_t devaddr) {
+    memset(p, 0, sizeof *p);
+    memset(r, 0, sizeof *r);
+    p->freq_hz = freq_hz;
+    p->datarate = sf;
+    p->status = STAT_CRC_OK;
+    r->devaddr = devaddr;
+    r->rssi = -100.0f;
+    r->snr = 5.0f;
+    r->toa = 1.0f;
+}
+
+/* estimate for n distinct DevAddrs, each sent twice */
+static double estimate(uint32_t n) {
+
+    chan_agg_t a;
+    struct lgw_pkt_rx_s p;
+    ed_report_t r;
+    uint32_t pos = 0, i;
+    double est;
+
+    chan_agg_init(&a, WIDTH);
+    for (i = 0; i < 2 * n; i++) {
+        packet(&p, &r, 868100000, 7, 0x26000000 + (i % n) * 7);
+        chan_agg_add(&a, &p, &r, T0);
+    }
+    est = chan_agg_devices(chan_agg_next(&a, &pos));
+    chan_agg_free(&a);
+
+    return est;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    chan_agg_t a;
+    struct lgw_pkt_rx_s p;
+    ed_report_t r;
+    const chan_cell_t *c;
+    char line[CHAN_AGG_JSON_MAX];
+    JSON_Value *val;
+    JSON_Object *obj;
+    uint32_t i, pos;
+    const uint32_t counts[] = {1, 10, 100, 1000, 10000, 100000};
+    struct timespec t0, t1;
+    double ns_add, est;
+    bool ok;
+
+    CHECK(chan_agg_init(&a, 0) != 0, "empty bucket refused");
+    CHECK(chan_agg_init(&a, WIDTH) == 0, "aggregator allocated");
+    CHECK(!chan_agg_due(&a, T0 + 3600), "empty bucket never due");
+
+    /* two channels, one with two SFs */
+    packet(&p, &r, 868100000, 7, 0x26000001);
+    chan_agg_add(&a, &p, &r, T0);
+    CHECK(a.start == T0 - 10, "bucket starts on a multiple of its length");
+    packet(&p, &r, 868100000, 7, 0x26000002);
+    r.rssi = -80.0f;
+    r.snr = -2.0f;
+    r.toa = 2.5f;
+    chan_agg_add(&a, &p, &r, T0 + 1);
+    packet(&p, &r, 868100000, 7, 0x26000002);
+    p.status = STAT_CRC_BAD;
+    r.rssi = -120.0f;
+    chan_agg_add(&a, &p, &r, T0 + 2);
+    packet(&p, &r, 868100000, 9, 0x26000003);
+    chan_agg_add(&a, &p, &r, T0 + 3);
+    packet(&p, &r, 868300000, 7, 0x26000004);
+    chan_agg_add(&a, &p, &r, T0 + 4);
+
+    pos = 0;
+    c = chan_agg_next(&a, &pos);
+    CHECK(c != NULL && c->freq_hz == 868100000 && c->datarate == 7, "first cell");
+    CHECK(c->nb_pkt == 3 && c->nb_crc_ok == 2 && c->nb_crc_bad == 1 && c->airtime_us == 4500, "packet, CRC and airtime counts");
+    CHECK(c->rssi_min == -120.0f && c->rssi_max == -80.0f && fabs(c->rssi_sum / 3 + 100.0) < 1e-6 &&
+          c->snr_min == -2.0f && c->snr_max == 5.0f, "RSSI and SNR statistics");
+    CHECK(fabs(chan_agg_devices(c) - 2.0) < 0.1, "distinct devices of the CRC checked frames");
+    c = chan_agg_next(&a, &pos);
+    CHECK(c != NULL && c->freq_hz == 868100000 && c->datarate == 9 && c->nb_pkt == 1, "SF cell of the same channel");
+    c = chan_agg_next(&a, &pos);
+    CHECK(c != NULL && c->freq_hz == 868300000 && c->nb_pkt == 1, "second channel");
+    CHECK(chan_agg_next(&a, &pos) == NULL, "three cells");
+
+    CHECK(!chan_agg_due(&a, T0 + 49), "bucket not over");
+    CHECK(chan_agg_due(&a, T0 + 50), "bucket over");
+
+    /* bucket checked with parson */
+    pos = 0;
+    CHECK(chan_agg_encode(&a, chan_agg_next(&a, &pos), line, sizeof line) > 0, "bucket encoded");
+    val = json_parse_string(line);
+    obj = json_value_get_object(val);
+    CHECK(obj != NULL && strcmp(json_object_get_string(obj, "type"), CHAN_AGG_TYPE) == 0 &&
+          strcmp(json_object_get_string(obj, "@timestamp"), "2023-11-14T22:13:00Z") == 0, "bucket type and start");
+    CHECK(json_object_get_number(obj, "Freq") == 868.1 && json_object_get_number(obj, "SF") == 7 &&
+          json_object_get_number(obj, "Period") == WIDTH, "bucket channel");
+    CHECK(json_object_get_number(obj, "Packets") == 3 && json_object_get_number(obj, "CRCOK") == 2 &&
+          json_object_get_number(obj, "CRCBad") == 1 && json_object_get_number(obj, "Devices") == 2, "bucket counts");
+    CHECK(json_object_get_number(obj, "Airtime") == 4.5 && fabs(json_object_get_number(obj, "DutyCycle") - 0.0075) < 0.001 &&
+          json_object_get_number(obj, "RSSIAvg") == -100 && json_object_get_number(obj, "RSSIMin") == -120, "bucket airtime and RSSI");
+    json_value_free(val);
+    pos = 0;
+    CHECK(chan_agg_encode(&a, chan_agg_next(&a, &pos), line, 64) < 0, "bucket refused if it does not fit");
+
+    chan_agg_reset(&a);
+    pos = 0;
+    CHECK(chan_agg_next(&a, &pos) == NULL && !chan_agg_due(&a, T0 + 3600), "new bucket empty");
+    packet(&p, &r, 868100000, 7, 0x26000001);
+    chan_agg_add(&a, &p, &r, T0 + 60);
+    pos = 0;
+    c = chan_agg_next(&a, &pos);
+    CHECK(a.start == T0 + 50 && c->nb_pkt == 1 && c->nb_crc_bad == 0 && fabs(chan_agg_devices(c) - 1.0) < 0.1, "cells cleared");
+    chan_agg_reset(&a);
+
+    /* cell limit */
+    ok = true;
+    for (i = 0; i < CHAN_AGG_MAX_CELLS; i++) {
+        packet(&p, &r, 863000000 + i * 100000, 7, 1);
+        ok = ok && (chan_agg_add(&a, &p, &r, T0) == 0);
+    }
+    packet(&p, &r, 870000000, 12, 1);
+    CHECK(ok && chan_agg_add(&a, &p, &r, T0) == -1 && a.full == 1, "cells beyond the limit refused");
+    packet(&p, &r, 863000000, 7, 1);
+    CHECK(chan_agg_add(&a, &p, &r, T0) == 0, "active cells still counted");
+    chan_agg_free(&a);
+
+    /* distinct DevAddrs */
+    ok = true;
+    for (i = 0; i < sizeof counts / sizeof counts[0]; i++) {
+        est = estimate(counts[i]);
+        printf("%u distinct DevAddrs estimated at %.1f\n", counts[i], est);
+        ok = ok && (fabs(est - counts[i]) <= HLL_MAX_ERROR * counts[i] + 0.5);
+    }
+    CHECK(ok, "distinct DevAddr estimates");
+
+    /* cost of counting a packet, 8 channels by 6 SFs */
+    chan_agg_init(&a, WIDTH);
+    packet(&p, &r, 868100000, 7, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < NB_ADDS; i++) {
+        p.freq_hz = 867100000 + (i & 7) * 200000;
+        p.datarate = 7 + (i >> 3) % 6;
+        r.devaddr = 0x26000000 + (i & 0xFFF);
+        chan_agg_add(&a, &p, &r, T0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_add = elapsed_ns(&t0, &t1) / NB_ADDS;
+    CHECK(a.nb_used == 48, "one cell per channel and SF");
+    printf("Packet counted in %.1f ns\n", ns_add);
+    chan_agg_free(&a);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,236 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Description:
+    Check the per device state (FCnt rollover, losses, repeats, restarts,
+    averages, SF/ADR changes), the summaries against parson, and removal of
+    silent devices from full probe runs. The cost of an update is timed
+    with as many devices as a busy site would see.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memset strcpy strcmp */
+#include <time.h>       /* clock_gettime */
+#include <math.h>       /* fabs */
+
+#include "parson.h"
+#include "dev_table.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_DEVICES          4096        /* devices for the expiry and timing runs */
+#define NB_UPDATES          2000000     /* updates timed */
+#define T0                  1700000000  /* reception time of the first frame */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/* report of a CRC checked unconfirmed uplink */
+static void uplink(ed_report_t *r, uint32_t devaddr, uint16_t fcnt) {
+    memset(r, 0, sizeof *r);
+    strcpy(r->mtype, "UDU");
+    strcpy(r->crc, "OK");
+    r->devaddr = devaddr;
+    r->fcnt = fcnt;
+    r->sf = 7;
+    r->rssi = -100.0f;
+    r->snr = 5.0f;
+}
+
+/* every device in the table can be found from its home slot */
+static bool table_consistent(dev_table_t *t) {
+
+    dev_entry_t *d;
+    uint32_t pos = 0, nb = 0;
+
+    while ((d = dev_table_next(t, &pos)) != NULL) {
+        if (dev_table_find(t, d->devaddr) != d) {
+            return false;
+        }
+        nb++;
+    }
+
+    return nb == t->count;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    dev_table_t t;
+    dev_entry_t *d;
+    ed_report_t r;
+    char line[DEV_SUMMARY_JSON_MAX];
+    JSON_Value *val;
+    JSON_Object *obj;
+    uint32_t i, nb;
+    struct timespec t0, t1;
+    double ns_update;
+    bool ok;
+
+    CHECK(dev_table_init(&t, 0) != 0, "empty table refused");
+    CHECK(dev_table_init(&t, 1000) == 0 && t.size == 2048 && t.capacity == 1000, "table at most half full");
+
+    /* FCnt sequence */
+    uplink(&r, 0x26011234, 10);
+    CHECK(dev_table_update(&t, &r, T0) == 0, "new device");
+    d = dev_table_find(&t, 0x26011234);
+    CHECK(d != NULL && d->fcnt == 10 && d->nb_rx == 1 && d->nb_lost == 0 && t.count == 1, "first frame");
+    uplink(&r, 0x26011234, 11);
+    dev_table_update(&t, &r, T0 + 1);
+    uplink(&r, 0x26011234, 14);
+    dev_table_update(&t, &r, T0 + 2);
+    CHECK(d->fcnt == 14 && d->nb_rx == 3 && d->nb_lost == 2, "gap counted as lost frames");
+    dev_table_update(&t, &r, T0 + 3);
+    CHECK(d->nb_dup == 1 && d->nb_lost == 2 && d->fcnt == 14, "repeated FCnt");
+    CHECK(fabs(dev_table_loss_rate(d) - 2.0 / 5.0) < 1e-6, "loss rate over the frames sent");
+
+    d->fcnt = 0xFFFE;
+    uplink(&r, 0x26011234, 0x0001);
+    dev_table_update(&t, &r, T0 + 4);
+    CHECK(d->fcnt == 0x10001 && d->nb_lost == 4, "16 bit rollover");
+    uplink(&r, 0x26011234, 0x0003);
+    dev_table_update(&t, &r, T0 + 5);
+    CHECK(d->fcnt == 0x10003, "upper 16 bits kept");
+    uplink(&r, 0x26011234, 0x0000);
+    dev_table_update(&t, &r, T0 + 6);
+    CHECK(d->fcnt == 0 && d->nb_reset == 1 && d->nb_lost == 5, "FCnt back to 0 is a restart");
+    uplink(&r, 0x26011234, DEV_FCNT_MAX_GAP);
+    dev_table_update(&t, &r, T0 + 7);
+    CHECK(d->fcnt == DEV_FCNT_MAX_GAP && d->nb_reset == 2 && d->nb_lost == 5, "jump past the maximum gap is a restart");
+
+    /* averages and changes */
+    uplink(&r, 0x26011234, DEV_FCNT_MAX_GAP + 1);
+    r.rssi = -60.0f;
+    r.snr = -3.0f;
+    r.sf = 9;
+    r.adr = true;
+    dev_table_update(&t, &r, T0 + 8);
+    CHECK(fabs(d->rssi - (-100.0 + DEV_EWMA_WEIGHT * 40.0)) < 1e-3 && fabs(d->snr - (5.0 - DEV_EWMA_WEIGHT * 8.0)) < 1e-3, "RSSI and SNR averages");
+    CHECK(d->sf == 9 && d->adr && d->nb_sf_change == 1 && d->nb_adr_change == 1 && d->last_seen == T0 + 8, "SF and ADR changes");
+
+    /* reports that do not tell about the device */
+    uplink(&r, 0x26015678, 1);
+    strcpy(r.crc, "BAD");
+    CHECK(dev_table_update(&t, &r, T0) == 1, "bad CRC ignored");
+    uplink(&r, 0x26015678, 1);
+    strcpy(r.mtype, "UDD");
+    CHECK(dev_table_update(&t, &r, T0) == 1, "downlink ignored");
+    uplink(&r, 0x26015678, 1);
+    r.is_jr = true;
+    CHECK(dev_table_update(&t, &r, T0) == 1, "join request ignored");
+    uplink(&r, 0x26015678, 1);
+    strcpy(r.mtype, "CDU");
+    CHECK(dev_table_update(&t, &r, T0) == 0 && t.count == 2, "confirmed uplink taken");
+
+    /* summary, checked with parson */
+    d = dev_table_find(&t, 0x26011234);
+    CHECK(dev_table_encode(d, T0 + 60, line, sizeof line) > 0, "summary encoded");
+    val = json_parse_string(line);
+    obj = json_value_get_object(val);
+    CHECK(obj != NULL, "summary is JSON");
+    CHECK(strcmp(json_object_get_string(obj, "type"), DEV_TABLE_TYPE) == 0 &&
+          strcmp(json_object_get_string(obj, "DevAddr"), "26011234") == 0, "summary type and DevAddr");
+    CHECK(strcmp(json_object_get_string(obj, "@timestamp"), "2023-11-14T22:14:20Z") == 0 &&
+          strcmp(json_object_get_string(obj, "LastSeen"), "2023-11-14T22:13:28Z") == 0, "summary times");
+    CHECK(json_object_get_number(obj, "Frames") == 9 && json_object_get_number(obj, "Lost") == 5 &&
+          json_object_get_number(obj, "Dup") == 1 && json_object_get_number(obj, "Resets") == 2 &&
+          json_object_get_number(obj, "FCnt") == DEV_FCNT_MAX_GAP + 1, "summary counters");
+    CHECK(fabs(json_object_get_number(obj, "Loss") - dev_table_loss_rate(d)) < 1e-3 &&
+          json_object_get_number(obj, "SF") == 9 && json_object_get_boolean(obj, "ADR") == 1, "summary state");
+    json_value_free(val);
+    CHECK(dev_table_encode(d, T0, line, 64) < 0, "summary refused if it does not fit");
+
+    dev_table_reset_period(d);
+    CHECK(d->nb_rx == 0 && d->nb_lost == 0 && d->nb_reset == 0 && d->fcnt == DEV_FCNT_MAX_GAP + 1 && dev_table_loss_rate(d) == 0, "new period");
+    dev_table_free(&t);
+
+    /* full table, then expiry of every other device from crowded probe runs */
+    dev_table_init(&t, NB_DEVICES);
+    for (i = 0; i < NB_DEVICES; i++) {
+        uplink(&r, 0x26000000 + (i << 8), 1);   /* same low bits, only the hash spreads them */
+        dev_table_update(&t, &r, T0 + (i & 1));
+    }
+    uplink(&r, 0x27000000, 1);
+    CHECK(t.count == NB_DEVICES && dev_table_update(&t, &r, T0) == -1 && t.full == 1, "full table refuses new devices");
+    CHECK(table_consistent(&t), "every device found");
+    CHECK(dev_table_expire(&t, T0 + 1) == NB_DEVICES / 2 && t.count == NB_DEVICES / 2, "silent devices removed");
+    ok = table_consistent(&t);
+    for (i = 0; i < NB_DEVICES; i++) {
+        ok = ok && ((dev_table_find(&t, 0x26000000 + (i << 8)) != NULL) == ((i & 1) == 1));
+    }
+    CHECK(ok, "other devices still found");
+    CHECK(dev_table_update(&t, &r, T0) == 0, "room again after expiry");
+    CHECK(dev_table_expire(&t, T0 + 2) == NB_DEVICES / 2 + 1 && t.count == 0, "table emptied");
+    dev_table_free(&t);
+
+    /* cost of an update, frames from many devices in turn */
+    dev_table_init(&t, NB_DEVICES);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < NB_UPDATES; i++) {
+        uplink(&r, 0x26000000 + (i % NB_DEVICES) * 0x1F3, (uint16_t)(i / NB_DEVICES));
+        dev_table_update(&t, &r, T0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_update = elapsed_ns(&t0, &t1) / NB_UPDATES;
+    nb = 0;
+    for (i = 0; i < NB_DEVICES; i++) {
+        d = dev_table_find(&t, 0x26000000 + i * 0x1F3);
+        nb += (d != NULL && d->nb_lost == 0 && d->nb_dup == 0) ? 1 : 0;
+    }
+    CHECK(nb == NB_DEVICES, "no loss seen in a complete sequence");
+    printf("Device updated in %.1f ns (%u devices)\n", ns_update, NB_DEVICES);
+    dev_table_free(&t);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,337 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Check that ed_report_encode writes the same JSON line as the former parson
+    based encoder, for join requests, data frames with and without MAC
+    commands and every CRC status, then count heap allocations and time both
+    encoders over the per packet path (ed_report_write, encode, append to a
+    report segment).
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memcpy memset strcmp strstr */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getpid */
+
+#include "parson.h"
+#include "base64.h"
+#include "loragw_hal.h"
+#include "report_segment.h"
+#include "ed_report.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define BENCH_PACKETS       200000      /* packets per timed run */
+#define NB_TEST_PKTS        7
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* heap allocations seen while counting is on */
+static bool alloc_counting = false;
+static unsigned long alloc_count = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- ALLOCATION COUNTING -------------------------------------------------- */
+
+#ifdef __GLIBC__
+/* wrap the glibc allocator, every other libc call keeps working as usual */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+    if (alloc_counting) {
+        alloc_count++;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    if (alloc_counting) {
+        alloc_count++;
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (alloc_counting) {
+        alloc_count++;
+    }
+    return __libc_realloc(ptr, size);
+}
+#define ALLOC_COUNTED   true
+#else
+#define ALLOC_COUNTED   false
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/**
+ * Former encoder, as thread_encode used it: one parson object per report.
+*/
+static char *parson_encode(const ed_report_t *r) {
+
+    JSON_Value *root_value;
+    JSON_Object *root_object;
+    char devaddr[9];
+    char names[ED_REPORT_FOPTS_LEN * MAC_CMD_NAME_MAX];
+    char data[((ED_REPORT_DATA_LEN + 2) / 3) * 4 + 1];
+    char *serialized_string;
+    int i;
+
+    root_value = json_value_init_object();
+    root_object = json_value_get_object(root_value);
+    json_object_set_string(root_object, "@timestamp",   r->timestamp);
+    json_object_set_string(root_object, "type",         ED_REPORT_TYPE);
+    json_object_set_string(root_object, "MType",        r->mtype);
+    json_object_set_string(root_object, "CRC",          r->crc);
+    json_object_set_number(root_object, "Freq",         r->freq);
+    json_object_set_number(root_object, "SF",           r->sf);
+    json_object_set_number(root_object, "RSSI",         r->rssi);
+    json_object_set_number(root_object, "ToA",          r->toa);
+    json_object_set_number(root_object, "FRMLen",       r->frmlength);
+    json_object_set_number(root_object, "SNR",          r->snr);
+    if (strcmp("JR", r->mtype)) {
+        snprintf(devaddr, sizeof devaddr, "%.8x", r->devaddr);
+        json_object_set_number(root_object, "FCnt",     r->fcnt);
+        json_object_set_string(root_object, "DevAddr",  devaddr);
+        json_object_set_boolean(root_object, "ADR",     r->adr);
+        json_object_set_number(root_object, "FPort",    r->fport);
+        if (r->nb_mac_cmds > 0 || r->mac_status != MAC_CMD_OK) {
+            mac_cmd_list(r->mac_cmds, r->nb_mac_cmds, names, sizeof names);
+            json_object_set_string(root_object, "MACCmds", names);
+            if (r->mac_status != MAC_CMD_OK) {
+                json_object_set_string(root_object, "MACError", mac_cmd_status_str(r->mac_status));
+            }
+        }
+        for (i = r->nb_mac_cmds - 1; i >= 0; i--) {
+            if (r->mac_cmds[i].uplink && r->mac_cmds[i].cid == MAC_CID_DEV_STATUS) {
+                json_object_set_number(root_object, "Battery", r->mac_cmds[i].u.dev_status_ans.battery);
+                json_object_set_number(root_object, "Margin", r->mac_cmds[i].u.dev_status_ans.margin);
+                break;
+            }
+        }
+        if (r->mic != ED_MIC_NONE) {
+            json_object_set_string(root_object, "MIC", (r->mic == ED_MIC_OK) ? "OK" : "BAD");
+        }
+        if (r->datalen > 0 && bin_to_b64(r->data, r->datalen, data, sizeof data) >= 0) {
+            json_object_set_string(root_object, "Data", data);
+        }
+    }
+    serialized_string = json_serialize_to_string(root_value);
+    json_value_free(root_value);
+
+    return serialized_string;
+}
+
+/**
+ * Build a received packet.
+*/
+static void make_pkt(struct lgw_pkt_rx_s *p, uint8_t mhdr, uint8_t fctrl, uint8_t size, uint32_t dr, uint8_t status, uint32_t freq_hz) {
+
+    int i;
+
+    memset(p, 0, sizeof *p);
+    p->freq_hz = freq_hz;
+    p->status = status;
+    p->datarate = dr;
+    p->bandwidth = BW_125KHZ;
+    p->coderate = CR_LORA_4_5;
+    p->snr = -7.25;
+    p->rssis = -113.0;
+    p->size = size;
+    for (i = 0; i < size; i++) {
+        p->payload[i] = (uint8_t)(0x11 * i + 3);
+    }
+    p->payload[0] = mhdr;
+    p->payload[5] = fctrl;
+}
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    int i, n, len;
+    bool same;
+    struct lgw_pkt_rx_s pkts[NB_TEST_PKTS];
+    struct timespec fetch_time = {1700000000, 123456789};
+    struct timespec t0, t1;
+    ed_report_t report;
+    char line[ED_REPORT_JSON_MAX];
+    char *ref;
+    char prefix[32];
+    segment_writer_t segment;
+    double ns_parson, ns_direct;
+    unsigned long alloc_parson, alloc_direct;
+
+    make_pkt(&pkts[0], 0x40, 0x80, 23, DR_LORA_SF7, STAT_CRC_OK, 868100000);     /* UDU, ADR, FPort */
+    make_pkt(&pkts[1], 0x80, 0x23, 11, DR_LORA_SF9, STAT_CRC_BAD, 867300000);    /* CDU, ACK, 3 bytes FOpts, no FPort */
+    make_pkt(&pkts[2], 0x00, 0x00, 23, DR_LORA_SF12, STAT_NO_CRC, 868500000);    /* JR */
+    make_pkt(&pkts[3], 0x60, 0x05, 40, DR_LORA_SF10, STAT_UNDEFINED, 867900000); /* UDD, 5 bytes FOpts, FPort */
+    make_pkt(&pkts[4], 0xE0, 0x0F, 30, DR_LORA_SF11, 0x42, 868300000);          /* PRP, 15 bytes FOpts, unknown CRC status */
+    make_pkt(&pkts[5], 0x40, 0x00, 13, DR_LORA_SF8, STAT_CRC_OK, 869525000);     /* frequency with decimals */
+    pkts[5].snr = 10.0;
+    pkts[5].rssis = -50.5;
+    make_pkt(&pkts[6], 0x40, 0x05, 20, DR_LORA_SF7, STAT_CRC_OK, 868100000);     /* UDU, LinkADRAns and DevStatusAns in FOpts */
+    memcpy(&pkts[6].payload[8], (const uint8_t[]){0x03, 0x07, 0x06, 0xFE, 0x3A}, 5);
+
+    /* same line as the parson encoder */
+    same = true;
+    for (i = 0; i < NB_TEST_PKTS; i++) {
+        ed_report_write(&report, &pkts[i], &fetch_time);
+        len = ed_report_encode(&report, line, sizeof line);
+        ref = parson_encode(&report);
+        if (len < 0 || ref == NULL || strcmp(line, ref) != 0 || (size_t)len != strlen(ref)) {
+            printf("  encoded: %s\n  parson:  %s\n", line, (ref != NULL) ? ref : "(null)");
+            same = false;
+        }
+        json_free_serialized_string(ref);
+    }
+    CHECK(same, "encoded lines match the parson encoder");
+
+    /* session key items, as key_store_process leaves them */
+    ed_report_write(&report, &pkts[0], &fetch_time);
+    report.mic = ED_MIC_OK;
+    report.datalen = 5;
+    memcpy(report.data, "hello", 5);
+    len = ed_report_encode(&report, line, sizeof line);
+    ref = parson_encode(&report);
+    CHECK(len > 0 && ref != NULL && strcmp(line, ref) == 0, "MIC and data match the parson encoder");
+    json_free_serialized_string(ref);
+
+    /* decoding */
+    ed_report_write(&report, &pkts[2], &fetch_time);
+    CHECK(report.is_jr && strcmp(report.mtype, "JR") == 0 && report.frmlength == 23, "join request");
+    /* payload[5] is the FCtrl byte of make_pkt, 0 for a join request */
+    CHECK(report.app_eui == 0x8B7A690047362514ULL && report.dev_eui == 0x1302F1E0CFBEAD9CULL, "join request EUIs");
+    CHECK(strcmp(report.timestamp, "2023-11-14T22:13:20.123Z") == 0, "ISO 8601 timestamp");
+
+    ed_report_write(&report, &pkts[3], &fetch_time);
+    CHECK(report.devaddr == 0x47362514U && report.fcnt == 0x7A69, "DevAddr and FCnt");
+    CHECK(report.foptslen == 5 && memcmp(report.fopts, &pkts[3].payload[8], 5) == 0, "FOpts kept raw");
+    CHECK(report.fport == pkts[3].payload[13] && report.frmlength == 40 - 8 - 5 - 1, "FPort read after FOpts");
+
+    ed_report_write(&report, &pkts[6], &fetch_time);
+    CHECK(report.nb_mac_cmds == 2 && report.mac_status == MAC_CMD_OK, "FOpts decoded");
+    CHECK(report.mac_cmds[0].u.link_adr_ans.ch_mask_ack && report.mac_cmds[1].u.dev_status_ans.battery == 0xFE &&
+          report.mac_cmds[1].u.dev_status_ans.margin == -6, "LinkADRAns and DevStatusAns");
+    ed_report_encode(&report, line, sizeof line);
+    CHECK(strstr(line, "\"MACCmds\":\"LinkADRAns,DevStatusAns\",\"Battery\":254,\"Margin\":-6") != NULL, "MAC commands encoded");
+
+    ed_report_write(&report, &pkts[3], &fetch_time);
+    CHECK(report.nb_mac_cmds == 0 && report.mac_status == MAC_CMD_UNKNOWN, "unknown CID stops decoding");
+
+    pkts[3].size = 10;
+    ed_report_write(&report, &pkts[3], &fetch_time);
+    CHECK(report.foptslen == 2 && report.fport == -1 && report.frmlength == 0, "FOpts kept within the frame");
+    pkts[3].size = 40;
+
+    ed_report_write(&report, &pkts[1], &fetch_time);
+    CHECK(report.fport == -1 && report.frmlength == 0 && report.ack && !report.adr, "no FPort without payload");
+
+    ed_report_write(&report, &pkts[0], &fetch_time);
+    CHECK(ed_report_encode(&report, line, 64) == -1 && line[0] == '\0', "short buffer refused");
+
+    /* heap allocations and time per packet, appending to a report segment */
+    snprintf(prefix, sizeof prefix, "/tmp/ed_report_%d", (int)getpid());
+    CHECK(segment_init(&segment, prefix, 1 << 30, 3600) == 0, "segment writer");
+    segment_append(&segment, "{}", 2); /* open the segment file outside of the counted runs */
+
+    alloc_count = 0;
+    alloc_counting = true;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (n = 0; n < BENCH_PACKETS; n++) {
+        ed_report_write(&report, &pkts[n % NB_TEST_PKTS], &fetch_time);
+        ref = parson_encode(&report);
+        segment_append(&segment, ref, strlen(ref));
+        json_free_serialized_string(ref);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    alloc_counting = false;
+    alloc_parson = alloc_count;
+    ns_parson = elapsed_ns(&t0, &t1) / BENCH_PACKETS;
+
+    alloc_count = 0;
+    alloc_counting = true;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (n = 0; n < BENCH_PACKETS; n++) {
+        ed_report_write(&report, &pkts[n % NB_TEST_PKTS], &fetch_time);
+        len = ed_report_encode(&report, line, sizeof line);
+        segment_append(&segment, line, (size_t)len);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    alloc_counting = false;
+    alloc_direct = alloc_count;
+    ns_direct = elapsed_ns(&t0, &t1) / BENCH_PACKETS;
+
+    printf("Per packet, %d packets (write, encode, append):\n", BENCH_PACKETS);
+    printf("  parson  %8.0f ns, %6.2f allocations\n", ns_parson, (double)alloc_parson / BENCH_PACKETS);
+    printf("  direct  %8.0f ns, %6.2f allocations\n", ns_direct, (double)alloc_direct / BENCH_PACKETS);
+    if (ALLOC_COUNTED) {
+        CHECK(alloc_parson >= BENCH_PACKETS, "allocations counted on the parson path");
+        CHECK(alloc_direct == 0, "no heap allocation on the direct path");
+    }
+
+    /* drop the test segments */
+    segment_seal(&segment);
+    for (n = 0; n <= (int)segment_sealed_end(&segment); n++) {
+        segment_name(line, sizeof line, prefix, n, true);
+        remove(line);
+        segment_name(line, sizeof line, prefix, n, false);
+        remove(line);
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,321 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Exercise the HTTP uploader against a stand-in dashboard on loopback.
+    Checks that requests share one keep-alive connection, that bodies arrive
+    intact (newlines included), that the bearer token is sent and that the
+    response is available in memory.
+    The stand-in also answers _bulk requests like Elasticsearch, throttling
+    SF12 documents (429) and refusing SF99 documents (400), to check that
+    partial failures are mapped back onto the right documents.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 700
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* strstr memcpy */
+#include <unistd.h>     /* close read write */
+
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "http_uploader.h"
+#include "bulk_upload.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define STUB_BUF_LEN        65536
+#define STUB_RESPONSE       "{\"result\":\"created\"}"
+#define STUB_BULK_PATH      "/_bulk"
+#define TEST_TOKEN          "test-token-1234"
+#define TEST_REQUESTS       5
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* loopback dashboard stand-in */
+static int stub_fd = -1;
+static uint16_t stub_port = 0;
+static int stub_connections = 0;
+static int stub_requests = 0;
+static bool stub_saw_bearer = false;
+static char stub_body[STUB_BUF_LEN];
+static size_t stub_body_len = 0;
+static char stub_reply[STUB_BUF_LEN];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/**
+ * Build an Elasticsearch style _bulk response for a request body. Every second line
+ * is a document; SF12 documents are throttled and SF99 documents are refused.
+ *
+ * @param body      Request body
+ * @param len       Length of the request body
+ * @param dest      Response destination
+ * @param size      Size of the response destination
+*/
+static void stub_bulk_reply(const char *body, size_t len, char *dest, size_t size) {
+
+    const char *line = body;
+    const char *end = body + len;
+    const char *nl, *sf;
+    size_t used;
+    int doc = 0;
+    int status;
+    bool errors = false;
+    char items[STUB_BUF_LEN] = "";
+
+    used = 0;
+    while (line < end && (nl = memchr(line, '\n', end - line)) != NULL) {
+        if (doc++ % 2 == 1) { /* document line, the one before it is the action */
+            sf = strstr(line, "\"SF\":");
+            if (sf != NULL && sf < nl && !strncmp(sf + 5, "12", 2)) {
+                status = 429;
+            } else if (sf != NULL && sf < nl && !strncmp(sf + 5, "99", 2)) {
+                status = 400;
+            } else {
+                status = 201;
+            }
+            errors |= (status != 201);
+            used += snprintf(items + used, sizeof items - used, "%s{\"index\":{\"_index\":\"sniffer\",\"status\":%d}}", used ? "," : "", status);
+        }
+        line = nl + 1;
+    }
+
+    snprintf(dest, size, "{\"took\":3,\"errors\":%s,\"items\":[%s]}", errors ? "true" : "false", items);
+}
+
+/**
+ * Serve every request on one connection until the client closes it.
+*/
+static void stub_serve(int fd) {
+
+    static char buf[STUB_BUF_LEN];
+    char reply[256];
+    size_t have = 0;
+    ssize_t n;
+    char *end, *cl;
+    size_t head_len, body_len;
+
+    while (1) {
+        /* read until a full header and body are buffered */
+        end = NULL;
+        while ((end = strstr(buf, "\r\n\r\n")) == NULL || have < (size_t)(end - buf) + 4) {
+            n = read(fd, buf + have, sizeof buf - 1 - have);
+            if (n <= 0) return;
+            have += n;
+            buf[have] = '\0';
+        }
+        head_len = (end - buf) + 4;
+        cl = strstr(buf, "Content-Length:");
+        body_len = (cl != NULL && cl < end) ? strtoul(cl + 15, NULL, 10) : 0;
+        while (have < head_len + body_len) {
+            n = read(fd, buf + have, sizeof buf - 1 - have);
+            if (n <= 0) return;
+            have += n;
+            buf[have] = '\0';
+        }
+
+        stub_requests++;
+        if (strstr(buf, "Authorization: Bearer " TEST_TOKEN) != NULL && strstr(buf, "Authorization") < end) {
+            stub_saw_bearer = true;
+        }
+        memcpy(stub_body, buf + head_len, body_len);
+        stub_body_len = body_len;
+
+        if (strstr(buf, STUB_BULK_PATH " HTTP/1.1") != NULL) {
+            stub_bulk_reply(stub_body, stub_body_len, stub_reply, sizeof stub_reply);
+        } else {
+            strcpy(stub_reply, STUB_RESPONSE);
+        }
+
+        snprintf(reply, sizeof reply, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %u\r\n\r\n", (unsigned)strlen(stub_reply));
+        if (write(fd, reply, strlen(reply)) < 0) return;
+        if (write(fd, stub_reply, strlen(stub_reply)) < 0) return;
+
+        /* keep whatever belongs to a pipelined follow-up */
+        memmove(buf, buf + head_len + body_len, have - head_len - body_len);
+        have -= head_len + body_len;
+        buf[have] = '\0';
+    }
+}
+
+static void *stub_thread(void *arg) {
+
+    int fd;
+
+    (void)arg;
+
+    while ((fd = accept(stub_fd, NULL, NULL)) >= 0) {
+        stub_connections++;
+        stub_serve(fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static int stub_start(pthread_t *thr) {
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof addr;
+
+    stub_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (stub_fd < 0) return -1;
+
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0; /* let the kernel pick */
+
+    if (bind(stub_fd, (struct sockaddr*)&addr, sizeof addr) || listen(stub_fd, 4)) return -1;
+    if (getsockname(stub_fd, (struct sockaddr*)&addr, &len)) return -1;
+    stub_port = ntohs(addr.sin_port);
+
+    return pthread_create(thr, NULL, stub_thread, NULL);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int i, res;
+    int failures = 0;
+    char url[64];
+    char url_bulk[64];
+    const char body[] = "{\"type\":\"device\",\"SF\":7}\n{\"type\":\"device\",\"SF\":12}\n";
+    const char segment[] = "{\"type\":\"device\",\"SF\":7}\n{\"type\":\"device\",\"SF\":12}\n{\"type\":\"device\",\"SF\":99}\n\n{\"type\":\"device\",\"SF\":9}\n";
+    char failed[256];
+    FILE *fp;
+    http_uploader_t h;
+    bulk_req_t b;
+    bulk_result_t result;
+    pthread_t thr;
+
+    if (stub_start(&thr)) {
+        printf("ERROR: failed to start loopback stand-in\n");
+        return EXIT_FAILURE;
+    }
+    snprintf(url, sizeof url, "http://127.0.0.1:%u/API/sniffer", stub_port);
+    snprintf(url_bulk, sizeof url_bulk, "http://127.0.0.1:%u%s", stub_port, STUB_BULK_PATH);
+    printf("INFO: stand-in dashboard at %s\n", url);
+
+    if (http_global_init() || http_init(&h, 15)) {
+        printf("ERROR: failed to initialise uploader\n");
+        return EXIT_FAILURE;
+    }
+    http_set_bearer(&h, TEST_TOKEN);
+
+    for (i = 0; i < TEST_REQUESTS; i++) {
+        res = http_post(&h, url, HTTP_CONTENT_NDJSON, 1, body, strlen(body));
+        if (res != CURLE_OK) {
+            printf("ERROR: request %d failed with %d (%s)\n", i, res, h.error);
+            failures++;
+        }
+    }
+
+    CHECK(stub_requests == TEST_REQUESTS, "every request reached the stand-in");
+    CHECK(stub_connections == 1, "requests share one keep-alive connection");
+    CHECK(stub_saw_bearer, "bearer token sent");
+    CHECK(stub_body_len == strlen(body) && !memcmp(stub_body, body, stub_body_len), "body (with newlines) arrives intact");
+    CHECK(h.status == 200, "HTTP status recorded");
+    CHECK(!strcmp(h.response.data, STUB_RESPONSE), "response captured in memory");
+
+    res = http_get(&h, url);
+    CHECK(res == CURLE_OK && stub_connections == 1, "probe reuses the connection");
+
+    /* _bulk request with a partial failure */
+    bulk_init(&b, "sniffer");
+    CHECK(bulk_add_ndjson(&b, segment, strlen(segment)) == 4, "empty lines skipped when building _bulk body");
+    CHECK(!strncmp(b.body.data, "{\"index\":{\"_index\":\"sniffer\"}}\n{\"type\"", strlen("{\"index\":{\"_index\":\"sniffer\"}}\n{\"type\"")), "action line precedes each document");
+
+    res = http_post(&h, url_bulk, HTTP_CONTENT_NDJSON, 1, b.body.data, b.body.len);
+    CHECK(res == CURLE_OK && stub_connections == 1, "_bulk request sent on the same connection");
+    CHECK(!bulk_parse_response(&b, h.response.data, &result), "_bulk response parsed");
+    CHECK(result.accepted == 2 && result.retry == 1 && result.rejected == 1, "per item statuses mapped onto documents");
+
+    fp = fmemopen(failed, sizeof failed, "w");
+    CHECK(bulk_write_failed(&b, fp, true) == 1, "one document kept for retry");
+    fclose(fp);
+    CHECK(!strcmp(failed, "{\"type\":\"device\",\"SF\":12}\n"), "retry holds only the throttled document");
+
+    fp = fmemopen(failed, sizeof failed, "w");
+    CHECK(bulk_write_failed(&b, fp, false) == 1, "one document refused for good");
+    fclose(fp);
+    CHECK(!strcmp(failed, "{\"type\":\"device\",\"SF\":99}\n"), "refused holds only the mapping failure");
+
+    bulk_reset(&b);
+    bulk_add_ndjson(&b, body, 25);
+    res = http_post(&h, url_bulk, HTTP_CONTENT_NDJSON, 1, b.body.data, b.body.len);
+    CHECK(res == CURLE_OK && !bulk_parse_response(&b, h.response.data, &result) && result.accepted == 1, "clean _bulk response accepts everything");
+    CHECK(bulk_parse_response(&b, STUB_RESPONSE, &result) == -1, "non _bulk response reported");
+    bulk_free(&b);
+
+    /* nothing listens on port 1, the uploader must report it rather than hang */
+    res = http_post(&h, "http://127.0.0.1:1/", HTTP_CONTENT_JSON, 0, "{}", 2);
+    CHECK(res == CURLE_COULDNT_CONNECT, "refused connection reported as CURLE_COULDNT_CONNECT");
+
+    http_cleanup(&h);
+    http_global_cleanup();
+
+    shutdown(stub_fd, SHUT_RDWR);
+    close(stub_fd);
+    pthread_join(thr, NULL);
+
+    printf("%s: %d failure(s)\n", failures ? "FAILED" : "PASSED", failures);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,276 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Compare the JSON emitter with parson's compact serialiser: numbers drawn
+    from the ranges reports use, rounding ties, random bit patterns and every
+    string byte must come out identical. Then time the number formatting and
+    the construction of a report sized object against parson.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf snprintf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memcpy strcmp */
+#include <time.h>       /* clock_gettime */
+
+#include "parson.h"
+#include "json_emit.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_NUMBERS          1000000     /* random numbers compared with parson */
+#define BENCH_NUMBERS       1000000     /* numbers per timed run */
+#define BENCH_OBJECTS       200000      /* objects per timed run */
+#define OUT_LEN             2048        /* holds any "%.3f" double */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* xorshift64*, reproducible from one run to the next */
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* a number like the ones reports carry, or one that is hard to round */
+static double rng_number(void) {
+
+    uint64_t r = rng_next();
+    int64_t milli = (int64_t)(rng_next() % 4000000000ULL) - 2000000000LL;
+    double d;
+
+    switch (r % 6) {
+        case 0: return (float)((double)milli / 1000.0);             /* float fields: Freq, RSSI, SNR, ToA */
+        case 1: return (double)milli / 1000.0;                      /* on a thousandth */
+        case 2: return ((double)milli + 0.5) / 1000.0;              /* on a rounding tie */
+        case 3: return (double)milli;                               /* integral, in and out of int range */
+        case 4: return (double)milli / 1e6;                         /* small */
+        default:
+            r = rng_next();
+            memcpy(&d, &r, sizeof d);                               /* any bit pattern: huge, tiny, inf, NaN */
+            return d;
+    }
+}
+
+/* parson's compact serialisation of a single number */
+static void parson_number(char *dest, size_t size, double num) {
+
+    JSON_Value *v = json_value_init_number(num);
+    char *s = json_serialize_to_string(v);
+
+    snprintf(dest, size, "%s", (s != NULL) ? s : "");
+    json_free_serialized_string(s);
+    json_value_free(v);
+}
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    int i, n, mismatch;
+    double num;
+    char out[OUT_LEN], ref[OUT_LEN];
+    char str[128];
+    char *s;
+    json_emit_t e;
+    JSON_Value *root_value;
+    JSON_Object *root_object;
+    struct timespec t0, t1;
+    double ns_ref, ns_emit;
+    volatile int sink = 0;
+    const double fixed[] = {0, -0.0, 1, -1, 0.5, -0.5, 0.0005, -0.0005, 0.0015, 2.675, 1.0005, 868.1,
+                            -113.25, 2147483647.0, 2147483648.0, -2147483648.0, -2147483649.0, 999999.9995, 1e6 + 0.25, 1e300, 5e-324};
+
+    /* numbers */
+    mismatch = 0;
+    for (i = 0; i < (int)(sizeof fixed / sizeof fixed[0]); i++) {
+        json_format_number(out, sizeof out, fixed[i]);
+        parson_number(ref, sizeof ref, fixed[i]);
+        if (strcmp(out, ref) != 0) {
+            printf("  %.17g: %s, parson %s\n", fixed[i], out, ref);
+            mismatch++;
+        }
+    }
+    CHECK(mismatch == 0, "edge numbers formatted as parson does");
+
+    mismatch = 0;
+    for (i = 0; i < NB_NUMBERS; i++) {
+        num = rng_number();
+        json_format_number(out, sizeof out, num);
+        parson_number(ref, sizeof ref, num);
+        if (strcmp(out, ref) != 0) {
+            if (mismatch < 10) {
+                printf("  %.17g: %s, parson %s\n", num, out, ref);
+            }
+            mismatch++;
+        }
+    }
+    CHECK(mismatch == 0, "random numbers formatted as parson does");
+
+    /* strings, every ASCII byte (parson drops strings that are not valid UTF-8) */
+    for (i = 1; i < 128; i++) {
+        str[i - 1] = (char)i;
+    }
+    str[127] = '\0';
+    json_emit_begin(&e, out, sizeof out);
+    json_emit_string(&e, "k/\"\\", str);
+    json_emit_hex(&e, "a", 0x0026011F, 8);
+    json_emit_hex(&e, "b", 0, 8);
+    json_emit_bool(&e, "c", true);
+    json_emit_bool(&e, "d", false);
+    json_emit_number(&e, "e", -7.25);
+    n = json_emit_end(&e);
+
+    root_value = json_value_init_object();
+    root_object = json_value_get_object(root_value);
+    json_object_set_string(root_object, "k/\"\\", str);
+    json_object_set_string(root_object, "a", "0026011f");
+    json_object_set_string(root_object, "b", "00000000");
+    json_object_set_boolean(root_object, "c", true);
+    json_object_set_boolean(root_object, "d", false);
+    json_object_set_number(root_object, "e", -7.25);
+    s = json_serialize_to_string(root_value);
+    CHECK(s != NULL && n == (int)strlen(s) && strcmp(out, s) == 0, "strings, hex, booleans match parson");
+    json_free_serialized_string(s);
+    json_value_free(root_value);
+
+    /* buffer limits */
+    json_emit_begin(&e, out, 14);
+    json_emit_string(&e, "key", "val");
+    CHECK(json_emit_end(&e) == 13 && strcmp(out, "{\"key\":\"val\"}") == 0, "object fits");
+    json_emit_begin(&e, out, 13);
+    json_emit_string(&e, "key", "val");
+    CHECK(json_emit_end(&e) == -1 && out[0] == '\0', "object one byte too long refused");
+    json_emit_begin(&e, out, 8);
+    json_emit_number(&e, "n", 1e300);
+    CHECK(json_emit_end(&e) == -1, "number too long refused");
+
+    /* number formatting speed */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_NUMBERS; i++) {
+        num = (i % 2000) * -0.0625 + 868.1;
+        if (num == (double)(int)num) {
+            sink += snprintf(out, sizeof out, "%d", (int)num);
+        } else {
+            sink += snprintf(out, sizeof out, "%.3f", num);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_ref = elapsed_ns(&t0, &t1) / BENCH_NUMBERS;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_NUMBERS; i++) {
+        num = (i % 2000) * -0.0625 + 868.1;
+        sink += json_format_number(out, sizeof out, num);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_emit = elapsed_ns(&t0, &t1) / BENCH_NUMBERS;
+    printf("Number: snprintf %6.1f ns, json_format_number %6.1f ns\n", ns_ref, ns_emit);
+
+    /* report sized object speed */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_OBJECTS; i++) {
+        root_value = json_value_init_object();
+        root_object = json_value_get_object(root_value);
+        json_object_set_string(root_object, "@timestamp", "2023-11-14T22:13:20.123Z");
+        json_object_set_string(root_object, "type", "device");
+        json_object_set_string(root_object, "MType", "UDU");
+        json_object_set_string(root_object, "CRC", "OK");
+        json_object_set_number(root_object, "Freq", 868.1 + (i % 8) * 0.2);
+        json_object_set_number(root_object, "SF", 7 + (i % 6));
+        json_object_set_number(root_object, "RSSI", -113.25);
+        json_object_set_number(root_object, "ToA", 61.664);
+        json_object_set_number(root_object, "FRMLen", i % 51);
+        json_object_set_number(root_object, "SNR", -7.25);
+        json_object_set_number(root_object, "FCnt", i);
+        json_object_set_string(root_object, "DevAddr", "26011f2a");
+        json_object_set_boolean(root_object, "ADR", true);
+        json_object_set_number(root_object, "FPort", 1);
+        s = json_serialize_to_string(root_value);
+        sink += s[0];
+        json_free_serialized_string(s);
+        json_value_free(root_value);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_ref = elapsed_ns(&t0, &t1) / BENCH_OBJECTS;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_OBJECTS; i++) {
+        json_emit_begin(&e, out, sizeof out);
+        json_emit_string(&e, "@timestamp", "2023-11-14T22:13:20.123Z");
+        json_emit_string(&e, "type", "device");
+        json_emit_string(&e, "MType", "UDU");
+        json_emit_string(&e, "CRC", "OK");
+        json_emit_number(&e, "Freq", 868.1 + (i % 8) * 0.2);
+        json_emit_number(&e, "SF", 7 + (i % 6));
+        json_emit_number(&e, "RSSI", -113.25);
+        json_emit_number(&e, "ToA", 61.664);
+        json_emit_number(&e, "FRMLen", i % 51);
+        json_emit_number(&e, "SNR", -7.25);
+        json_emit_number(&e, "FCnt", i);
+        json_emit_hex(&e, "DevAddr", 0x26011F2A, 8);
+        json_emit_bool(&e, "ADR", true);
+        json_emit_number(&e, "FPort", 1);
+        sink += json_emit_end(&e);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_emit = elapsed_ns(&t0, &t1) / BENCH_OBJECTS;
+    printf("Report object: parson %6.0f ns, json_emit %6.0f ns\n", ns_ref, ns_emit);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,299 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Check AES-128 and AES-CMAC against the FIPS-197 and RFC 4493 vectors,
+    the MIC check and payload decryption against a known LoRaWAN frame,
+    FCnt rollovers, port 0 MAC commands and broken key files, then time the
+    per packet cost of key_store_process with a realistic number of devices.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fopen */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memcmp memcpy memset */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getpid unlink */
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "aes128.h"
+#include "ed_report.h"
+#include "key_store.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define BENCH_PACKETS       200000      /* packets per timed run */
+#define BENCH_DEVICES       1000        /* devices in the key file of the benchmark */
+#define BENCH_PAYLOAD       51          /* largest payload of SF12 in EU868 */
+
+/* known frame: DevAddr 49BE7DF1, FCnt 2, FPort 1, payload "test" */
+#define KNOWN_FRAME         "40F17DBE4900020001954378762B11FF0D"
+#define KNOWN_NWKSKEY       "44024241ED4CE9A68C6A8BC055233FD3"
+#define KNOWN_APPSKEY       "EC925802AE430CA77FD3DD73CB2CC588"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static size_t from_hex(const char *hex, uint8_t *out) {
+    size_t i;
+    unsigned v;
+
+    for (i = 0; hex[2 * i] != '\0'; i++) {
+        sscanf(&hex[2 * i], "%2x", &v);
+        out[i] = (uint8_t)v;
+    }
+    return i;
+}
+
+static int write_file(const char *path, const char *contents) {
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL) {
+        return -1;
+    }
+    fputs(contents, f);
+    return fclose(f);
+}
+
+/**
+ * Build a data frame, encrypted and signed with the keys of an entry.
+*/
+static void make_frame(struct lgw_pkt_rx_s *p, const key_entry_t *e, uint8_t mhdr, uint32_t fcnt, int fport, const uint8_t *plain, size_t len) {
+
+    size_t n = 0;
+    bool uplink = (mhdr >> 5) == 0b010 || (mhdr >> 5) == 0b100;
+
+    memset(p, 0, sizeof *p);
+    p->status = STAT_CRC_OK;
+    p->datarate = DR_LORA_SF7;
+    p->bandwidth = BW_125KHZ;
+    p->coderate = CR_LORA_4_5;
+    p->freq_hz = 868100000;
+    p->payload[n++] = mhdr;
+    p->payload[n++] = (uint8_t)e->devaddr;
+    p->payload[n++] = (uint8_t)(e->devaddr >> 8);
+    p->payload[n++] = (uint8_t)(e->devaddr >> 16);
+    p->payload[n++] = (uint8_t)(e->devaddr >> 24);
+    p->payload[n++] = 0x00;
+    p->payload[n++] = (uint8_t)fcnt;
+    p->payload[n++] = (uint8_t)(fcnt >> 8);
+    if (fport >= 0) {
+        p->payload[n++] = (uint8_t)fport;
+        key_store_crypt((fport == 0) ? &e->nwk_skey : &e->app_skey, plain, len, uplink, e->devaddr, fcnt, &p->payload[n]);
+        n += len;
+    }
+    key_store_mic(&e->nwk_skey, p->payload, n, uplink, e->devaddr, fcnt, &p->payload[n]);
+    p->size = (uint16_t)(n + KEY_MIC_LEN);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    int i, n;
+    aes128_ctx_t ctx;
+    uint8_t key[AES128_KEY_SIZE], msg[64], out[AES128_BLOCK_SIZE], ref[AES128_BLOCK_SIZE];
+    char path[64], line[ED_REPORT_JSON_MAX];
+    char *big;
+    size_t len;
+    key_store_t ks;
+    key_entry_t *e;
+    struct lgw_pkt_rx_s pkt;
+    struct timespec fetch_time = {1700000000, 0};
+    struct timespec t0, t1;
+    ed_report_t report;
+    uint8_t plain[BENCH_PAYLOAD];
+    double ns_write, ns_key;
+
+    lora_packet_toa_init();
+
+    /* FIPS-197 appendix C.1 and RFC 4493 section 4 */
+    from_hex("000102030405060708090A0B0C0D0E0F", key);
+    from_hex("00112233445566778899AABBCCDDEEFF", msg);
+    from_hex("69C4E0D86A7B0430D8CDB78070B4C55A", ref);
+    aes128_set_key(&ctx, key);
+    aes128_encrypt(&ctx, msg, out);
+    CHECK(memcmp(out, ref, sizeof ref) == 0, "AES-128 block");
+
+    from_hex("2B7E151628AED2A6ABF7158809CF4F3C", key);
+    from_hex("6BC1BEE22E409F96E93D7E117393172AAE2D8A571E03AC9C9EB76FAC45AF8E51"
+             "30C81C46A35CE411E5FBC1191A0A52EFF69F2445DF4F9B17AD2B417BE66C3710", msg);
+    aes128_set_key(&ctx, key);
+    from_hex("BB1D6929E95937287FA37D129B756746", ref);
+    aes128_cmac(&ctx, NULL, 0, NULL, 0, out);
+    CHECK(memcmp(out, ref, sizeof ref) == 0, "AES-CMAC empty message");
+    from_hex("070A16B46B4D4144F79BDD9DD04A287C", ref);
+    aes128_cmac(&ctx, NULL, 0, msg, 16, out);
+    CHECK(memcmp(out, ref, sizeof ref) == 0, "AES-CMAC one block");
+    from_hex("DFA66747DE9AE63030CA32611497C827", ref);
+    aes128_cmac(&ctx, NULL, 0, msg, 40, out);
+    CHECK(memcmp(out, ref, sizeof ref) == 0, "AES-CMAC padded last block");
+    aes128_cmac(&ctx, msg, 7, &msg[7], 33, out);
+    CHECK(memcmp(out, ref, sizeof ref) == 0, "AES-CMAC message in two parts");
+    from_hex("51F0BEBF7E3B9D92FC49741779363CFE", ref);
+    aes128_cmac(&ctx, msg, 16, &msg[16], 48, out);
+    CHECK(memcmp(out, ref, sizeof ref) == 0, "AES-CMAC four blocks");
+
+    /* key files */
+    snprintf(path, sizeof path, "/tmp/key_store_%d.json", (int)getpid());
+    write_file(path, "{\"devices\": [{\"DevAddr\": \"49BE7DF1\", \"NwkSKey\": \"" KNOWN_NWKSKEY "\", \"AppSKey\": \"" KNOWN_APPSKEY "\"},\n"
+                     "  {\"DevAddr\": \"26011BDA\", \"NwkSKey\": \"000102030405060708090A0B0C0D0E0F\", \"AppSKey\": \"0F0E0D0C0B0A09080706050403020100\"},\n"
+                     "  {\"DevAddr\": \"00000001\", \"NwkSKey\": \"000102030405060708090A0B0C0D0E0F\", \"AppSKey\": \"0F0E0D0C0B0A09080706050403020100\"}]}");
+    CHECK(key_store_load(&ks, path) == 3, "key file loaded");
+    CHECK(key_store_find(&ks, 0x49BE7DF1) != NULL && key_store_find(&ks, 0x00000001) != NULL && key_store_find(&ks, 0x26011BDB) == NULL, "lookups");
+
+    /* known frame */
+    ks.keep_data = true;
+    pkt.size = (uint16_t)from_hex(KNOWN_FRAME, pkt.payload);
+    pkt.status = STAT_CRC_OK;
+    pkt.bandwidth = BW_125KHZ;
+    pkt.coderate = CR_LORA_4_5;
+    pkt.datarate = DR_LORA_SF7;
+    ed_report_write(&report, &pkt, &fetch_time);
+    CHECK(key_store_process(&ks, &pkt, &report) == ED_MIC_OK && report.mic == ED_MIC_OK, "MIC of the known frame");
+    CHECK(report.datalen == 4 && memcmp(report.data, "test", 4) == 0, "payload of the known frame");
+    ed_report_encode(&report, line, sizeof line);
+    CHECK(strstr(line, "\"MIC\":\"OK\",\"Data\":\"dGVzdA==\"") != NULL, "MIC and data encoded");
+
+    pkt.payload[10] ^= 0x01;
+    ed_report_write(&report, &pkt, &fetch_time);
+    CHECK(key_store_process(&ks, &pkt, &report) == ED_MIC_BAD && report.datalen == 0, "corrupted payload, bad MIC");
+    ed_report_encode(&report, line, sizeof line);
+    CHECK(strstr(line, "\"MIC\":\"BAD\"") != NULL && strstr(line, "\"Data\"") == NULL, "bad MIC encoded");
+
+    pkt.payload[1] ^= 0x01;
+    ed_report_write(&report, &pkt, &fetch_time);
+    CHECK(key_store_process(&ks, &pkt, &report) == ED_MIC_NONE, "unknown device");
+    ed_report_encode(&report, line, sizeof line);
+    CHECK(strstr(line, "\"MIC\"") == NULL, "no MIC for unknown devices");
+
+    /* FCnt rollover, restart, and a downlink on the same device */
+    e = key_store_find(&ks, 0x26011BDA);
+    memcpy(plain, "rollover", 8);
+    make_frame(&pkt, e, 0x40, 0xFFFE, 1, plain, 8);
+    ed_report_write(&report, &pkt, &fetch_time);
+    CHECK(key_store_process(&ks, &pkt, &report) == ED_MIC_OK && report.fcnt == 0xFFFE, "uplink before the rollover");
+    make_frame(&pkt, e, 0x40, 0x10001, 1, plain, 8);
+    ed_report_write(&report, &pkt, &fetch_time);
+    CHECK(key_store_process(&ks, &pkt, &report) == ED_MIC_OK && report.fcnt == 0x10001, "uplink after the rollover");
+    CHECK(report.datalen == 8 && memcmp(report.data, plain, 8) == 0, "payload after the rollover");
+    make_frame(&pkt, e, 0x40, 3, 1, plain, 8);
+    ed_report_write(&report, &pkt, &fetch_time);
+    CHECK(key_store_process(&ks, &pkt, &report) == ED_MIC_OK && report.fcnt == 3, "FCnt restart");
+    make_frame(&pkt, e, 0x60, 7, -1, NULL, 0);
+    ed_report_write(&report, &pkt, &fetch_time);
+    CHECK(key_store_process(&ks, &pkt, &report) == ED_MIC_OK && e->fcnt_down == 7 && e->fcnt_up == 3, "downlink counter apart");
+
+    /* port 0: LinkADRAns, DevStatusAns */
+    memcpy(plain, (const uint8_t[]){0x03, 0x07, 0x06, 0x64, 0x05}, 5);
+    make_frame(&pkt, e, 0x80, 4, 0, plain, 5);
+    ed_report_write(&report, &pkt, &fetch_time);
+    CHECK(key_store_process(&ks, &pkt, &report) == ED_MIC_OK && report.nb_mac_cmds == 2 &&
+          report.mac_cmds[1].u.dev_status_ans.battery == 100 && report.datalen == 0, "port 0 MAC commands decrypted");
+
+    ks.keep_data = false;
+    make_frame(&pkt, e, 0x40, 5, 1, plain, 5);
+    ed_report_write(&report, &pkt, &fetch_time);
+    CHECK(key_store_process(&ks, &pkt, &report) == ED_MIC_OK && report.datalen == 0, "payloads not kept");
+    CHECK(ks.nb_mic_ok == 7 && ks.nb_mic_bad == 1 && ks.nb_decrypted == 6, "counters");
+    key_store_free(&ks);
+
+    /* broken key files */
+    write_file(path, "{\"devices\": [{\"DevAddr\": \"26011BDA\", \"NwkSKey\": \"00010203\", \"AppSKey\": \"0F0E0D0C0B0A09080706050403020100\"}]}");
+    CHECK(key_store_load(&ks, path) == -1 && ks.entries == NULL, "short key refused");
+    write_file(path, "{\"devices\": [{\"DevAddr\": \"26011BDA\", \"NwkSKey\": \"000102030405060708090A0B0C0D0E0F\", \"AppSKey\": \"0F0E0D0C0B0A09080706050403020100\"},"
+                     " {\"DevAddr\": \"26011BDA\", \"NwkSKey\": \"000102030405060708090A0B0C0D0E0F\", \"AppSKey\": \"0F0E0D0C0B0A09080706050403020100\"}]}");
+    CHECK(key_store_load(&ks, path) == -1, "DevAddr given twice refused");
+    write_file(path, "{\"devices\": []}");
+    CHECK(key_store_load(&ks, path) == 0, "empty key file");
+    key_store_free(&ks);
+    CHECK(key_store_load(&ks, "/nonexistent/keys.json") == -1, "missing key file");
+
+    /* time per packet, a busy site with BENCH_DEVICES known devices */
+    big = malloc(BENCH_DEVICES * 128 + 32);
+    len = (size_t)sprintf(big, "{\"devices\": [");
+    for (i = 0; i < BENCH_DEVICES; i++) {
+        len += (size_t)sprintf(&big[len], "%s{\"DevAddr\": \"%08X\", \"NwkSKey\": \"%032X\", \"AppSKey\": \"%032X\"}",
+                               (i > 0) ? "," : "", 0x26000000U + (unsigned)i * 7919U, (unsigned)i, (unsigned)i + 1);
+    }
+    sprintf(&big[len], "]}");
+    write_file(path, big);
+    free(big);
+    CHECK(key_store_load(&ks, path) == BENCH_DEVICES, "benchmark key file");
+    ks.keep_data = true;
+    e = key_store_find(&ks, 0x26000000U + 500U * 7919U);
+    memset(plain, 0x5A, sizeof plain);
+    make_frame(&pkt, e, 0x40, 42, 10, plain, sizeof plain);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (n = 0; n < BENCH_PACKETS; n++) {
+        ed_report_write(&report, &pkt, &fetch_time);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_write = elapsed_ns(&t0, &t1) / BENCH_PACKETS;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (n = 0; n < BENCH_PACKETS; n++) {
+        ed_report_write(&report, &pkt, &fetch_time);
+        key_store_process(&ks, &pkt, &report);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_key = elapsed_ns(&t0, &t1) / BENCH_PACKETS - ns_write;
+    CHECK(report.mic == ED_MIC_OK && report.datalen == BENCH_PAYLOAD, "benchmark frames checked");
+
+    printf("Per packet, %d devices, %d bytes payload: ed_report_write %.0f ns, key_store_process %.0f ns\n",
+           BENCH_DEVICES, BENCH_PAYLOAD, ns_write, ns_key);
+
+    key_store_free(&ks);
+    unlink(path);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
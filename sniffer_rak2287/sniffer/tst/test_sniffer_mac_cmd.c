@@ -0,0 +1,292 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Check the MAC command parser on known uplink and downlink FOpts, on
+    truncated frames, unknown CIDs and full output arrays, then fuzz it with
+    random buffers against an independent table of command lengths: every
+    split must stay within the buffer and agree with the specification.
+    The cost of decoding a FOpts field is timed on a mix of common commands.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memcpy strcmp */
+#include <time.h>       /* clock_gettime */
+
+#include "mac_cmd.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_FUZZ             2000000     /* random buffers parsed */
+#define FUZZ_LEN_MAX        64          /* longest random buffer, a port 0 FRMPayload can be longer than FOpts */
+#define BENCH_FOPTS         5000000     /* FOpts fields per timed run */
+#define MAX_CMDS            15
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+/* payload lengths from the LoRaWAN 1.1 and 1.0.4 specifications, -1 for an unknown CID */
+static const int8_t spec_len_down[MAC_CID_NB] = {
+    -1, 1, 2, 4, 1, 4, 0, 5, 1, 1, 4, 1, 1, 5, 2, 1,
+     0, 4, 3, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     1
+};
+static const int8_t spec_len_up[MAC_CID_NB] = {
+    -1, 1, 0, 1, 0, 1, 2, 1, 0, 0, 1, 1, 0, 0, -1, 1,
+     1, 1, 0, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     1
+};
+
+/* FOpts seen on a busy network */
+static const struct {
+    bool uplink;
+    uint8_t len;
+    uint8_t fopts[15];
+} bench_fopts[] = {
+    {true,  1, {0x02}},                                                 /* LinkCheckReq */
+    {true,  2, {0x03, 0x07}},                                           /* LinkADRAns */
+    {true,  5, {0x03, 0x07, 0x06, 0xFF, 0x0A}},                         /* LinkADRAns, DevStatusAns */
+    {true,  4, {0x05, 0x07, 0x08, 0x0D}},                               /* RXParamSetupAns, RXTimingSetupAns, DeviceTimeReq */
+    {false, 5, {0x03, 0x51, 0xFF, 0x00, 0x01}},                         /* LinkADRReq */
+    {false, 9, {0x06, 0x07, 0x03, 0x18, 0x4F, 0x84, 0x50, 0x04, 0x03}}, /* DevStatusReq, NewChannelReq, DutyCycleReq */
+    {false, 6, {0x0D, 0x10, 0x32, 0x54, 0x76, 0x80}},                   /* DeviceTimeAns */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* xorshift64*, reproducible from one run to the next */
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/**
+ * Check one parse result against the specification lengths.
+ *
+ * @return  true if the split and the status are the expected ones
+*/
+static bool check_split(const uint8_t *buf, size_t len, bool uplink, const mac_cmd_t *cmds, int nb, int max, uint8_t status) {
+
+    const int8_t *spec_len = uplink ? spec_len_up : spec_len_down;
+    size_t pos = 0;
+    int i, l;
+
+    if (nb < 0 || nb > max) {
+        return false;
+    }
+
+    for (i = 0; i < nb; i++) {
+        if (pos >= len || buf[pos] >= MAC_CID_NB) {
+            return false;
+        }
+        l = spec_len[buf[pos]];
+        if (l < 0 || cmds[i].cid != buf[pos] || cmds[i].len != l || cmds[i].uplink != uplink || pos + 1 + l > len) {
+            return false;
+        }
+        if (mac_cmd_name(cmds[i].cid, uplink) == NULL) {
+            return false;
+        }
+        pos += 1 + l;
+    }
+
+    /* why it stopped there */
+    switch (status) {
+        case MAC_CMD_OK:
+            return pos == len;
+        case MAC_CMD_UNKNOWN:
+            return pos < len && (buf[pos] >= MAC_CID_NB || spec_len[buf[pos]] < 0);
+        case MAC_CMD_TRUNCATED:
+            return pos < len && buf[pos] < MAC_CID_NB && spec_len[buf[pos]] >= 0 && pos + 1 + spec_len[buf[pos]] > len;
+        case MAC_CMD_TOO_MANY:
+            return pos < len && nb == max;
+        default:
+            return false;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    int n, nb, max, bad;
+    unsigned long i, nb_cmds, by_status[4] = {0, 0, 0, 0};
+    size_t len;
+    uint64_t r;
+    bool uplink;
+    uint8_t status;
+    /* random buffers are written at the end, a read past them leaves the array */
+    uint8_t fuzz[FUZZ_LEN_MAX];
+    uint8_t *buf;
+    mac_cmd_t cmds[MAX_CMDS];
+    char names[MAX_CMDS * MAC_CMD_NAME_MAX];
+    struct timespec t0, t1;
+    double ns;
+
+    /* uplink: LinkADRAns, DevStatusAns, RXParamSetupAns, DlChannelAns, ResetInd */
+    {
+        const uint8_t fopts[] = {0x03, 0x06, 0x06, 0x00, 0x1F, 0x05, 0x05, 0x0A, 0x03, 0x01, 0x01};
+        nb = mac_cmd_parse(fopts, sizeof fopts, true, cmds, MAX_CMDS, &status);
+        CHECK(nb == 5 && status == MAC_CMD_OK, "uplink FOpts split");
+        CHECK(!cmds[0].u.link_adr_ans.ch_mask_ack && cmds[0].u.link_adr_ans.datarate_ack && cmds[0].u.link_adr_ans.power_ack, "LinkADRAns");
+        CHECK(cmds[1].u.dev_status_ans.battery == 0 && cmds[1].u.dev_status_ans.margin == 31, "DevStatusAns");
+        CHECK(cmds[2].u.rx_param_setup_ans.rx1_dr_offset_ack && !cmds[2].u.rx_param_setup_ans.rx2_datarate_ack &&
+              cmds[2].u.rx_param_setup_ans.channel_ack, "RXParamSetupAns");
+        CHECK(cmds[3].u.dl_channel_ans.uplink_freq_exists && cmds[3].u.dl_channel_ans.channel_freq_ok, "DlChannelAns");
+        CHECK(cmds[4].cid == MAC_CID_RESET && cmds[4].u.minor == 1, "ResetInd");
+        CHECK(mac_cmd_list(cmds, nb, names, sizeof names) > 0 &&
+              strcmp(names, "LinkADRAns,DevStatusAns,RXParamSetupAns,DlChannelAns,ResetInd") == 0, "command names");
+    }
+
+    /* downlink: LinkADRReq, DutyCycleReq, RXParamSetupReq, NewChannelReq, RXTimingSetupReq, TxParamSetupReq, DeviceTimeAns, LinkCheckAns */
+    {
+        const uint8_t fopts[] = {0x03, 0x52, 0x07, 0x00, 0x61, 0x04, 0x03, 0x05, 0x32, 0xD2, 0xAD, 0x84};
+        const uint8_t fopts2[] = {0x07, 0x03, 0x18, 0x4F, 0x84, 0x50, 0x08, 0x0F, 0x09, 0x1B};
+        const uint8_t fopts3[] = {0x0D, 0x10, 0x32, 0x54, 0x76, 0x80, 0x02, 0x14, 0x03};
+        nb = mac_cmd_parse(fopts, sizeof fopts, false, cmds, MAX_CMDS, &status);
+        CHECK(nb == 3 && status == MAC_CMD_OK, "downlink FOpts split");
+        CHECK(cmds[0].u.link_adr_req.datarate == 5 && cmds[0].u.link_adr_req.tx_power == 2 && cmds[0].u.link_adr_req.ch_mask == 0x0007 &&
+              cmds[0].u.link_adr_req.ch_mask_cntl == 6 && cmds[0].u.link_adr_req.nb_trans == 1, "LinkADRReq");
+        CHECK(cmds[1].u.duty_cycle_req.max_dcycle == 3, "DutyCycleReq");
+        CHECK(cmds[2].u.rx_param_setup_req.rx1_dr_offset == 3 && cmds[2].u.rx_param_setup_req.rx2_datarate == 2 &&
+              cmds[2].u.rx_param_setup_req.freq_hz == 869525000U, "RXParamSetupReq");
+        nb = mac_cmd_parse(fopts2, sizeof fopts2, false, cmds, MAX_CMDS, &status);
+        CHECK(nb == 3 && status == MAC_CMD_OK, "downlink FOpts split");
+        CHECK(cmds[0].u.new_channel_req.ch_index == 3 && cmds[0].u.new_channel_req.freq_hz == 867100000U &&
+              cmds[0].u.new_channel_req.min_dr == 0 && cmds[0].u.new_channel_req.max_dr == 5, "NewChannelReq");
+        CHECK(cmds[1].u.rx_timing_setup_req.delay == 15, "RXTimingSetupReq");
+        CHECK(!cmds[2].u.tx_param_setup_req.downlink_dwell && cmds[2].u.tx_param_setup_req.uplink_dwell &&
+              cmds[2].u.tx_param_setup_req.max_eirp == 11, "TxParamSetupReq");
+        nb = mac_cmd_parse(fopts3, sizeof fopts3, false, cmds, MAX_CMDS, &status);
+        CHECK(nb == 2 && status == MAC_CMD_OK, "downlink FOpts split");
+        CHECK(cmds[0].u.device_time_ans.seconds == 0x76543210U && cmds[0].u.device_time_ans.fraction == 0x80, "DeviceTimeAns");
+        CHECK(cmds[1].u.link_check_ans.margin == 20 && cmds[1].u.link_check_ans.gw_cnt == 3, "LinkCheckAns");
+    }
+
+    /* same CID, other direction */
+    {
+        const uint8_t fopts[] = {0x06};
+        CHECK(mac_cmd_parse(fopts, 1, false, cmds, MAX_CMDS, &status) == 1 && status == MAC_CMD_OK, "DevStatusReq has no payload");
+        CHECK(mac_cmd_parse(fopts, 1, true, cmds, MAX_CMDS, &status) == 0 && status == MAC_CMD_TRUNCATED, "DevStatusAns truncated");
+        CHECK(strcmp(mac_cmd_name(MAC_CID_DEV_STATUS, true), "DevStatusAns") == 0 &&
+              strcmp(mac_cmd_name(MAC_CID_DEV_STATUS, false), "DevStatusReq") == 0, "names by direction");
+        CHECK(mac_cmd_name(MAC_CID_FORCE_REJOIN, true) == NULL && mac_cmd_name(0x80, false) == NULL, "no name for unknown commands");
+    }
+
+    /* stops */
+    {
+        const uint8_t fopts[] = {0x02, 0x80, 0x03, 0x07};
+        const uint8_t trunc[] = {0x02, 0x03, 0x52, 0x07};
+        const uint8_t many[] = {0x02, 0x02, 0x02, 0x02};
+        nb = mac_cmd_parse(fopts, sizeof fopts, true, cmds, MAX_CMDS, &status);
+        CHECK(nb == 1 && status == MAC_CMD_UNKNOWN && strcmp(mac_cmd_status_str(status), "unknown") == 0, "proprietary CID stops the split");
+        nb = mac_cmd_parse(trunc, sizeof trunc, false, cmds, MAX_CMDS, &status);
+        CHECK(nb == 1 && status == MAC_CMD_TRUNCATED, "truncated LinkADRReq");
+        nb = mac_cmd_parse(many, sizeof many, true, cmds, 3, &status);
+        CHECK(nb == 3 && status == MAC_CMD_TOO_MANY, "output array full");
+        nb = mac_cmd_parse(many, 0, true, cmds, MAX_CMDS, &status);
+        CHECK(nb == 0 && status == MAC_CMD_OK, "empty FOpts");
+        CHECK(mac_cmd_list(cmds, 0, names, sizeof names) == 0 && names[0] == '\0', "empty name list");
+        nb = mac_cmd_parse(many, sizeof many, true, cmds, MAX_CMDS, &status);
+        CHECK(mac_cmd_list(cmds, nb, names, 20) == -1 && names[0] == '\0', "short name buffer refused");
+    }
+
+    /* fuzz, CIDs mostly in the known range so long valid splits happen */
+    bad = 0;
+    nb_cmds = 0;
+    for (i = 0; i < NB_FUZZ; i++) {
+        r = rng_next();
+        len = (r & 1) ? (r >> 1) % 16 : (r >> 1) % (FUZZ_LEN_MAX + 1);
+        uplink = (r >> 20) & 1;
+        max = 1 + (int)((r >> 24) % MAX_CMDS);
+        buf = &fuzz[FUZZ_LEN_MAX - len];
+        for (n = 0; n < (int)len; n++) {
+            r = rng_next();
+            buf[n] = ((r & 7) == 0) ? (uint8_t)(r >> 8) : (uint8_t)((r >> 8) % (MAC_CID_NB + 1));
+        }
+        nb = mac_cmd_parse(buf, len, uplink, cmds, max, &status);
+        if (!check_split(buf, len, uplink, cmds, nb, max, status)) {
+            if (bad == 0) {
+                printf("  len %zu, uplink %d, max %d: %d commands, status %u\n", len, uplink, max, nb, status);
+            }
+            bad++;
+        }
+        if (status < 4) {
+            by_status[status]++;
+        }
+        nb_cmds += nb;
+    }
+    printf("Fuzz, %d buffers: %lu commands, %lu ok, %lu unknown, %lu truncated, %lu too many\n",
+           NB_FUZZ, nb_cmds, by_status[MAC_CMD_OK], by_status[MAC_CMD_UNKNOWN], by_status[MAC_CMD_TRUNCATED], by_status[MAC_CMD_TOO_MANY]);
+    CHECK(bad == 0, "random buffers split as the specification says");
+    CHECK(by_status[MAC_CMD_OK] > 0 && by_status[MAC_CMD_UNKNOWN] > 0 && by_status[MAC_CMD_TRUNCATED] > 0 &&
+          by_status[MAC_CMD_TOO_MANY] > 0, "every stop reached");
+
+    /* time per FOpts field */
+    nb_cmds = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < BENCH_FOPTS; i++) {
+        n = i % (sizeof bench_fopts / sizeof bench_fopts[0]);
+        nb_cmds += mac_cmd_parse(bench_fopts[n].fopts, bench_fopts[n].len, bench_fopts[n].uplink, cmds, MAX_CMDS, &status);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = elapsed_ns(&t0, &t1) / BENCH_FOPTS;
+
+    printf("Per FOpts field, %d fields (%.2f commands each): %.1f ns\n", BENCH_FOPTS, (double)nb_cmds / BENCH_FOPTS, ns);
+    CHECK(nb_cmds > BENCH_FOPTS, "benchmark commands decoded");
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,288 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Check the Prometheus text written for samples and histograms, serve it
+    on loopback and scrape it as Prometheus would, including a scraper that
+    hangs up before the page is sent, and count from several
+    threads at once to check no update is lost. The cost of counting a
+    latency is timed.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 700
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* strstr memset */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* close read write */
+
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "metrics.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_THREADS          4           /* threads counting at once */
+#define NB_OBSERVE          250000      /* latencies counted by each thread */
+#define PAGE_LEN            65536
+#define SLOW_RENDER_MS      200         /* time to render the page of a scraper that hangs up */
+#define SLOW_SAMPLES        20000       /* samples of that page, more than the socket buffers hold */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static metrics_hist_t hist;
+static _Atomic uint64_t counter;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static int render(metrics_out_t *out, void *arg) {
+
+    (void)arg;
+
+    metrics_family(out, "test_packets_total", "counter", "Packets counted");
+    metrics_sample(out, "test_packets_total", "card=\"0\",sf=\"7\"", atomic_load(&counter));
+    metrics_family(out, "test_latency_seconds", "histogram", "Latencies counted");
+    metrics_sample_hist(out, "test_latency_seconds", "card=\"0\"", &hist);
+
+    return 0;
+}
+
+/**
+ * Render a large page slowly, so the scraper has hung up before it is sent.
+*/
+static int render_slow(metrics_out_t *out, void *arg) {
+
+    struct timespec wait = {0, SLOW_RENDER_MS * 1000000L};
+    char labels[32];
+    int i;
+
+    (void)arg;
+
+    nanosleep(&wait, NULL);
+    metrics_family(out, "test_slow_total", "counter", "Samples of a slow page");
+    for (i = 0; i < SLOW_SAMPLES; i++) {
+        snprintf(labels, sizeof labels, "n=\"%d\"", i);
+        metrics_sample(out, "test_slow_total", labels, i);
+    }
+
+    return 0;
+}
+
+static void *thread_count(void *arg) {
+
+    int i;
+
+    (void)arg;
+
+    for (i = 0; i < NB_OBSERVE; i++) {
+        metrics_hist_observe(&hist, (uint64_t)(i % 2000));
+        atomic_fetch_add_explicit(&counter, 1, memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+/**
+ * GET a path from the server, as a scraper would.
+ *
+ * @param port  Server port
+ * @param path  Path to get
+ * @param page  Response, status line included
+ * @param size  Size of the response buffer
+ * @return      Length of the response, -1 on failure
+*/
+static int scrape(uint16_t port, const char *path, char *page, size_t size) {
+
+    struct sockaddr_in addr;
+    char req[128];
+    int fd, len;
+    size_t have = 0;
+    ssize_t n;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof addr)) {
+        close(fd);
+        return -1;
+    }
+
+    len = snprintf(req, sizeof req, "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept: text/plain\r\n\r\n", path);
+    if (write(fd, req, (size_t)len) != len) {
+        close(fd);
+        return -1;
+    }
+    while (have < size - 1 && (n = read(fd, page + have, size - 1 - have)) > 0) {
+        have += (size_t)n;
+    }
+    page[have] = '\0';
+    close(fd);
+
+    return (int)have;
+}
+
+/**
+ * Send a GET and hang up while the page renders, as a scraper timing out would.
+ *
+ * @param port  Server port
+ * @return      0 on success, -1 on failure
+*/
+static int hang_up(uint16_t port) {
+
+    struct sockaddr_in addr;
+    struct timespec wait = {0, SLOW_RENDER_MS * 1000000L / 2};
+    const char req[] = "GET /metrics HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    int fd;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof addr) || write(fd, req, sizeof req - 1) != (ssize_t)(sizeof req - 1)) {
+        close(fd);
+        return -1;
+    }
+    nanosleep(&wait, NULL);
+    close(fd);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    int i;
+    static char page[PAGE_LEN];
+    metrics_out_t out;
+    metrics_server_t srv;
+    pthread_t thr[NB_THREADS];
+    struct timespec t0, t1;
+    double ns_observe;
+
+    /* text format */
+    memset(&out, 0, sizeof out);
+    memset(&hist, 0, sizeof hist);
+    metrics_hist_observe(&hist, 0);
+    metrics_hist_observe(&hist, 1);
+    metrics_hist_observe(&hist, 2);
+    metrics_hist_observe(&hist, 1500);
+    metrics_hist_observe(&hist, 20000000);
+    metrics_family(&out, "test_packets_total", "counter", "Packets counted");
+    metrics_sample(&out, "test_packets_total", NULL, 12345678901.0);
+    metrics_sample(&out, "test_packets_total", "", 0.25);
+    metrics_sample_hist(&out, "test_latency_seconds", NULL, &hist);
+    CHECK(!out.full && strstr(out.data, "# HELP test_packets_total Packets counted\n# TYPE test_packets_total counter\n") == out.data, "help and type lines");
+    CHECK(strstr(out.data, "\ntest_packets_total 12345678901\ntest_packets_total 0.25\n") != NULL, "samples without labels");
+    CHECK(strstr(out.data, "test_latency_seconds_bucket{le=\"1e-06\"} 2\ntest_latency_seconds_bucket{le=\"5e-06\"} 3\n") != NULL, "values on a bound counted in its bucket");
+    CHECK(strstr(out.data, "test_latency_seconds_bucket{le=\"0.001\"} 3\ntest_latency_seconds_bucket{le=\"0.005\"} 4\n") != NULL, "buckets cumulative");
+    CHECK(strstr(out.data, "test_latency_seconds_bucket{le=\"10\"} 4\ntest_latency_seconds_bucket{le=\"+Inf\"} 5\n") != NULL, "values above every bound in +Inf");
+    CHECK(strstr(out.data, "test_latency_seconds_sum 20.001503\ntest_latency_seconds_count 5\n") != NULL, "sum in seconds and count");
+    free(out.data);
+
+    /* counting from several threads */
+    memset(&hist, 0, sizeof hist);
+    atomic_store(&counter, 0);
+    for (i = 0; i < NB_THREADS; i++) {
+        pthread_create(&thr[i], NULL, thread_count, NULL);
+    }
+    for (i = 0; i < NB_THREADS; i++) {
+        pthread_join(thr[i], NULL);
+    }
+    CHECK(atomic_load(&counter) == NB_THREADS * NB_OBSERVE, "counter updates from every thread");
+
+    /* scrapes */
+    CHECK(metrics_server_start(&srv, "127.0.0.1", 0, render, NULL) == 0 && srv.port != 0, "server on a port picked by the kernel");
+    CHECK(scrape(srv.port, "/metrics", page, sizeof page) > 0 && strstr(page, "HTTP/1.1 200 OK\r\n") == page, "scrape answered");
+    CHECK(strstr(page, "Content-Type: " METRICS_CONTENT_TYPE "\r\n") != NULL, "Prometheus content type");
+    CHECK(strstr(page, "\ntest_packets_total{card=\"0\",sf=\"7\"} 1000000\n") != NULL, "labelled sample");
+    CHECK(strstr(page, "\ntest_latency_seconds_bucket{card=\"0\",le=\"+Inf\"} 1000000\n") != NULL &&
+          strstr(page, "\ntest_latency_seconds_count{card=\"0\"} 1000000\n") != NULL, "histogram updates from every thread");
+    CHECK(strstr(page, "\ntest_latency_seconds_bucket{card=\"0\",le=\"0.001\"} 500500\n") != NULL, "labelled histogram bucket");
+    CHECK(scrape(srv.port, "/other", page, sizeof page) > 0 && strstr(page, "HTTP/1.1 404 Not Found\r\n") == page, "other paths refused");
+    CHECK(atomic_load(&srv.scrapes) == 1, "scrapes counted");
+    metrics_server_stop(&srv);
+    CHECK(scrape(srv.port, "/metrics", page, sizeof page) < 0, "server stopped");
+    CHECK(metrics_server_start(&srv, "not an address", 0, render, NULL) != 0, "bad address refused");
+
+    /* a scraper hanging up while the page renders fails the response, not the process */
+    CHECK(metrics_server_start(&srv, "127.0.0.1", 0, render_slow, NULL) == 0, "server with a slow page");
+    CHECK(hang_up(srv.port) == 0 && hang_up(srv.port) == 0, "scrapers hung up");
+    CHECK(scrape(srv.port, "/metrics", page, sizeof page) > 0 && strstr(page, "HTTP/1.1 200 OK\r\n") == page, "next scrape answered");
+    metrics_server_stop(&srv);
+
+    /* cost of counting a latency */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < NB_OBSERVE; i++) {
+        metrics_hist_observe(&hist, (uint64_t)(i & 0x3FFF));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_observe = elapsed_ns(&t0, &t1) / NB_OBSERVE;
+    printf("Latency counted in %.1f ns\n", ns_observe);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
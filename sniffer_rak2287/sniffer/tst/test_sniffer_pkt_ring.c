@@ -0,0 +1,240 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Description:
+    Check the packet ring: capacity rounding and limits, write spans that
+    stop at the end of the slots, commit, peek and release across the wrap
+    (free running indexes included), pushes into a full ring counted as
+    overflow, and the high water mark. Then a listener thread fills the ring
+    in batches of random size while an encoder thread drains it: every
+    packet must come out once, intact and in order.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memset */
+#include <sched.h>      /* sched_yield */
+
+#include <pthread.h>
+
+#include "pkt_ring.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define RING_CAPACITY       6           /* rounded up to 8 slots */
+#define RUN_CAPACITY        64          /* slots of the two thread run */
+#define RUN_PACKETS         2000000     /* packets through the two thread run */
+#define RUN_BATCH_MAX       16          /* most packets filled in one span by the listener */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* xorshift64*, reproducible from one run to the next */
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* a packet carrying its number, in count_us and in its payload */
+static void fill_pkt(struct lgw_pkt_rx_s *p, uint32_t n) {
+
+    p->count_us = n;
+    p->size = 4;
+    p->payload[0] = (uint8_t)n;
+    p->payload[1] = (uint8_t)(n >> 8);
+    p->payload[2] = (uint8_t)(n >> 16);
+    p->payload[3] = (uint8_t)(n >> 24);
+}
+
+static bool pkt_is(const struct lgw_pkt_rx_s *p, uint32_t n) {
+
+    return p != NULL && p->count_us == n && p->size == 4 && p->payload[0] == (uint8_t)n && p->payload[1] == (uint8_t)(n >> 8) &&
+           p->payload[2] == (uint8_t)(n >> 16) && p->payload[3] == (uint8_t)(n >> 24);
+}
+
+/* listener side of the two thread run */
+static void *thread_listener(void *arg) {
+
+    pkt_ring_t *r = arg;
+    struct lgw_pkt_rx_s *slots;
+    uint32_t n = 0, span, nb, i;
+
+    while (n < RUN_PACKETS) {
+        span = pkt_ring_write_span(r, &slots);
+        if (span == 0) {
+            sched_yield();
+            continue;
+        }
+        nb = 1 + (uint32_t)(rng_next() % RUN_BATCH_MAX);
+        nb = (nb < span) ? nb : span;
+        nb = (nb < RUN_PACKETS - n) ? nb : RUN_PACKETS - n;
+        for (i = 0; i < nb; i++) {
+            fill_pkt(&slots[i], n++);
+        }
+        pkt_ring_commit(r, nb);
+    }
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    pkt_ring_t r;
+    struct lgw_pkt_rx_s pkt, *slots, *p;
+    pthread_t thrid;
+    uint32_t span, n, i, expected, bad;
+    bool ok;
+
+    /* capacity */
+    CHECK(pkt_ring_init(&r, 0) == -1, "empty ring refused");
+    CHECK(pkt_ring_init(&r, (1U << 20) + 1) == -1, "ring past the size limit refused");
+    CHECK(pkt_ring_init(&r, 1U << 20) == 0 && r.size == (1U << 20), "ring at the size limit");
+    pkt_ring_free(&r);
+    CHECK(pkt_ring_init(&r, 8) == 0 && r.size == 8 && r.mask == 7, "power of two kept");
+    pkt_ring_free(&r);
+    CHECK(pkt_ring_init(&r, RING_CAPACITY) == 0 && r.size == 8 && r.mask == 7, "capacity rounded up to a power of two");
+    CHECK(pkt_ring_peek(&r) == NULL && pkt_ring_count(&r) == 0, "new ring empty");
+
+    /* spans stop at the end of the slots */
+    span = pkt_ring_write_span(&r, &slots);
+    CHECK(span == 8 && slots == &r.slots[0], "whole ring free");
+    for (i = 0; i < 5; i++) {
+        fill_pkt(&slots[i], i);
+    }
+    pkt_ring_commit(&r, 5);
+    CHECK(pkt_ring_count(&r) == 5 && r.high_water == 5, "five packets committed");
+    span = pkt_ring_write_span(&r, &slots);
+    CHECK(span == 3 && slots == &r.slots[5], "span up to the end of the slots");
+    ok = true;
+    for (i = 0; i < 3; i++) {
+        ok = ok && pkt_is(pkt_ring_peek(&r), i);
+        pkt_ring_release(&r);
+    }
+    CHECK(ok && pkt_ring_count(&r) == 2, "packets read in order");
+    span = pkt_ring_write_span(&r, &slots);
+    CHECK(span == 3 && slots == &r.slots[5], "span still stops at the wrap with the start free");
+    for (i = 0; i < 3; i++) {
+        fill_pkt(&slots[i], 5 + i);
+    }
+    pkt_ring_commit(&r, 3);
+    span = pkt_ring_write_span(&r, &slots);
+    CHECK(span == 3 && slots == &r.slots[0], "next span from the start of the slots");
+    for (i = 0; i < 2; i++) {
+        fill_pkt(&slots[i], 8 + i);
+    }
+    pkt_ring_commit(&r, 2);
+    CHECK(pkt_ring_count(&r) == 7 && r.high_water == 7, "high water mark follows the fill level");
+
+    /* full ring */
+    fill_pkt(&pkt, 10);
+    CHECK(pkt_ring_push(&r, &pkt) == 0 && pkt_ring_count(&r) == 8 && r.high_water == 8, "ring filled by a push");
+    span = pkt_ring_write_span(&r, &slots);
+    CHECK(span == 0, "no span in a full ring");
+    fill_pkt(&pkt, 11);
+    CHECK(pkt_ring_push(&r, &pkt) == -1 && pkt_ring_push(&r, &pkt) == -1 && r.overflow == 2, "pushes into a full ring counted as overflow");
+    pkt_ring_drop(&r, 3);
+    CHECK(r.overflow == 5, "packets dropped by the listener counted");
+
+    /* read across the wrap */
+    ok = true;
+    for (n = 3; n <= 10; n++) {
+        ok = ok && pkt_is(pkt_ring_peek(&r), n);
+        pkt_ring_release(&r);
+    }
+    CHECK(ok, "packets read in order across the wrap");
+    CHECK(pkt_ring_peek(&r) == NULL && pkt_ring_count(&r) == 0, "ring drained");
+    CHECK(r.high_water == 8 && r.overflow == 5, "high water mark and overflow kept once drained");
+    pkt_ring_free(&r);
+    CHECK(r.slots == NULL && r.size == 0, "ring freed");
+
+    /* free running indexes wrapping past 2^32 */
+    pkt_ring_init(&r, RING_CAPACITY);
+    atomic_store(&r.head, UINT32_MAX - 2);
+    atomic_store(&r.tail, UINT32_MAX - 2);
+    ok = true;
+    for (n = 0; n < 20; n++) {
+        ok = ok && (pkt_ring_count(&r) == 0);
+        fill_pkt(&pkt, n);
+        ok = ok && (pkt_ring_push(&r, &pkt) == 0) && (pkt_ring_count(&r) == 1) && pkt_is(pkt_ring_peek(&r), n);
+        pkt_ring_release(&r);
+    }
+    CHECK(ok && pkt_ring_peek(&r) == NULL && r.overflow == 0, "indexes wrap past 2^32");
+    pkt_ring_free(&r);
+
+    /* listener and encoder threads */
+    pkt_ring_init(&r, RUN_CAPACITY);
+    pthread_create(&thrid, NULL, thread_listener, &r);
+    expected = 0;
+    bad = 0;
+    while (expected < RUN_PACKETS) {
+        p = pkt_ring_peek(&r);
+        if (p == NULL) {
+            sched_yield();
+            continue;
+        }
+        bad += pkt_is(p, expected) ? 0 : 1;
+        expected++;
+        pkt_ring_release(&r);
+    }
+    pthread_join(thrid, NULL);
+    printf("INFO: %d packets through %u slots, high water %u\n", RUN_PACKETS, r.size, (unsigned)r.high_water);
+    CHECK(bad == 0, "every packet read once, intact and in order");
+    CHECK(pkt_ring_peek(&r) == NULL && r.overflow == 0, "nothing left over, nothing dropped");
+    CHECK(r.high_water <= r.size, "high water mark within the ring");
+    pkt_ring_free(&r);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
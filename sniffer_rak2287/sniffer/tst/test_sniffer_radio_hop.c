@@ -0,0 +1,246 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Description:
+    Check the radio group hopping schedule, then survey a simulated AU915 site
+    with one card: eight radio groups, each with its own Poisson packet source,
+    and a retune costing the time to stop and start the concentrator. Fixed
+    and traffic weighted dwells are compared on packets heard, time spent on
+    each group and the longest time a group went unheard.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+
+#include "radio_hop.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SIM_DURATION_US     (3600ULL * 1000000) /* simulated survey */
+#define SIM_TICK_US         10000       /* time step of the survey */
+#define SIM_RETUNE_US       40000       /* lgw_stop, lgw_rxrf_setconf and lgw_start of a retune */
+#define SIM_GROUPS          8           /* AU915 sub-bands, one radio group each */
+#define SIM_DWELL_MS        10000
+#define SIM_DWELL_MIN_MS    2000
+#define SIM_DWELL_MAX_MS    60000
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* outcome of one simulated survey */
+typedef struct sim_result_s {
+    uint64_t sent;                      /* packets sent on every sub-band */
+    uint64_t heard;                     /* packets sent on the group listened to */
+    radio_hop_stats_t stats;
+} sim_result_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* packets per second on each sub-band: a busy network on sub-band 2, some on 6, a little elsewhere */
+static const double sim_rate[SIM_GROUPS] = {0.05, 2.0, 8.0, 0.0, 0.1, 0.5, 0.02, 0.0};
+
+static uint64_t sim_seed;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/**
+ * xorshift64*, uniform in [0, 1).
+*/
+static double sim_uniform(void) {
+
+    sim_seed ^= sim_seed >> 12;
+    sim_seed ^= sim_seed << 25;
+    sim_seed ^= sim_seed >> 27;
+
+    return ((sim_seed * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Run the hopping thread and the listener against the simulated site.
+ *
+ * @param mode  RADIO_HOP_FIXED or RADIO_HOP_TRAFFIC
+ * @return      Outcome of the survey
+*/
+static sim_result_t sim_run(int mode) {
+
+    sim_result_t r = {0};
+    radio_hop_t h;
+    uint64_t t = 0, retune_end = 0;
+    int g, next;
+
+    sim_seed = 0x9E3779B97F4A7C15ULL;
+    radio_hop_init(&h, SIM_GROUPS, 0, mode, SIM_DWELL_MS, SIM_DWELL_MIN_MS, SIM_DWELL_MAX_MS, 0);
+
+    for (t = 0; t < SIM_DURATION_US; t += SIM_TICK_US) {
+        /* packets of the tick, heard only on the tuned group outside a retune */
+        for (g = 0; g < SIM_GROUPS; g++) {
+            if (sim_uniform() < sim_rate[g] * SIM_TICK_US / 1e6) {
+                r.sent++;
+                if (g == atomic_load(&h.current) && t >= retune_end) {
+                    radio_hop_count(&h, g, 1);
+                    r.heard++;
+                }
+            }
+        }
+
+        next = radio_hop_next(&h, t);
+        if (next >= 0) {
+            retune_end = t + SIM_RETUNE_US;
+            radio_hop_tuned(&h, next, t, retune_end);
+        }
+    }
+
+    radio_hop_stats(&h, t, &r.stats);
+
+    return r;
+}
+
+/**
+ * Print one survey.
+*/
+static void sim_print(const char *name, const sim_result_t *r) {
+
+    int g;
+    double elapsed = r->stats.elapsed_us / 1e6;
+
+    printf("  %-8s heard %llu of %llu packets (%.1f%%), %llu hops, %.1fs retuning (%.2f%%)\n", name,
+            (unsigned long long)r->heard, (unsigned long long)r->sent, 100.0 * r->heard / r->sent,
+            (unsigned long long)r->stats.hops, r->stats.dead_us / 1e6, r->stats.dead_us / 1e4 / elapsed);
+    for (g = 0; g < r->stats.nb_groups; g++) {
+        printf("    group %d %5.2f pkt/s: %5.1f%% of the time, %4llu packets, unheard for %5.1fs at most\n", g, sim_rate[g],
+                100.0 * r->stats.listen_us[g] / r->stats.elapsed_us, (unsigned long long)r->stats.packets[g], r->stats.gap_max_us[g] / 1e6);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    radio_hop_t h;
+    radio_hop_stats_t s;
+    sim_result_t fixed, traffic;
+    uint64_t gap_bound;
+    int g;
+    bool ok;
+
+    /* parameters */
+    CHECK(radio_hop_init(&h, 0, 0, RADIO_HOP_FIXED, 1000, 100, 2000, 0) == -1, "no radio group refused");
+    CHECK(radio_hop_init(&h, RADIO_HOP_MAX_GROUPS + 1, 0, RADIO_HOP_FIXED, 1000, 100, 2000, 0) == -1, "too many radio groups refused");
+    CHECK(radio_hop_init(&h, 2, 2, RADIO_HOP_FIXED, 1000, 100, 2000, 0) == -1, "first group out of range refused");
+    CHECK(radio_hop_init(&h, 2, 0, 2, 1000, 100, 2000, 0) == -1, "unknown dwell mode refused");
+    CHECK(radio_hop_init(&h, 2, 0, RADIO_HOP_TRAFFIC, 1000, 3000, 2000, 0) == -1, "dwell floor above the ceiling refused");
+
+    /* one group: nowhere to go */
+    radio_hop_init(&h, 1, 0, RADIO_HOP_FIXED, 1000, 100, 2000, 0);
+    CHECK(radio_hop_next(&h, 10000000) == -1, "single group never left");
+
+    /* fixed dwell, in turn from the first group */
+    radio_hop_init(&h, 3, 1, RADIO_HOP_FIXED, 1000, 100, 2000, 0);
+    CHECK(radio_hop_next(&h, 999999) == -1, "group kept until its dwell is over");
+    CHECK(radio_hop_next(&h, 1000000) == 2, "next group in turn once the dwell is over");
+    radio_hop_count(&h, 1, 5);
+    radio_hop_tuned(&h, 2, 1000000, 1050000);
+    CHECK(radio_hop_next(&h, 2049999) == -1 && radio_hop_next(&h, 2050000) == 0, "dwell counted from the end of the retune, groups wrap around");
+    radio_hop_tuned(&h, 0, 2050000, 2100000);
+    radio_hop_count(&h, 0, 3);
+    radio_hop_stats(&h, 2600000, &s);
+    CHECK(s.current == 0 && s.covered == 3 && s.hops == 2 && s.dead_us == 100000, "current group, coverage, hops and dead time");
+    CHECK(s.listen_us[1] == 1000000 && s.listen_us[2] == 1000000 && s.listen_us[0] == 500000, "time heard per group, visit in progress included");
+    CHECK(s.visits[1] == 1 && s.visits[2] == 1 && s.visits[0] == 0, "visits counted when they end");
+    CHECK(s.packets[1] == 5 && s.packets[0] == 3 && s.packets[2] == 0, "packets per group");
+    CHECK(s.gap_max_us[2] == 1050000 && s.gap_max_us[0] == 2100000, "groups unheard from the start until their first visit");
+    radio_hop_count(&h, 3, 1);
+    radio_hop_stats(&h, 2600000, &s);
+    CHECK(s.packets[0] == 3 && s.packets[1] == 5 && s.packets[2] == 0, "packets of an unknown group ignored");
+
+    /* traffic weighted: same dwell for the first round, then shares of the traffic within the bounds */
+    radio_hop_init(&h, 3, 0, RADIO_HOP_TRAFFIC, 1000, 200, 2000, 0);
+    ok = true;
+    for (g = 0; g < 3; g++) {
+        ok = ok && (radio_hop_dwell_ms(&h, g) == 1000);
+    }
+    CHECK(ok, "traffic weighted dwell fixed until every group was heard");
+    radio_hop_count(&h, 0, 10);                     /* 10 pkt/s */
+    radio_hop_tuned(&h, 1, 1000000, 1000000);
+    radio_hop_count(&h, 1, 40);                     /* 40 pkt/s */
+    radio_hop_tuned(&h, 2, 2000000, 2000000);
+    CHECK(radio_hop_dwell_ms(&h, 2) == 1000, "last group of the first round gets the fixed dwell");
+    radio_hop_tuned(&h, 0, 3000000, 3000000);       /* silent */
+    CHECK(radio_hop_dwell_ms(&h, 0) > 550 && radio_hop_dwell_ms(&h, 0) < 650, "dwell proportional to the traffic");
+    CHECK(radio_hop_dwell_ms(&h, 1) == 2000, "busiest group held to the dwell ceiling");
+    CHECK(radio_hop_dwell_ms(&h, 2) == 200, "silent group kept at the dwell floor");
+
+    /* survey of the simulated site */
+    printf("Simulated AU915 survey, %d groups, %.0fs, %dus per retune:\n", SIM_GROUPS, SIM_DURATION_US / 1e6, SIM_RETUNE_US);
+    fixed = sim_run(RADIO_HOP_FIXED);
+    traffic = sim_run(RADIO_HOP_TRAFFIC);
+    sim_print("fixed", &fixed);
+    sim_print("traffic", &traffic);
+
+    CHECK(fixed.stats.covered == SIM_GROUPS && traffic.stats.covered == SIM_GROUPS, "every group surveyed");
+    ok = true;
+    for (g = 0; g < SIM_GROUPS; g++) {
+        ok = ok && (fixed.stats.packets[g] <= fixed.heard) && (fixed.stats.visits[g] > 0);
+        ok = ok && (fixed.stats.gap_max_us[g] <= (uint64_t)(SIM_GROUPS - 1) * (SIM_DWELL_MS * 1000 + SIM_RETUNE_US) + SIM_RETUNE_US + SIM_TICK_US);
+    }
+    CHECK(ok, "fixed dwell: each group revisited within one round");
+    gap_bound = (uint64_t)(SIM_GROUPS - 1) * (SIM_DWELL_MAX_MS * 1000 + SIM_RETUNE_US) + SIM_RETUNE_US + SIM_TICK_US;
+    ok = true;
+    for (g = 0; g < SIM_GROUPS; g++) {
+        ok = ok && (traffic.stats.gap_max_us[g] <= gap_bound) && (traffic.stats.visits[g] > 0);
+    }
+    CHECK(ok, "traffic weighted dwell: each group revisited within a round of ceilings");
+    CHECK(fixed.stats.dead_us < fixed.stats.elapsed_us / 100, "fixed dwell: under 1% of the time lost retuning");
+    CHECK(traffic.stats.listen_us[2] > 4 * fixed.stats.listen_us[2], "traffic weighted dwell: busiest group heard at least 4 times longer");
+    CHECK(traffic.heard > 3 * fixed.heard, "traffic weighted dwell: at least 3 times more packets heard");
+    CHECK(traffic.stats.listen_us[3] >= (uint64_t)traffic.stats.visits[3] * SIM_DWELL_MIN_MS * 1000, "traffic weighted dwell: silent groups still get the floor");
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,219 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Write a capture with known count_us and fetch times, then check the
+    replay schedule: count_us spacing within a concentrator, wrap of the
+    counter, placement of a second concentrator, resync on a concentrator
+    restart, scaling by the replay speed and no pacing at maximum speed.
+    The cost of handing out a replayed record is timed.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf remove */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memset */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getpid */
+
+#include "loragw_hal.h"
+#include "capture.h"
+#include "replay.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define T0_NS               1700000000000000000ULL  /* fetch time of the first record */
+#define NB_SCHED            8           /* records of the schedule capture */
+#define BENCH_RECORDS       200000      /* records per timed run */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* one record of the schedule capture and when it must be due at 1x */
+struct sched_s {
+    uint8_t card;
+    uint64_t fetch_us;                  /* fetch time from T0_NS */
+    uint32_t count_us;
+    uint64_t due_us;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const struct sched_s sched[NB_SCHED] = {
+    {0,       0, 0xFFFF0000,       0},  /* first packet */
+    {0,    1500, 0xFFFF1000,    4096},  /* spaced by count_us, not by the fetch time */
+    {1,    2000,      50000,    4096},  /* other card placed by its fetch time, schedule never goes back */
+    {0,   70000,     0x1000,   69632},  /* count_us wrapped */
+    {1,   71000,     120000,   72000},  /* 70 ms of count_us after its previous one */
+    {0,   72000,     0x0F00,   72000},  /* fetched after, slightly earlier on the counter */
+    {0, 5072000,        100, 5069376},  /* concentrator restarted: count_us went back, fetch time wins */
+    {1, 5100000,    5148000, 5100000},  /* 5028 ms of count_us, confirmed by the wall clock */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static int write_sched(const char *prefix) {
+
+    int i;
+    capture_writer_t cw;
+    struct lgw_pkt_rx_s p;
+
+    if (capture_open(&cw, prefix, 0, 0, 0) != 0) {
+        return -1;
+    }
+    memset(&p, 0, sizeof p);
+    p.status = STAT_CRC_OK;
+    p.modulation = MOD_LORA;
+    p.datarate = DR_LORA_SF7;
+    p.size = 12;
+    for (i = 0; i < NB_SCHED; i++) {
+        p.count_us = sched[i].count_us;
+        p.payload[0] = (uint8_t)i;
+        capture_write(&cw, sched[i].card, T0_NS + sched[i].fetch_us * 1000, &p);
+    }
+    capture_close(&cw);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    int i, n;
+    bool ok;
+    char prefix[CAPTURE_PREFIX_LEN];
+    char name[CAPTURE_NAME_LEN];
+    replay_t rp;
+    capture_rec_t rec;
+    capture_writer_t cw;
+    struct lgw_pkt_rx_s p;
+    uint64_t due_us, last_us;
+    struct timespec t0, t1;
+    double ns_next;
+
+    snprintf(prefix, sizeof prefix, "/tmp/test_replay_%d", (int)getpid());
+    snprintf(name, sizeof name, "%s%s", prefix, CAPTURE_SUFFIX);
+
+    /* schedule at real time */
+    CHECK(write_sched(prefix) == 0, "write schedule capture");
+    CHECK(replay_open(&rp, name, 1.0) == 0, "open capture for replay");
+    ok = true;
+    n = 0;
+    while (replay_next(&rp, &rec, &due_us) == 1) {
+        if (n >= NB_SCHED || rec.pkt.payload[0] != n || due_us != sched[n].due_us) {
+            printf("record %d: due %llu us\n", n, (unsigned long long)due_us);
+            ok = false;
+        }
+        n++;
+    }
+    CHECK(ok && n == NB_SCHED, "real time schedule");
+    CHECK(rp.resyncs == 1, "one count_us resync");
+    CHECK(rp.capture_us == sched[NB_SCHED - 1].due_us, "capture duration");
+    replay_close(&rp);
+
+    /* 10 times faster */
+    replay_open(&rp, name, 10.0);
+    ok = true;
+    n = 0;
+    while (replay_next(&rp, &rec, &due_us) == 1) {
+        ok = ok && (due_us == sched[n].due_us / 10);
+        n++;
+    }
+    CHECK(ok && n == NB_SCHED, "schedule at 10x");
+    replay_close(&rp);
+
+    /* no pacing */
+    replay_open(&rp, name, REPLAY_SPEED_MAX);
+    ok = true;
+    n = 0;
+    while (replay_next(&rp, &rec, &due_us) == 1) {
+        ok = ok && (due_us == 0);
+        n++;
+    }
+    CHECK(ok && n == NB_SCHED && rp.packets == NB_SCHED, "nothing due later at maximum speed");
+    replay_close(&rp);
+
+    CHECK(replay_open(&rp, "/tmp/test_replay_missing.lgwcap", 1.0) != 0, "missing capture refused");
+    remove(name);
+
+    /* handing out records, one packet every ms on 4 cards */
+    capture_open(&cw, prefix, 0, 0, 0);
+    memset(&p, 0, sizeof p);
+    p.size = 23;
+    for (i = 0; i < BENCH_RECORDS; i++) {
+        p.count_us = (uint32_t)(i * 1000);
+        capture_write(&cw, (uint8_t)(i % 4), T0_NS + (uint64_t)i * 1000000, &p);
+    }
+    capture_close(&cw);
+
+    replay_open(&rp, name, 1.0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    n = 0;
+    ok = true;
+    last_us = 0;
+    while (replay_next(&rp, &rec, &due_us) == 1) {
+        ok = ok && (due_us >= last_us);
+        last_us = due_us;
+        n++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_next = elapsed_ns(&t0, &t1) / BENCH_RECORDS;
+    replay_close(&rp);
+
+    printf("Replay of %d records: %.0f ns per record, %.3f s of capture\n", n, ns_next, last_us / 1e6);
+    CHECK(n == BENCH_RECORDS && ok, "timed records in order");
+    CHECK(last_us == (uint64_t)(BENCH_RECORDS - 1) * 1000, "timed capture duration");
+    remove(name);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,407 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Check the binary report encoding: every kind of report read back by the
+    reference decoder gives the JSON line of the original report, records
+    start with the schema header and never hold a newline, members of a
+    later schema are skipped, another schema version, truncated and
+    corrupted records are refused, and a segment mixing JSON lines and
+    records is exported as NDJSON. Size and encoding time are compared with
+    the JSON encoder.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fopen fgets */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memcpy memset memchr strcmp */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getpid unlink */
+
+#include "loragw_hal.h"
+#include "ed_report.h"
+#include "report_cbor.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_TEST_PKTS        8
+#define NB_CORRUPT          200000      /* corrupted records fed to the decoder */
+#define BENCH_REPORTS       1000000     /* reports per timed run */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* xorshift64*, reproducible from one run to the next */
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/* radio side of a test packet, the report fields that are not in the frame */
+static void make_radio(struct lgw_pkt_rx_s *p, uint32_t dr, uint8_t status, uint32_t freq_hz) {
+
+    memset(p, 0, sizeof *p);
+    p->freq_hz = freq_hz;
+    p->status = status;
+    p->datarate = dr;
+    p->bandwidth = BW_125KHZ;
+    p->coderate = CR_LORA_4_5;
+    p->snr = -7.25;
+    p->rssis = -113.0;
+}
+
+/**
+ * Build a join request. The EUIs go on air little endian, the DevNonce and MIC
+ * hold the bytes the framing has to escape (0x00 and the 0x0A line separator).
+*/
+static void make_join(struct lgw_pkt_rx_s *p, uint64_t app_eui, uint64_t dev_eui, uint32_t dr, uint8_t status, uint32_t freq_hz) {
+
+    int i;
+
+    make_radio(p, dr, status, freq_hz);
+    p->payload[0] = 0x00;
+    for (i = 0; i < 8; i++) {
+        p->payload[1 + i] = (uint8_t)(app_eui >> (8 * i));
+        p->payload[9 + i] = (uint8_t)(dev_eui >> (8 * i));
+    }
+    memcpy(&p->payload[17], (const uint8_t[]){0x0A, 0x00, 0x0A, 0x00, 0x5C, 0x0A}, 6);
+    p->size = 23;
+}
+
+/**
+ * Build a data frame: FHDR with FOptsLen taken from fctrl, then FPort and a
+ * FRMPayload of frm_len bytes if fport is not negative, then the MIC. The
+ * FRMPayload cycles through 0x00 and 0x0A so every frame needs escaping.
+*/
+static void make_frame(struct lgw_pkt_rx_s *p, uint8_t mhdr, uint32_t devaddr, uint8_t fctrl, uint16_t fcnt, const uint8_t *fopts,
+                       int fport, uint8_t frm_len, uint32_t dr, uint8_t status, uint32_t freq_hz) {
+
+    int i, n = 0;
+
+    make_radio(p, dr, status, freq_hz);
+    p->payload[n++] = mhdr;
+    for (i = 0; i < 4; i++) {
+        p->payload[n++] = (uint8_t)(devaddr >> (8 * i));
+    }
+    p->payload[n++] = fctrl;
+    p->payload[n++] = (uint8_t)fcnt;
+    p->payload[n++] = (uint8_t)(fcnt >> 8);
+    for (i = 0; i < (fctrl & 0x0F); i++) {
+        p->payload[n++] = fopts[i];
+    }
+    if (fport >= 0) {
+        p->payload[n++] = (uint8_t)fport;
+        for (i = 0; i < frm_len; i++) {
+            p->payload[n++] = (uint8_t[]){0x00, 0x0A, 0x3C, 0xFF}[i % 4];
+        }
+    }
+    for (i = 0; i < 4; i++) {
+        p->payload[n++] = (uint8_t)(0x0A << i);
+    }
+    p->size = (uint16_t)n;
+}
+
+/* framing as a receiver would write it: COBS, then XOR 0x0A */
+static size_t frame(const uint8_t *raw, size_t len, uint8_t *out) {
+    size_t i, o = 1, code_pos = 0;
+    uint8_t code = 1;
+
+    for (i = 0; i < len; i++) {
+        if (raw[i] != 0) {
+            out[o++] = raw[i] ^ 0x0A;
+            code++;
+        }
+        if (raw[i] == 0 || code == 0xFF) {
+            out[code_pos] = code ^ 0x0A;
+            code_pos = o++;
+            code = 1;
+        }
+    }
+    out[code_pos] = code ^ 0x0A;
+    return o;
+}
+
+static size_t unframe(const uint8_t *rec, size_t len, uint8_t *out) {
+    size_t i = 0, o = 0;
+    uint8_t code, j;
+
+    while (i < len) {
+        code = rec[i++] ^ 0x0A;
+        for (j = 1; j < code && i < len; j++) {
+            out[o++] = rec[i++] ^ 0x0A;
+        }
+        if (code != 0xFF && i < len) {
+            out[o++] = 0;
+        }
+    }
+    return o;
+}
+
+/* the decoded report gives the same JSON line as the original one */
+static bool same_json(const ed_report_t *a, const ed_report_t *b) {
+    char la[ED_REPORT_JSON_MAX], lb[ED_REPORT_JSON_MAX];
+    int na, nb;
+
+    na = ed_report_encode(a, la, sizeof la);
+    nb = ed_report_encode(b, lb, sizeof lb);
+    if (na < 0 || nb < 0 || strcmp(la, lb) != 0) {
+        printf("  original: %s\n  decoded:  %s\n", la, lb);
+        return false;
+    }
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    int i, n, len, json_len;
+    bool ok, no_newline, lead;
+    struct lgw_pkt_rx_s pkts[NB_TEST_PKTS];
+    struct timespec fetch_time = {1700000000, 123456789};
+    struct timespec t0, t1;
+    ed_report_t reports[NB_TEST_PKTS + 2];
+    ed_report_t decoded;
+    uint8_t rec[REPORT_CBOR_MAX], raw[REPORT_CBOR_MAX], bad[REPORT_CBOR_MAX];
+    char line[ED_REPORT_JSON_MAX], json[ED_REPORT_JSON_MAX];
+    size_t raw_len;
+    long nb_json = 0, nb_cbor = 0, nb_ok;
+    double ns_json, ns_cbor;
+    char segment_name[64], ndjson_name[80];
+    FILE *fp;
+    static const char summary[] = "{\"@timestamp\":\"2023-11-14T22:13:20Z\",\"type\":\"summary\",\"DevAddr\":\"47362514\",\"Packets\":3}";
+
+    /* FCnt at each CBOR integer width, DevAddrs and EUIs with 0x00 and 0x0A bytes */
+    make_frame(&pkts[0], 0x40, 0x26011B42, 0x80, 23, NULL, 1, 12, DR_LORA_SF7, STAT_CRC_OK, 868100000);                      /* UDU, ADR, FPort */
+    make_frame(&pkts[1], 0x80, 0x00000A00, 0x23, 24, (const uint8_t[]){0x02, 0x0A, 0x00}, -1, 0, DR_LORA_SF9, STAT_CRC_BAD, 867300000);   /* CDU, ACK, 3 bytes FOpts, no FPort */
+    make_join(&pkts[2], 0x70B3D57ED0000A0AULL, 0x0004A30B001C0A00ULL, DR_LORA_SF12, STAT_NO_CRC, 868500000);                  /* JR, 64 bit EUIs */
+    make_frame(&pkts[3], 0x60, 0x260A0A0A, 0x05, 256, (const uint8_t[]){0x03, 0x00, 0x0A, 0x00, 0x0A}, 0, 40, DR_LORA_SF10, STAT_UNDEFINED, 867900000); /* UDD, 5 bytes FOpts, FPort 0 */
+    make_frame(&pkts[4], 0xE0, 0xFFFFFFFF, 0x0F, 65535, (const uint8_t[]){0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14},
+               224, 0, DR_LORA_SF11, 0x42, 868300000);                                                                     /* PRP, 15 bytes FOpts, unknown CRC status */
+    make_frame(&pkts[5], 0x40, 0x00000001, 0x00, 255, NULL, 255, 1, DR_LORA_SF8, STAT_CRC_OK, 917525000);                    /* frequency with decimals */
+    pkts[5].snr = 10.0;
+    pkts[5].rssis = -50.5;
+    make_frame(&pkts[6], 0x40, 0x47362514, 0x05, 0, (const uint8_t[]){0x03, 0x07, 0x06, 0xFE, 0x3A}, -1, 0, DR_LORA_SF7, STAT_CRC_OK, 868100000); /* UDU, LinkADRAns and DevStatusAns in FOpts */
+    make_frame(&pkts[7], 0x20, 0x00000000, 0x00, 0, NULL, -1, 0, DR_LORA_SF7, STAT_CRC_OK, 923300000);                       /* JA, MType left empty */
+    pkts[7].rssis = -94.38;
+    for (i = 0; i < NB_TEST_PKTS; i++) {
+        ed_report_write(&reports[i], &pkts[i], &fetch_time);
+    }
+    /* session key items, as key_store_process leaves them */
+    reports[NB_TEST_PKTS] = reports[0];
+    reports[NB_TEST_PKTS].mic = ED_MIC_OK;
+    reports[NB_TEST_PKTS].datalen = 5;
+    memcpy(reports[NB_TEST_PKTS].data, "hello", 5);
+    reports[NB_TEST_PKTS + 1] = reports[0];
+    reports[NB_TEST_PKTS + 1].mic = ED_MIC_BAD;
+    reports[NB_TEST_PKTS + 1].datalen = ED_REPORT_DATA_LEN - 1;
+    for (i = 0; i < ED_REPORT_DATA_LEN - 1; i++) {
+        reports[NB_TEST_PKTS + 1].data[i] = (i % 2) ? 0x0A : 0x00;  /* longest data, escaped throughout */
+    }
+
+    /* round trip, through the JSON line of each report */
+    ok = true;
+    no_newline = true;
+    lead = true;
+    for (i = 0; i < NB_TEST_PKTS + 2; i++) {
+        len = report_cbor_encode(&reports[i], rec, sizeof rec);
+        if (len <= 0 || report_cbor_decode(rec, (size_t)len, &decoded) || !same_json(&reports[i], &decoded)) {
+            ok = false;
+            continue;
+        }
+        no_newline = no_newline && (memchr(rec, '\n', (size_t)len) == NULL);
+        lead = lead && (rec[0] == REPORT_CBOR_LEAD);
+    }
+    CHECK(ok, "decoded reports give the JSON lines of the originals");
+    CHECK(no_newline, "records never hold a newline");
+    CHECK(lead, "records start with the lead byte");
+
+    /* integers and fixed point values */
+    len = report_cbor_encode(&reports[2], rec, sizeof rec);
+    CHECK(report_cbor_decode(rec, (size_t)len, &decoded) == 0 && decoded.is_jr &&
+          decoded.app_eui == reports[2].app_eui && decoded.dev_eui == reports[2].dev_eui, "join request EUIs");
+    len = report_cbor_encode(&reports[6], rec, sizeof rec);
+    CHECK(report_cbor_decode(rec, (size_t)len, &decoded) == 0 && decoded.devaddr == reports[6].devaddr &&
+          decoded.nb_mac_cmds == 2 && decoded.mac_cmds[1].u.dev_status_ans.battery == 0xFE, "DevAddr and MAC commands parsed again");
+    CHECK(decoded.time_ms == 1700000000123ULL && strcmp(decoded.timestamp, reports[6].timestamp) == 0, "timestamp");
+    CHECK(decoded.snr == -7.25f && decoded.rssi == -113.0f, "RSSI and SNR in hundredths of dB");
+    len = report_cbor_encode(&reports[7], rec, sizeof rec);
+    CHECK(report_cbor_decode(rec, (size_t)len, &decoded) == 0 && decoded.rssi == -94.38f && decoded.freq == reports[7].freq, "frequency in Hz");
+    ok = true;
+    for (i = 0; i < NB_TEST_PKTS; i++) {
+        len = report_cbor_encode(&reports[i], rec, sizeof rec);
+        ok = ok && (report_cbor_decode(rec, (size_t)len, &decoded) == 0) && (decoded.fcnt == reports[i].fcnt) &&
+             (decoded.devaddr == reports[i].devaddr) && (decoded.foptslen == reports[i].foptslen) &&
+             (memcmp(decoded.fopts, reports[i].fopts, reports[i].foptslen) == 0);
+    }
+    CHECK(ok, "FCnt, DevAddr and FOpts at every integer width");
+    len = report_cbor_encode(&reports[NB_TEST_PKTS + 1], rec, sizeof rec);
+    CHECK(report_cbor_decode(rec, (size_t)len, &decoded) == 0 && decoded.mic == ED_MIC_BAD && decoded.datalen == ED_REPORT_DATA_LEN - 1 &&
+          memcmp(decoded.data, reports[NB_TEST_PKTS + 1].data, ED_REPORT_DATA_LEN - 1) == 0, "MIC status and longest data");
+
+    /* header: self-described CBOR, a map, then the schema version */
+    len = report_cbor_encode(&reports[0], rec, sizeof rec);
+    raw_len = unframe(rec, (size_t)len, raw);
+    CHECK(raw_len > 6 && raw[0] == 0xD9 && raw[1] == 0xD9 && raw[2] == 0xF7 && (raw[3] & 0xE0) == 0xA0 &&
+          raw[4] == 0x00 && raw[5] == REPORT_CBOR_VERSION, "schema header");
+    CHECK(frame(raw, raw_len, bad) == (size_t)len && memcmp(bad, rec, (size_t)len) == 0, "framing as documented");
+
+    /* a member of a later schema is skipped */
+    memcpy(bad, raw, raw_len);
+    bad[3]++;
+    memcpy(&bad[raw_len], (const uint8_t[]){0x18, 0x20, 0x63, 'n', 'e', 'w'}, 6);
+    len = (int)frame(bad, raw_len + 6, rec);
+    CHECK(report_cbor_decode(rec, (size_t)len, &decoded) == 0 && same_json(&reports[0], &decoded), "unknown member skipped");
+
+    /* another schema version */
+    memcpy(bad, raw, raw_len);
+    bad[5] = REPORT_CBOR_VERSION + 1;
+    len = (int)frame(bad, raw_len, rec);
+    CHECK(report_cbor_decode(rec, (size_t)len, &decoded) == -1, "other schema version refused");
+
+    /* a join request without its DevEUI, the last member: key and 64 bit value */
+    len = report_cbor_encode(&reports[2], rec, sizeof rec);
+    raw_len = unframe(rec, (size_t)len, bad);
+    bad[3]--;
+    len = (int)frame(bad, raw_len - 10, rec);
+    CHECK(report_cbor_decode(rec, (size_t)len, &decoded) == -1, "missing member refused");
+
+    /* truncated records */
+    len = report_cbor_encode(&reports[NB_TEST_PKTS], rec, sizeof rec);
+    ok = true;
+    for (n = 0; n < len; n++) {
+        ok = ok && (report_cbor_decode(rec, (size_t)n, &decoded) == -1);
+    }
+    CHECK(ok, "truncated records refused");
+    CHECK(report_cbor_encode(&reports[0], rec, 8) == -1, "short buffer refused");
+
+    /* corrupted records, the decoder must stay within its buffers */
+    len = report_cbor_encode(&reports[6], rec, sizeof rec);
+    nb_ok = 0;
+    for (n = 0; n < NB_CORRUPT; n++) {
+        memcpy(bad, rec, (size_t)len);
+        for (i = 0; i < 1 + (int)(rng_next() % 3); i++) {
+            bad[rng_next() % (uint64_t)len] ^= (uint8_t)(1 << (rng_next() % 8));
+        }
+        nb_ok += (report_cbor_decode(bad, (size_t)len, &decoded) == 0) ? 1 : 0;
+    }
+    printf("INFO: %d corrupted records, %ld still decoded\n", NB_CORRUPT, nb_ok);
+    CHECK(nb_ok < NB_CORRUPT, "corrupted records refused");
+
+    /* segment mixing JSON lines and records, exported as NDJSON */
+    snprintf(segment_name, sizeof segment_name, "/tmp/report_cbor_%d.ndjson", (int)getpid());
+    snprintf(ndjson_name, sizeof ndjson_name, "%s.decoded.ndjson", segment_name);
+    fp = fopen(segment_name, "w");
+    for (i = 0; fp != NULL && i < NB_TEST_PKTS + 2; i++) {
+        len = report_cbor_encode(&reports[i], rec, sizeof rec);
+        fwrite(rec, 1, (size_t)len, fp);
+        fputc('\n', fp);
+        if (i == 3) {
+            fprintf(fp, "%s\n", summary);
+        }
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    CHECK(report_cbor_export_ndjson(segment_name, ndjson_name) == NB_TEST_PKTS + 3, "segment exported");
+    fp = fopen(ndjson_name, "r");
+    ok = (fp != NULL);
+    for (i = 0; ok && i < NB_TEST_PKTS + 2; i++) {
+        ok = (fgets(line, sizeof line, fp) != NULL);
+        if (ok && i == 4) {
+            ok = (strncmp(line, summary, sizeof summary - 1) == 0) && (fgets(line, sizeof line, fp) != NULL);
+        }
+        n = ed_report_encode(&reports[i], json, sizeof json);
+        ok = ok && (n > 0) && (strncmp(line, json, (size_t)n) == 0) && (line[n] == '\n');
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    CHECK(ok, "exported lines match the JSON encoder, JSON lines copied");
+    fp = fopen(segment_name, "a");
+    if (fp != NULL) {
+        fputs("\x0F\x01\n", fp);
+        fclose(fp);
+    }
+    CHECK(report_cbor_export_ndjson(segment_name, ndjson_name) == -1, "malformed record stops the export");
+    unlink(segment_name);
+    unlink(ndjson_name);
+
+    /* size and time, the reports are filled once */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (n = 0; n < BENCH_REPORTS; n++) {
+        json_len = ed_report_encode(&reports[n % NB_TEST_PKTS], line, sizeof line);
+        nb_json += json_len;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_json = elapsed_ns(&t0, &t1) / BENCH_REPORTS;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (n = 0; n < BENCH_REPORTS; n++) {
+        len = report_cbor_encode(&reports[n % NB_TEST_PKTS], rec, sizeof rec);
+        nb_cbor += len;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_cbor = elapsed_ns(&t0, &t1) / BENCH_REPORTS;
+
+    printf("Per report, %d reports:\n", BENCH_REPORTS);
+    printf("  json  %6.1f ns, %6.1f bytes\n", ns_json, (double)nb_json / BENCH_REPORTS);
+    printf("  cbor  %6.1f ns, %6.1f bytes\n", ns_cbor, (double)nb_cbor / BENCH_REPORTS);
+    CHECK(nb_cbor * 2 < nb_json, "records less than half the size of the JSON lines");
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,337 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Check the report filter: invalid rules are refused, each match term and
+    its operators select the expected packets, NetIDs give the DevAddr
+    prefixes of the LoRaWAN backend specification, rules stop or carry on
+    as their action says, and sample, limit and dedup keep the expected
+    share of the traffic. The cost of a packet going through a typical rule
+    list is timed on random traffic.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memset strcmp */
+#include <time.h>       /* clock_gettime */
+
+#include "report_filter.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define MTYPE_JR            0
+#define MTYPE_UDU           2
+#define MTYPE_CDU           4
+#define MTYPE_PRP           7
+
+#define NB_BENCH            5000000     /* packets per timed run */
+#define BENCH_DEVICES       2000        /* devices in the timed traffic */
+#define BENCH_PKTS          4096        /* packets generated before the timed run, used over and over */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static struct lgw_pkt_rx_s bench_pkts[BENCH_PKTS];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* xorshift64*, reproducible from one run to the next */
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/**
+ * Fill a 12 byte frame, FCnt in the payload so that frames of a device differ.
+ *
+ * @param p         Packet to fill
+ * @param mtype     MHDR.MType
+ * @param devaddr   DevAddr, for data frames
+ * @param fcnt      Frame counter
+*/
+static void make_pkt(struct lgw_pkt_rx_s *p, uint8_t mtype, uint32_t devaddr, uint16_t fcnt) {
+
+    memset(p, 0, sizeof *p);
+    p->status = STAT_CRC_OK;
+    p->modulation = MOD_LORA;
+    p->datarate = DR_LORA_SF7;
+    p->rssis = -90.0;
+    p->snr = 5.0;
+    p->size = 12;
+    p->payload[0] = (uint8_t)(mtype << 5);
+    p->payload[1] = (uint8_t)devaddr;
+    p->payload[2] = (uint8_t)(devaddr >> 8);
+    p->payload[3] = (uint8_t)(devaddr >> 16);
+    p->payload[4] = (uint8_t)(devaddr >> 24);
+    p->payload[6] = (uint8_t)fcnt;
+    p->payload[7] = (uint8_t)(fcnt >> 8);
+}
+
+/**
+ * Run a single rule on a packet.
+ *
+ * @return  1 if the packet is reported, 0 if dropped, -1 if the rule does not compile
+*/
+static int one_rule(const char *match, const char *action, const struct lgw_pkt_rx_s *p) {
+
+    report_filter_t f;
+    int r = -1;
+
+    if (report_filter_init(&f, 1) == 0 && report_filter_add(&f, NULL, match, action) == 0) {
+        r = report_filter_check(&f, p, 1000) ? 1 : 0;
+    }
+    report_filter_free(&f);
+    return r;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    report_filter_t f;
+    struct lgw_pkt_rx_s p, q;
+    struct timespec t0, t1;
+    int i, n;
+    uint32_t devaddr;
+    uint64_t r;
+    double ns;
+
+    /* invalid rules */
+    report_filter_init(&f, 2);
+    CHECK(report_filter_add(&f, NULL, "port=1", "drop") == -1, "unknown term refused");
+    CHECK(report_filter_add(&f, NULL, "mtype=UDX", "drop") == -1, "unknown MType refused");
+    CHECK(report_filter_add(&f, NULL, "mtype<UDU", "drop") == -1, "MType bound refused");
+    CHECK(report_filter_add(&f, NULL, "sf=13", "drop") == -1, "SF13 refused");
+    CHECK(report_filter_add(&f, NULL, "sf>=7,8", "drop") == -1, "SF bound list refused");
+    CHECK(report_filter_add(&f, NULL, "devaddr=26011B00/33", "drop") == -1, "prefix longer than a DevAddr refused");
+    CHECK(report_filter_add(&f, NULL, "devaddr=26011B00/24 netid=000013", "drop") == -1, "second DevAddr term refused");
+    CHECK(report_filter_add(&f, NULL, "netid=1000000", "drop") == -1, "NetID of more than 24 bits refused");
+    CHECK(report_filter_add(&f, NULL, "rssi!=-100", "drop") == -1, "RSSI != refused");
+    CHECK(report_filter_add(&f, NULL, "snr>x", "drop") == -1, "SNR not a number refused");
+    CHECK(report_filter_add(&f, NULL, "=7", "drop") == -1, "term without key refused");
+    CHECK(report_filter_add(&f, NULL, "", "drop 2") == -1, "drop with a count refused");
+    CHECK(report_filter_add(&f, NULL, "", "sample 0") == -1, "sample 0 refused");
+    CHECK(report_filter_add(&f, NULL, "", "limit 5") == -1, "limit without period refused");
+    CHECK(report_filter_add(&f, NULL, "", "dedup 2/3") == -1, "dedup with a count refused");
+    CHECK(report_filter_add(&f, NULL, "", "forward") == -1, "unknown action refused");
+    CHECK(report_filter_add(&f, NULL, "", NULL) == -1, "missing action refused");
+    CHECK(report_filter_add(&f, "a rule", "", "drop") == -1, "name with a space refused");
+    CHECK(report_filter_add(&f, "crc\"}", "", "drop") == -1, "name with a quote refused, it would end the metric label");
+    CHECK(report_filter_add(&f, "crc\\n", "", "drop") == -1, "name with a backslash refused, it would escape in the metric label");
+    CHECK(report_filter_add(&f, "", "", "drop") == -1, "empty name refused");
+    CHECK(f.nb_rules == 0, "no rule added");
+    CHECK(report_filter_add(&f, NULL, "", "keep") == 0 && strcmp(f.rules[0].name, "rule0") == 0, "rule named after its position");
+    CHECK(report_filter_add(&f, "crc_error-1", " crc=BAD  ", "drop") == 0, "rule with a name and spaces");
+    CHECK(report_filter_add(&f, NULL, "", "drop") == -1, "full filter refused");
+    report_filter_free(&f);
+
+    /* MType and CRC */
+    make_pkt(&p, MTYPE_UDU, 0x26011B42, 1);
+    CHECK(one_rule("mtype=JR,JA", "drop", &p) == 1, "UDU not in JR,JA");
+    CHECK(one_rule("mtype=UDU,CDU", "drop", &p) == 0, "UDU in UDU,CDU");
+    CHECK(one_rule("mtype!=UDU", "drop", &p) == 1, "UDU not in !=UDU");
+    CHECK(one_rule("mtype!=JR mtype!=CDU", "drop", &p) == 0, "two MType terms intersect");
+    CHECK(one_rule("crc=BAD,NONE", "drop", &p) == 1, "CRC OK not in BAD,NONE");
+    p.status = STAT_NO_CRC;
+    CHECK(one_rule("crc=BAD,NONE", "drop", &p) == 0, "no CRC in BAD,NONE");
+    p.status = STAT_UNDEFINED;
+    CHECK(one_rule("crc!=OK,BAD,NONE", "drop", &p) == 0, "undefined CRC status is the other one");
+    p.size = 0;
+    CHECK(one_rule("mtype=JR", "drop", &p) == 1 && one_rule("mtype!=JR", "drop", &p) == 1, "empty payload has no MType");
+
+    /* SF */
+    make_pkt(&p, MTYPE_UDU, 0x26011B42, 1);
+    p.datarate = DR_LORA_SF10;
+    CHECK(one_rule("sf>=10", "drop", &p) == 0 && one_rule("sf>10", "drop", &p) == 1, "SF lower bound");
+    CHECK(one_rule("sf<=10", "drop", &p) == 0 && one_rule("sf<10", "drop", &p) == 1, "SF upper bound");
+    CHECK(one_rule("sf=7,8,10", "drop", &p) == 0 && one_rule("sf!=7,8,10", "drop", &p) == 1, "SF list");
+    CHECK(one_rule("sf>=8 sf<=9", "drop", &p) == 1 && one_rule("sf>=8 sf<=11", "drop", &p) == 0, "SF range");
+    p.modulation = MOD_FSK;
+    p.datarate = 50000;
+    CHECK(one_rule("sf>=5", "drop", &p) == 1 && one_rule("sf!=7", "drop", &p) == 1, "FSK packet has no SF");
+
+    /* DevAddr and NetID */
+    make_pkt(&p, MTYPE_UDU, 0x26011B42, 1);
+    CHECK(one_rule("devaddr=26011B00/24", "drop", &p) == 0, "DevAddr in prefix");
+    CHECK(one_rule("devaddr=26011C00/24", "drop", &p) == 1, "DevAddr out of prefix");
+    CHECK(one_rule("devaddr!=26011C00/24", "drop", &p) == 0, "DevAddr out of prefix with !=");
+    CHECK(one_rule("devaddr=26011B42", "drop", &p) == 0 && one_rule("devaddr=26011B43", "drop", &p) == 1, "full DevAddr");
+    CHECK(one_rule("devaddr=0/0", "drop", &p) == 0, "empty prefix matches every DevAddr");
+    CHECK(one_rule("netid=000013", "drop", &p) == 0, "type 0 NetID 000013 is 26000000/7");
+    p.payload[4] = 0x27;
+    CHECK(one_rule("netid=000013", "drop", &p) == 0, "27xxxxxx is in NetID 000013");
+    p.payload[4] = 0x28;
+    CHECK(one_rule("netid=000013", "drop", &p) == 1, "28xxxxxx is not in NetID 000013");
+    make_pkt(&p, MTYPE_CDU, 0xE05B1234, 1);
+    CHECK(one_rule("netid=60002D", "drop", &p) == 0, "type 3 NetID 60002D is E05A0000/15");
+    p.payload[3] = 0x5C;
+    CHECK(one_rule("netid=60002D", "drop", &p) == 1, "E05Cxxxx is not in NetID 60002D");
+    make_pkt(&p, MTYPE_UDU, 0xFE0001A5, 1);
+    CHECK(one_rule("netid=E00003", "drop", &p) == 0, "type 7 NetID E00003 is FE000180/25");
+    p.payload[1] = 0x25;
+    CHECK(one_rule("netid=E00003", "drop", &p) == 1, "FE000125 is not in NetID E00003");
+    make_pkt(&p, MTYPE_JR, 0x26011B42, 1);
+    CHECK(one_rule("devaddr=0/0", "drop", &p) == 1 && one_rule("devaddr!=0/0", "drop", &p) == 1, "join request has no DevAddr");
+    make_pkt(&p, MTYPE_PRP, 0x26011B42, 1);
+    CHECK(one_rule("devaddr=0/0", "drop", &p) == 1, "proprietary frame has no DevAddr");
+
+    /* RSSI and SNR, bounds */
+    make_pkt(&p, MTYPE_UDU, 0x26011B42, 1);
+    p.rssis = -120.0;
+    CHECK(one_rule("rssi<-120", "drop", &p) == 1 && one_rule("rssi<=-120", "drop", &p) == 0, "RSSI upper bound");
+    CHECK(one_rule("rssi>-120", "drop", &p) == 1 && one_rule("rssi>=-120", "drop", &p) == 0, "RSSI lower bound");
+    CHECK(one_rule("rssi>=-130 rssi<-110", "drop", &p) == 0 && one_rule("rssi>=-110 rssi<-100", "drop", &p) == 1, "RSSI range");
+    CHECK(one_rule("rssi=-120", "drop", &p) == 0, "RSSI equal");
+    p.snr = -7.25;
+    CHECK(one_rule("snr<-5", "drop", &p) == 0 && one_rule("snr>=-5", "drop", &p) == 1, "SNR bound");
+    CHECK(one_rule("snr<-5 mtype=UDU crc=OK sf=7 devaddr=26000000/8 rssi<-100", "drop", &p) == 0, "all terms hold");
+    CHECK(one_rule("snr<-5 mtype=UDU crc=OK sf=8 devaddr=26000000/8 rssi<-100", "drop", &p) == 1, "one term fails");
+
+    /* rule order, counters */
+    report_filter_init(&f, 3);
+    report_filter_add(&f, "mine", "devaddr=26011B00/24", "keep");
+    report_filter_add(&f, "errors", "crc=BAD", "drop");
+    report_filter_add(&f, "uplinks", "mtype=UDU", "drop");
+    make_pkt(&p, MTYPE_UDU, 0x26011B42, 1);
+    p.status = STAT_CRC_BAD;
+    CHECK(report_filter_check(&f, &p, 1000), "keep stops before drop");
+    make_pkt(&p, MTYPE_UDU, 0x26021B42, 1);
+    CHECK(!report_filter_check(&f, &p, 1000), "first matching drop");
+    p.status = STAT_CRC_BAD;
+    CHECK(!report_filter_check(&f, &p, 1000), "earlier drop");
+    make_pkt(&p, MTYPE_CDU, 0x26021B42, 1);
+    CHECK(report_filter_check(&f, &p, 1000), "no rule stops, reported");
+    CHECK(f.rules[0].hits == 1 && f.rules[1].hits == 1 && f.rules[2].hits == 1, "hits per rule");
+    CHECK(f.rules[0].dropped == 0 && f.rules[1].dropped == 1 && f.rules[2].dropped == 1, "drops per rule");
+    CHECK(f.nb_kept == 2 && f.nb_dropped == 2, "kept and dropped");
+    report_filter_free(&f);
+
+    /* sample: 1 in 4 of the matching packets, the others untouched */
+    report_filter_init(&f, 1);
+    report_filter_add(&f, NULL, "mtype=UDU", "sample 4");
+    for (i = 0, n = 0; i < 1000; i++) {
+        make_pkt(&p, (i & 1) ? MTYPE_UDU : MTYPE_CDU, 0x26011B42, (uint16_t)i);
+        n += report_filter_check(&f, &p, 1000) ? 1 : 0;
+    }
+    CHECK(n == 500 + 125, "sample 4 keeps 1 in 4");
+    report_filter_free(&f);
+
+    /* limit: per device, per window */
+    report_filter_init(&f, 1);
+    report_filter_add(&f, NULL, "", "limit 3/60");
+    for (i = 0, n = 0; i < 10; i++) {
+        make_pkt(&p, MTYPE_UDU, 0x26011B42, (uint16_t)i);
+        n += report_filter_check(&f, &p, 1000) ? 1 : 0;
+        make_pkt(&p, MTYPE_UDU, 0x26011B43, (uint16_t)i);
+        n += report_filter_check(&f, &p, 1000 + i) ? 1 : 0;
+    }
+    CHECK(n == 6, "limit 3/60 for two devices");
+    make_pkt(&p, MTYPE_UDU, 0x26011B42, 10);
+    CHECK(!report_filter_check(&f, &p, 1059), "limit window still open");
+    CHECK(report_filter_check(&f, &p, 1060), "next limit window");
+    for (i = 0, n = 0; i < 10; i++) {
+        make_pkt(&p, MTYPE_JR, 0, (uint16_t)i);
+        n += report_filter_check(&f, &p, 1000) ? 1 : 0;
+    }
+    CHECK(n == 3, "frames without DevAddr share a limit");
+    report_filter_free(&f);
+
+    /* dedup: same payload within the window */
+    report_filter_init(&f, 1);
+    report_filter_add(&f, NULL, "", "dedup 2");
+    make_pkt(&p, MTYPE_UDU, 0x26011B42, 7);
+    make_pkt(&q, MTYPE_UDU, 0x26011B42, 8);
+    CHECK(report_filter_check(&f, &p, 1000), "first copy reported");
+    CHECK(!report_filter_check(&f, &p, 1000), "second copy dropped");
+    CHECK(report_filter_check(&f, &q, 1000), "next frame reported");
+    p.rssis = -110.0;
+    CHECK(!report_filter_check(&f, &p, 1001), "copy from another gateway dropped");
+    CHECK(report_filter_check(&f, &p, 1002), "copy after the window reported");
+    q.size = 11;
+    CHECK(report_filter_check(&f, &q, 1000), "shorter payload is another frame");
+    report_filter_free(&f);
+
+    /* time per packet through a typical rule list */
+    report_filter_init(&f, 5);
+    report_filter_add(&f, "errors", "crc=BAD,NONE", "drop");
+    report_filter_add(&f, "other", "mtype=RFU,PRP", "drop");
+    report_filter_add(&f, "mine", "netid=000013 rssi>=-120", "keep");
+    report_filter_add(&f, "busy", "mtype=UDU,CDU", "limit 10/60");
+    report_filter_add(&f, "copies", "", "dedup 2");
+    for (i = 0; i < BENCH_PKTS; i++) {
+        r = rng_next();
+        devaddr = ((r & 3) == 0) ? 0x26000000U | (uint32_t)(r >> 40) % BENCH_DEVICES : 0x48000000U | (uint32_t)(r >> 40) % BENCH_DEVICES;
+        make_pkt(&bench_pkts[i], (uint8_t)((r >> 8) & 7), devaddr, (uint16_t)(r >> 16));
+        bench_pkts[i].status = ((r >> 24) & 15) == 0 ? STAT_CRC_BAD : STAT_CRC_OK;
+        bench_pkts[i].rssis = -(float)((r >> 28) & 63) - 80;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < NB_BENCH; i++) {
+        report_filter_check(&f, &bench_pkts[i % BENCH_PKTS], 1000 + i / 10000);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = elapsed_ns(&t0, &t1) / NB_BENCH;
+
+    printf("Per packet, %d packets, %d rules: %.1f ns, %lu kept, %lu dropped\n", NB_BENCH, f.nb_rules, ns,
+           (unsigned long)f.nb_kept, (unsigned long)f.nb_dropped);
+    for (i = 0; i < f.nb_rules; i++) {
+        printf("  %-8s %9lu hits %9lu dropped\n", f.rules[i].name, (unsigned long)f.rules[i].hits, (unsigned long)f.rules[i].dropped);
+    }
+    CHECK(f.nb_kept + f.nb_dropped == NB_BENCH, "every benchmark packet counted");
+    report_filter_free(&f);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,351 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Check the durable report spool in a scratch directory: sealed segments
+    and acknowledgements survive a restart, a writer killed in the middle of
+    a segment leaves whole records only once recovered, sealed segments the
+    journal missed are taken in, damaged ones are put aside, and numbering
+    never reuses a file on disk. A writer thread then hands segments over
+    to a slow uploader, through the published sealed range only: every
+    record must come out once. The cost of an appended record is timed
+    with the group commit, and with a sync after every record.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fopen */
+#include <stdlib.h>     /* EXIT_FAILURE mkdtemp */
+#include <string.h>     /* strlen */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* chdir fork _exit */
+#include <sys/wait.h>   /* waitpid */
+#include <stdatomic.h>  /* C11 atomics */
+#include <pthread.h>
+
+#include "report_segment.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PREFIX              "device"
+#define SEG_BYTES           1000        /* small segments, a few records each */
+#define NB_BENCH_GROUP      200000      /* records appended with the group commit */
+#define NB_BENCH_EACH       2000        /* records appended with a sync each */
+#define NB_HANDOFF          20000       /* records handed over to the uploader */
+#define UPLOAD_MS           20          /* time taken by an upload */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static _Atomic bool writer_done = false;
+static uint64_t writer_max_ns = 0;        /* slowest append, poll included */
+
+static const char record[] = "{\"DevAddr\":\"26011B42\",\"FCnt\":1234,\"RSSI\":-97.0,\"SNR\":7.5,\"SF\":7}";
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static bool exists(const char *prefix, uint32_t seq, const char *suffix) {
+
+    char name[SEGMENT_NAME_LEN];
+
+    snprintf(name, sizeof name, "%s_%u%s", prefix, seq, suffix);
+    return access(name, F_OK) == 0;
+}
+
+static long file_size(const char *name) {
+
+    FILE *fp = fopen(name, "r");
+    long size;
+
+    if (fp == NULL) {
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+static int append_n(segment_writer_t *sw, int n) {
+
+    int i, ret = 0;
+
+    for (i = 0; i < n; i++) {
+        ret |= segment_append(sw, record, strlen(record));
+    }
+    return ret;
+}
+
+/* writer side of the handoff: the encoder appends and polls, never waits on the uploader */
+static void *thread_writer(void *arg) {
+
+    segment_writer_t *sw = arg;
+    struct timespec t0, t1;
+    double ns;
+    int i;
+
+    for (i = 0; i < NB_HANDOFF; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        segment_append(sw, record, strlen(record));
+        segment_poll(sw);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ns = elapsed_ns(&t0, &t1);
+        writer_max_ns = (ns > writer_max_ns) ? (uint64_t)ns : writer_max_ns;
+        if ((i % 100) == 0) {
+            usleep(1000);
+        }
+    }
+    segment_seal(sw);
+    writer_done = true;
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    char dir[] = "/tmp/test_sniffer_spool_XXXXXX";
+    char name[SEGMENT_NAME_LEN];
+    segment_writer_t sw;
+    segment_recovery_t rec;
+    struct timespec t0, t1;
+    double ns_group, ns_each;
+    uint64_t syncs_group;
+    uint32_t seq;
+    pid_t pid;
+    FILE *fp;
+    int i, status;
+    pthread_t thrid;
+    uint32_t seq_upload, seq_end, found;
+    long records, nb_handed;
+    bool all_sealed;
+
+    /* CRC-32 check value, and in pieces */
+    CHECK(segment_crc32(0, "123456789", 9) == 0xCBF43926, "CRC-32 check value");
+    CHECK(segment_crc32(segment_crc32(0, "1234", 4), "56789", 5) == 0xCBF43926, "CRC-32 in pieces");
+
+    if (mkdtemp(dir) == NULL || chdir(dir)) {
+        printf("FAIL: scratch directory\n");
+        return EXIT_FAILURE;
+    }
+
+    /* first run: several sealed segments, the first two acknowledged */
+    segment_init(&sw, PREFIX, SEG_BYTES, 0);
+    CHECK(segment_journal_open(&sw, 1000, &rec) == 0, "journal opened in an empty directory");
+    CHECK(rec.seq_acked == 0 && rec.pending == 0 && rec.adopted == 0 && rec.repaired == 0, "nothing to recover");
+    CHECK(append_n(&sw, 60) == 0, "records appended");
+    seq = segment_sealed_end(&sw);
+    CHECK(seq >= 3, "several segments sealed");
+    segment_ack(&sw, 2);
+    remove(PREFIX "_0" SEGMENT_SUFFIX_SEALED);
+    remove(PREFIX "_1" SEGMENT_SUFFIX_SEALED);
+    segment_close(&sw);
+    seq += 1;   /* the open one was sealed on close */
+    CHECK(sw.nb_syncs > 0, "journal committed");
+    CHECK(!exists(PREFIX, seq - 1, SEGMENT_SUFFIX_OPEN) && exists(PREFIX, seq - 1, SEGMENT_SUFFIX_SEALED), "last segment sealed on close");
+
+    /* restart: uploads resume after the acknowledged ones, numbering goes on */
+    segment_init(&sw, PREFIX, SEG_BYTES, 0);
+    CHECK(segment_journal_open(&sw, 1000, &rec) == 0, "journal replayed");
+    CHECK(rec.seq_acked == 2, "acknowledged end restored");
+    CHECK(rec.pending == seq - 2 && rec.missing == 0 && rec.quarantined == 0 && !rec.torn_journal, "sealed segments pending");
+    CHECK(segment_sealed_end(&sw) == seq, "numbering goes on");
+    snprintf(name, sizeof name, "%s%s", PREFIX, SEGMENT_SUFFIX_JOURNAL);
+    CHECK(file_size(name) < 30 * (long)(seq - 1), "journal rewritten with the pending segments only");
+    segment_close(&sw);
+
+    /* crash: a writer dies after a group commit, leaving its open segment and a partial record */
+    pid = fork();
+    if (pid == 0) {
+        segment_init(&sw, PREFIX, SEG_BYTES, 0);
+        segment_journal_open(&sw, 1000, &rec);
+        append_n(&sw, 5);
+        segment_sync(&sw);
+        append_n(&sw, 3);       /* still in the stdio buffer, lost */
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    CHECK(exists(PREFIX, seq, SEGMENT_SUFFIX_OPEN), "open segment left by the crash");
+    snprintf(name, sizeof name, "%s_%u%s", PREFIX, seq, SEGMENT_SUFFIX_OPEN);
+    fp = fopen(name, "a");
+    fputs("{\"DevAddr\":\"2601", fp);
+    fclose(fp);
+    snprintf(name, sizeof name, "%s%s", PREFIX, SEGMENT_SUFFIX_JOURNAL);
+    fp = fopen(name, "a");
+    fputs("S 99 12", fp);
+    fclose(fp);
+
+    /* a sealed segment the journal never heard of, from an older run */
+    snprintf(name, sizeof name, "%s_%u%s", PREFIX, seq + 1, SEGMENT_SUFFIX_SEALED);
+    fp = fopen(name, "w");
+    fprintf(fp, "%s\n%s\n", record, record);
+    fclose(fp);
+
+    /* damage a pending segment, lose another */
+    snprintf(name, sizeof name, "%s_2%s", PREFIX, SEGMENT_SUFFIX_SEALED);
+    fp = fopen(name, "r+");
+    fseek(fp, 10, SEEK_SET);
+    fputc('X', fp);
+    fclose(fp);
+    remove(PREFIX "_3" SEGMENT_SUFFIX_SEALED);
+
+    segment_init(&sw, PREFIX, SEG_BYTES, 0);
+    CHECK(segment_journal_open(&sw, 1000, &rec) == 0, "recovery after a crash");
+    CHECK(rec.torn_journal, "partial journal entry found");
+    CHECK(rec.repaired == 1 && !exists(PREFIX, seq, SEGMENT_SUFFIX_OPEN), "open segment repaired");
+    snprintf(name, sizeof name, "%s_%u%s", PREFIX, seq, SEGMENT_SUFFIX_SEALED);
+    CHECK(segment_count_records(name) == 5 && file_size(name) == 5 * (long)(strlen(record) + 1), "whole records only");
+    CHECK(rec.adopted == 1, "unknown sealed segment taken in");
+    CHECK(rec.quarantined == 1 && exists(PREFIX, 2, SEGMENT_SUFFIX_BAD) && !exists(PREFIX, 2, SEGMENT_SUFFIX_SEALED), "damaged segment put aside");
+    CHECK(rec.missing == 1, "lost segment counted");
+    CHECK(rec.pending == (seq - 4) + 2, "pending segments");
+    CHECK(segment_sealed_end(&sw) == seq + 2, "numbering after every file on disk");
+    append_n(&sw, 1);
+    segment_seal(&sw);
+    snprintf(name, sizeof name, "%s_%u%s", PREFIX, seq + 1, SEGMENT_SUFFIX_SEALED);
+    CHECK(segment_count_records(name) == 2, "older segment not overwritten");
+
+    /* everything acknowledged: nothing pending on the next start */
+    segment_ack(&sw, segment_sealed_end(&sw));
+    segment_close(&sw);
+    segment_init(&sw, PREFIX, SEG_BYTES, 0);
+    segment_journal_open(&sw, 1000, &rec);
+    CHECK(rec.pending == 0 && rec.seq_acked == seq + 3, "all acknowledged");
+    segment_close(&sw);
+
+    /* without journal: a restart numbers after the segments on disk and leaves them alone */
+    segment_init(&sw, "nojournal", SEG_BYTES, 0);
+    CHECK(segment_skip_existing(&sw, &found) == 0 && found == 0 && segment_sealed_end(&sw) == 0, "nothing left without journal");
+    append_n(&sw, 30);
+    segment_close(&sw);
+    seq = segment_sealed_end(&sw);
+    records = segment_count_records("nojournal_0" SEGMENT_SUFFIX_SEALED);
+    CHECK(seq >= 2 && records > 2, "segments sealed without journal");
+    CHECK(access("nojournal" SEGMENT_SUFFIX_JOURNAL, F_OK) != 0, "no journal written");
+    segment_init(&sw, "nojournal", SEG_BYTES, 0);
+    CHECK(segment_skip_existing(&sw, &found) == 0 && found == seq, "segments of the last run found");
+    CHECK(segment_sealed_end(&sw) == seq, "numbering goes on without journal");
+    append_n(&sw, 2);
+    segment_close(&sw);
+    CHECK(segment_count_records("nojournal_0" SEGMENT_SUFFIX_SEALED) == records, "first segment of the last run not overwritten");
+    snprintf(name, sizeof name, "nojournal_%u%s", seq, SEGMENT_SUFFIX_SEALED);
+    CHECK(segment_count_records(name) == 2, "new records in a new segment");
+
+    /* handoff: the uploader asks for seals, reads the published range and acknowledges it, slowly */
+    segment_init(&sw, "handoff", 4096, 0);
+    segment_journal_open(&sw, 100, &rec);
+    seq_upload = 0;
+    nb_handed = 0;
+    all_sealed = true;
+    pthread_create(&thrid, NULL, thread_writer, &sw);
+    while (!writer_done || seq_upload < segment_sealed_end(&sw)) {
+        segment_request_seal(&sw);
+        for (i = 0; i < 100 && segment_seal_pending(&sw) && !writer_done; i++) {
+            usleep(1000);
+        }
+        seq_end = segment_sealed_end(&sw);
+        for (; seq_upload < seq_end; seq_upload++) {
+            snprintf(name, sizeof name, "handoff_%u%s", seq_upload, SEGMENT_SUFFIX_SEALED);
+            records = segment_count_records(name);
+            all_sealed = all_sealed && (records > 0);
+            nb_handed += (records > 0) ? records : 0;
+            usleep(UPLOAD_MS * 1000);
+            remove(name);
+            segment_ack(&sw, seq_upload + 1);
+        }
+    }
+    pthread_join(thrid, NULL);
+    segment_close(&sw);
+    printf("Handoff: %ld records in %u segments, slowest append %.0f us\n", nb_handed, seq_upload, writer_max_ns / 1e3);
+    CHECK(all_sealed, "published segments are sealed");
+    CHECK(nb_handed == NB_HANDOFF, "every record handed over once");
+    segment_init(&sw, "handoff", 4096, 0);
+    segment_journal_open(&sw, 100, &rec);
+    CHECK(rec.seq_acked == seq_upload && rec.pending == 0, "handoff acknowledgements journaled");
+    segment_close(&sw);
+
+    /* time per record, group commit against a sync per record */
+    segment_init(&sw, "bench", 262144, 0);
+    segment_journal_open(&sw, 1000, &rec);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < NB_BENCH_GROUP; i++) {
+        segment_append(&sw, record, strlen(record));
+        segment_poll(&sw);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    segment_close(&sw);
+    ns_group = elapsed_ns(&t0, &t1) / NB_BENCH_GROUP;
+    syncs_group = sw.nb_syncs;
+
+    segment_init(&sw, "bench", 262144, 0);
+    segment_journal_open(&sw, 0, &rec);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < NB_BENCH_EACH; i++) {
+        segment_append(&sw, record, strlen(record));
+        segment_poll(&sw);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns_each = elapsed_ns(&t0, &t1) / NB_BENCH_EACH;
+    CHECK(sw.nb_syncs >= NB_BENCH_EACH, "sync interval 0 syncs every record");
+    segment_close(&sw);
+
+    printf("Per record: %.0f ns with the group commit (%lu syncs for %d records), %.0f ns with a sync each\n",
+           ns_group, (unsigned long)syncs_group, NB_BENCH_GROUP, ns_each);
+    CHECK(syncs_group < NB_BENCH_GROUP / 100, "group commit syncs far less than once per record");
+
+    /* leave nothing behind */
+    snprintf(name, sizeof name, "rm -rf %s", dir);
+    if (system(name) != 0) {
+        printf("WARN: scratch directory %s left\n", dir);
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
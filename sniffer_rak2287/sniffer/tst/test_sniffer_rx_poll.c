@@ -0,0 +1,215 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Drive the adaptive RX polling schedule with a simulated packet source.
+    Packets arrive in a model of the SX1302 RX buffer as a Poisson process and
+    every poll costs SPI time, so the schedule can be compared with the former
+    fixed 3 ms sleep on poll rate, buffer wait and overflow at quiet, moderate
+    and busy sites.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <math.h>       /* log */
+
+#include "rx_poll.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SIM_DURATION_US     (60ULL * 1000000)   /* simulated time per run */
+#define SIM_FIFO_PKTS       64          /* packets the RX buffer model holds before overflowing */
+#define SIM_MAX_PKT         16          /* packets fetched per lgw_receive, as in thread_listen */
+#define SIM_POLL_COST_US    150         /* SPI time of a poll (NB_BYTES and counter reads) */
+#define SIM_PKT_COST_US     60          /* SPI time to fetch one packet */
+#define SIM_FIXED_SLEEP_US  3000        /* former fixed sleep of thread_listen */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* outcome of one simulated run */
+typedef struct sim_result_s {
+    uint64_t polls;
+    uint64_t packets;
+    uint64_t overflow;
+    double wait_avg_us;                 /* average time a packet sat in the RX buffer */
+    uint64_t wait_max_us;
+} sim_result_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint64_t sim_seed;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/**
+ * xorshift64*, uniform in (0, 1).
+*/
+static double sim_uniform(void) {
+
+    sim_seed ^= sim_seed >> 12;
+    sim_seed ^= sim_seed << 25;
+    sim_seed ^= sim_seed >> 27;
+
+    return ((sim_seed * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0) + 1e-12;
+}
+
+/**
+ * Run the listener loop against the simulated RX buffer.
+ *
+ * @param rate      Packet arrival rate (packets per second)
+ * @param adaptive  true for the adaptive schedule, false for the fixed sleep
+ * @param p         Polling state used by the adaptive schedule
+ * @return          Outcome of the run
+*/
+static sim_result_t sim_run(double rate, bool adaptive, rx_poll_t *p) {
+
+    sim_result_t r = {0};
+    uint64_t fifo[SIM_FIFO_PKTS];       /* arrival times of the buffered packets */
+    unsigned fifo_head = 0, fifo_count = 0;
+    uint64_t t = 0, next_arrival, wait, wait_sum = 0, delay;
+    int nb, i;
+
+    sim_seed = 0x9E3779B97F4A7C15ULL;
+    next_arrival = (uint64_t)(-log(sim_uniform()) / rate * 1e6);
+
+    while (t < SIM_DURATION_US) {
+        /* packets received since the last poll */
+        while (next_arrival <= t) {
+            if (fifo_count < SIM_FIFO_PKTS) {
+                fifo[(fifo_head + fifo_count) % SIM_FIFO_PKTS] = next_arrival;
+                fifo_count++;
+            } else {
+                r.overflow++;
+            }
+            next_arrival += (uint64_t)(-log(sim_uniform()) / rate * 1e6) + 1;
+        }
+
+        /* lgw_receive */
+        nb = (fifo_count < SIM_MAX_PKT) ? (int)fifo_count : SIM_MAX_PKT;
+        for (i = 0; i < nb; i++) {
+            wait = t - fifo[fifo_head];
+            wait_sum += wait;
+            if (wait > r.wait_max_us) {
+                r.wait_max_us = wait;
+            }
+            fifo_head = (fifo_head + 1) % SIM_FIFO_PKTS;
+            fifo_count--;
+        }
+        r.polls++;
+        r.packets += nb;
+        t += SIM_POLL_COST_US + (uint64_t)nb * SIM_PKT_COST_US;
+
+        if (adaptive) {
+            delay = rx_poll_update(p, t, nb, SIM_MAX_PKT);
+        } else {
+            delay = (nb == 0) ? SIM_FIXED_SLEEP_US : 0;
+        }
+        t += delay;
+    }
+
+    r.wait_avg_us = (r.packets > 0) ? (double)wait_sum / r.packets : 0;
+
+    return r;
+}
+
+/**
+ * Print one run.
+*/
+static void sim_print(const char *name, double rate, const sim_result_t *r) {
+
+    printf("  %-8s %8.2f pkt/s: %8.1f polls/s, wait avg %7.0fus max %6lluus, %llu packets, %llu lost\n",
+            name, rate, r->polls / (SIM_DURATION_US / 1e6), r->wait_avg_us, (unsigned long long)r->wait_max_us,
+            (unsigned long long)r->packets, (unsigned long long)r->overflow);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void) {
+
+    int failures = 0;
+    rx_poll_t p;
+    rx_poll_stats_t s;
+    sim_result_t fixed, adaptive;
+    const double rates[] = {0.05, 20, 2000};
+    uint32_t d[6];
+    unsigned i;
+
+    /* schedule itself */
+    rx_poll_init(&p, 1000, 16000);
+    for (i = 0; i < 6; i++) {
+        d[i] = rx_poll_update(&p, 1000 + i, 0, SIM_MAX_PKT);
+    }
+    CHECK(d[0] == 1000 && d[1] == 2000 && d[2] == 4000 && d[3] == 8000 && d[4] == 16000 && d[5] == 16000, "idle delay doubles up to the ceiling");
+    CHECK(rx_poll_update(&p, 2000, SIM_MAX_PKT, SIM_MAX_PKT) == 0, "full fetch re-polls at once");
+    CHECK(rx_poll_update(&p, 2001, SIM_MAX_PKT / 2, SIM_MAX_PKT) == 0, "filling buffer is busy polled");
+    CHECK(rx_poll_update(&p, 2002, 1, SIM_MAX_PKT) == 1000, "light traffic polls at the minimum delay");
+    CHECK(rx_poll_update(&p, 2003, 0, SIM_MAX_PKT) == 1000, "backoff restarts after packets");
+    rx_poll_stats(&p, &s);
+    CHECK(s.polls == 10 && s.polls_empty == 7 && s.polls_full == 1 && s.packets == 25, "poll counters");
+
+    /* against the simulated packet source */
+    printf("Simulated RX buffer (%d packets, %dus per poll, %dus per packet):\n", SIM_FIFO_PKTS, SIM_POLL_COST_US, SIM_PKT_COST_US);
+    for (i = 0; i < sizeof rates / sizeof rates[0]; i++) {
+        rx_poll_init(&p, 0, 0);
+        fixed = sim_run(rates[i], false, NULL);
+        adaptive = sim_run(rates[i], true, &p);
+        sim_print("fixed", rates[i], &fixed);
+        sim_print("adaptive", rates[i], &adaptive);
+
+        if (i == 0) {
+            CHECK(adaptive.polls * 4 < fixed.polls, "quiet site polled at least 4 times less often");
+        } else if (i == 1) {
+            CHECK(adaptive.wait_avg_us < RX_POLL_MAX_US, "moderate traffic waits less than the backoff ceiling");
+        } else {
+            CHECK(adaptive.overflow == 0 && adaptive.wait_avg_us < fixed.wait_avg_us, "busy site drained without overflow, quicker than the fixed sleep");
+        }
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
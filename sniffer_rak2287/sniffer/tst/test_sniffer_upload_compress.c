@@ -0,0 +1,278 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Check the upload compression: bodies come back intact through gzip and
+    through deflate with the preset dictionary, the dictionary is built
+    from the field names of an index mapping, it makes short bodies
+    smaller, and a segment of device reports shrinks at least five times.
+    Throughput and ratio are printed for a few levels.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf snprintf fopen */
+#include <stdlib.h>     /* EXIT_FAILURE malloc free */
+#include <string.h>     /* memcmp strlen */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* unlink */
+
+#include <zlib.h>
+
+#include "upload_compress.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define CHECK(cond, msg) {                                  \
+    if (cond) {                                             \
+        printf("PASS: %s\n", msg);                          \
+    } else {                                                \
+        printf("FAIL: %s\n", msg);                          \
+        failures++;                                         \
+    }                                                       \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define MAPPING_FILE        "test_upload_compress_mapping.json"
+#define SEGMENT_BYTES       262144      /* default size of a sealed report segment */
+#define SHORT_LINES         8           /* reports in a short body */
+#define NB_DEVICES          300         /* devices heard in the generated reports */
+#define NB_BENCH            20          /* segments compressed per timed run */
+
+static const char *mtypes[4] = {"JR", "UDU", "CDU", "UDD"};
+static const double freqs[8] = {916.8, 917.0, 917.2, 917.4, 917.6, 917.8, 918.0, 918.2};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* xorshift64*, reproducible from one run to the next */
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double elapsed_ns(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/* device reports as the encoder writes them, with a summary now and then */
+static size_t make_reports(char *buf, size_t size, int nb_lines) {
+    size_t len = 0;
+    uint64_t r;
+    int i, n, sf;
+
+    for (i = 0; (nb_lines <= 0) || (i < nb_lines); i++) {
+        r = rng_next();
+        sf = 7 + (int)((r >> 8) % 6);
+        if ((r & 63) == 0) {
+            n = snprintf(buf + len, size - len,
+                    "{\"@timestamp\":\"2026-10-16T10:%02d:%02d.%03dZ\",\"type\":\"summary\",\"DevAddr\":\"2601%04X\",\"Packets\":%d,\"Lost\":%d,\"RSSI\":%.3f,\"SNR\":%.2f}\n",
+                    (int)(i / 600) % 60, (int)(i / 10) % 60, (int)((r >> 16) % 1000), (unsigned)((r >> 24) % NB_DEVICES),
+                    (int)((r >> 32) % 500), (int)((r >> 40) % 9), -80.0 - (double)((r >> 44) % 4000) / 100, (double)((r >> 52) % 200) / 10 - 10);
+        } else {
+            n = snprintf(buf + len, size - len,
+                    "{\"@timestamp\":\"2026-10-16T10:%02d:%02d.%03dZ\",\"type\":\"device\",\"MType\":\"%s\",\"CRC\":\"OK\",\"Freq\":%.3f,\"SF\":%d,\"RSSI\":%.3f,\"ToA\":%.3f,\"FRMLen\":%d,\"SNR\":%d,\"FCnt\":%d,\"DevAddr\":\"2601%04X\",\"ADR\":%s,\"FPort\":%d}\n",
+                    (int)(i / 600) % 60, (int)(i / 10) % 60, (int)((r >> 16) % 1000), mtypes[(r >> 26) & 3], freqs[(r >> 28) & 7], sf,
+                    -80.0 - (double)((r >> 31) % 40000) / 1000, 41.216 * (1 << (sf - 7)), (int)((r >> 47) % 52),
+                    (int)((r >> 53) % 20) - 10, i / NB_DEVICES, (unsigned)((r >> 24) % NB_DEVICES), (r & 64) ? "true" : "false", 1 + (int)((r >> 58) % 16));
+        }
+        if ((n < 0) || ((size_t)n >= (size - len))) {
+            break;
+        }
+        len += (size_t)n;
+    }
+
+    return len;
+}
+
+static bool contains(const char *buf, size_t len, const char *s) {
+    size_t n = strlen(s), i;
+
+    for (i = 0; i + n <= len; i++) {
+        if (memcmp(buf + i, s, n) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* inflate a compressed body, with the preset dictionary when the stream asks for one */
+static long inflate_body(const compress_t *c, int window_bits, const uint8_t *dict, size_t dict_len, uint32_t *dict_id, char *out, size_t size) {
+    z_stream zs;
+    int x;
+    long len;
+
+    memset(&zs, 0, sizeof zs);
+    if (inflateInit2(&zs, window_bits) != Z_OK) {
+        return -1;
+    }
+    zs.next_in = (Bytef *)c->out.data;
+    zs.avail_in = (uInt)c->out.len;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = (uInt)size;
+    x = inflate(&zs, Z_FINISH);
+    if (x == Z_NEED_DICT) {
+        *dict_id = (uint32_t)zs.adler;
+        if ((dict == NULL) || (inflateSetDictionary(&zs, dict, (uInt)dict_len) != Z_OK)) {
+            inflateEnd(&zs);
+            return -1;
+        }
+        x = inflate(&zs, Z_FINISH);
+    }
+    len = (x == Z_STREAM_END) ? (long)zs.total_out : -1;
+    inflateEnd(&zs);
+
+    return len;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void)
+{
+    int failures = 0;
+    compress_t c, cd;
+    FILE *fp;
+    char dict[COMPRESS_DICT_MAX];
+    long dict_len, clen, len;
+    char *body, *out;
+    size_t body_len, short_len;
+    uint32_t dict_id;
+    long gzip_short, dict_short;
+    struct timespec t0, t1;
+    double ns;
+    uint64_t cpu_us;
+    int i, k, level;
+    static const int levels[3] = {1, 6, 9};
+
+    body = malloc(SEGMENT_BYTES + 1);
+    out = malloc(SEGMENT_BYTES + 1);
+    if ((body == NULL) || (out == NULL)) {
+        return EXIT_FAILURE;
+    }
+
+    /* Invalid set ups */
+    CHECK(compress_init(&c, COMPRESS_GZIP, 0, NULL, 0) == -1, "level 0 refused");
+    CHECK(compress_init(&c, COMPRESS_GZIP, 10, NULL, 0) == -1, "level 10 refused");
+    CHECK(compress_init(&c, COMPRESS_DEFLATE_DICT, 6, NULL, 0) == -1, "deflate without a dictionary refused");
+    CHECK(compress_init(&c, COMPRESS_NONE, 6, NULL, 0) == -1, "no method refused");
+    CHECK(compress_encoding(&c) == NULL, "no Content-Encoding without a method");
+    compress_free(&c);
+    CHECK(compress_dict_from_mapping("no_such_mapping.json", dict, sizeof dict) == -1, "missing mapping");
+
+    /* Dictionary from a mapping, main fields last */
+    fp = fopen(MAPPING_FILE, "w");
+    if (fp == NULL) {
+        return EXIT_FAILURE;
+    }
+    fputs("{\"properties\": {\"@timestamp\": {\"type\": \"date\"}, \"type\": {\"type\": \"keyword\"}, \"DevAddr\": {\"type\": \"keyword\"},\n"
+          "\"SNR\": {\"type\": \"half_float\"}, \"RSSI\": {\"type\": \"half_float\"}, \"ToA\": {\"type\": \"half_float\"},\n"
+          "\"ADR\": {\"type\": \"boolean\"}, \"MType\": {\"type\": \"keyword\"}, \"CRC\": {\"type\": \"keyword\"}, \"FCnt\": {\"type\": \"integer\"},\n"
+          "\"Freq\": {\"type\": \"half_float\"}, \"SF\": {\"type\": \"byte\"}, \"FPort\": {\"type\": \"short\"}, \"FRMLen\": {\"type\": \"short\"}}}\n", fp);
+    fclose(fp);
+    dict_len = compress_dict_from_mapping(MAPPING_FILE, dict, sizeof dict);
+    unlink(MAPPING_FILE);
+    CHECK(dict_len > 0, "dictionary built from the mapping");
+    CHECK((dict_len > 15) && (memcmp(dict + dict_len - 15, "{\"@timestamp\":\"", 15) == 0), "record opening is the end of the dictionary");
+    CHECK(contains(dict, (size_t)dict_len, ",\"DevAddr\":\""), "keyword fields open their string");
+    CHECK(contains(dict, (size_t)dict_len, ",\"FCnt\":") && !contains(dict, (size_t)dict_len, ",\"FCnt\":\""), "numeric fields do not");
+
+    /* gzip round trip on a segment */
+    body_len = make_reports(body, SEGMENT_BYTES + 1, 0);
+    CHECK(compress_init(&c, COMPRESS_GZIP, 6, NULL, 0) == 0, "gzip set up");
+    CHECK(strcmp(compress_encoding(&c), HTTP_ENCODING_GZIP) == 0, "gzip Content-Encoding");
+    clen = compress_body(&c, body, body_len);
+    CHECK(clen > 0 && (size_t)clen == c.out.len, "segment compressed");
+    CHECK((c.out.len > 2) && ((uint8_t)c.out.data[0] == 0x1F) && ((uint8_t)c.out.data[1] == 0x8B), "gzip magic");
+    len = inflate_body(&c, 15 + 16, NULL, 0, &dict_id, out, SEGMENT_BYTES + 1);
+    CHECK((len == (long)body_len) && (memcmp(out, body, body_len) == 0), "gzip round trip");
+    printf("INFO: segment of %lu bytes, gzip -6 %ld bytes (%.1fx)\n", (unsigned long)body_len, clen, (double)body_len / clen);
+    CHECK((double)body_len / clen >= 5.0, "segment at least 5 times smaller");
+
+    /* the buffer is reused, the second body must not carry anything of the first */
+    clen = compress_body(&c, "{}\n", 3);
+    len = inflate_body(&c, 15 + 16, NULL, 0, &dict_id, out, SEGMENT_BYTES + 1);
+    CHECK((len == 3) && (memcmp(out, "{}\n", 3) == 0), "compressor reset between bodies");
+    CHECK((c.nb_bodies == 2) && (c.bytes_in == body_len + 3) && (c.bytes_out > 0), "bodies and bytes counted");
+
+    /* deflate with the dictionary */
+    CHECK(compress_init(&cd, COMPRESS_DEFLATE_DICT, 6, dict, (size_t)dict_len) == 0, "deflate with dictionary set up");
+    CHECK(strcmp(compress_encoding(&cd), HTTP_ENCODING_DEFLATE) == 0, "deflate Content-Encoding");
+    clen = compress_body(&cd, body, body_len);
+    dict_id = 0;
+    len = inflate_body(&cd, 15, (const uint8_t *)dict, (size_t)dict_len, &dict_id, out, SEGMENT_BYTES + 1);
+    CHECK((len == (long)body_len) && (memcmp(out, body, body_len) == 0), "deflate round trip");
+    CHECK(dict_id == cd.dict_id, "stream names the dictionary");
+    CHECK(inflate_body(&cd, 15, NULL, 0, &dict_id, out, SEGMENT_BYTES + 1) == -1, "stream cannot be read without the dictionary");
+    printf("INFO: segment of %lu bytes, deflate -6 with a %ld byte dictionary %ld bytes (%.1fx)\n", (unsigned long)body_len, dict_len, clen, (double)body_len / clen);
+
+    /* a short body gains from the dictionary */
+    short_len = make_reports(body, SEGMENT_BYTES + 1, SHORT_LINES);
+    gzip_short = compress_body(&c, body, short_len);
+    dict_short = compress_body(&cd, body, short_len);
+    len = inflate_body(&cd, 15, (const uint8_t *)dict, (size_t)dict_len, &dict_id, out, SEGMENT_BYTES + 1);
+    CHECK((len == (long)short_len) && (memcmp(out, body, short_len) == 0), "short body round trip");
+    printf("INFO: %d reports, %lu bytes, gzip %ld bytes, deflate with dictionary %ld bytes\n", SHORT_LINES, (unsigned long)short_len, gzip_short, dict_short);
+    CHECK(dict_short < gzip_short, "dictionary makes short bodies smaller");
+    compress_free(&c);
+    compress_free(&cd);
+
+    /* Throughput and ratio per level */
+    body_len = make_reports(body, SEGMENT_BYTES + 1, 0);
+    for (i = 0; i < 3; i++) {
+        level = levels[i];
+        compress_init(&c, COMPRESS_GZIP, level, NULL, 0);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (k = 0; k < NB_BENCH; k++) {
+            clen = compress_body(&c, body, body_len);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ns = elapsed_ns(&t0, &t1) / NB_BENCH;
+        cpu_us = c.cpu_us;
+        printf("gzip -%d: %.1fx, %.1f MB/s, %.2f ms CPU per %lu byte segment\n", level, (double)body_len / clen,
+               body_len / ns * 1e3, (double)cpu_us / NB_BENCH / 1e3, (unsigned long)body_len);
+        compress_free(&c);
+    }
+
+    free(body);
+    free(out);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
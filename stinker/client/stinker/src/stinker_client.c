@@ -65,6 +65,7 @@ Maintainer: Sylvain Miermont
 
 #include "parson.h"
 #include "base64.h"
+#include "async_log.h"
 #include "loragw_hal.h"
 #include "loragw_aux.h"
 #include "loragw_gps.h"
@@ -78,29 +79,11 @@ Maintainer: Sylvain Miermont
 
 #define ARRAY_SIZE(a)   (sizeof(a) / sizeof((a)[0]))
 
-/* message macros that utilise the wider logging function */
-#define MSG_INFO(format, ...)   print_log("INFO: " format __VA_OPT__(,) __VA_ARGS__)
-#define MSG_WARN(format, ...)   print_log("WARNING: " format __VA_OPT__(,) __VA_ARGS__)
-#define MSG_ERR(format, ...)    print_log("ERROR: " format __VA_OPT__(,) __VA_ARGS__)
-#define MSG_LOG(format, ...)    print_log("LOG: " format __VA_OPT__(,) __VA_ARGS__)
-
-/* Logging macro function */
-#define print_log(format, ...) {                                                                    \
-    int i = 0;                                                                                      \
-    log_file = fopen(log_file_name, "a");                                                           \
-    time_t ltime = time(NULL);                                                                      \
-    char *time_str = ctime(&ltime);                                                                 \
-    time_str[strlen(time_str)-1] = '\0';                                                            \
-    if (verbose) {                                                                                  \
-        fprintf(stdout, format __VA_OPT__(,) __VA_ARGS__);                                          \
-    }                                                                                               \
-    fprintf(log_file, "%s - " format , time_str __VA_OPT__(,) __VA_ARGS__);                         \
-    i = fclose(log_file);                                                                           \
-    if (i < 0) {                                                                                    \
-        printf("Failed to close log file\n");                                                       \
-        sniffer_exit();                                                                             \
-    }                                                                                               \
-}
+/* message macros that utilise the asynchronous logger */
+#define MSG_INFO(format, ...)   log_printf("INFO: " format __VA_OPT__(,) __VA_ARGS__)
+#define MSG_WARN(format, ...)   log_printf("WARNING: " format __VA_OPT__(,) __VA_ARGS__)
+#define MSG_ERR(format, ...)    log_printf("ERROR: " format __VA_OPT__(,) __VA_ARGS__)
+#define MSG_LOG(format, ...)    log_printf("LOG: " format __VA_OPT__(,) __VA_ARGS__)
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE TYPES -------------------------------------------------------- */
@@ -149,8 +132,6 @@ static lgw_com_type_t com_type = LGW_COM_SPI;
 
 /* Logging stuff */
 static bool verbose = false;
-static FILE * log_file = NULL;
-static char log_file_name[128];
 
 static spectral_scan_t spectral_scan_params = {
     .enable = false,
@@ -973,26 +954,35 @@ static int parse_SX130x_configuration(const char * conf_file) {
 
 /**
  * Open new log file. This log file is written to by all "MSG_" logging functions,
- * regardless of verbose status.
+ * regardless of verbose status. The first call starts the logger, later ones switch
+ * files once the messages already queued have been written.
 */
 static void log_open (char* file_name) {
 
-    struct timespec now_utc_time;
-    char iso_date[40];
-    
-    clock_gettime(CLOCK_REALTIME, &now_utc_time);
-    strftime(iso_date, ARRAY_SIZE(iso_date),"%Y%m%dT%H%M%SZ", gmtime(&now_utc_time.tv_sec)); /* format yyyymmddThhmmssZ */
+    log_conf_t conf = {
+        .name = file_name,
+        .time_fmt = NULL, /* ctime() style */
+        .stamped = false,
+        .truncate = true,
+        .verbose = verbose,
+        .max_bytes = 0,
+        .max_age = 0
+    };
+    static bool started = false;
+
+    if (started) {
+        if (log_rotate(file_name)) {
+            MSG_WARN("[log_open] Unable to switch to log file %s.txt\n", file_name);
+        }
+        return;
+    }
 
-    sprintf(log_file_name, "%s.txt", file_name);
-    log_file = fopen(log_file_name, "w"); /* create log file to check if its possible */
-    if (log_file == NULL) {
-        printf("impossible to create log file %s\n", log_file_name);
+    if (log_start(&conf)) {
+        printf("impossible to create log file %s.txt\n", file_name);
         sniffer_exit();
     }
+    started = true;
 
-    fclose(log_file);
-
-    MSG_INFO("Now writing to log file %s\n", log_file_name);
     return;
 }
 
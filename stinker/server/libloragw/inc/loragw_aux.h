@@ -101,6 +101,36 @@ uint32_t lora_packet_time_on_air( const uint8_t bw,
                                   uint32_t * nb_symbols_payload,
                                   uint16_t * t_symbol_us);
 
+/**
+@brief Build the time on air lookup table used by lora_packet_toa_lookup
+Must be called once at start-up, before the threads that use the lookup.
+Until then, lora_packet_toa_lookup falls back to lora_packet_time_on_air.
+*/
+void lora_packet_toa_init(void);
+
+/**
+@brief Time on air of a LoRa packet in microseconds, read from the precomputed table
+Gives the same result as lora_packet_time_on_air, in constant time.
+@param bw packet bandwidth
+@param sf packet spreading factor
+@param cr packet coding rate
+@param n_symbol_preamble packet preamble length (number of symbols)
+@param no_header true if packet has no header
+@param no_crc true if packet has no CRC
+@param size packet size in bytes
+@return the packet time on air in microseconds, 0 if a parameter is not a LoRa one
+*/
+uint32_t lora_packet_toa_lookup(uint8_t bw, uint8_t sf, uint8_t cr, uint16_t n_symbol_preamble,
+                                bool no_header, bool no_crc, uint8_t size);
+
+/**
+@brief Duration of a LoRa symbol in microseconds
+@param bw bandwidth
+@param sf spreading factor
+@return the symbol duration in microseconds, 0 if a parameter is not a LoRa one
+*/
+uint16_t lora_symbol_time_us(uint8_t bw, uint8_t sf);
+
 /**
 @brief Record the current time, for measure start
 @param tm Pointer to the current time value
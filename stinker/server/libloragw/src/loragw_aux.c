@@ -41,6 +41,20 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
     #define DEBUG_PRINTF(fmt, args...)
 #endif
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define TOA_BW_NB   3   /* BW_125KHZ, BW_250KHZ, BW_500KHZ */
+#define TOA_SF_NB   8   /* DR_LORA_SF5 to DR_LORA_SF12 */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* time on air lookup table, see lora_packet_toa_init */
+static bool toa_table_ready = false;
+static uint16_t toa_t_symbol_us[TOA_BW_NB][TOA_SF_NB];
+static uint8_t toa_payload_blocks[TOA_SF_NB][2][2][256]; /* [sf][no_header][no_crc][size] */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
@@ -164,6 +178,64 @@ uint32_t lora_packet_time_on_air(const uint8_t bw, const uint8_t sf, const uint8
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+void lora_packet_toa_init(void) {
+    int i, j, h, c;
+    uint32_t n_symbol_payload;
+    uint16_t t_symbol_us;
+
+    /* The payload is sent in blocks of (4 * SF) bits coded in (CR + 4) symbols,
+     * so only the number of blocks depends on the size, header and CRC.
+     * Build it from lora_packet_time_on_air so that both always agree. */
+    for (j = 0; j < TOA_SF_NB; j++) {
+        for (i = 0; i < TOA_BW_NB; i++) {
+            lora_packet_time_on_air(BW_125KHZ + i, DR_LORA_SF5 + j, CR_LORA_4_5, 0, false, false, 0, NULL, NULL, &t_symbol_us);
+            toa_t_symbol_us[i][j] = t_symbol_us;
+        }
+        for (h = 0; h < 2; h++) {
+            for (c = 0; c < 2; c++) {
+                for (i = 0; i < 256; i++) {
+                    lora_packet_time_on_air(BW_125KHZ, DR_LORA_SF5 + j, CR_LORA_4_5, 0, h, c, i, NULL, &n_symbol_payload, NULL);
+                    toa_payload_blocks[j][h][c][i] = n_symbol_payload / (CR_LORA_4_5 + 4);
+                }
+            }
+        }
+    }
+
+    toa_table_ready = true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lora_packet_toa_lookup(uint8_t bw, uint8_t sf, uint8_t cr, uint16_t n_symbol_preamble,
+                                bool no_header, bool no_crc, uint8_t size) {
+    uint64_t n_quarter_symbol;
+
+    if (!toa_table_ready) {
+        return lora_packet_time_on_air(bw, sf, cr, n_symbol_preamble, no_header, no_crc, size, NULL, NULL, NULL);
+    }
+    if (!IS_LORA_BW(bw) || !IS_LORA_DR(sf) || !IS_LORA_CR(cr)) {
+        return 0;
+    }
+
+    /* Count in quarters of symbol, the sync word is 4.25 (6.25 for SF5/6) symbols long:
+     * the symbol duration is a multiple of 4us so the division below is exact */
+    n_quarter_symbol = 4 * ((uint64_t)n_symbol_preamble + 8 + toa_payload_blocks[sf - DR_LORA_SF5][no_header][no_crc][size] * (cr + 4))
+                       + ((sf >= 7) ? 17 : 25);
+
+    return (uint32_t)(n_quarter_symbol * toa_t_symbol_us[bw - BW_125KHZ][sf - DR_LORA_SF5] / 4);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint16_t lora_symbol_time_us(uint8_t bw, uint8_t sf) {
+    if (!IS_LORA_BW(bw) || !IS_LORA_DR(sf)) {
+        return 0;
+    }
+    return (1 << sf) * 8 / (1 << (bw - BW_125KHZ));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 void _meas_time_start(struct timeval *tm)
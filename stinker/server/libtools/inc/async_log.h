@@ -0,0 +1,114 @@
+/*
+MIT License
+
+Copyright (c) 2022 IsaacGraham128
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Description:
+    Asynchronous logger. Messages are formatted by the calling thread into a
+    preallocated lock-free queue and written out in batches by a dedicated
+    writer thread, which also takes care of opening and rotating log files.
+    Logging therefore never opens, writes or closes files on the caller's path.
+*/
+
+#ifndef _ASYNC_LOG_H
+#define _ASYNC_LOG_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LOG_LINE_LEN        256         /* Max length of a message, longer ones are truncated */
+#define LOG_QUEUE_LEN       1024        /* Messages that can wait for the writer, power of two */
+#define LOG_NAME_LEN        128         /* Max length of a log file name, including null terminator */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* logger configuration */
+typedef struct log_conf_s {
+    const char *name;                   /* base name of the log file, ".txt" is appended */
+    const char *time_fmt;               /* strftime format (local time) of the prefix of every line */
+    bool stamped;                       /* append the UTC opening time to the file name, i.e. name_20220101T000000Z.txt */
+    bool truncate;                      /* empty an existing file on opening instead of appending to it */
+    bool verbose;                       /* echo every message, without its time prefix, to stdout */
+    size_t max_bytes;                   /* size (bytes) at which a new file is started, 0 to disable */
+    unsigned max_age;                   /* age (seconds) at which a new file is started, 0 to disable */
+} log_conf_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+ * Open the first log file and start the writer thread. Pending messages are
+ * flushed at exit.
+ *
+ * @param conf  Logger configuration, the strings are copied
+ * @return      0 on success, -1 if the log file or thread cannot be created
+*/
+int log_start(const log_conf_t *conf);
+
+/**
+ * Stop the writer thread once every queued message has been written, and close the log file.
+*/
+void log_stop(void);
+
+/**
+ * Queue a message. Never blocks: the message is dropped and counted if the queue is full.
+ * Before log_start (or after log_stop) the message goes straight to stdout.
+ *
+ * @param format    printf style format
+*/
+void log_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * Change the rotation limits, i.e. once the configuration file has been parsed.
+ *
+ * @param max_bytes Size (bytes) at which a new file is started, 0 to disable
+ * @param max_age   Age (seconds) at which a new file is started, 0 to disable
+*/
+void log_set_rotation(size_t max_bytes, unsigned max_age);
+
+/**
+ * Start a new log file once the messages queued so far have been written.
+ *
+ * @param name  New base name, NULL to keep the current one
+ * @return      0 on success, -1 if the request could not be queued
+*/
+int log_rotate(const char *name);
+
+/**
+ * Number of messages dropped because the queue was full.
+ *
+ * @return  Messages dropped since log_start
+*/
+uint32_t log_dropped(void);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
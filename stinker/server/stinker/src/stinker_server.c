@@ -65,6 +65,7 @@ Maintainer: Sylvain Miermont
 
 #include "parson.h"
 #include "base64.h"
+#include "async_log.h"
 #include "loragw_hal.h"
 #include "loragw_aux.h"
 #include "loragw_gps.h"
@@ -79,31 +80,11 @@ Maintainer: Sylvain Miermont
 
 #define ARRAY_SIZE(a)   (sizeof(a) / sizeof((a)[0]))
 
-/* message macros that utilise the wider logging function */
-#define MSG_INFO(format, ...)   print_log("INFO: " format __VA_OPT__(,) __VA_ARGS__)
-#define MSG_WARN(format, ...)   print_log("WARNING: " format __VA_OPT__(,) __VA_ARGS__)
-#define MSG_ERR(format, ...)    print_log("ERROR: " format __VA_OPT__(,) __VA_ARGS__)
-#define MSG_LOG(format, ...)    print_log("LOG: " format __VA_OPT__(,) __VA_ARGS__)
-
-/* Logging macro function */
-/* Modified to match kibana visualisation style */
-#define print_log(format, ...) {                                                                    \
-    int i = 0;                                                                                      \
-    char time_str[40] = {'\0'};                                                                     \
-    log_file = fopen(log_file_name, "a");                                                           \
-    struct timespec local_time;                                                                     \
-    clock_gettime(CLOCK_REALTIME, &local_time);                                                     \
-    strftime(time_str, ARRAY_SIZE(time_str),"%b %d, %Y @ %H:%M:%S", localtime(&local_time.tv_sec)); \
-    if (verbose) {                                                                                  \
-        fprintf(stdout, format __VA_OPT__(,) __VA_ARGS__);                                          \
-    }                                                                                               \
-    fprintf(log_file, "%s - " format , time_str __VA_OPT__(,) __VA_ARGS__);                         \
-    i = fclose(log_file);                                                                           \
-    if (i < 0) {                                                                                    \
-        printf("Failed to close log file\n");                                                       \
-        sniffer_exit();                                                                             \
-    }                                                                                               \
-}
+/* message macros that utilise the asynchronous logger */
+#define MSG_INFO(format, ...)   log_printf("INFO: " format __VA_OPT__(,) __VA_ARGS__)
+#define MSG_WARN(format, ...)   log_printf("WARNING: " format __VA_OPT__(,) __VA_ARGS__)
+#define MSG_ERR(format, ...)    log_printf("ERROR: " format __VA_OPT__(,) __VA_ARGS__)
+#define MSG_LOG(format, ...)    log_printf("LOG: " format __VA_OPT__(,) __VA_ARGS__)
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE TYPES -------------------------------------------------------- */
@@ -130,16 +111,6 @@ typedef struct spectral_scan_s {
 
 #define PORT                    8000
 
-#define BITS_PREAMBLE_N_SYNC    98
-#define BITS_PHDR_N_CRC         64
-
-#define BITRATE_DR0             250         /* Bitrate(bit/sec) for SF12@125KHz*/
-#define BITRATE_DR1             440         /* Bitrate(bit/sec) for SF11@125KHz*/
-#define BITRATE_DR2             980         /* Bitrate(bit/sec) for SF10@125KHz*/
-#define BITRATE_DR3             1760        /* Bitrate(bit/sec) for SF9@125KHz*/
-#define BITRATE_DR4             3125        /* Bitrate(bit/sec) for SF8@125KHz*/
-#define BITRATE_DR5             5470        /* Bitrate(bit/sec) for SF7@125KHz*/
-
 /* signal handling variables */
 struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
 volatile bool exit_sig = false; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
@@ -162,8 +133,6 @@ static lgw_com_type_t com_type = LGW_COM_SPI;
 
 /* Logging stuff */
 static bool verbose = false;
-static FILE * log_file = NULL;
-static char log_file_name[128];
 
 static spectral_scan_t spectral_scan_params = {
     .enable = false,
@@ -986,26 +955,35 @@ static int parse_SX130x_configuration(const char * conf_file) {
 
 /**
  * Open new log file. This log file is written to by all "MSG_" logging functions,
- * regardless of verbose status.
+ * regardless of verbose status. The first call starts the logger, later ones switch
+ * files once the messages already queued have been written.
 */
 static void log_open (char* file_name) {
 
-    struct timespec local_time;
-    char iso_date[40];
-    
-    clock_gettime(CLOCK_REALTIME, &local_time);
-    strftime(iso_date, ARRAY_SIZE(iso_date),"%Y%m%dT%H%M%SZ", localtime(&local_time.tv_sec)); /* format yyyymmddThhmmssZ */
+    log_conf_t conf = {
+        .name = file_name,
+        .time_fmt = "%b %d, %Y @ %H:%M:%S", /* kibana visualisation style */
+        .stamped = false,
+        .truncate = true,
+        .verbose = verbose,
+        .max_bytes = 0,
+        .max_age = 0
+    };
+    static bool started = false;
+
+    if (started) {
+        if (log_rotate(file_name)) {
+            MSG_WARN("[log_open] Unable to switch to log file %s.txt\n", file_name);
+        }
+        return;
+    }
 
-    sprintf(log_file_name, "%s.txt", file_name);
-    log_file = fopen(log_file_name, "w"); /* create log file to check if its possible */
-    if (log_file == NULL) {
-        printf("impossible to create log file %s\n", log_file_name);
+    if (log_start(&conf)) {
+        printf("impossible to create log file %s.txt\n", file_name);
         sniffer_exit();
     }
+    started = true;
 
-    fclose(log_file);
-
-    MSG_INFO("Now writing to log file %s\n", log_file_name);
     return;
 }
 
@@ -1121,7 +1099,7 @@ void jamming_selective(struct lgw_pkt_tx_s *ref_pkt, uint8_t frame_section, int
     struct lgw_pkt_tx_s pkt;
     int ret;
     float ms_time_to_wait = 0;
-    float bitrate = 0;
+    uint32_t toa_us, t_symbol_us, sync_end_us;
     char buffer_fcnt[5] = {'F', 'C', 'T', 0, 0};
     uint8_t fcnt = 0;
 
@@ -1139,16 +1117,14 @@ void jamming_selective(struct lgw_pkt_tx_s *ref_pkt, uint8_t frame_section, int
     pkt.payload[7] = 0x00; // FCnt[1]
     pkt.payload[8] = 0x69; // Funny number FPort
 
-    /* Get our datarate (bits/sec)*/
-    switch(pkt.datarate) {
-        case DR_LORA_SF7:   bitrate = BITRATE_DR5; break;
-        case DR_LORA_SF8:   bitrate = BITRATE_DR4; break;
-        case DR_LORA_SF9:   bitrate = BITRATE_DR3; break;
-        case DR_LORA_SF10:  bitrate = BITRATE_DR2; break;
-        case DR_LORA_SF11:  bitrate = BITRATE_DR1; break;
-        case DR_LORA_SF12:  bitrate = BITRATE_DR0; break;
-        default:            MSG_ERR("Unknown spreading factor found");
+    /* Frame timings, the jammed packet has the same radio parameters as ours */
+    toa_us = lora_packet_toa_lookup(pkt.bandwidth, pkt.datarate, pkt.coderate, pkt.preamble, pkt.no_header, pkt.no_crc, pkt.size);
+    t_symbol_us = lora_symbol_time_us(pkt.bandwidth, pkt.datarate);
+    if (toa_us == 0) {
+        MSG_ERR("Unknown spreading factor found");
+        return;
     }
+    sync_end_us = ((4 * pkt.preamble + ((pkt.datarate >= DR_LORA_SF7) ? 17 : 25)) * t_symbol_us) / 4; /* sync word is 4.25 symbols, 6.25 for SF5/6 */
 
     /* Make our time to wait */
     switch(frame_section) {
@@ -1158,19 +1134,15 @@ void jamming_selective(struct lgw_pkt_tx_s *ref_pkt, uint8_t frame_section, int
             break;
         case 1 :
             //MSG_INFO("Transmission will interrupt the PHDR and CRC.\n");
-            ms_time_to_wait = (BITS_PREAMBLE_N_SYNC / bitrate) * 1e3;
-            ms_time_to_wait = (BITS_PHDR_N_CRC / bitrate) * 1e3;
+            ms_time_to_wait = sync_end_us / 1e3;
             break;
         case 2 :
             //MSG_INFO("Transmission will interrupt the FRMPayload.\n");
-            ms_time_to_wait = (BITS_PREAMBLE_N_SYNC / bitrate) * 1e3;
-            ms_time_to_wait += (BITS_PHDR_N_CRC / bitrate) * 1e3;
+            ms_time_to_wait = (sync_end_us + 8 * t_symbol_us) / 1e3; /* the PHDR is sent in the first 8 symbols */
             break;
         case 3 :
             //MSG_INFO("Transmission will interrupt the final CRC.\n");
-            ms_time_to_wait = (BITS_PREAMBLE_N_SYNC / bitrate) * 1e3;
-            ms_time_to_wait += (BITS_PHDR_N_CRC / bitrate) * 1e3;
-            ms_time_to_wait = (255 * 8 / bitrate) * 1e3; // 255 is the size of the second radio
+            ms_time_to_wait = (toa_us - (pkt.coderate + 4) * t_symbol_us) / 1e3; /* last block of the payload holds the CRC */
             break;
         default: 
             MSG_ERR("Bad frame section selected. Exiting function");
@@ -1192,7 +1164,7 @@ void jamming_selective(struct lgw_pkt_tx_s *ref_pkt, uint8_t frame_section, int
             wait_ms((unsigned long)ms_time_to_wait);
         ret = lgw_send(&pkt);
         if (ret != LGW_HAL_SUCCESS) {
-            MSG_ERR("Failed to transmit packet.\n")
+            MSG_ERR("Failed to transmit packet.\n");
         } else {
             // Do nothing
         }  
@@ -1238,16 +1210,12 @@ void jamming_scaling (struct lgw_pkt_tx_s *ref_pkt, int socket, int jammer_pkt_s
     for (int i = 9; i < jammer_pkt_size; i++)
         pkt.payload[i] = i;
 
-    /* Get our datarate (bits/sec)*/
-    airtime = (pkt.size + 8 + 4.25 + 8 + 2) * 8;
-    switch (pkt.datarate) {
-        case DR_LORA_SF7:   airtime = airtime / BITRATE_DR5; break;
-        case DR_LORA_SF8:   airtime = airtime / BITRATE_DR4; break;
-        case DR_LORA_SF9:   airtime = airtime / BITRATE_DR3; break;
-        case DR_LORA_SF10:  airtime = airtime / BITRATE_DR2; break;
-        case DR_LORA_SF11:  airtime = airtime / BITRATE_DR1; break;
-        case DR_LORA_SF12:  airtime = airtime / BITRATE_DR0; break;
-        default:            MSG_ERR("Unknown spreading factor found");
+    /* The jammer cannot send faster than its own time on air */
+    airtime = lora_packet_toa_lookup(pkt.bandwidth, pkt.datarate, pkt.coderate, pkt.preamble, pkt.no_header, pkt.no_crc, pkt.size) / 1e6;
+    if (airtime == 0) {
+        MSG_ERR("Unknown spreading factor found");
+    } else if (jammer_spacing_ms < (long)(airtime * 1e3)) {
+        MSG_WARN("Jammer spacing %ldms is shorter than its %.1fms time on air\n", jammer_spacing_ms, airtime * 1e3);
     }
 
     run_time = 0;
@@ -1410,15 +1378,10 @@ int main(int argc, char **argv) {
     for (i = 9; i < 17; i++)
         pkt.payload[i] = i;
 
-    airtime = (pkt.size + 8 + 4.25 + 8 + 2) * 8;
-    switch (pkt.datarate) {
-        case DR_LORA_SF7:   airtime = airtime / BITRATE_DR5; break;
-        case DR_LORA_SF8:   airtime = airtime / BITRATE_DR4; break;
-        case DR_LORA_SF9:   airtime = airtime / BITRATE_DR3; break;
-        case DR_LORA_SF10:  airtime = airtime / BITRATE_DR2; break;
-        case DR_LORA_SF11:  airtime = airtime / BITRATE_DR1; break;
-        case DR_LORA_SF12:  airtime = airtime / BITRATE_DR0; break;
-        default:            MSG_ERR("Unknown spreading factor found");
+    lora_packet_toa_init();
+    airtime = lora_packet_toa_lookup(pkt.bandwidth, pkt.datarate, pkt.coderate, pkt.preamble, pkt.no_header, pkt.no_crc, pkt.size) / 1e6;
+    if (airtime == 0) {
+        MSG_ERR("Unknown spreading factor found");
     }
     packet_airtime_ms = (long int)(airtime * 1e3);
 